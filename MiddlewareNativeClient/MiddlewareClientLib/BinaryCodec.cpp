@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "BinaryCodec.h"
+#include <string.h>
+
+namespace MiddlewareLib
+{
+	namespace BinaryCodec
+	{
+		namespace
+		{
+			const size_t HeaderSize = 3;
+			const int FieldCount = 6;
+			//a varint of a 64 bit length
+			const size_t MaxVarintSize = 10;
+
+			inline void WriteField(std::string& out, const std::string& value)
+			{
+				char length[MaxVarintSize];
+				size_t n = 0;
+				uint64_t size = value.size();
+				while (size >= 0x80)
+				{
+					length[n++] = (char)(size | 0x80);
+					size >>= 7;
+				}
+				length[n++] = (char)size;
+				out.append(length, n);
+				out.append(value);
+			}
+
+			inline bool ReadField(const char*& p, const char* end, std::string_view& value)
+			{
+				uint64_t size = 0;
+				for (int shift = 0; ; shift += 7)
+				{
+					if (p == end || shift > 63)
+					{
+						return false;
+					}
+					uint8_t byte = (uint8_t)*p++;
+					size |= (uint64_t)(byte & 0x7F) << shift;
+					if ((byte & 0x80) == 0)
+					{
+						break;
+					}
+				}
+
+				if (size > (uint64_t)(end - p))
+				{
+					return false;
+				}
+				value = std::string_view(p, (size_t)size);
+				p += size;
+				return true;
+			}
+		}
+
+		void MIDDLEWARE_EXP Encode(const Message& msg, std::string& out)
+		{
+			out.clear();
+			out.reserve(HeaderSize + FieldCount * MaxVarintSize + msg.requestId_.size() + msg.command_.size() +
+				msg.channel_.size() + msg.sourceId_.size() + msg.destinationId_.size() + msg.payload_.size());
+
+			out.push_back((char)MAGIC);
+			out.push_back((char)VERSION);
+			out.push_back((char)msg.type_);
+			WriteField(out, msg.requestId_);
+			WriteField(out, msg.command_);
+			WriteField(out, msg.channel_);
+			WriteField(out, msg.sourceId_);
+			WriteField(out, msg.destinationId_);
+			WriteField(out, msg.payload_);
+		}
+
+		bool MIDDLEWARE_EXP DecodeView(const char* data, size_t size, MessageView& view)
+		{
+			if (size < HeaderSize || (uint8_t)data[0] != MAGIC || (uint8_t)data[1] != VERSION)
+			{
+				return false;
+			}
+
+			uint8_t type = (uint8_t)data[2];
+			if (type > RESPONSE_SUCCESS)
+			{
+				return false;
+			}
+			view.type_ = (MessageType)type;
+
+			const char* p = data + HeaderSize;
+			const char* end = data + size;
+			return ReadField(p, end, view.requestId_) &&
+				ReadField(p, end, view.command_) &&
+				ReadField(p, end, view.channel_) &&
+				ReadField(p, end, view.sourceId_) &&
+				ReadField(p, end, view.destinationId_) &&
+				ReadField(p, end, view.payload_) &&
+				p == end;
+		}
+
+		bool MIDDLEWARE_EXP Decode(const char* data, size_t size, Message& msg)
+		{
+			MessageView view;
+			if (!DecodeView(data, size, view))
+			{
+				return false;
+			}
+			Decode(view, msg);
+			return true;
+		}
+
+		void MIDDLEWARE_EXP Decode(const MessageView& view, Message& msg)
+		{
+			msg.type_ = view.type_;
+			msg.requestId_.assign(view.requestId_.data(), view.requestId_.size());
+			msg.command_.assign(view.command_.data(), view.command_.size());
+			msg.channel_.assign(view.channel_.data(), view.channel_.size());
+			msg.sourceId_.assign(view.sourceId_.data(), view.sourceId_.size());
+			msg.destinationId_.assign(view.destinationId_.data(), view.destinationId_.size());
+			msg.payload_.assign(view.payload_.data(), view.payload_.size());
+		}
+	}
+}
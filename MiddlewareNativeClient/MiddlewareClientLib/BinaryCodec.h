@@ -0,0 +1,47 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <string>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//compact binary envelope for Message, sent in WebSocket binary frames once
+	//a session has negotiated BINARY_PROTOCOL. The layout is
+	//
+	//  MAGIC, VERSION, type, then requestId, command, channel, sourceId,
+	//  destinationId and payload, each as a varint length and the raw bytes
+	//
+	//so the payload travels as it is, with no escaping, and a view of a frame
+	//can be taken without copying or modifying it. MAGIC can never start a UTF-8
+	//text frame, which tells the envelope apart from a JSON message.
+	namespace BinaryCodec
+	{
+		const uint8_t MAGIC = 0xC1;
+		const uint8_t VERSION = 1;
+
+		//WebSocket subprotocols offered when connecting. A peer that selects
+		//BINARY_PROTOCOL is sent binary envelopes, any other answer falls back
+		//to JSON text frames.
+		const char* const BINARY_PROTOCOL = "middleware.binary.v1";
+		const char* const JSON_PROTOCOL = "middleware.json";
+		const char* const OFFERED_PROTOCOLS = "middleware.binary.v1, middleware.json";
+
+		//true if data starts like a binary envelope
+		inline bool IsBinary(const char* data, size_t size)
+		{
+			return size > 0 && (uint8_t)data[0] == MAGIC;
+		}
+
+		//encode msg into out, replacing its contents but keeping its capacity
+		void MIDDLEWARE_EXP Encode(const Message& msg, std::string& out);
+
+		//decode into msg, reusing the capacity of its strings. Returns false if
+		//the envelope is truncated or not one this version understands.
+		bool MIDDLEWARE_EXP Decode(const char* data, size_t size, Message& msg);
+		//copy a decoded view into msg
+		void MIDDLEWARE_EXP Decode(const MessageView& view, Message& msg);
+		//decode into views of data
+		bool MIDDLEWARE_EXP DecodeView(const char* data, size_t size, MessageView& view);
+	}
+}
@@ -0,0 +1,459 @@
+#include "stdafx.h"
+#include "EpollReactor.h"
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		const int MaxEventsPerWait = 256;
+	}
+
+	EpollReactor::EpollReactor() : stopped_(false), wakeups_(0), loopThread_(std::thread::id()), ticking_(false)
+	{
+		epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+		wakeupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (epollFd_ < 0 || wakeupFd_ < 0 || timerFd_ < 0)
+		{
+			throw std::runtime_error("unable to create epoll reactor");
+		}
+
+		//the wakeup and timer descriptors are registered without a handler
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeupFd_, &ev);
+		ev.data.ptr = &timerFd_;
+		epoll_ctl(epollFd_, EPOLL_CTL_ADD, timerFd_, &ev);
+	}
+
+	EpollReactor::~EpollReactor()
+	{
+		::close(timerFd_);
+		::close(wakeupFd_);
+		::close(epollFd_);
+	}
+
+	bool EpollReactor::Add(int fd, uint32_t events, IReactorHandler* handler)
+	{
+		epoll_event ev = {};
+		ev.events = events;
+		ev.data.ptr = handler;
+		return epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+	}
+
+	bool EpollReactor::Modify(int fd, uint32_t events, IReactorHandler* handler)
+	{
+		epoll_event ev = {};
+		ev.events = events;
+		ev.data.ptr = handler;
+		return epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+	}
+
+	void EpollReactor::Remove(int fd, IReactorHandler* handler)
+	{
+		//the descriptor may already have been closed, which removes it implicitly
+		epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, NULL);
+		//by address, the handler may be freed before the batch is done
+		removed_.insert(handler);
+		CancelFlush(handler);
+	}
+
+	void EpollReactor::AddTicker(IReactorHandler* handler)
+	{
+		if (handler->tickerIndex_ != IReactorHandler::NotQueued)
+		{
+			return;
+		}
+		handler->tickerIndex_ = tickers_.size();
+		tickers_.push_back(handler);
+	}
+
+	void EpollReactor::RemoveTicker(IReactorHandler* handler)
+	{
+		size_t index = handler->tickerIndex_;
+		if (index == IReactorHandler::NotQueued)
+		{
+			return;
+		}
+		handler->tickerIndex_ = IReactorHandler::NotQueued;
+		if (ticking_)
+		{
+			//Tick is walking the list, it drops the gap when it is done
+			tickers_[index] = NULL;
+			return;
+		}
+		IReactorHandler* last = tickers_.back();
+		tickers_.pop_back();
+		if (index < tickers_.size())
+		{
+			tickers_[index] = last;
+			last->tickerIndex_ = index;
+		}
+	}
+
+	void EpollReactor::ScheduleFlush(IReactorHandler* handler, std::chrono::microseconds delay)
+	{
+		auto due = std::chrono::steady_clock::now() + delay;
+		size_t index = handler->flushIndex_;
+		if (index == IReactorHandler::NotQueued)
+		{
+			PushFlush(Flush{ handler, due });
+			return;
+		}
+		if (due < flushes_[index].due)
+		{
+			flushes_[index].due = due;
+			SiftUp(index);
+		}
+	}
+
+	void EpollReactor::CancelFlush(IReactorHandler* handler)
+	{
+		if (handler->flushIndex_ != IReactorHandler::NotQueued)
+		{
+			RemoveFlush(handler->flushIndex_);
+		}
+		//RunFlushes may be part way through the ones that are due
+		if (handler->dueIndex_ != IReactorHandler::NotQueued)
+		{
+			dueFlushes_[handler->dueIndex_].handler = NULL;
+			handler->dueIndex_ = IReactorHandler::NotQueued;
+		}
+	}
+
+	void EpollReactor::Post(Task_t task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(tasksLock_);
+			tasks_.push_back(std::move(task));
+		}
+		Wakeup();
+	}
+
+	void EpollReactor::Invoke(Task_t task)
+	{
+		if (InLoopThread() || !IsRunning())
+		{
+			task();
+			return;
+		}
+
+		std::promise<void> done;
+		Post([&task, &done]()
+		{
+			task();
+			done.set_value();
+		});
+		done.get_future().wait();
+	}
+
+	void EpollReactor::Run()
+	{
+		loopThread_ = std::this_thread::get_id();
+		epoll_event events[MaxEventsPerWait];
+		while (!stopped_)
+		{
+			int count = epoll_wait(epollFd_, events, MaxEventsPerWait, Timeout());
+			wakeups_.fetch_add(1, std::memory_order_relaxed);
+			if (count < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+
+			removed_.clear();
+			for (int i = 0; i < count; i++)
+			{
+				IReactorHandler* handler = (IReactorHandler*)events[i].data.ptr;
+				if (handler == NULL)
+				{
+					uint64_t value;
+					while (::read(wakeupFd_, &value, sizeof(value)) > 0) {}
+					continue;
+				}
+				if (events[i].data.ptr == &timerFd_)
+				{
+					//RunFlushes picks up whatever is due
+					uint64_t value;
+					while (::read(timerFd_, &value, sizeof(value)) > 0) {}
+					continue;
+				}
+
+				//skip handlers that an earlier callback in this batch removed
+				if (!removed_.empty() && removed_.count(handler) != 0)
+				{
+					continue;
+				}
+				handler->OnReady(events[i].events);
+			}
+
+			RunTasks();
+			Tick();
+			RunFlushes();
+		}
+
+		RunTasks();
+		RunFlushes();
+		loopThread_ = std::thread::id();
+		stopped_ = false;
+	}
+
+	void EpollReactor::Stop()
+	{
+		stopped_ = true;
+		Wakeup();
+	}
+
+	bool EpollReactor::IsRunning() const
+	{
+		return loopThread_.load() != std::thread::id();
+	}
+
+	bool EpollReactor::InLoopThread() const
+	{
+		return loopThread_.load() == std::this_thread::get_id();
+	}
+
+	uint64_t EpollReactor::Wakeups() const
+	{
+		return wakeups_.load(std::memory_order_relaxed);
+	}
+
+	void EpollReactor::Wakeup()
+	{
+		uint64_t one = 1;
+		ssize_t ret = ::write(wakeupFd_, &one, sizeof(one));
+		(void)ret;
+	}
+
+	void EpollReactor::RunTasks()
+	{
+		std::vector<Task_t> tasks;
+		{
+			std::lock_guard<std::mutex> lock(tasksLock_);
+			tasks.swap(tasks_);
+		}
+
+		for (auto& task : tasks)
+		{
+			task();
+		}
+	}
+
+	void EpollReactor::Tick()
+	{
+		if (tickers_.empty())
+		{
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastTick_ < std::chrono::milliseconds(TICK_MS))
+		{
+			return;
+		}
+		lastTick_ = now;
+
+		ticking_ = true;
+		//by index, as a ticker may add another
+		for (size_t i = 0; i < tickers_.size(); i++)
+		{
+			if (tickers_[i] != NULL)
+			{
+				tickers_[i]->OnTick();
+			}
+		}
+		ticking_ = false;
+
+		//close the gaps left by RemoveTicker
+		size_t kept = 0;
+		for (size_t i = 0; i < tickers_.size(); i++)
+		{
+			if (tickers_[i] != NULL)
+			{
+				tickers_[i]->tickerIndex_ = kept;
+				tickers_[kept++] = tickers_[i];
+			}
+		}
+		tickers_.resize(kept);
+	}
+
+	void EpollReactor::RunFlushes()
+	{
+		if (flushes_.empty())
+		{
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		dueFlushes_.clear();
+		while (!flushes_.empty() && flushes_[0].due <= now)
+		{
+			IReactorHandler* handler = flushes_[0].handler;
+			RemoveFlush(0);
+			handler->dueIndex_ = dueFlushes_.size();
+			dueFlushes_.push_back(Flush{ handler, now });
+		}
+
+		//by index, a flush may cancel a later one
+		for (size_t i = 0; i < dueFlushes_.size(); i++)
+		{
+			IReactorHandler* handler = dueFlushes_[i].handler;
+			if (handler != NULL)
+			{
+				handler->dueIndex_ = IReactorHandler::NotQueued;
+				handler->OnFlush();
+			}
+		}
+		dueFlushes_.clear();
+	}
+
+	void EpollReactor::PushFlush(const Flush& flush)
+	{
+		flush.handler->flushIndex_ = flushes_.size();
+		flushes_.push_back(flush);
+		SiftUp(flushes_.size() - 1);
+	}
+
+	void EpollReactor::RemoveFlush(size_t index)
+	{
+		flushes_[index].handler->flushIndex_ = IReactorHandler::NotQueued;
+		size_t last = flushes_.size() - 1;
+		if (index != last)
+		{
+			flushes_[index] = flushes_[last];
+			flushes_[index].handler->flushIndex_ = index;
+		}
+		flushes_.pop_back();
+		if (index < flushes_.size())
+		{
+			//the one moved into the gap may belong either side of it
+			SiftDown(index);
+			SiftUp(index);
+		}
+	}
+
+	void EpollReactor::SwapFlushes(size_t a, size_t b)
+	{
+		std::swap(flushes_[a], flushes_[b]);
+		flushes_[a].handler->flushIndex_ = a;
+		flushes_[b].handler->flushIndex_ = b;
+	}
+
+	void EpollReactor::SiftUp(size_t index)
+	{
+		while (index > 0)
+		{
+			size_t parent = (index - 1) / 2;
+			if (!(flushes_[index].due < flushes_[parent].due))
+			{
+				break;
+			}
+			SwapFlushes(index, parent);
+			index = parent;
+		}
+	}
+
+	void EpollReactor::SiftDown(size_t index)
+	{
+		for (;;)
+		{
+			size_t earliest = index;
+			size_t left = index * 2 + 1;
+			size_t right = left + 1;
+			if (left < flushes_.size() && flushes_[left].due < flushes_[earliest].due)
+			{
+				earliest = left;
+			}
+			if (right < flushes_.size() && flushes_[right].due < flushes_[earliest].due)
+			{
+				earliest = right;
+			}
+			if (earliest == index)
+			{
+				return;
+			}
+			SwapFlushes(index, earliest);
+			index = earliest;
+		}
+	}
+
+	int EpollReactor::Timeout()
+	{
+		int timeout = tickers_.empty() ? -1 : TICK_MS;
+		if (flushes_.empty())
+		{
+			return timeout;
+		}
+
+		auto next = flushes_[0].due;
+		if (next <= std::chrono::steady_clock::now())
+		{
+			return 0;
+		}
+
+		//epoll_wait only counts milliseconds, the timer is precise
+		if (next != timerDue_)
+		{
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count();
+			itimerspec spec = {};
+			spec.it_value.tv_sec = (time_t)(ns / 1000000000);
+			spec.it_value.tv_nsec = (long)(ns % 1000000000);
+			timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, NULL);
+			timerDue_ = next;
+		}
+		return timeout;
+	}
+
+	ReactorPool::ReactorPool(unsigned int threads) : next_(0)
+	{
+		if (threads == 0)
+		{
+			threads = 1;
+		}
+
+		for (unsigned int i = 0; i < threads; i++)
+		{
+			reactors_.push_back(EpollReactorPtr_t(new EpollReactor()));
+		}
+
+		for (auto& reactor : reactors_)
+		{
+			EpollReactor* r = reactor.get();
+			threads_.push_back(std::thread([r]() { r->Run(); }));
+			//make sure the loop is up before any session is attached to it
+			while (!r->IsRunning())
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	ReactorPool::~ReactorPool()
+	{
+		for (auto& reactor : reactors_)
+		{
+			reactor->Stop();
+		}
+
+		for (auto& thread : threads_)
+		{
+			thread.join();
+		}
+	}
+
+	EpollReactor& ReactorPool::Next()
+	{
+		return *reactors_[next_++ % reactors_.size()];
+	}
+}
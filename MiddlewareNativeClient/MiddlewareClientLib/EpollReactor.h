@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//implemented by anything that registers a file descriptor with the reactor
+	class IReactorHandler
+	{
+	public:
+		IReactorHandler() : flushIndex_(NotQueued), dueIndex_(NotQueued), tickerIndex_(NotQueued) {}
+		virtual ~IReactorHandler() {}
+		//called on the loop thread with the epoll event mask that fired
+		virtual void OnReady(uint32_t events) = 0;
+		//called on the loop thread every TICK_MS or so once added with AddTicker
+		virtual void OnTick() {}
+		//called on the loop thread once for each ScheduleFlush
+		virtual void OnFlush() {}
+
+	private:
+		friend class EpollReactor;
+		static const size_t NotQueued = (size_t)-1;
+
+		//where the reactor holds the handler, so scheduling and cancelling
+		//never have to search for it
+		size_t flushIndex_;
+		size_t dueIndex_;
+		size_t tickerIndex_;
+	};
+
+	//single threaded epoll event loop. Handler callbacks and posted tasks all run
+	//on the thread that calls Run, so handlers need no locking of their own.
+	class EpollReactor
+	{
+	public:
+		typedef std::function<void()> Task_t;
+		static const int TICK_MS = 10;
+
+		EpollReactor();
+		~EpollReactor();
+
+		bool Add(int fd, uint32_t events, IReactorHandler* handler);
+		bool Modify(int fd, uint32_t events, IReactorHandler* handler);
+		void Remove(int fd, IReactorHandler* handler);
+
+		//loop thread only. The loop wakes up to tick while there are tickers.
+		void AddTicker(IReactorHandler* handler);
+		void RemoveTicker(IReactorHandler* handler);
+
+		//loop thread only. Call the handler's OnFlush once, at the end of the
+		//current cycle, after the events, tasks and ticks, or once delay has
+		//passed. Scheduling again before then keeps the earlier of the two.
+		//Remove and CancelFlush drop a scheduled flush.
+		void ScheduleFlush(IReactorHandler* handler, std::chrono::microseconds delay = std::chrono::microseconds(0));
+		void CancelFlush(IReactorHandler* handler);
+
+		//queue a task for the loop thread and wake it up
+		void Post(Task_t task);
+		//run a task on the loop thread and wait for it. Runs inline if called
+		//from the loop thread or if the loop is not running.
+		void Invoke(Task_t task);
+
+		//dispatch events on the calling thread until Stop is called
+		void Run();
+		void Stop();
+
+		bool IsRunning() const;
+		bool InLoopThread() const;
+		//times the loop has woken up, to check that an idle loop sleeps
+		uint64_t Wakeups() const;
+
+	private:
+		struct Flush
+		{
+			IReactorHandler* handler;
+			std::chrono::steady_clock::time_point due;
+		};
+
+		void Wakeup();
+		void RunTasks();
+		void Tick();
+		void RunFlushes();
+		//flushes_ is a min heap on due, these keep the handlers' indexes
+		void PushFlush(const Flush& flush);
+		void RemoveFlush(size_t index);
+		void SwapFlushes(size_t a, size_t b);
+		void SiftUp(size_t index);
+		void SiftDown(size_t index);
+		//epoll_wait timeout, arming the timer for the next delayed flush
+		int Timeout();
+
+		int epollFd_;
+		int wakeupFd_;
+		//timerfd that wakes the loop for delayed flushes
+		int timerFd_;
+		std::chrono::steady_clock::time_point timerDue_;
+		std::atomic<bool> stopped_;
+		std::atomic<uint64_t> wakeups_;
+		std::atomic<std::thread::id> loopThread_;
+		std::mutex tasksLock_;
+		std::vector<Task_t> tasks_;
+		//handlers removed while an event batch is being dispatched
+		std::unordered_set<IReactorHandler*> removed_;
+		std::vector<IReactorHandler*> tickers_;
+		bool ticking_;
+		std::chrono::steady_clock::time_point lastTick_;
+		//scheduled flushes, earliest first
+		std::vector<Flush> flushes_;
+		std::vector<Flush> dueFlushes_;
+	};
+
+	//a fixed set of reactors, each running on its own thread
+	class ReactorPool
+	{
+	public:
+		ReactorPool(unsigned int threads);
+		~ReactorPool();
+
+		//reactors are handed out round robin
+		EpollReactor& Next();
+
+	private:
+		typedef std::unique_ptr<EpollReactor> EpollReactorPtr_t;
+		std::vector<EpollReactorPtr_t> reactors_;
+		std::vector<std::thread> threads_;
+		std::atomic<unsigned int> next_;
+	};
+}
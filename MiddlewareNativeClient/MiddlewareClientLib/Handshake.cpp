@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "Handshake.h"
+#include "Masking.h"
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	namespace Handshake
+	{
+		namespace
+		{
+			const char Guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+			inline uint32_t Rotate(uint32_t value, int bits)
+			{
+				return (value << bits) | (value >> (32 - bits));
+			}
+		}
+
+		MIDDLEWARE_EXP std::string CreateKey()
+		{
+			//the masking key generator is seeded from the OS entropy source
+			static thread_local Masking::KeyGenerator generator;
+			std::string nonce(16, '\0');
+			for (size_t i = 0; i < nonce.size(); i += 4)
+			{
+				generator.Next((uint8_t*)&nonce[i]);
+			}
+			return Base64(nonce);
+		}
+
+		MIDDLEWARE_EXP std::string Accept(const std::string& key)
+		{
+			return Base64(Sha1(key + Guid));
+		}
+
+		MIDDLEWARE_EXP std::string Sha1(const std::string& input)
+		{
+			uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+			std::string data(input);
+			uint64_t bits = (uint64_t)input.size() * 8;
+			data.push_back((char)0x80);
+			while (data.size() % 64 != 56)
+			{
+				data.push_back('\0');
+			}
+			for (int i = 7; i >= 0; i--)
+			{
+				data.push_back((char)(bits >> (i * 8)));
+			}
+
+			for (size_t block = 0; block < data.size(); block += 64)
+			{
+				uint32_t w[80];
+				for (int i = 0; i < 16; i++)
+				{
+					const uint8_t* p = (const uint8_t*)data.data() + block + i * 4;
+					w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+				}
+				for (int i = 16; i < 80; i++)
+				{
+					w[i] = Rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+				}
+
+				uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+				for (int i = 0; i < 80; i++)
+				{
+					uint32_t f, k;
+					if (i < 20)
+					{
+						f = (b & c) | (~b & d);
+						k = 0x5A827999;
+					}
+					else if (i < 40)
+					{
+						f = b ^ c ^ d;
+						k = 0x6ED9EBA1;
+					}
+					else if (i < 60)
+					{
+						f = (b & c) | (b & d) | (c & d);
+						k = 0x8F1BBCDC;
+					}
+					else
+					{
+						f = b ^ c ^ d;
+						k = 0xCA62C1D6;
+					}
+					uint32_t temp = Rotate(a, 5) + f + e + k + w[i];
+					e = d;
+					d = c;
+					c = Rotate(b, 30);
+					b = a;
+					a = temp;
+				}
+				h[0] += a;
+				h[1] += b;
+				h[2] += c;
+				h[3] += d;
+				h[4] += e;
+			}
+
+			std::string digest;
+			for (int i = 0; i < 5; i++)
+			{
+				for (int j = 3; j >= 0; j--)
+				{
+					digest.push_back((char)(h[i] >> (j * 8)));
+				}
+			}
+			return digest;
+		}
+
+		MIDDLEWARE_EXP std::string Base64(const std::string& input)
+		{
+			static const char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			std::string out;
+			size_t i = 0;
+			for (; i + 2 < input.size(); i += 3)
+			{
+				uint32_t n = ((uint8_t)input[i] << 16) | ((uint8_t)input[i + 1] << 8) | (uint8_t)input[i + 2];
+				out.push_back(Alphabet[(n >> 18) & 63]);
+				out.push_back(Alphabet[(n >> 12) & 63]);
+				out.push_back(Alphabet[(n >> 6) & 63]);
+				out.push_back(Alphabet[n & 63]);
+			}
+			if (i + 1 == input.size())
+			{
+				uint32_t n = (uint8_t)input[i] << 16;
+				out.push_back(Alphabet[(n >> 18) & 63]);
+				out.push_back(Alphabet[(n >> 12) & 63]);
+				out.append("==");
+			}
+			else if (i + 2 == input.size())
+			{
+				uint32_t n = ((uint8_t)input[i] << 16) | ((uint8_t)input[i + 1] << 8);
+				out.push_back(Alphabet[(n >> 18) & 63]);
+				out.push_back(Alphabet[(n >> 12) & 63]);
+				out.push_back(Alphabet[(n >> 6) & 63]);
+				out.push_back('=');
+			}
+			return out;
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <string>
+
+namespace MiddlewareLib
+{
+	//the opening handshake (RFC 6455 section 4). The client sends a random
+	//key and the server proves it understood the upgrade by answering with
+	//a hash of that key.
+	namespace Handshake
+	{
+		//a new Sec-WebSocket-Key, 16 random bytes in base64
+		MIDDLEWARE_EXP std::string CreateKey();
+		//the Sec-WebSocket-Accept a server answers key with
+		MIDDLEWARE_EXP std::string Accept(const std::string& key);
+
+		//only used for the handshake, so written for clarity over speed
+		MIDDLEWARE_EXP std::string Sha1(const std::string& input);
+		MIDDLEWARE_EXP std::string Base64(const std::string& input);
+	}
+}
@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "HashRing.h"
+#include <algorithm>
+#include <string>
+
+namespace MiddlewareLib
+{
+	HashRing::HashRing(unsigned int slots, unsigned int virtualNodes) : slots_(slots > 0 ? slots : 1)
+	{
+		if (virtualNodes == 0)
+		{
+			virtualNodes = 1;
+		}
+
+		points_.reserve((size_t)slots_ * virtualNodes);
+		for (unsigned int slot = 0; slot < slots_; slot++)
+		{
+			for (unsigned int node = 0; node < virtualNodes; node++)
+			{
+				std::string name = std::to_string(slot) + "#" + std::to_string(node);
+				points_.push_back(std::make_pair(Hash(name), slot));
+			}
+		}
+		std::sort(points_.begin(), points_.end());
+	}
+
+	size_t HashRing::Find(std::string_view key) const
+	{
+		if (slots_ == 1)
+		{
+			return 0;
+		}
+
+		auto point = std::lower_bound(points_.begin(), points_.end(), std::make_pair(Hash(key), 0u));
+		if (point == points_.end())
+		{
+			point = points_.begin();
+		}
+		return point->second;
+	}
+
+	uint64_t HashRing::Hash(std::string_view key)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (char c : key)
+		{
+			hash ^= (uint8_t)c;
+			hash *= 1099511628211ULL;
+		}
+
+		//splitmix64 finaliser
+		hash ^= hash >> 30;
+		hash *= 0xbf58476d1ce4e5b9ULL;
+		hash ^= hash >> 27;
+		hash *= 0x94d049bb133111ebULL;
+		hash ^= hash >> 31;
+		return hash;
+	}
+}
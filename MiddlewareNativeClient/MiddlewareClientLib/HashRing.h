@@ -0,0 +1,30 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//consistent hash of keys onto a number of slots. Each slot owns
+	//virtualNodes points on a ring and a key belongs to the first point after
+	//its hash, so adding a slot only moves the keys it takes over. The hash is
+	//the same in every process, so a channel always maps to the same slot.
+	class MIDDLEWARE_EXP HashRing
+	{
+	public:
+		HashRing(unsigned int slots, unsigned int virtualNodes);
+
+		size_t Find(std::string_view key) const;
+		unsigned int Slots() const { return slots_; }
+
+		//FNV-1a with a final mix so similar keys spread round the ring
+		static uint64_t Hash(std::string_view key);
+
+	private:
+		unsigned int slots_;
+		//sorted by hash
+		std::vector<std::pair<uint64_t, unsigned int>> points_;
+	};
+}
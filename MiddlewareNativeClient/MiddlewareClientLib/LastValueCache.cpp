@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "LastValueCache.h"
+
+namespace MiddlewareLib
+{
+	LastValueCache::LastValueCache(bool conflate) : conflate_(conflate), updates_(0), conflated_(0), delivered_(0)
+	{
+	}
+
+	void LastValueCache::Update(const Message& msg)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		updates_++;
+		Entry& entry = entries_[msg.channel_];
+		entry.value = msg;
+		if (!conflate_)
+		{
+			return;
+		}
+
+		if (entry.changed)
+		{
+			//the consumer never sees the value it replaced
+			conflated_++;
+			return;
+		}
+		entry.changed = true;
+		changed_.push_back(msg.channel_);
+	}
+
+	bool LastValueCache::Get(const std::string& channel, Message& msg) const
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		auto entry = entries_.find(channel);
+		if (entry == entries_.end())
+		{
+			return false;
+		}
+		msg = entry->second.value;
+		return true;
+	}
+
+	size_t LastValueCache::Drain(std::vector<Message>& out, size_t max)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		size_t count = max == 0 || max > changed_.size() ? changed_.size() : max;
+		for (size_t i = 0; i < count; i++)
+		{
+			Entry& entry = entries_[changed_[i]];
+			entry.changed = false;
+			out.push_back(entry.value);
+		}
+		changed_.erase(changed_.begin(), changed_.begin() + count);
+		delivered_ += count;
+		return count;
+	}
+
+	void LastValueCache::GetStats(ConflationStats& stats) const
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		stats.updates += updates_;
+		stats.conflated += conflated_;
+		stats.delivered += delivered_;
+		stats.waiting += changed_.size();
+		stats.channels += entries_.size();
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//the latest UPDATE received on each channel. With conflation the updates
+	//are held here rather than delivered, a newer one replacing any the
+	//consumer has not yet taken, and Drain hands over what has changed.
+	class MIDDLEWARE_EXP LastValueCache
+	{
+	public:
+		explicit LastValueCache(bool conflate);
+
+		bool Conflating() const { return conflate_; }
+
+		//dispatcher or worker thread. Keep msg as its channel's latest value.
+		void Update(const Message& msg);
+
+		//any thread. False if nothing has been received on channel.
+		bool Get(const std::string& channel, Message& msg) const;
+
+		//any thread. Append the latest value of up to max channels updated
+		//since they were last drained, in the order they first changed. 0
+		//takes them all.
+		size_t Drain(std::vector<Message>& out, size_t max);
+
+		void GetStats(ConflationStats& stats) const;
+
+	private:
+		struct Entry
+		{
+			Entry() : changed(false) {}
+
+			Message value;
+			//received but not yet drained
+			bool changed;
+		};
+
+		LastValueCache(const LastValueCache&);
+		LastValueCache& operator=(const LastValueCache&);
+
+		bool conflate_;
+		mutable std::mutex lock_;
+		std::unordered_map<std::string, Entry> entries_;
+		//channels with a changed value, oldest first
+		std::vector<std::string> changed_;
+		uint64_t updates_;
+		uint64_t conflated_;
+		uint64_t delivered_;
+	};
+}
@@ -0,0 +1,212 @@
+#include "stdafx.h"
+#include "LatencyHistogram.h"
+#include <limits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		const uint64_t NoMin = std::numeric_limits<uint64_t>::max();
+
+		//index of the highest set bit, value must not be 0
+		inline unsigned int HighestBit(uint64_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+			{
+				return (unsigned int)index + 32;
+			}
+			_BitScanReverse(&index, (unsigned long)value);
+			return (unsigned int)index;
+#else
+			return 63 - (unsigned int)__builtin_clzll(value);
+#endif
+		}
+
+		inline void LowerTo(std::atomic<uint64_t>& current, uint64_t value)
+		{
+			uint64_t seen = current.load(std::memory_order_relaxed);
+			while (value < seen && !current.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		inline void RaiseTo(std::atomic<uint64_t>& current, uint64_t value)
+		{
+			uint64_t seen = current.load(std::memory_order_relaxed);
+			while (value > seen && !current.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+			{
+			}
+		}
+	}
+
+	LatencyHistogram::LatencyHistogram()
+	{
+		Reset();
+	}
+
+	LatencyHistogram::LatencyHistogram(const LatencyHistogram& other)
+	{
+		*this = other;
+	}
+
+	LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other)
+	{
+		if (this != &other)
+		{
+			for (size_t i = 0; i < BUCKETS; i++)
+			{
+				counts_[i].store(other.counts_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+			count_.store(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			sum_.store(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			min_.store(other.min_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			max_.store(other.max_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		return *this;
+	}
+
+	void LatencyHistogram::Record(uint64_t value)
+	{
+		counts_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		count_.fetch_add(1, std::memory_order_relaxed);
+		sum_.fetch_add(value, std::memory_order_relaxed);
+
+		LowerTo(min_, value);
+		RaiseTo(max_, value);
+	}
+
+	void LatencyHistogram::Add(const LatencyHistogram& other)
+	{
+		for (size_t i = 0; i < BUCKETS; i++)
+		{
+			uint64_t count = other.counts_[i].load(std::memory_order_relaxed);
+			if (count > 0)
+			{
+				counts_[i].fetch_add(count, std::memory_order_relaxed);
+			}
+		}
+		count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		LowerTo(min_, other.min_.load(std::memory_order_relaxed));
+		RaiseTo(max_, other.max_.load(std::memory_order_relaxed));
+	}
+
+	void LatencyHistogram::Reset()
+	{
+		for (size_t i = 0; i < BUCKETS; i++)
+		{
+			counts_[i].store(0, std::memory_order_relaxed);
+		}
+		count_.store(0, std::memory_order_relaxed);
+		sum_.store(0, std::memory_order_relaxed);
+		min_.store(NoMin, std::memory_order_relaxed);
+		max_.store(0, std::memory_order_relaxed);
+	}
+
+	void LatencyHistogram::Drain(LatencyHistogram& into)
+	{
+		for (size_t i = 0; i < BUCKETS; i++)
+		{
+			if (counts_[i].load(std::memory_order_relaxed) > 0)
+			{
+				into.counts_[i].fetch_add(counts_[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+		}
+		into.count_.fetch_add(count_.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+		into.sum_.fetch_add(sum_.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+
+		LowerTo(into.min_, min_.exchange(NoMin, std::memory_order_relaxed));
+		RaiseTo(into.max_, max_.exchange(0, std::memory_order_relaxed));
+	}
+
+	uint64_t LatencyHistogram::Min() const
+	{
+		uint64_t min = min_.load(std::memory_order_relaxed);
+		return min == NoMin ? 0 : min;
+	}
+
+	double LatencyHistogram::Mean() const
+	{
+		uint64_t count = Count();
+		return count == 0 ? 0.0 : (double)sum_.load(std::memory_order_relaxed) / (double)count;
+	}
+
+	uint64_t LatencyHistogram::ValueAtPercentile(double percentile) const
+	{
+		//the total of the buckets rather than count_, which may already
+		//include a value whose bucket has not been counted yet
+		uint64_t total = 0;
+		for (size_t i = 0; i < BUCKETS; i++)
+		{
+			total += counts_[i].load(std::memory_order_relaxed);
+		}
+		if (total == 0)
+		{
+			return 0;
+		}
+
+		if (percentile >= 100.0)
+		{
+			return Max();
+		}
+		uint64_t rank = percentile <= 0.0 ? 1 : (uint64_t)(percentile / 100.0 * (double)total + 0.5);
+		if (rank == 0)
+		{
+			rank = 1;
+		}
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BUCKETS; i++)
+		{
+			seen += counts_[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+			{
+				uint64_t limit = BucketLimit(i);
+				uint64_t max = Max();
+				return limit < max ? limit : max;
+			}
+		}
+		return Max();
+	}
+
+	size_t LatencyHistogram::BucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return (size_t)value;
+		}
+
+		unsigned int bit = HighestBit(value);
+		if (bit >= MAX_BITS)
+		{
+			return BUCKETS - 1;
+		}
+		unsigned int shift = bit - SUB_BUCKET_BITS;
+		//the bits below the highest, in SUB_BUCKETS steps
+		size_t sub = (size_t)(value >> shift) - SUB_BUCKETS;
+		return (size_t)(shift + 1) * SUB_BUCKETS + sub;
+	}
+
+	uint64_t LatencyHistogram::BucketLimit(size_t index)
+	{
+		if (index < SUB_BUCKETS)
+		{
+			return index;
+		}
+		if (index >= BUCKETS - 1)
+		{
+			return std::numeric_limits<uint64_t>::max();
+		}
+
+		unsigned int shift = (unsigned int)(index / SUB_BUCKETS) - 1;
+		uint64_t sub = index % SUB_BUCKETS;
+		return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <atomic>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//counts of values, e.g. latencies in nanoseconds, in log scale buckets.
+	//Each power of two is split into SUB_BUCKETS linear buckets, so a value
+	//is known to within 1/SUB_BUCKETS of itself however large it is, in a
+	//fixed 9KB. Record is a few relaxed atomic operations and may be called
+	//from any number of threads at once. The other functions read the counts
+	//as they are at the time, so may miss values recorded while they run.
+	class MIDDLEWARE_EXP LatencyHistogram
+	{
+	public:
+		static constexpr unsigned int SUB_BUCKET_BITS = 5;
+		static constexpr unsigned int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		//values of 2^MAX_BITS and above are counted in the last bucket,
+		//about 18 minutes in nanoseconds
+		static constexpr unsigned int MAX_BITS = 40;
+		static constexpr size_t BUCKETS = SUB_BUCKETS * (MAX_BITS - SUB_BUCKET_BITS + 1);
+
+		LatencyHistogram();
+		LatencyHistogram(const LatencyHistogram& other);
+		LatencyHistogram& operator=(const LatencyHistogram& other);
+
+		void Record(uint64_t value);
+		//add other's counts to these
+		void Add(const LatencyHistogram& other);
+		void Reset();
+		//add these counts to into and reset them, without losing any
+		//recorded meanwhile as a copy then Reset could
+		void Drain(LatencyHistogram& into);
+
+		uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+		//0 if nothing has been recorded
+		uint64_t Min() const;
+		uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+		double Mean() const;
+		//the value percentile (0 to 100) of the recorded values are at or
+		//below, to within a bucket. 0 if nothing has been recorded.
+		uint64_t ValueAtPercentile(double percentile) const;
+
+		static size_t BucketIndex(uint64_t value);
+		//the largest value counted in a bucket
+		static uint64_t BucketLimit(size_t index);
+
+	private:
+		std::atomic<uint64_t> counts_[BUCKETS];
+		std::atomic<uint64_t> count_;
+		std::atomic<uint64_t> sum_;
+		std::atomic<uint64_t> min_;
+		std::atomic<uint64_t> max_;
+	};
+}
@@ -0,0 +1,177 @@
+#include "stdafx.h"
+#include "Masking.h"
+#include <chrono>
+#include <random>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIDDLEWARE_MASK_SSE2
+#endif
+
+//the AVX2 kernel is compiled for x86 whatever the build flags and only called
+//when the processor reports support for it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MIDDLEWARE_MASK_AVX2
+#define MIDDLEWARE_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define MIDDLEWARE_MASK_AVX2
+#define MIDDLEWARE_TARGET_AVX2
+#endif
+
+namespace MiddlewareLib
+{
+	namespace Masking
+	{
+		namespace
+		{
+			typedef void(*MaskFunc_t)(uint8_t* data, size_t size, const uint8_t key[4]);
+
+			MaskFunc_t SelectKernel()
+			{
+				if (HasAVX2())
+				{
+					return MaskAVX2;
+				}
+				if (HasSSE2())
+				{
+					return MaskSSE2;
+				}
+				return MaskWord;
+			}
+
+			//the key repeated across a 32 bit word in memory order
+			inline uint32_t KeyWord(const uint8_t key[4])
+			{
+				uint32_t word;
+				memcpy(&word, key, sizeof(word));
+				return word;
+			}
+		}
+
+		void Mask(uint8_t* data, size_t size, const uint8_t key[4])
+		{
+			static const MaskFunc_t kernel = SelectKernel();
+			kernel(data, size, key);
+		}
+
+		void MaskScalar(uint8_t* data, size_t size, const uint8_t key[4])
+		{
+			for (size_t i = 0; i != size; ++i)
+			{
+				data[i] ^= key[i & 0x3];
+			}
+		}
+
+		void MaskWord(uint8_t* data, size_t size, const uint8_t key[4])
+		{
+			uint64_t word = KeyWord(key);
+			word |= word << 32;
+			size_t i = 0;
+			for (; i + 8 <= size; i += 8)
+			{
+				uint64_t chunk;
+				memcpy(&chunk, data + i, sizeof(chunk));
+				chunk ^= word;
+				memcpy(data + i, &chunk, sizeof(chunk));
+			}
+			//i is a multiple of 4, so the key lines up again for the tail
+			MaskScalar(data + i, size - i, key);
+		}
+
+		void MaskSSE2(uint8_t* data, size_t size, const uint8_t key[4])
+		{
+			size_t i = 0;
+#ifdef MIDDLEWARE_MASK_SSE2
+			const __m128i word = _mm_set1_epi32((int)KeyWord(key));
+			for (; i + 16 <= size; i += 16)
+			{
+				__m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+				_mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(chunk, word));
+			}
+#endif
+			MaskWord(data + i, size - i, key);
+		}
+
+#ifdef MIDDLEWARE_MASK_AVX2
+		MIDDLEWARE_TARGET_AVX2 void MaskAVX2(uint8_t* data, size_t size, const uint8_t key[4])
+		{
+			const __m256i word = _mm256_set1_epi32((int)KeyWord(key));
+			size_t i = 0;
+			for (; i + 64 <= size; i += 64)
+			{
+				__m256i first = _mm256_loadu_si256((const __m256i*)(data + i));
+				__m256i second = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+				_mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(first, word));
+				_mm256_storeu_si256((__m256i*)(data + i + 32), _mm256_xor_si256(second, word));
+			}
+			for (; i + 32 <= size; i += 32)
+			{
+				__m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+				_mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(chunk, word));
+			}
+			MaskSSE2(data + i, size - i, key);
+		}
+#else
+		void MaskAVX2(uint8_t* data, size_t size, const uint8_t key[4])
+		{
+			MaskSSE2(data, size, key);
+		}
+#endif
+
+		bool HasSSE2()
+		{
+#ifdef MIDDLEWARE_MASK_SSE2
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		bool HasAVX2()
+		{
+#if !defined(MIDDLEWARE_MASK_AVX2)
+			return false;
+#elif defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			//the OS has to save the AVX registers as well as the processor supporting them
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+			{
+				return false;
+			}
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") != 0;
+#endif
+		}
+
+		KeyGenerator::KeyGenerator()
+		{
+			std::random_device device;
+			state_ = ((uint64_t)device() << 32) ^ device();
+			state_ ^= (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+			if (state_ == 0)
+			{
+				state_ = 0x9E3779B97F4A7C15ull;
+			}
+		}
+
+		void KeyGenerator::Next(uint8_t key[4])
+		{
+			//xorshift64*
+			state_ ^= state_ >> 12;
+			state_ ^= state_ << 25;
+			state_ ^= state_ >> 27;
+			uint32_t word = (uint32_t)((state_ * 0x2545F4914F6CDD1Dull) >> 32);
+			memcpy(key, &word, sizeof(word));
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//WebSocket payload masking (RFC 6455 section 5.3). Masking is its own
+	//inverse, so the same kernels unmask received frames.
+	namespace Masking
+	{
+		//xor data with the repeating 4 byte key, using the widest kernel the
+		//processor supports. The choice is made once, on first use.
+		void MIDDLEWARE_EXP Mask(uint8_t* data, size_t size, const uint8_t key[4]);
+
+		//the individual kernels, for testing and benchmarking. MaskAVX2 must only
+		//be called if HasAVX2 returns true.
+		void MIDDLEWARE_EXP MaskScalar(uint8_t* data, size_t size, const uint8_t key[4]);
+		void MIDDLEWARE_EXP MaskWord(uint8_t* data, size_t size, const uint8_t key[4]);
+		void MIDDLEWARE_EXP MaskSSE2(uint8_t* data, size_t size, const uint8_t key[4]);
+		void MIDDLEWARE_EXP MaskAVX2(uint8_t* data, size_t size, const uint8_t key[4]);
+		bool MIDDLEWARE_EXP HasSSE2();
+		bool MIDDLEWARE_EXP HasAVX2();
+
+		//generates masking keys with xorshift64*. Seeded once from the OS
+		//entropy source so each key costs a few instructions rather than a
+		//system call. Not thread safe, each connection keeps its own.
+		class MIDDLEWARE_EXP KeyGenerator
+		{
+		public:
+			KeyGenerator();
+			void Next(uint8_t key[4]);
+
+		private:
+			uint64_t state_;
+		};
+	}
+}
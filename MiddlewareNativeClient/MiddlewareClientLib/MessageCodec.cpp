@@ -0,0 +1,696 @@
+#include "stdafx.h"
+#include "MessageCodec.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIDDLEWARE_CODEC_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace MiddlewareLib
+{
+	namespace MessageCodec
+	{
+		namespace
+		{
+			const char EmptyValue[] = "";
+			const int MaxDepth = 64;
+
+#ifdef MIDDLEWARE_CODEC_SSE2
+			inline int CountTrailingZeros(int mask)
+			{
+#ifdef _MSC_VER
+				unsigned long index;
+				_BitScanForward(&index, (unsigned long)mask);
+				return (int)index;
+#else
+				return __builtin_ctz((unsigned int)mask);
+#endif
+			}
+#endif
+
+			//first quote or backslash in [p, end)
+			inline const char* FindQuoteOrBackslash(const char* p, const char* end)
+			{
+#ifdef MIDDLEWARE_CODEC_SSE2
+				const __m128i quote = _mm_set1_epi8('"');
+				const __m128i backslash = _mm_set1_epi8('\\');
+				while (end - p >= 16)
+				{
+					__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+					int mask = _mm_movemask_epi8(_mm_or_si128(
+						_mm_cmpeq_epi8(chunk, quote),
+						_mm_cmpeq_epi8(chunk, backslash)));
+					if (mask != 0)
+					{
+						return p + CountTrailingZeros(mask);
+					}
+					p += 16;
+				}
+#endif
+				while (p != end && *p != '"' && *p != '\\')
+				{
+					p++;
+				}
+				return p;
+			}
+
+			inline bool IsEscapeCandidate(unsigned char c)
+			{
+				return c < 0x20 || c == '"' || c == '\\' || c == 0xC2 || c == 0xE2;
+			}
+
+			//first byte that may need escaping on output. As well as quotes,
+			//backslashes and control characters Newtonsoft escapes U+0085, U+2028
+			//and U+2029, so their UTF-8 lead bytes are candidates too.
+			inline const char* FindEscapeCandidate(const char* p, const char* end)
+			{
+#ifdef MIDDLEWARE_CODEC_SSE2
+				const __m128i quote = _mm_set1_epi8('"');
+				const __m128i backslash = _mm_set1_epi8('\\');
+				const __m128i control = _mm_set1_epi8(0x1F);
+				const __m128i lead2 = _mm_set1_epi8((char)0xC2);
+				const __m128i lead3 = _mm_set1_epi8((char)0xE2);
+				while (end - p >= 16)
+				{
+					__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+					__m128i special = _mm_or_si128(
+						_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+						_mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control),
+							_mm_or_si128(_mm_cmpeq_epi8(chunk, lead2), _mm_cmpeq_epi8(chunk, lead3))));
+					int mask = _mm_movemask_epi8(special);
+					if (mask != 0)
+					{
+						return p + CountTrailingZeros(mask);
+					}
+					p += 16;
+				}
+#endif
+				while (p != end && !IsEscapeCandidate((unsigned char)*p))
+				{
+					p++;
+				}
+				return p;
+			}
+
+			inline int HexValue(char c)
+			{
+				if (c >= '0' && c <= '9') return c - '0';
+				if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+				if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+				return -1;
+			}
+
+			inline bool ReadHex4(const char* p, const char* end, unsigned int& value)
+			{
+				if (end - p < 4)
+				{
+					return false;
+				}
+
+				value = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					int digit = HexValue(p[i]);
+					if (digit < 0)
+					{
+						return false;
+					}
+					value = (value << 4) | (unsigned int)digit;
+				}
+				return true;
+			}
+
+			inline char* WriteUtf8(char* out, unsigned int cp)
+			{
+				if (cp < 0x80)
+				{
+					*out++ = (char)cp;
+				}
+				else if (cp < 0x800)
+				{
+					*out++ = (char)(0xC0 | (cp >> 6));
+					*out++ = (char)(0x80 | (cp & 0x3F));
+				}
+				else if (cp < 0x10000)
+				{
+					*out++ = (char)(0xE0 | (cp >> 12));
+					*out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+					*out++ = (char)(0x80 | (cp & 0x3F));
+				}
+				else
+				{
+					*out++ = (char)(0xF0 | (cp >> 18));
+					*out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+					*out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+					*out++ = (char)(0x80 | (cp & 0x3F));
+				}
+				return out;
+			}
+
+			class Scanner
+			{
+			public:
+				Scanner(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+				bool ScanMessage(RawMessage& raw)
+				{
+					for (int i = 0; i < FIELD_COUNT; i++)
+					{
+						raw.fields[i].data = EmptyValue;
+						raw.fields[i].size = 0;
+						raw.fields[i].escaped = false;
+					}
+
+					bool hasType = false;
+					if (!Consume('{'))
+					{
+						return false;
+					}
+
+					SkipWhitespace();
+					if (p_ != end_ && *p_ == '}')
+					{
+						return false;
+					}
+
+					do
+					{
+						SkipWhitespace();
+						RawField key;
+						if (!ScanString(key) || !Consume(':'))
+						{
+							return false;
+						}
+
+						SkipWhitespace();
+						int field = Lookup(key);
+						if (field == TYPE)
+						{
+							if (!ScanType(raw.type))
+							{
+								return false;
+							}
+							hasType = true;
+						}
+						else if (field > TYPE)
+						{
+							if (p_ != end_ && *p_ == '"')
+							{
+								if (!ScanString(raw.fields[field]))
+								{
+									return false;
+								}
+							}
+							else if (!ScanLiteral("null", 4))
+							{
+								return false;
+							}
+						}
+						else if (!SkipValue(0))
+						{
+							return false;
+						}
+					} while (Consume(','));
+
+					if (!Consume('}'))
+					{
+						return false;
+					}
+					SkipWhitespace();
+					return hasType && p_ == end_;
+				}
+
+			private:
+				static int Lookup(const RawField& key)
+				{
+					if (key.escaped)
+					{
+						return -1;
+					}
+
+					switch (key.size)
+					{
+					case 4:
+						return memcmp(key.data, "Type", 4) == 0 ? TYPE : -1;
+					case 7:
+						if (memcmp(key.data, "Command", 7) == 0) return COMMAND;
+						if (memcmp(key.data, "Channel", 7) == 0) return CHANNEL;
+						if (memcmp(key.data, "Payload", 7) == 0) return PAYLOAD;
+						return -1;
+					case 8:
+						return memcmp(key.data, "SourceId", 8) == 0 ? SOURCE_ID : -1;
+					case 9:
+						return memcmp(key.data, "RequestId", 9) == 0 ? REQUEST_ID : -1;
+					case 13:
+						return memcmp(key.data, "DestinationId", 13) == 0 ? DESTINATION_ID : -1;
+					default:
+						return -1;
+					}
+				}
+
+				void SkipWhitespace()
+				{
+					while (p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+					{
+						p_++;
+					}
+				}
+
+				bool Consume(char c)
+				{
+					SkipWhitespace();
+					if (p_ != end_ && *p_ == c)
+					{
+						p_++;
+						return true;
+					}
+					return false;
+				}
+
+				bool ScanLiteral(const char* literal, size_t size)
+				{
+					if ((size_t)(end_ - p_) < size || memcmp(p_, literal, size) != 0)
+					{
+						return false;
+					}
+					p_ += size;
+					return true;
+				}
+
+				bool ScanString(RawField& field)
+				{
+					if (p_ == end_ || *p_ != '"')
+					{
+						return false;
+					}
+
+					const char* start = ++p_;
+					bool escaped = false;
+					while (true)
+					{
+						p_ = FindQuoteOrBackslash(p_, end_);
+						if (p_ == end_)
+						{
+							return false;
+						}
+						if (*p_ == '"')
+						{
+							break;
+						}
+						//skip the backslash and the character it escapes. the hex
+						//digits of a \u escape can never be a quote or backslash.
+						escaped = true;
+						if (end_ - p_ < 2)
+						{
+							return false;
+						}
+						p_ += 2;
+					}
+
+					field.data = start;
+					field.size = p_ - start;
+					field.escaped = escaped;
+					p_++;
+					return true;
+				}
+
+				static bool ParseInt(const char* p, const char* end, int& value)
+				{
+					bool negative = false;
+					if (p != end && *p == '-')
+					{
+						negative = true;
+						p++;
+					}
+					if (p == end)
+					{
+						return false;
+					}
+
+					int result = 0;
+					for (; p != end; p++)
+					{
+						if (*p < '0' || *p > '9')
+						{
+							return false;
+						}
+						result = result * 10 + (*p - '0');
+					}
+					value = negative ? -result : result;
+					return true;
+				}
+
+				//Newtonsoft writes the enum as a number, the old property_tree
+				//writer quoted it
+				bool ScanType(int& type)
+				{
+					if (p_ != end_ && *p_ == '"')
+					{
+						RawField value;
+						return ScanString(value) && !value.escaped &&
+							ParseInt(value.data, value.data + value.size, type);
+					}
+
+					const char* start = p_;
+					while (p_ != end_ && (*p_ == '-' || (*p_ >= '0' && *p_ <= '9')))
+					{
+						p_++;
+					}
+					return ParseInt(start, p_, type);
+				}
+
+				bool SkipValue(int depth)
+				{
+					if (depth > MaxDepth)
+					{
+						return false;
+					}
+
+					SkipWhitespace();
+					if (p_ == end_)
+					{
+						return false;
+					}
+
+					RawField ignored;
+					switch (*p_)
+					{
+					case '"':
+						return ScanString(ignored);
+					case '{':
+						p_++;
+						if (Consume('}'))
+						{
+							return true;
+						}
+						do
+						{
+							SkipWhitespace();
+							if (!ScanString(ignored) || !Consume(':') || !SkipValue(depth + 1))
+							{
+								return false;
+							}
+						} while (Consume(','));
+						return Consume('}');
+					case '[':
+						p_++;
+						if (Consume(']'))
+						{
+							return true;
+						}
+						do
+						{
+							if (!SkipValue(depth + 1))
+							{
+								return false;
+							}
+						} while (Consume(','));
+						return Consume(']');
+					case 't':
+						return ScanLiteral("true", 4);
+					case 'f':
+						return ScanLiteral("false", 5);
+					case 'n':
+						return ScanLiteral("null", 4);
+					default:
+					{
+						const char* start = p_;
+						while (p_ != end_ && ((*p_ >= '0' && *p_ <= '9') ||
+							*p_ == '-' || *p_ == '+' || *p_ == '.' || *p_ == 'e' || *p_ == 'E'))
+						{
+							p_++;
+						}
+						return p_ != start;
+					}
+					}
+				}
+
+				const char* p_;
+				const char* end_;
+			};
+
+			void AssignField(std::string& out, const RawField& field)
+			{
+				if (!field.escaped)
+				{
+					out.assign(field.data, field.size);
+					return;
+				}
+
+				out.resize(field.size);
+				char* begin = &out[0];
+				char* end = Unescape(field.data, field.data + field.size, begin);
+				out.resize(end - begin);
+			}
+
+			std::string_view ViewField(char* data, const RawField& field)
+			{
+				if (!field.escaped)
+				{
+					return std::string_view(field.data, field.size);
+				}
+
+				char* begin = data + (field.data - data);
+				char* end = Unescape(begin, begin + field.size, begin);
+				return std::string_view(begin, end - begin);
+			}
+
+			void WriteInt(std::string& out, int value)
+			{
+				char buffer[12];
+				char* end = buffer + sizeof(buffer);
+				char* p = end;
+				unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+				do
+				{
+					*--p = (char)('0' + magnitude % 10);
+					magnitude /= 10;
+				} while (magnitude != 0);
+				if (value < 0)
+				{
+					*--p = '-';
+				}
+				out.append(p, end - p);
+			}
+
+			//empty strings are written as null, as the C# client does for unset members
+			void WriteString(std::string& out, const std::string& value)
+			{
+				static const char Hex[] = "0123456789abcdef";
+
+				if (value.empty())
+				{
+					out.append("null", 4);
+					return;
+				}
+
+				out.push_back('"');
+				const char* p = value.data();
+				const char* end = p + value.size();
+				while (true)
+				{
+					const char* special = FindEscapeCandidate(p, end);
+					out.append(p, special - p);
+					if (special == end)
+					{
+						break;
+					}
+
+					unsigned char c = (unsigned char)*special;
+					p = special + 1;
+					switch (c)
+					{
+					case '"': out.append("\\\"", 2); break;
+					case '\\': out.append("\\\\", 2); break;
+					case '\b': out.append("\\b", 2); break;
+					case '\t': out.append("\\t", 2); break;
+					case '\n': out.append("\\n", 2); break;
+					case '\f': out.append("\\f", 2); break;
+					case '\r': out.append("\\r", 2); break;
+					case 0xC2:
+						if (p != end && (unsigned char)*p == 0x85)
+						{
+							out.append("\\u0085", 6);
+							p++;
+						}
+						else
+						{
+							out.push_back((char)c);
+						}
+						break;
+					case 0xE2:
+						if (end - p >= 2 && (unsigned char)p[0] == 0x80 &&
+							((unsigned char)p[1] == 0xA8 || (unsigned char)p[1] == 0xA9))
+						{
+							out.append((unsigned char)p[1] == 0xA8 ? "\\u2028" : "\\u2029", 6);
+							p += 2;
+						}
+						else
+						{
+							out.push_back((char)c);
+						}
+						break;
+					default:
+					{
+						char escape[6] = { '\\', 'u', '0', '0', Hex[c >> 4], Hex[c & 0xF] };
+						out.append(escape, 6);
+						break;
+					}
+					}
+				}
+				out.push_back('"');
+			}
+		}
+
+		bool MIDDLEWARE_EXP Scan(const char* data, size_t size, RawMessage& raw)
+		{
+			Scanner scanner(data, size);
+			return scanner.ScanMessage(raw);
+		}
+
+		MIDDLEWARE_EXP char* Unescape(const char* begin, const char* end, char* out)
+		{
+			while (begin != end)
+			{
+				const char* backslash = (const char*)memchr(begin, '\\', end - begin);
+				if (backslash == NULL)
+				{
+					backslash = end;
+				}
+
+				size_t run = backslash - begin;
+				if (out != begin)
+				{
+					memmove(out, begin, run);
+				}
+				out += run;
+				begin = backslash;
+				if (end - begin < 2)
+				{
+					break;
+				}
+
+				char c = begin[1];
+				begin += 2;
+				switch (c)
+				{
+				case 'b': *out++ = '\b'; break;
+				case 't': *out++ = '\t'; break;
+				case 'n': *out++ = '\n'; break;
+				case 'f': *out++ = '\f'; break;
+				case 'r': *out++ = '\r'; break;
+				case 'u':
+				{
+					unsigned int cp;
+					if (!ReadHex4(begin, end, cp))
+					{
+						*out++ = '?';
+						break;
+					}
+					begin += 4;
+
+					if (cp >= 0xD800 && cp <= 0xDBFF)
+					{
+						unsigned int low;
+						if (end - begin >= 6 && begin[0] == '\\' && begin[1] == 'u' &&
+							ReadHex4(begin + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF)
+						{
+							cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+							begin += 6;
+						}
+						else
+						{
+							cp = 0xFFFD;
+						}
+					}
+					else if (cp >= 0xDC00 && cp <= 0xDFFF)
+					{
+						cp = 0xFFFD;
+					}
+					out = WriteUtf8(out, cp);
+					break;
+				}
+				default:
+					//quote, backslash and solidus map to themselves
+					*out++ = c;
+					break;
+				}
+			}
+			return out;
+		}
+
+		bool MIDDLEWARE_EXP Decode(const char* data, size_t size, Message& msg)
+		{
+			RawMessage raw;
+			if (!Scan(data, size, raw))
+			{
+				return false;
+			}
+
+			Decode(raw, msg);
+			return true;
+		}
+
+		void MIDDLEWARE_EXP Decode(const RawMessage& raw, Message& msg)
+		{
+			msg.type_ = (MessageType)raw.type;
+			AssignField(msg.requestId_, raw.fields[REQUEST_ID]);
+			AssignField(msg.command_, raw.fields[COMMAND]);
+			AssignField(msg.channel_, raw.fields[CHANNEL]);
+			AssignField(msg.sourceId_, raw.fields[SOURCE_ID]);
+			AssignField(msg.destinationId_, raw.fields[DESTINATION_ID]);
+			AssignField(msg.payload_, raw.fields[PAYLOAD]);
+		}
+
+		bool MIDDLEWARE_EXP DecodeView(char* data, size_t size, MessageView& view)
+		{
+			RawMessage raw;
+			if (!Scan(data, size, raw))
+			{
+				return false;
+			}
+
+			DecodeView(data, raw, view);
+			return true;
+		}
+
+		void MIDDLEWARE_EXP DecodeView(char* data, const RawMessage& raw, MessageView& view)
+		{
+			view.type_ = (MessageType)raw.type;
+			view.requestId_ = ViewField(data, raw.fields[REQUEST_ID]);
+			view.command_ = ViewField(data, raw.fields[COMMAND]);
+			view.channel_ = ViewField(data, raw.fields[CHANNEL]);
+			view.sourceId_ = ViewField(data, raw.fields[SOURCE_ID]);
+			view.destinationId_ = ViewField(data, raw.fields[DESTINATION_ID]);
+			view.payload_ = ViewField(data, raw.fields[PAYLOAD]);
+		}
+
+		void MIDDLEWARE_EXP Encode(const Message& msg, std::string& out)
+		{
+			out.clear();
+			out.reserve(128 + msg.requestId_.size() + msg.command_.size() + msg.channel_.size() +
+				msg.sourceId_.size() + msg.destinationId_.size() + msg.payload_.size());
+
+			//member order matches the declaration order of the C# Message class
+			out.append("{\"Type\":", 8);
+			WriteInt(out, (int)msg.type_);
+			out.append(",\"RequestId\":", 13);
+			WriteString(out, msg.requestId_);
+			out.append(",\"Command\":", 11);
+			WriteString(out, msg.command_);
+			out.append(",\"Channel\":", 11);
+			WriteString(out, msg.channel_);
+			out.append(",\"SourceId\":", 12);
+			WriteString(out, msg.sourceId_);
+			out.append(",\"DestinationId\":", 17);
+			WriteString(out, msg.destinationId_);
+			out.append(",\"Payload\":", 11);
+			WriteString(out, msg.payload_);
+			out.append(",\"BinaryPayload\":null}", 22);
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <string>
+
+namespace MiddlewareLib
+{
+	//hand written JSON codec specialised to the Message schema. Encode produces
+	//the same bytes Newtonsoft.Json emits for the C# Message class, Decode accepts
+	//any field order, whitespace, null strings and the quoted "Type" values the
+	//old property_tree writer produced.
+	namespace MessageCodec
+	{
+		enum Field
+		{
+			TYPE = 0,
+			REQUEST_ID,
+			COMMAND,
+			CHANNEL,
+			SOURCE_ID,
+			DESTINATION_ID,
+			PAYLOAD,
+			FIELD_COUNT
+		};
+
+		//a string value as it appears in the document, without the quotes
+		struct RawField
+		{
+			const char* data;
+			size_t size;
+			bool escaped;
+		};
+
+		struct RawMessage
+		{
+			int type;
+			RawField fields[FIELD_COUNT];
+		};
+
+		//single pass scan of a document. Unknown members are skipped, missing
+		//string members are left empty. Returns false if the document is malformed.
+		bool MIDDLEWARE_EXP Scan(const char* data, size_t size, RawMessage& raw);
+
+		//decode the JSON escapes in [begin, end) into out, which may alias begin
+		//as the output is never longer than the input. Returns the end of the output.
+		MIDDLEWARE_EXP char* Unescape(const char* begin, const char* end, char* out);
+
+		//decode into msg, reusing the capacity of its strings
+		bool MIDDLEWARE_EXP Decode(const char* data, size_t size, Message& msg);
+		void MIDDLEWARE_EXP Decode(const RawMessage& raw, Message& msg);
+
+		//decode into views of data, unescaping any escaped fields in place.
+		//raw must have been scanned from data.
+		bool MIDDLEWARE_EXP DecodeView(char* data, size_t size, MessageView& view);
+		void MIDDLEWARE_EXP DecodeView(char* data, const RawMessage& raw, MessageView& view);
+
+		//encode msg into out, replacing its contents but keeping its capacity
+		void MIDDLEWARE_EXP Encode(const Message& msg, std::string& out);
+	}
+}
@@ -2,123 +2,343 @@
 //
 #include "stdafx.h"
 
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_io.hpp>
-#include <boost/uuid/uuid_generators.hpp>
-#include <map>
-#include <sstream>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 #include "MiddlewareClientLib.h"
+#include "BinaryCodec.h"
+#include "MessageCodec.h"
+#include "RequestLatency.h"
+#include "Trace.h"
+#include "SessionContext.h"
 
 //#include <boost/uuid/uuid_generators.hpp>
 //#include "IMiddlewareHandler.h"
 
-namespace pt = boost::property_tree;
-
 namespace MiddlewareLib
 {
 	Message fromJSON(const std::string& data)
 	{
 		Message msg;
-		pt::ptree tree;
-
-		std::istringstream in(data);
-		pt::read_json(in, tree);
-		msg.type_ = (MessageType)tree.get<int>("Type");
-		msg.requestId_ = tree.get<std::string>("RequestId");
-		msg.command_ = tree.get<std::string>("Command");
-		msg.channel_ = tree.get<std::string>("Channel");
-		msg.destinationId_ = tree.get<std::string>("DestinationId");
-		msg.sourceId_ = tree.get<std::string>("SourceId");
-		msg.payload_ = tree.get<std::string>("Payload");
+		if (!MessageCodec::Decode(data.data(), data.size(), msg))
+		{
+			throw std::runtime_error("invalid message: " + data);
+		}
 		return msg;
 	}
 
 	std::string toJSON(const Message& msg)
 	{
-		pt::ptree tree;
-		tree.put("Type", (int)msg.type_);
-		tree.put("RequestId", msg.requestId_);
-		tree.put("Command", msg.command_);
-		tree.put("Channel", msg.channel_);
-		tree.put("SourceId", msg.sourceId_);
-		tree.put("DestinationId", msg.destinationId_);
-		tree.put("Payload", msg.payload_);
-			
-		std::ostringstream out;
-		pt::write_json(out, tree);
-		return out.str();
+		std::string out;
+		MessageCodec::Encode(msg, out);
+		return out;
 	}
 
 	MSG_CALLBACK_FUNC g_msgCallback = NULL;
+	MSG_VIEW_CALLBACK_FUNC g_msgViewCallback = NULL;
 
 	//IMiddlewareHandler* g_handler = NULL;
 
-	typedef std::map<std::string, MiddlewareRequestParams> REQUEST_LIST_T;
-	REQUEST_LIST_T g_currentCalls;
+	MIDDLEWARE_EXP SessionContext* CreateSessionContext()
+	{
+		return new SessionContext();
+	}
 
-	void callbackHandler(ISession* session, const std::string& data)
+	//call the error callbacks of requests that will get no response
+	void failRequests(ISession* session, const std::vector<MiddlewareRequestParams>& failed, const char* error)
+	{
+		for (auto& params : failed)
+		{
+			if (params.on_error != NULL)
+			{
+				params.on_error(session, error);
+			}
+			if (params.completion != NULL)
+			{
+				params.completion->Complete(session, false, error);
+			}
+		}
+	}
+
+	void MIDDLEWARE_EXP ReleaseSessionContext(ISession* session)
+	{
+		//nothing will answer the requests still pending, so fail them rather
+		//than leave anyone waiting on them for ever
+		SessionContext* context = session->context_;
+		std::vector<MiddlewareRequestParams> cancelled;
+		{
+			std::lock_guard<std::mutex> lock(context->pendingLock_);
+			context->pending_.Clear(cancelled);
+		}
+		failRequests(session, cancelled, REQUEST_CANCELLED);
+		delete context;
+	}
+
+	//a response to one of our requests, complete it and call its callback
+	void completeRequest(ISession* session, const MessageView& view)
+	{
+		//ids we did not make can not be pending on this session
+		SessionContext& context = *session->context_;
+		uint64_t id;
+		if (!context.requestIds_.Parse(view.requestId_, id))
+		{
+			return;
+		}
+
+		MiddlewareRequestParams params;
+		RequestTiming timing;
+		{
+			std::lock_guard<std::mutex> lock(context.pendingLock_);
+			if (!context.pending_.Complete(id, params, &timing))
+			{
+				return;
+			}
+		}
+		RequestLatency::Finish(timing, context.NowNs());
+
+		MIDDLEWARE_TRACE_CALLBACKS(view.type_);
+		if (view.type_ == RESPONSE_SUCCESS)
+		{
+			if (params.on_success != NULL) {
+				params.on_success(session, std::string(view.payload_));
+			}
+		}
+		else if (view.type_ == RESPONSE_ERROR)
+		{
+			if (params.on_error != NULL) {
+				params.on_error(session, std::string(view.payload_));
+			}
+		}
+		else
+		{
+			return;
+		}
+
+		if (params.completion != NULL)
+		{
+			params.completion->Complete(session, view.type_ == RESPONSE_SUCCESS, view.payload_);
+		}
+	}
+
+	//data is the frame raw was scanned from, escaped fields are decoded in place
+	void handleMessage(ISession* session, char* data, const MessageCodec::RawMessage& raw)
 	{
-		//deserailise data into a Message object
-		Message msg = fromJSON(data);
-		
-		if (msg.type_ == REQUEST || msg.type_ == UPDATE)
+		if (raw.type == REQUEST || raw.type == UPDATE)
 		{
+			SessionContext& context = *session->context_;
+			LastValueCache* lastValues = raw.type == UPDATE ? context.lastValues_.get() : NULL;
+			Message msg;
+			if (g_msgCallback != NULL || lastValues != NULL)
+			{
+				MessageCodec::Decode(raw, msg);
+			}
+			if (lastValues != NULL)
+			{
+				lastValues->Update(msg);
+				//held for DeliverConflated
+				if (lastValues->Conflating())
+				{
+					return;
+				}
+			}
+
+			//decoded last as the view unescapes the frame in place
+			bool routed = !context.subscriptions_.Empty();
+			MessageView view;
+			if (g_msgViewCallback != NULL || routed)
+			{
+				MessageCodec::DecodeView(data, raw, view);
+			}
+			MIDDLEWARE_TRACE(PARSE_COMPLETE, raw.type);
+
+			MIDDLEWARE_TRACE_CALLBACKS(raw.type);
+			//channels with handlers go to them alone
+			if (routed && context.subscriptions_.Dispatch(session, view))
+			{
+				return;
+			}
+
 			//just send message to client
 			if (g_msgCallback != NULL)
 			{
 				g_msgCallback(session, msg);
 			}
+			if (g_msgViewCallback != NULL)
+			{
+				g_msgViewCallback(session, view);
+			}
 			return;
 		}
 
-		REQUEST_LIST_T::const_iterator it = g_currentCalls.find(msg.requestId_);
-		if (it != g_currentCalls.end())
+		MessageView view;
+		MessageCodec::DecodeView(data, raw, view);
+		MIDDLEWARE_TRACE(PARSE_COMPLETE, raw.type);
+		completeRequest(session, view);
+	}
+
+	//a binary envelope. The view refers to the frame, which is left as it is.
+	void handleBinaryMessage(ISession* session, const MessageView& view)
+	{
+		MIDDLEWARE_TRACE(PARSE_COMPLETE, view.type_);
+		if (view.type_ == REQUEST || view.type_ == UPDATE)
 		{
-			MiddlewareRequestParams const& params = it->second;
-			if (msg.type_ == RESPONSE_SUCCESS)
-				if (params.on_success != NULL) {
-					params.on_success(session, msg.payload_);
-				}
-			else if (msg.type_ == RESPONSE_ERROR)
-				if (params.on_error != NULL) {
-					params.on_error(session, msg.payload_);
+			LastValueCache* lastValues = view.type_ == UPDATE ? session->context_->lastValues_.get() : NULL;
+			Message msg;
+			if (g_msgCallback != NULL || lastValues != NULL)
+			{
+				BinaryCodec::Decode(view, msg);
+			}
+			if (lastValues != NULL)
+			{
+				lastValues->Update(msg);
+				if (lastValues->Conflating())
+				{
+					return;
 				}
+			}
+
+			MIDDLEWARE_TRACE_CALLBACKS(view.type_);
+			if (session->context_->subscriptions_.Dispatch(session, view))
+			{
+				return;
+			}
+			if (g_msgCallback != NULL)
+			{
+				g_msgCallback(session, msg);
+			}
 
-			g_currentCalls.erase(it);
+			if (g_msgViewCallback != NULL)
+			{
+				g_msgViewCallback(session, view);
+			}
+			return;
 		}
+		completeRequest(session, view);
+	}
+
+	//a frame copied to a dispatch worker
+	void handleFrame(ISession* session, char* data, size_t size)
+	{
+		if (BinaryCodec::IsBinary(data, size))
+		{
+			MessageView view;
+			BinaryCodec::DecodeView(data, size, view);
+			handleBinaryMessage(session, view);
+			return;
+		}
+
+		MessageCodec::RawMessage raw;
+		MessageCodec::Scan(data, size, raw);
+		handleMessage(session, data, raw);
+	}
+
+	size_t channelKey(std::string_view channel)
+	{
+		return std::hash<std::string_view>()(channel);
+	}
+
+	//data is the received frame. It is only valid for the duration of the call and
+	//escaped fields are decoded in place.
+	void frameHandler(ISession* session, char* data, size_t size)
+	{
+		//with workers this thread only finds the channel, decoding and the
+		//callbacks happen on the channel's worker
+		WorkerPool* workers = session->context_->workers_.get();
+
+		if (BinaryCodec::IsBinary(data, size))
+		{
+			MessageView view;
+			if (!BinaryCodec::DecodeView(data, size, view))
+			{
+				throw std::runtime_error("invalid binary message");
+			}
+
+			if (workers != NULL)
+			{
+				workers->Post(channelKey(view.channel_), handleFrame, session, data, size);
+				return;
+			}
+			handleBinaryMessage(session, view);
+			return;
+		}
+
+		MessageCodec::RawMessage raw;
+		if (!MessageCodec::Scan(data, size, raw))
+		{
+			throw std::runtime_error("invalid message: " + std::string(data, size));
+		}
+
+		if (workers != NULL)
+		{
+			const MessageCodec::RawField& channel = raw.fields[MessageCodec::CHANNEL];
+			workers->Post(channelKey(std::string_view(channel.data, channel.size)), handleFrame, session, data, size);
+			return;
+		}
+		handleMessage(session, data, raw);
+	}
+
+	void callbackHandler(ISession* session, const std::string& data)
+	{
+		//copy the message so the frame handler can decode it in place
+		std::string frame(data);
+		frameHandler(session, &frame[0], frame.size());
 	}
 	 
 	bool doRequestInternal(ISession *session, const MiddlewareRequestParams& params, const std::string& command, const std::string& payload, const std::string& destination)
 	{
-		Message msg;
+		if (session == NULL)
+		{
+			return false;
+		}
+		session = session->SessionForRequest(params.channel);
+
+		//reuse one message per thread so its strings keep their capacity
+		static thread_local Message msg;
 		msg.channel_ = params.channel;
 		msg.command_ = command;
 		msg.type_ = REQUEST;
 		msg.payload_ = payload;
 		msg.destinationId_ = destination;
 
-		boost::uuids::random_generator gen;
-		boost::uuids::uuid u = gen();
-		msg.requestId_ = boost::uuids::to_string(u);
+		SessionContext& context = *session->context_;
+		char requestId[RequestIdGenerator::MAX_SIZE];
+		uint64_t id;
+		size_t size = context.requestIds_.Next(requestId, id);
+		msg.requestId_.assign(requestId, size);
 
-		//add to current call list
-		auto it = g_currentCalls.find(msg.requestId_);
-		if (it != g_currentCalls.end())
+		//add to the pending requests before sending, the response may come back
+		//on the dispatcher thread before SendData returns
 		{
-			throw new std::runtime_error("request already pending!!!");
+			uint64_t deadline = params.deadline_ms != 0 ? context.Now() + params.deadline_ms : 0;
+			RequestTiming timing;
+			std::lock_guard<std::mutex> lock(context.pendingLock_);
+			context.latency_.Start(command, params.channel, context.NowNs(), timing);
+			context.pending_.Add(id, params, deadline, timing);
 		}
 
-		g_currentCalls.insert(REQUEST_LIST_T::value_type(msg.requestId_, params));
-
-		if (session != NULL)
+		//serialise on the caller's thread and hand the frame over, the
+		//dispatcher only has to queue it for the socket
+		std::string frame;
+		bool binary = session->BinaryMessages();
+		if (binary)
 		{
-			session->SendData(toJSON(msg));
-			return true;
+			BinaryCodec::Encode(msg, frame);
 		}
-
-		return false;
+		else
+		{
+			MessageCodec::Encode(msg, frame);
+		}
+		MIDDLEWARE_TRACE(SEND_ENQUEUE, frame.size());
+		if (session->TrySendData(std::move(frame), binary) != SEND_OK)
+		{
+			//the transmit buffer is full, so no response is coming
+			MiddlewareRequestParams withdrawn;
+			std::lock_guard<std::mutex> lock(context.pendingLock_);
+			context.pending_.Complete(id, withdrawn);
+			return false;
+		}
+		return true;
 	}
 
 	bool MIDDLEWARE_EXP SubscribeToChannel(ISession *session, const MiddlewareRequestParams& params)
@@ -149,14 +369,276 @@ namespace MiddlewareLib
 		return doRequestInternal(session, params, "PUBLISHMESSAGE", payload, "");
 	}
 
+	bool MIDDLEWARE_EXP RemoveSubscription(ISession *session, const MiddlewareRequestParams& params)
+	{
+		return doRequestInternal(session, params, "REMOVESUBSCRIPTION", "", "");
+	}
+
+	//forgets a channel handler's subscription when it fails, so the next
+	//handler added subscribes again
+	class SubscribeCompletion : public IRequestCompletion
+	{
+	public:
+		SubscribeCompletion(SubscriptionRegistry& subscriptions, uint64_t handle, const std::shared_ptr<IRequestCompletion>& completion) :
+			subscriptions_(subscriptions), handle_(handle), completion_(completion)
+		{
+		}
+
+		void Complete(ISession* session, bool success, std::string_view payload)
+		{
+			if (!success)
+			{
+				subscriptions_.SubscribeFailed(handle_);
+			}
+			if (completion_ != NULL)
+			{
+				completion_->Complete(session, success, payload);
+			}
+		}
+
+	private:
+		//only completed while the connection holding it is alive
+		SubscriptionRegistry& subscriptions_;
+		uint64_t handle_;
+		std::shared_ptr<IRequestCompletion> completion_;
+	};
+
+	uint64_t MIDDLEWARE_EXP AddChannelHandler(ISession *session, const MiddlewareRequestParams& params, CHANNEL_HANDLER_FUNC handler, void* context)
+	{
+		//a pooled session's messages arrive on the channel's connection
+		ISession* connection = session->SessionForChannel(params.channel);
+		SubscriptionRegistry& subscriptions = connection->context_->subscriptions_;
+		bool subscribe;
+		uint64_t handle = subscriptions.Add(params.channel, handler, context, subscribe);
+		if (!subscribe)
+		{
+			return handle;
+		}
+
+		MiddlewareRequestParams subscription = params;
+		subscription.completion.reset(new SubscribeCompletion(subscriptions, handle, params.completion));
+		//sent through the session so a pooled one counts the request
+		if (!SubscribeToChannel(session, subscription))
+		{
+			subscriptions.SubscribeFailed(handle);
+			std::string channel;
+			bool unsubscribe;
+			subscriptions.Remove(handle, channel, unsubscribe);
+			return 0;
+		}
+		return handle;
+	}
+
+	bool MIDDLEWARE_EXP RemoveChannelHandler(ISession *session, uint64_t handle)
+	{
+		//the handle does not say which connection of a pooled session it is on
+		size_t connections = ConnectionCount(session);
+		for (size_t i = 0; i < connections; i++)
+		{
+			ISession* connection = GetConnection(session, i);
+			std::string channel;
+			bool unsubscribe;
+			if (!connection->context_->subscriptions_.Remove(handle, channel, unsubscribe))
+			{
+				continue;
+			}
+			if (unsubscribe)
+			{
+				MiddlewareRequestParams params{ channel, NULL, NULL, 0, NULL };
+				RemoveSubscription(session, params);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	ChannelId MIDDLEWARE_EXP InternChannel(ISession *session, const std::string& channel)
+	{
+		return session->SessionForChannel(channel)->context_->subscriptions_.Intern(channel);
+	}
+
 	void MIDDLEWARE_EXP RegisterMessageCallbackFunction(MSG_CALLBACK_FUNC msgCallback)
 	{
 		g_msgCallback = msgCallback;
 	}
 
+	void MIDDLEWARE_EXP RegisterMessageViewCallbackFunction(MSG_VIEW_CALLBACK_FUNC msgViewCallback)
+	{
+		g_msgViewCallback = msgViewCallback;
+	}
+
 	void MIDDLEWARE_EXP StartDispatching(ISession *session)
 	{
-		session->StartDispatcher(callbackHandler);
+		session->StartDispatcher(callbackHandler, frameHandler);
+	}
+
+	void MIDDLEWARE_EXP ExpireRequests(ISession *session)
+	{
+		SessionContext& context = *session->context_;
+		std::vector<MiddlewareRequestParams> expired;
+		{
+			std::lock_guard<std::mutex> lock(context.pendingLock_);
+			if (context.pending_.Size() == 0)
+			{
+				return;
+			}
+			context.pending_.Expire(context.Now(), expired);
+		}
+
+		//outside the lock, a callback may well send another request
+		failRequests(session, expired, REQUEST_TIMED_OUT);
+	}
+
+	size_t MIDDLEWARE_EXP PendingRequestCount(ISession *session)
+	{
+		SessionContext& context = *session->context_;
+		std::lock_guard<std::mutex> lock(context.pendingLock_);
+		return context.pending_.Size();
+	}
+
+	size_t MIDDLEWARE_EXP PendingDeadlineCount(ISession *session)
+	{
+		SessionContext& context = *session->context_;
+		std::lock_guard<std::mutex> lock(context.pendingLock_);
+		return context.pending_.Deadlines();
+	}
+
+	void MIDDLEWARE_EXP FailDroppedFrame(ISession *session, char* data, size_t size)
+	{
+		//only the request id is needed, but the frame is encoded as it was sent
+		MessageView view;
+		if (BinaryCodec::IsBinary(data, size))
+		{
+			if (!BinaryCodec::DecodeView(data, size, view))
+			{
+				return;
+			}
+		}
+		else if (!MessageCodec::DecodeView(data, size, view))
+		{
+			return;
+		}
+
+		SessionContext& context = *session->context_;
+		uint64_t id;
+		if (view.type_ != REQUEST || !context.requestIds_.Parse(view.requestId_, id))
+		{
+			return;
+		}
+		std::vector<MiddlewareRequestParams> dropped(1);
+		{
+			std::lock_guard<std::mutex> lock(context.pendingLock_);
+			if (!context.pending_.Complete(id, dropped[0]))
+			{
+				return;
+			}
+		}
+		failRequests(session, dropped, REQUEST_NOT_SENT);
+	}
+
+	bool MIDDLEWARE_EXP GetRequestLatency(ISession* session, RequestLatencySnapshot& snapshot, bool reset)
+	{
+		if (session == NULL)
+		{
+			return false;
+		}
+
+		//a pooled session's requests are sent on its connections
+		size_t connections = ConnectionCount(session);
+		for (size_t i = 0; i < connections; i++)
+		{
+			SessionContext& context = *GetConnection(session, i)->context_;
+			std::lock_guard<std::mutex> lock(context.pendingLock_);
+			context.latency_.Snapshot(snapshot, reset);
+		}
+		return true;
+	}
+
+	void MIDDLEWARE_EXP StartDispatchWorkers(ISession *session, unsigned int workers)
+	{
+		if (workers > 0 && session->context_->workers_ == NULL)
+		{
+			session->context_->workers_.reset(new WorkerPool(workers));
+		}
+	}
+
+	void MIDDLEWARE_EXP StopDispatchWorkers(ISession *session)
+	{
+		if (session->context_->workers_ != NULL)
+		{
+			session->context_->workers_->Stop();
+		}
+	}
+
+	void MIDDLEWARE_EXP EnableLastValueCache(ISession *session, const LastValueCacheOptions& options)
+	{
+		if (options.enabled && session->context_->lastValues_ == NULL)
+		{
+			session->context_->lastValues_.reset(new LastValueCache(options.conflate));
+		}
+	}
+
+	bool MIDDLEWARE_EXP GetLastValue(ISession *session, const std::string& channel, Message& msg)
+	{
+		//a pooled session's updates are cached on the channel's connection
+		LastValueCache* lastValues = session->SessionForChannel(channel)->context_->lastValues_.get();
+		return lastValues != NULL && lastValues->Get(channel, msg);
+	}
+
+	size_t deliverConflated(ISession *connection, size_t max)
+	{
+		LastValueCache* lastValues = connection->context_->lastValues_.get();
+		if (lastValues == NULL || !lastValues->Conflating())
+		{
+			return 0;
+		}
+
+		std::vector<Message> messages;
+		lastValues->Drain(messages, max);
+		for (auto& msg : messages)
+		{
+			MessageView view{ msg.type_, msg.requestId_, msg.command_, msg.channel_, msg.sourceId_, msg.destinationId_, msg.payload_ };
+			if (connection->context_->subscriptions_.Dispatch(connection, view))
+			{
+				continue;
+			}
+			if (g_msgCallback != NULL)
+			{
+				g_msgCallback(connection, msg);
+			}
+			if (g_msgViewCallback != NULL)
+			{
+				g_msgViewCallback(connection, view);
+			}
+		}
+		return messages.size();
+	}
+
+	size_t MIDDLEWARE_EXP DeliverConflated(ISession *session, size_t max)
+	{
+		size_t delivered = 0;
+		size_t connections = ConnectionCount(session);
+		for (size_t i = 0; i < connections && (max == 0 || delivered < max); i++)
+		{
+			delivered += deliverConflated(GetConnection(session, i), max == 0 ? 0 : max - delivered);
+		}
+		return delivered;
+	}
+
+	bool MIDDLEWARE_EXP GetConflationStats(ISession *session, ConflationStats& stats)
+	{
+		bool cached = false;
+		size_t connections = ConnectionCount(session);
+		for (size_t i = 0; i < connections; i++)
+		{
+			LastValueCache* lastValues = GetConnection(session, i)->context_->lastValues_.get();
+			if (lastValues != NULL)
+			{
+				lastValues->GetStats(stats);
+				cached = true;
+			}
+		}
+		return cached;
 	}
 }
 
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <memory>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+
+#ifdef _WIN32
 #ifdef MIDDLEWARECLIENTLIB_EXPORTS
 #define MIDDLEWARE_EXP __declspec(dllexport)
 #else
 #define MIDDLEWARE_EXP __declspec(dllimport)
 #endif
+#else
+#define MIDDLEWARE_EXP __attribute__((visibility("default")))
+#endif
 
 namespace MiddlewareLib
 {
@@ -27,17 +36,496 @@ namespace MiddlewareLib
 		std::string payload_;
 
 	};
+
+	//same fields as Message but referencing the received frame directly. Only
+	//valid for the duration of the callback it is passed to.
+	struct MessageView
+	{
+		MessageType type_;
+		std::string_view requestId_;
+		std::string_view command_;
+		std::string_view channel_;
+		std::string_view sourceId_;
+		std::string_view destinationId_;
+		std::string_view payload_;
+	};
 	
 	class ISession;
+	class SessionContext;
+	struct DeflateStats;
+	struct SendStats;
+	struct ConnectTimings;
+	struct TransportStats;
+
+	//the state the library keeps for each session, made and freed by ISession
+	MIDDLEWARE_EXP SessionContext* CreateSessionContext();
+	//fails the session's pending requests with REQUEST_CANCELLED, then frees
+	//its context. The session is being destroyed, so their callbacks must
+	//not call it.
+	void MIDDLEWARE_EXP ReleaseSessionContext(ISession* session);
 
 	typedef void(*CALLBACK_FUNC)(ISession* session, const std::string& message);
 	typedef void(*MSG_CALLBACK_FUNC)(ISession* session, const Message& message);
+	typedef void(*MSG_VIEW_CALLBACK_FUNC)(ISession* session, const MessageView& message);
+	//data points into the session's receive buffer and may be modified in place
+	typedef void(*FRAME_CALLBACK_FUNC)(ISession* session, char* data, size_t size);
+	//full is true when a send finds the transmit buffer at its high watermark
+	//and false once it has drained to the low watermark, see TransmitBufferOptions
+	typedef void(*WATERMARK_CALLBACK_FUNC)(ISession* session, bool full, size_t queuedBytes);
+	//a channel name interned by its session, see InternChannel
+	typedef uint32_t ChannelId;
+	//called for the messages on a channel the handler was added for, with
+	//the context it was added with, see AddChannelHandler
+	typedef void(*CHANNEL_HANDLER_FUNC)(ISession* session, ChannelId channel, const MessageView& message, void* context);
+
+	//what happened to data passed to ISession::TrySendData
+	enum SendStatus
+	{
+		SEND_OK = 0,
+		//the transmit buffer is full, nothing was queued
+		SEND_WOULD_BLOCK = 1,
+		//the transmit buffer is full and the data was discarded
+		SEND_DROPPED = 2,
+		//waited TransmitBufferOptions::blockTimeoutMs for room, nothing was queued
+		SEND_TIMED_OUT = 3
+	};
 
 	class ISession
 	{
 	public:
+		ISession() : context_(CreateSessionContext()) {}
+		virtual ~ISession() { ReleaseSessionContext(this); }
 		virtual void SendData(const std::string& data) = 0;
+		//may be called from any thread. Sessions that queue the data for their
+		//dispatcher override this to take it without a copy.
+		virtual void SendData(std::string&& data)
+		{
+			SendData((const std::string&)data);
+		}
+		//true once the session has negotiated the binary envelope with its peer,
+		//see SessionOptions::binaryMessages. Messages are then encoded with
+		//BinaryCodec and sent with SendBinaryData.
+		virtual bool BinaryMessages() const
+		{
+			return false;
+		}
+		//send data in a binary frame. Only called if BinaryMessages returns true.
+		virtual void SendBinaryData(std::string&& data)
+		{
+			SendData(std::move(data));
+		}
+		//as SendData or SendBinaryData, but reports whether the data was queued.
+		//Sessions with a bounded transmit buffer override this to apply their
+		//TransmitBufferOptions, SendData then applies them without saying.
+		virtual SendStatus TrySendData(std::string&& data, bool binary)
+		{
+			if (binary)
+			{
+				SendBinaryData(std::move(data));
+			}
+			else
+			{
+				SendData(std::move(data));
+			}
+			return SEND_OK;
+		}
+		//bytes sent but not yet written to the socket, 0 if not known
+		virtual size_t QueuedBytes() const
+		{
+			return 0;
+		}
+		//compression counters, false unless permessage-deflate was negotiated
+		virtual bool GetDeflateStats(DeflateStats& stats) const
+		{
+			return false;
+		}
+		//socket write counters, false if the session does not keep them
+		virtual bool GetSendStats(SendStats& stats) const
+		{
+			return false;
+		}
+		//how long connecting took, false if the session did not record it
+		virtual bool GetConnectTimings(ConnectTimings& timings) const
+		{
+			return false;
+		}
+		//what the connection's socket has carried, false if the session does
+		//not keep the counters
+		virtual bool GetTransportStats(TransportStats& stats) const
+		{
+			return false;
+		}
+		//send a ping, its round trip is recorded in TransportStats when the
+		//pong comes back. False if the session cannot send one.
+		virtual bool SendPing()
+		{
+			return false;
+		}
+		//the session that carries messages for channel. The request functions
+		//send on it, so a session spread over several connections picks one
+		//here, see CreatePooledSession.
+		virtual ISession* SessionForChannel(std::string_view channel)
+		{
+			return this;
+		}
+		//as SessionForChannel, for a request about to be sent. A session
+		//spread over several connections counts it here, see ConnectionLoad.
+		virtual ISession* SessionForRequest(std::string_view channel)
+		{
+			return SessionForChannel(channel);
+		}
 		virtual void StartDispatcher(CALLBACK_FUNC handler) = 0;
+		//sessions that can hand frames over without copying them override this
+		virtual void StartDispatcher(CALLBACK_FUNC handler, FRAME_CALLBACK_FUNC frameHandler)
+		{
+			StartDispatcher(handler);
+		}
+
+		//pending requests and other state the library keeps for this session
+		SessionContext* context_;
+	};
+
+	//permessage-deflate (RFC 7692) settings. Only offered when enabled and the
+	//library was built with zlib.
+	struct DeflateOptions
+	{
+		bool enabled;
+		//zlib compression level, 1 (fastest) to 9 (smallest)
+		int level;
+		//LZ77 window used to compress what we send, 9 to 15 bits. A smaller
+		//window needs less memory per connection but finds fewer repeats.
+		int windowBits;
+		//largest window the peer may compress with, 9 to 15 bits
+		int peerWindowBits;
+		//keep the compression window from one message to the next. Repeated
+		//content across messages then compresses well, at the cost of the
+		//window's memory for the life of the connection.
+		bool contextTakeover;
+		bool peerContextTakeover;
+		//messages shorter than this are sent uncompressed
+		size_t threshold;
+
+		DeflateOptions() :
+			enabled(false),
+			level(6),
+			windowBits(15),
+			peerWindowBits(15),
+			contextTakeover(true),
+			peerContextTakeover(true),
+			threshold(256)
+		{
+		}
+	};
+
+	//what permessage-deflate has done on a connection. Time is the CPU time
+	//of the thread doing the work, where the platform can measure it.
+	struct DeflateStats
+	{
+		uint64_t messagesDeflated;
+		//sent uncompressed as they were under the threshold
+		uint64_t messagesSkipped;
+		uint64_t deflateBytesIn;
+		uint64_t deflateBytesOut;
+		uint64_t deflateNanos;
+		uint64_t messagesInflated;
+		uint64_t inflateBytesIn;
+		uint64_t inflateBytesOut;
+		uint64_t inflateNanos;
+
+		DeflateStats() :
+			messagesDeflated(0), messagesSkipped(0), deflateBytesIn(0), deflateBytesOut(0), deflateNanos(0),
+			messagesInflated(0), inflateBytesIn(0), inflateBytesOut(0), inflateNanos(0)
+		{
+		}
+
+		//uncompressed bytes per byte on the wire, 0 before any messages
+		double DeflateRatio() const { return deflateBytesOut ? (double)deflateBytesIn / deflateBytesOut : 0.0; }
+		double InflateRatio() const { return inflateBytesIn ? (double)inflateBytesOut / inflateBytesIn : 0.0; }
+		double DeflateNanosPerMessage() const { return messagesDeflated ? (double)deflateNanos / messagesDeflated : 0.0; }
+		double InflateNanosPerMessage() const { return messagesInflated ? (double)inflateNanos / messagesInflated : 0.0; }
+	};
+
+	//how messages waiting to be sent are batched into socket writes. Messages
+	//queued while the dispatcher is busy always go out together at the end of
+	//its cycle, in writes of up to maxBatchMessages and maxBatchBytes.
+	struct CoalescingOptions
+	{
+		//frames per write, 1 to 512
+		unsigned int maxBatchMessages;
+		size_t maxBatchBytes;
+		//after a write, hold further messages for up to this long so a burst
+		//goes out in fewer, larger writes. A message sent at least this long
+		//after the last write is not held. 0 writes at the end of every cycle.
+		//Only used by the POSIX sessions.
+		unsigned int flushWindowMicros;
+
+		CoalescingOptions() : maxBatchMessages(64), maxBatchBytes(256 * 1024), flushWindowMicros(0) {}
+	};
+
+	//socket writes made by a session, to show how well sends are coalesced
+	struct SendStats
+	{
+		//calls that wrote to the socket
+		uint64_t writes;
+		//frames completely written
+		uint64_t messages;
+		uint64_t bytes;
+		//most frames completed by one write
+		uint64_t largestBatch;
+		//sends refused or discarded as the transmit buffer was full
+		uint64_t rejected;
+		uint64_t dropped;
+		//bytes waiting to be written when the stats were taken
+		uint64_t queuedBytes;
+
+		SendStats() : writes(0), messages(0), bytes(0), largestBatch(0), rejected(0), dropped(0), queuedBytes(0) {}
+
+		double MessagesPerWrite() const { return writes ? (double)messages / writes : 0.0; }
+		double BytesPerWrite() const { return writes ? (double)bytes / writes : 0.0; }
+	};
+
+	//what a send does when the transmit buffer is full
+	enum OverflowPolicy
+	{
+		//refuse it, TrySendData returns SEND_WOULD_BLOCK
+		OVERFLOW_REJECT = 0,
+		//discard it, TrySendData returns SEND_DROPPED
+		OVERFLOW_DROP_NEWEST = 1,
+		//queue it and discard the oldest messages not yet handed to the socket
+		//until it fits. Messages already framed for the socket are never
+		//discarded, nor is a message sent on the dispatcher thread. A request
+		//discarded this way fails with REQUEST_NOT_SENT.
+		OVERFLOW_DROP_OLDEST = 2,
+		//wait up to blockTimeoutMs for room. Sends on the dispatcher thread
+		//cannot wait and are refused.
+		OVERFLOW_BLOCK = 3
+	};
+
+	//limits on the data a session holds while the peer or network is slower
+	//than the sender. The queued bytes are the messages waiting for the
+	//dispatcher plus the frames it has not yet written to the socket.
+	struct TransmitBufferOptions
+	{
+		//bytes at which the buffer is full, 0 for no limit. A message is
+		//queued if it fits under this or nothing else is queued.
+		size_t highWatermark;
+		//once full, the buffer is not full again until it drains to this
+		size_t lowWatermark;
+		OverflowPolicy policy;
+		unsigned int blockTimeoutMs;
+		//optional. Called on the sending thread when a send finds the buffer
+		//full and on the dispatcher thread when it drains to lowWatermark.
+		WATERMARK_CALLBACK_FUNC onWatermark;
+
+		TransmitBufferOptions() :
+			highWatermark(0),
+			lowWatermark(0),
+			policy(OVERFLOW_REJECT),
+			blockTimeoutMs(1000),
+			onWatermark(NULL)
+		{
+		}
+	};
+
+	//how a session connects to the broker. Connecting is synchronous:
+	//CreateSession resolves the host, connects and completes the upgrade
+	//handshake on the calling thread, and returns once the session is open
+	//or has failed, even for a session on a ReactorPool.
+	struct ConnectOptions
+	{
+		//limit on connecting and the upgrade handshake together. Resolving
+		//the host name blocks for as long as the resolver takes, but counts
+		//towards this.
+		unsigned int timeoutMs;
+		//when the host has several addresses, start connecting to the next
+		//if the last has not connected after this long rather than waiting
+		//for it to fail ("happy eyeballs", RFC 8305). IPv6 and IPv4 addresses
+		//are tried alternately.
+		unsigned int attemptDelayMs;
+
+		ConnectOptions() : timeoutMs(10000), attemptDelayMs(250) {}
+	};
+
+	//where the time went while a session connected, in microseconds
+	struct ConnectTimings
+	{
+		uint64_t resolveMicros;
+		//from resolving to the first connection established
+		uint64_t connectMicros;
+		//from sending the upgrade request to reading the response
+		uint64_t handshakeMicros;
+		uint64_t totalMicros;
+		//addresses the host resolved to and connections started to them
+		unsigned int addresses;
+		unsigned int attempts;
+
+		ConnectTimings() : resolveMicros(0), connectMicros(0), handshakeMicros(0), totalMicros(0), addresses(0), attempts(0) {}
+	};
+
+	//what a connection's socket has carried, to show how messages map onto
+	//frames and system calls. Frames and payload bytes are counted by
+	//websocket opcode, e.g. framesIn[TransportStats::PONG].
+	struct TransportStats
+	{
+		enum Opcode
+		{
+			CONTINUATION = 0x0,
+			TEXT = 0x1,
+			BINARY = 0x2,
+			CLOSE = 0x8,
+			PING = 0x9,
+			PONG = 0xa,
+			OPCODES = 16
+		};
+
+		uint64_t framesIn[OPCODES];
+		uint64_t bytesIn[OPCODES];
+		//frames queued to send, see SendStats for how they were written
+		uint64_t framesOut[OPCODES];
+		uint64_t bytesOut[OPCODES];
+		//recv calls that returned data and socket writes, with the bytes
+		//they moved. A partial write took less than it was offered.
+		uint64_t recvCalls;
+		uint64_t recvBytes;
+		uint64_t sendCalls;
+		uint64_t sendBytes;
+		uint64_t partialWrites;
+		//most bytes held in the receive buffer and the send queue
+		uint64_t rxbufHighWater;
+		uint64_t txbufHighWater;
+		//the socket error that closed the connection, 0 if none
+		int closeError;
+
+		//pings sent by ISession::SendPing and their round trips
+		uint64_t pingsSent;
+		uint64_t pongsReceived;
+		uint64_t lastPingMicros;
+		uint64_t minPingMicros;
+		uint64_t maxPingMicros;
+
+		//the kernel's view of the connection, sampled from TCP_INFO at most
+		//every TCP_INFO_INTERVAL_MS while the connection is polled. Linux
+		//only, tcpInfoSamples stays 0 elsewhere.
+		static const unsigned int TCP_INFO_INTERVAL_MS = 1000;
+		uint64_t tcpInfoSamples;
+		//how long ago the last sample was taken
+		uint64_t tcpInfoAgeMicros;
+		uint32_t rttMicros;
+		uint32_t rttVarMicros;
+		//segments: congestion window, sent but not acknowledged, thought lost
+		uint32_t sndCwnd;
+		uint32_t sndMss;
+		uint32_t unacked;
+		uint32_t lost;
+		//retransmits of the current segment and over the connection's life
+		uint32_t retransmits;
+		uint32_t totalRetrans;
+
+		TransportStats() :
+			recvCalls(0), recvBytes(0), sendCalls(0), sendBytes(0), partialWrites(0),
+			rxbufHighWater(0), txbufHighWater(0), closeError(0),
+			pingsSent(0), pongsReceived(0), lastPingMicros(0), minPingMicros(0), maxPingMicros(0),
+			tcpInfoSamples(0), tcpInfoAgeMicros(0), rttMicros(0), rttVarMicros(0),
+			sndCwnd(0), sndMss(0), unacked(0), lost(0), retransmits(0), totalRetrans(0)
+		{
+			for (size_t i = 0; i < OPCODES; i++)
+			{
+				framesIn[i] = bytesIn[i] = framesOut[i] = bytesOut[i] = 0;
+			}
+		}
+	};
+
+	//keeping the latest UPDATE received on each channel, see GetLastValue
+	struct LastValueCacheOptions
+	{
+		bool enabled;
+		//hold UPDATEs in the cache rather than passing them to the message
+		//callbacks as they arrive. DeliverConflated then passes on the latest
+		//value of each channel that changed, so a consumer that falls behind
+		//skips the values it would have no use for.
+		bool conflate;
+
+		LastValueCacheOptions() : enabled(false), conflate(false) {}
+	};
+
+	//what a session's last value cache has done, see GetConflationStats
+	struct ConflationStats
+	{
+		uint64_t updates;
+		//replaced by a newer value before they were delivered
+		uint64_t conflated;
+		uint64_t delivered;
+		//channels with a value waiting to be delivered, and cached
+		uint64_t waiting;
+		uint64_t channels;
+
+		ConflationStats() : updates(0), conflated(0), delivered(0), waiting(0), channels(0) {}
+	};
+
+	//per session settings, the defaults suit most connections
+	struct SessionOptions
+	{
+		//bytes read from the socket ahead of dispatch. A message larger than
+		//this grows the buffer until it has been dispatched.
+		size_t receiveBufferSize;
+
+		//threads that decode received messages and call the callbacks. With 0
+		//they run on the dispatcher thread. Otherwise messages are spread over
+		//the workers by channel: each channel's messages arrive in order on one
+		//worker but callbacks for different channels run at the same time.
+		unsigned int dispatchWorkers;
+		//offer the compact binary envelope when connecting. It is only used if
+		//the peer selects it, otherwise messages are sent as JSON. Payloads can
+		//then be any bytes rather than text.
+		bool binaryMessages;
+		DeflateOptions deflate;
+		CoalescingOptions coalescing;
+		TransmitBufferOptions transmitBuffer;
+		ConnectOptions connect;
+		LastValueCacheOptions lastValueCache;
+
+		SessionOptions() : receiveBufferSize(64 * 1024), dispatchWorkers(0), binaryMessages(false) {}
+	};
+
+	//settings for a session spread over several connections to the broker
+	struct PooledSessionOptions
+	{
+		unsigned int connections;
+		//points each connection has on the hash ring. More spread the
+		//channels more evenly over the connections.
+		unsigned int virtualNodes;
+		//applied to every connection
+		SessionOptions session;
+
+		PooledSessionOptions() : connections(4), virtualNodes(64) {}
+	};
+
+	//what one connection of a pooled session is carrying
+	struct ConnectionLoad
+	{
+		//requests sent on the connection by the request functions, and
+		//channels pinned to it
+		uint64_t requests;
+		size_t pinnedChannels;
+		//requests still waiting for a response
+		size_t pendingRequests;
+		//socket writes, see SendStats. False if the connection failed.
+		bool connected;
+		SendStats sent;
+
+		ConnectionLoad() : requests(0), pinnedChannels(0), pendingRequests(0), connected(false) {}
+	};
+
+	//told the outcome of a request along with whatever state it keeps, so
+	//the response needs no lookup of its own, see RequestFuture. Called on
+	//the thread that handles the response, after on_success or on_error. Not
+	//called if the request function returns false.
+	class IRequestCompletion
+	{
+	public:
+		virtual ~IRequestCompletion() {}
+		//payload is only valid for the duration of the call
+		virtual void Complete(ISession* session, bool success, std::string_view payload) = 0;
 	};
 
 	struct MiddlewareRequestParams
@@ -45,17 +533,128 @@ namespace MiddlewareLib
 		std::string channel;
 		CALLBACK_FUNC on_success;
 		CALLBACK_FUNC on_error;
+		//milliseconds to wait for the response before on_error is called with
+		//REQUEST_TIMED_OUT. 0 waits for ever.
+		unsigned int deadline_ms = 0;
+		//optional, kept with the request until it completes
+		std::shared_ptr<IRequestCompletion> completion;
 	};
 
+	//payload passed to on_error when a request's deadline passes
+	const char* const REQUEST_TIMED_OUT = "REQUEST_TIMED_OUT";
+	//error a request completes with when it could not be sent
+	const char* const REQUEST_NOT_SENT = "REQUEST_NOT_SENT";
+	//error a request completes with when its session is destroyed first
+	const char* const REQUEST_CANCELLED = "REQUEST_CANCELLED";
+
+	//the request functions return false without sending if the session's
+	//transmit buffer refuses the message, see TransmitBufferOptions
+
 	bool MIDDLEWARE_EXP SubscribeToChannel(ISession *session, const MiddlewareRequestParams& params);
 	bool MIDDLEWARE_EXP SendMessageToChannel(ISession *session, const MiddlewareRequestParams& params, const std::string& payload, const std::string& destination);
 	bool MIDDLEWARE_EXP AddChannelListener(ISession *session, const MiddlewareRequestParams& params);
 	bool MIDDLEWARE_EXP SendRequest(ISession *session, const MiddlewareRequestParams& params, const std::string& payload);
 	bool MIDDLEWARE_EXP PublishMessage(ISession *session, const MiddlewareRequestParams& params, const std::string& payload);
+	bool MIDDLEWARE_EXP RemoveSubscription(ISession *session, const MiddlewareRequestParams& params);
+
+	//handle the messages on params.channel with handler rather than the
+	//message callbacks. Any number of handlers may be added for a channel and
+	//share one subscription: adding the first subscribes with params, later
+	//ones do not send anything and their params are not used. If the
+	//subscription is refused or times out, the next handler added for the
+	//channel subscribes again. Returns the handler's handle, 0 if the
+	//subscription could not be sent.
+	uint64_t MIDDLEWARE_EXP AddChannelHandler(ISession *session, const MiddlewareRequestParams& params, CHANNEL_HANDLER_FUNC handler, void* context);
+	//removing a channel's last handler sends REMOVESUBSCRIPTION, unless its
+	//subscription failed. False if the handle is not one of the session's.
+	bool MIDDLEWARE_EXP RemoveChannelHandler(ISession *session, uint64_t handle);
+	//the id channel's handlers are passed, the same for the life of the
+	//session, so they can tell channels apart without comparing names
+	ChannelId MIDDLEWARE_EXP InternChannel(ISession *session, const std::string& channel);
+	//connects before returning, blocking for up to options.connect.timeoutMs
 	MIDDLEWARE_EXP ISession*  CreateSession(char const* url);
+	MIDDLEWARE_EXP ISession*  CreateSession(char const* url, const SessionOptions& options);
 	void MIDDLEWARE_EXP DestroySession(ISession* session);
+	//a session that opens options.connections connections to the broker and
+	//sends each channel's requests on one of them, chosen by consistent hash
+	//of the channel name, so one busy channel does not hold up the others.
+	//It is used like any other session. Callbacks are passed the connection
+	//the message arrived on, which is a session in its own right, and
+	//PendingRequestCount and ExpireRequests apply to each connection.
+	//StartDispatching dispatches every connection, each on a thread of its
+	//own, and blocks until the session is destroyed. The connections are
+	//opened at the same time, each on a thread of its own, and it returns
+	//once they have all connected or failed.
+	MIDDLEWARE_EXP ISession* CreatePooledSession(char const* url, const PooledSessionOptions& options);
+	//connections in a session, 1 unless it is pooled
+	size_t MIDDLEWARE_EXP ConnectionCount(ISession* session);
+	//one of the session's connections, a session in its own right. An
+	//ordinary session is its own connection 0. NULL if there is no such
+	//connection.
+	MIDDLEWARE_EXP ISession* GetConnection(ISession* session, size_t connection);
+	//the load on one of the session's connections, false if there is no such connection
+	bool MIDDLEWARE_EXP GetConnectionLoad(ISession* session, size_t connection, ConnectionLoad& load);
+	//send channel on the given connection rather than the one it hashes to,
+	//e.g. to keep a heavy channel away from latency sensitive ones. False if
+	//the session is not pooled or has no such connection, or if the channel
+	//has handlers or a cached last value on another connection, which would
+	//stay there. Pin a channel before subscribing to it: a subscription made
+	//with SubscribeToChannel is not tracked and stays on its connection.
+	bool MIDDLEWARE_EXP PinChannel(ISession* session, const std::string& channel, size_t connection);
+
+#ifndef _WIN32
+	class ReactorPool;
+
+	//create a pool of epoll event loop threads. Sessions created on the pool share
+	//these threads, so a handful of threads can drive thousands of connections.
+	MIDDLEWARE_EXP ReactorPool* CreateReactorPool(unsigned int threads);
+	//all sessions created on the pool must be destroyed before the pool
+	void MIDDLEWARE_EXP DestroyReactorPool(ReactorPool* pool);
+	//create a session driven by one of the pool threads. StartDispatching on this
+	//session attaches it to its event loop and returns immediately. The
+	//connection is still made on the calling thread, not the pool's.
+	MIDDLEWARE_EXP ISession* CreateSession(ReactorPool* pool, char const* url);
+	MIDDLEWARE_EXP ISession* CreateSession(ReactorPool* pool, char const* url, const SessionOptions& options);
+	//a pooled session whose connections are driven by the pool threads.
+	//StartDispatching attaches them and returns immediately.
+	MIDDLEWARE_EXP ISession* CreatePooledSession(ReactorPool* pool, char const* url, const PooledSessionOptions& options);
+#endif
 	void MIDDLEWARE_EXP RegisterMessageCallbackFunction(MSG_CALLBACK_FUNC msgCallback);
+	//alternative to RegisterMessageCallbackFunction that does not copy the message
+	void MIDDLEWARE_EXP RegisterMessageViewCallbackFunction(MSG_VIEW_CALLBACK_FUNC msgViewCallback);
 	void MIDDLEWARE_EXP StartDispatching(ISession *session);
+	//fail the session's requests whose deadline has passed. The sessions made by
+	//CreateSession call this from their dispatcher, other ISession
+	//implementations should call it every few milliseconds.
+	void MIDDLEWARE_EXP ExpireRequests(ISession *session);
+	//requests sent on the session that are still waiting for a response
+	size_t MIDDLEWARE_EXP PendingRequestCount(ISession *session);
+	//the pending requests that have a deadline. A dispatcher only needs to
+	//call ExpireRequests while there are any.
+	size_t MIDDLEWARE_EXP PendingDeadlineCount(ISession *session);
+	//a frame the session accepted has been dropped from its transmit buffer
+	//under OVERFLOW_DROP_OLDEST. If it was a request, no response is coming
+	//so the request fails with REQUEST_NOT_SENT. data may be modified.
+	void MIDDLEWARE_EXP FailDroppedFrame(ISession *session, char* data, size_t size);
+	//hand received messages for session to a pool of worker threads, see
+	//SessionOptions::dispatchWorkers. The sessions made by CreateSession call
+	//these themselves. Stop handles the messages already queued before it
+	//returns and must be called before the session is destroyed.
+	void MIDDLEWARE_EXP StartDispatchWorkers(ISession *session, unsigned int workers);
+	void MIDDLEWARE_EXP StopDispatchWorkers(ISession *session);
+	//keep the latest UPDATE on each channel the session receives, see
+	//SessionOptions::lastValueCache. The sessions made by CreateSession call
+	//this themselves, other ISession implementations before they dispatch.
+	void MIDDLEWARE_EXP EnableLastValueCache(ISession *session, const LastValueCacheOptions& options);
+	//the latest UPDATE received on channel, false if there has not been one
+	//or the session has no cache
+	bool MIDDLEWARE_EXP GetLastValue(ISession *session, const std::string& channel, Message& msg);
+	//pass the latest value of up to max channels updated since they were
+	//last delivered to the message callbacks, on this thread. 0 delivers
+	//them all. Returns the number delivered, always 0 without conflation.
+	size_t MIDDLEWARE_EXP DeliverConflated(ISession *session, size_t max = 0);
+	//false if the session has no cache
+	bool MIDDLEWARE_EXP GetConflationStats(ISession *session, ConflationStats& stats);
 }
 
 
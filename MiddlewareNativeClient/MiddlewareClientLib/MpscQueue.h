@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace MiddlewareLib
+{
+	//unbounded lock free queue for many producers and a single consumer
+	//(Vyukov's intrusive MPSC queue). Push is one atomic exchange, so producers
+	//never wait on each other or on the consumer. Pop may briefly report the
+	//queue empty while a push is half done; callers that wake the consumer after
+	//pushing pick that item up on the next wakeup.
+	template<class T>
+	class MpscQueue
+	{
+	public:
+		MpscQueue() : head_(&stub_), tail_(&stub_)
+		{
+			stub_.next = NULL;
+		}
+
+		~MpscQueue()
+		{
+			T value;
+			while (Pop(value)) {}
+		}
+
+		//any thread
+		void Push(T&& value)
+		{
+			Node* node = new Node();
+			node->value = std::move(value);
+			Push(node);
+		}
+
+		//consumer thread only
+		bool Pop(T& value)
+		{
+			Node* tail = tail_;
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (tail == &stub_)
+			{
+				if (next == NULL)
+				{
+					return false;
+				}
+				tail_ = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if (next != NULL)
+			{
+				tail_ = next;
+				value = std::move(tail->value);
+				delete tail;
+				return true;
+			}
+
+			//a producer has swapped in a new head but not linked it yet
+			if (tail != head_.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+
+			//tail is the last node, put the stub behind it so it can be taken
+			Push(&stub_);
+			next = tail->next.load(std::memory_order_acquire);
+			if (next != NULL)
+			{
+				tail_ = next;
+				value = std::move(tail->value);
+				delete tail;
+				return true;
+			}
+			return false;
+		}
+
+	private:
+		struct Node
+		{
+			std::atomic<Node*> next;
+			T value;
+		};
+
+		void Push(Node* node)
+		{
+			node->next.store(NULL, std::memory_order_relaxed);
+			Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		MpscQueue(const MpscQueue&);
+		MpscQueue& operator=(const MpscQueue&);
+
+		std::atomic<Node*> head_;
+		Node* tail_;
+		Node stub_;
+	};
+}
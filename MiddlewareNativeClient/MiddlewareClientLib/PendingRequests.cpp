@@ -0,0 +1,177 @@
+#include "stdafx.h"
+#include "PendingRequests.h"
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		const size_t InitialSlots = 64;
+
+		inline size_t Hash(uint64_t id, size_t mask)
+		{
+			return (size_t)((id * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+		}
+	}
+
+	PendingRequests::PendingRequests(uint64_t now) :
+		slots_(InitialSlots, Slot{ 0, NO_REQUEST }),
+		free_(NO_REQUEST),
+		size_(0),
+		timers_(now)
+	{
+	}
+
+	void PendingRequests::Add(uint64_t id, const MiddlewareRequestParams& params, uint64_t deadline, const RequestTiming& timing)
+	{
+		//keep the table at most half full so probe sequences stay short
+		if ((size_ + 1) * 2 > slots_.size())
+		{
+			Grow();
+		}
+
+		uint32_t request = free_;
+		if (request != NO_REQUEST)
+		{
+			free_ = requests_[request].nextFree;
+		}
+		else
+		{
+			request = (uint32_t)requests_.size();
+			requests_.push_back(Request());
+		}
+		Request& r = requests_[request];
+		r.params = params;
+		r.timing = timing;
+		r.id = id;
+		r.timer = deadline != 0 ? timers_.Schedule(deadline, request) : TimerWheel::NO_TIMER;
+
+		size_t mask = slots_.size() - 1;
+		size_t slot = Hash(id, mask);
+		while (slots_[slot].request != NO_REQUEST)
+		{
+			slot = (slot + 1) & mask;
+		}
+		slots_[slot].id = id;
+		slots_[slot].request = request;
+		size_++;
+	}
+
+	bool PendingRequests::Complete(uint64_t id, MiddlewareRequestParams& params, RequestTiming* timing)
+	{
+		size_t slot = Find(id);
+		if (slot == slots_.size())
+		{
+			return false;
+		}
+
+		uint32_t request = slots_[slot].request;
+		RemoveSlot(slot);
+		if (requests_[request].timer != TimerWheel::NO_TIMER)
+		{
+			timers_.Cancel(requests_[request].timer);
+		}
+		params = std::move(requests_[request].params);
+		if (timing != NULL)
+		{
+			*timing = requests_[request].timing;
+		}
+		Release(request);
+		return true;
+	}
+
+	void PendingRequests::Expire(uint64_t now, std::vector<MiddlewareRequestParams>& expired)
+	{
+		expired_.clear();
+		timers_.Advance(now, expired_);
+		for (uint32_t request : expired_)
+		{
+			RemoveSlot(Find(requests_[request].id));
+			expired.push_back(std::move(requests_[request].params));
+			Release(request);
+		}
+	}
+
+	void PendingRequests::Clear(std::vector<MiddlewareRequestParams>& removed)
+	{
+		for (auto& slot : slots_)
+		{
+			if (slot.request == NO_REQUEST)
+			{
+				continue;
+			}
+			Request& r = requests_[slot.request];
+			if (r.timer != TimerWheel::NO_TIMER)
+			{
+				timers_.Cancel(r.timer);
+			}
+			removed.push_back(std::move(r.params));
+			Release(slot.request);
+			slot.request = NO_REQUEST;
+		}
+		size_ = 0;
+	}
+
+	size_t PendingRequests::Find(uint64_t id) const
+	{
+		size_t mask = slots_.size() - 1;
+		size_t slot = Hash(id, mask);
+		while (slots_[slot].request != NO_REQUEST)
+		{
+			if (slots_[slot].id == id)
+			{
+				return slot;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return slots_.size();
+	}
+
+	//backward shift deletion, so no tombstones build up in the table
+	void PendingRequests::RemoveSlot(size_t slot)
+	{
+		size_t mask = slots_.size() - 1;
+		size_t next = (slot + 1) & mask;
+		while (slots_[next].request != NO_REQUEST)
+		{
+			size_t home = Hash(slots_[next].id, mask);
+			//move the entry into the gap unless its home lies cyclically in (slot, next]
+			bool between = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+			if (!between)
+			{
+				slots_[slot] = slots_[next];
+				slot = next;
+			}
+			next = (next + 1) & mask;
+		}
+		slots_[slot].request = NO_REQUEST;
+		size_--;
+	}
+
+	void PendingRequests::Release(uint32_t request)
+	{
+		requests_[request].params = MiddlewareRequestParams();
+		requests_[request].nextFree = free_;
+		free_ = request;
+	}
+
+	void PendingRequests::Grow()
+	{
+		std::vector<Slot> old(slots_.size() * 2, Slot{ 0, NO_REQUEST });
+		old.swap(slots_);
+
+		size_t mask = slots_.size() - 1;
+		for (const Slot& entry : old)
+		{
+			if (entry.request == NO_REQUEST)
+			{
+				continue;
+			}
+			size_t slot = Hash(entry.id, mask);
+			while (slots_[slot].request != NO_REQUEST)
+			{
+				slot = (slot + 1) & mask;
+			}
+			slots_[slot] = entry;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include "RequestLatency.h"
+#include "TimerWheel.h"
+#include <vector>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//requests waiting for a response, keyed by the counter part of their id.
+	//An open addressing table with linear probing finds the request and a timer
+	//wheel expires it, so adding, completing and expiring are all O(1). Times
+	//are in milliseconds on whatever clock the caller uses. Not thread safe.
+	class MIDDLEWARE_EXP PendingRequests
+	{
+	public:
+		explicit PendingRequests(uint64_t now = 0);
+
+		//id must not be 0 or already pending. A deadline of 0 never expires.
+		void Add(uint64_t id, const MiddlewareRequestParams& params, uint64_t deadline, const RequestTiming& timing = RequestTiming());
+
+		//remove the request and return its params, and its timing if asked
+		//for. False if it is not pending.
+		bool Complete(uint64_t id, MiddlewareRequestParams& params, RequestTiming* timing = NULL);
+
+		//remove the requests whose deadline has passed by now, appending them to expired
+		void Expire(uint64_t now, std::vector<MiddlewareRequestParams>& expired);
+		//remove every request, appending them to removed
+		void Clear(std::vector<MiddlewareRequestParams>& removed);
+
+		size_t Size() const { return size_; }
+		//the pending requests that have a deadline
+		size_t Deadlines() const { return timers_.Size(); }
+
+	private:
+		static const uint32_t NO_REQUEST = 0xFFFFFFFF;
+
+		struct Slot
+		{
+			uint64_t id;
+			uint32_t request;
+		};
+
+		struct Request
+		{
+			MiddlewareRequestParams params;
+			RequestTiming timing;
+			uint64_t id;
+			uint32_t timer;
+			uint32_t nextFree;
+		};
+
+		size_t Find(uint64_t id) const;
+		void RemoveSlot(size_t slot);
+		void Release(uint32_t request);
+		void Grow();
+
+		std::vector<Slot> slots_;
+		std::vector<Request> requests_;
+		uint32_t free_;
+		size_t size_;
+		TimerWheel timers_;
+		std::vector<uint32_t> expired_;
+	};
+}
@@ -0,0 +1,527 @@
+#include "stdafx.h"
+#include "PerMessageDeflate.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifdef MIDDLEWARE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <chrono>
+#else
+#include <time.h>
+#endif
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		const char EXTENSION_NAME[] = "permessage-deflate";
+
+		//deflate ends each message with an empty stored block, RFC 7692 removes
+		//it from the wire and the receiver puts it back
+		const unsigned char FLUSH_TAIL[4] = { 0x00, 0x00, 0xff, 0xff };
+
+		struct Param
+		{
+			std::string name;
+			std::string value;
+			bool hasValue;
+		};
+
+		std::string Trim(const std::string& text, size_t begin, size_t end)
+		{
+			while (begin < end && (text[begin] == ' ' || text[begin] == '\t'))
+			{
+				++begin;
+			}
+			while (end > begin && (text[end - 1] == ' ' || text[end - 1] == '\t'))
+			{
+				--end;
+			}
+			return text.substr(begin, end - begin);
+		}
+
+		//split a Sec-WebSocket-Extensions value into its comma separated elements
+		std::vector<std::string> Elements(const std::string& header)
+		{
+			std::vector<std::string> elements;
+			size_t begin = 0;
+			while (begin <= header.size())
+			{
+				size_t end = header.find(',', begin);
+				if (end == std::string::npos)
+				{
+					end = header.size();
+				}
+				std::string element = Trim(header, begin, end);
+				if (!element.empty())
+				{
+					elements.push_back(element);
+				}
+				begin = end + 1;
+			}
+			return elements;
+		}
+
+		//"name; param; param=value". false if a parameter is repeated.
+		bool ParseElement(const std::string& element, std::string& name, std::vector<Param>& params)
+		{
+			std::set<std::string> seen;
+			size_t begin = 0;
+			bool first = true;
+			while (begin <= element.size())
+			{
+				size_t end = element.find(';', begin);
+				if (end == std::string::npos)
+				{
+					end = element.size();
+				}
+				std::string token = Trim(element, begin, end);
+				begin = end + 1;
+				if (first)
+				{
+					name = token;
+					first = false;
+					continue;
+				}
+				if (token.empty())
+				{
+					return false;
+				}
+				Param param;
+				size_t equals = token.find('=');
+				param.hasValue = equals != std::string::npos;
+				param.name = Trim(token, 0, param.hasValue ? equals : token.size());
+				if (param.hasValue)
+				{
+					param.value = Trim(token, equals + 1, token.size());
+					if (param.value.size() >= 2 && param.value.front() == '"' && param.value.back() == '"')
+					{
+						param.value = param.value.substr(1, param.value.size() - 2);
+					}
+				}
+				if (!seen.insert(param.name).second)
+				{
+					return false;
+				}
+				params.push_back(param);
+			}
+			return true;
+		}
+
+		//a max_window_bits value, 8 to 15
+		bool WindowBits(const Param& param, int& bits)
+		{
+			if (!param.hasValue || param.value.empty() || param.value.size() > 2 ||
+				param.value.find_first_not_of("0123456789") != std::string::npos)
+			{
+				return false;
+			}
+			bits = atoi(param.value.c_str());
+			return bits >= 8 && bits <= 15;
+		}
+
+		//zlib can not make a raw deflate stream with an 8 bit window, so 9 is the
+		//smallest we use ourselves
+		int ClampBits(int bits)
+		{
+			return std::min(15, std::max(9, bits));
+		}
+
+		//CPU time of the calling thread. Windows only has a coarse thread clock,
+		//so wall time is used there instead.
+		uint64_t ThreadNanos()
+		{
+#ifdef _WIN32
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+			timespec now;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+			return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+		}
+	}
+
+	struct PerMessageDeflate::Impl
+	{
+#ifdef MIDDLEWARE_HAVE_ZLIB
+		z_stream deflater;
+		z_stream inflater;
+#endif
+		bool deflateContextTakeover;
+		bool inflateContextTakeover;
+		size_t threshold;
+		//output of the last Deflate, swapped with the message so its capacity
+		//is reused
+		std::string scratch;
+
+		std::atomic<uint64_t> messagesDeflated;
+		std::atomic<uint64_t> messagesSkipped;
+		std::atomic<uint64_t> deflateBytesIn;
+		std::atomic<uint64_t> deflateBytesOut;
+		std::atomic<uint64_t> deflateNanos;
+		std::atomic<uint64_t> messagesInflated;
+		std::atomic<uint64_t> inflateBytesIn;
+		std::atomic<uint64_t> inflateBytesOut;
+		std::atomic<uint64_t> inflateNanos;
+	};
+
+	PerMessageDeflate::PerMessageDeflate(int level, int deflateWindowBits, bool deflateContextTakeover,
+		int inflateWindowBits, bool inflateContextTakeover, size_t threshold) :
+		impl_(new Impl())
+	{
+		impl_->deflateContextTakeover = deflateContextTakeover;
+		impl_->inflateContextTakeover = inflateContextTakeover;
+		impl_->threshold = threshold;
+		impl_->messagesDeflated = 0;
+		impl_->messagesSkipped = 0;
+		impl_->deflateBytesIn = 0;
+		impl_->deflateBytesOut = 0;
+		impl_->deflateNanos = 0;
+		impl_->messagesInflated = 0;
+		impl_->inflateBytesIn = 0;
+		impl_->inflateBytesOut = 0;
+		impl_->inflateNanos = 0;
+#ifdef MIDDLEWARE_HAVE_ZLIB
+		//negative window bits make zlib read and write raw deflate, without the
+		//zlib header and checksum
+		level = std::min(9, std::max(1, level));
+		if (deflateInit2(&impl_->deflater, level, Z_DEFLATED, -ClampBits(deflateWindowBits), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			delete impl_;
+			throw std::bad_alloc();
+		}
+		if (inflateInit2(&impl_->inflater, -ClampBits(inflateWindowBits)) != Z_OK)
+		{
+			deflateEnd(&impl_->deflater);
+			delete impl_;
+			throw std::bad_alloc();
+		}
+#endif
+	}
+
+	PerMessageDeflate::~PerMessageDeflate()
+	{
+#ifdef MIDDLEWARE_HAVE_ZLIB
+		deflateEnd(&impl_->deflater);
+		inflateEnd(&impl_->inflater);
+#endif
+		delete impl_;
+	}
+
+	bool PerMessageDeflate::Available()
+	{
+#ifdef MIDDLEWARE_HAVE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	std::string PerMessageDeflate::Offer(const DeflateOptions& options)
+	{
+		if (!options.enabled || !Available())
+		{
+			return std::string();
+		}
+		//client_max_window_bits without a value tells the server it may limit
+		//our window
+		std::string offer = EXTENSION_NAME;
+		offer += "; client_max_window_bits";
+		if (ClampBits(options.windowBits) < 15)
+		{
+			offer += "=" + std::to_string(ClampBits(options.windowBits));
+		}
+		if (ClampBits(options.peerWindowBits) < 15)
+		{
+			offer += "; server_max_window_bits=" + std::to_string(ClampBits(options.peerWindowBits));
+		}
+		if (!options.contextTakeover)
+		{
+			offer += "; client_no_context_takeover";
+		}
+		if (!options.peerContextTakeover)
+		{
+			offer += "; server_no_context_takeover";
+		}
+		return offer;
+	}
+
+	bool PerMessageDeflate::Accept(const DeflateOptions& options, const std::string& response, std::unique_ptr<PerMessageDeflate>& deflate)
+	{
+		deflate.reset();
+		std::vector<std::string> elements = Elements(response);
+		if (elements.empty())
+		{
+			return true;
+		}
+		//only one extension was offered, so only one can be accepted
+		if (Offer(options).empty() || elements.size() != 1)
+		{
+			return false;
+		}
+
+		std::string name;
+		std::vector<Param> params;
+		if (!ParseElement(elements[0], name, params) || name != EXTENSION_NAME)
+		{
+			return false;
+		}
+
+		int deflateBits = ClampBits(options.windowBits);
+		int inflateBits = 15;
+		bool deflateContextTakeover = options.contextTakeover;
+		bool inflateContextTakeover = true;
+		for (const Param& param : params)
+		{
+			int bits = 0;
+			if (param.name == "server_no_context_takeover" && !param.hasValue)
+			{
+				inflateContextTakeover = false;
+			}
+			else if (param.name == "client_no_context_takeover" && !param.hasValue)
+			{
+				deflateContextTakeover = false;
+			}
+			else if (param.name == "server_max_window_bits" && WindowBits(param, bits))
+			{
+				//the server may only narrow the window we asked for
+				if (bits > ClampBits(options.peerWindowBits))
+				{
+					return false;
+				}
+				inflateBits = bits;
+			}
+			else if (param.name == "client_max_window_bits" && WindowBits(param, bits))
+			{
+				if (bits < 9)
+				{
+					return false;
+				}
+				deflateBits = std::min(deflateBits, bits);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		deflate.reset(new PerMessageDeflate(options.level, deflateBits, deflateContextTakeover,
+			inflateBits, inflateContextTakeover, options.threshold));
+		return true;
+	}
+
+	void PerMessageDeflate::Respond(const DeflateOptions& options, const std::string& offers, std::string& response, std::unique_ptr<PerMessageDeflate>& deflate)
+	{
+		response.clear();
+		deflate.reset();
+		if (!options.enabled || !Available())
+		{
+			return;
+		}
+		for (const std::string& element : Elements(offers))
+		{
+			std::string name;
+			std::vector<Param> params;
+			if (!ParseElement(element, name, params) || name != EXTENSION_NAME)
+			{
+				continue;
+			}
+
+			bool acceptable = true;
+			int serverBits = ClampBits(options.windowBits);
+			bool serverBitsRequested = false;
+			int clientBits = 15;
+			bool clientBitsSupported = false;
+			bool serverContextTakeover = options.contextTakeover;
+			bool clientContextTakeover = options.peerContextTakeover;
+			for (const Param& param : params)
+			{
+				int bits = 0;
+				if (param.name == "server_no_context_takeover" && !param.hasValue)
+				{
+					serverContextTakeover = false;
+				}
+				else if (param.name == "client_no_context_takeover" && !param.hasValue)
+				{
+					clientContextTakeover = false;
+				}
+				else if (param.name == "server_max_window_bits" && WindowBits(param, bits) && bits >= 9)
+				{
+					serverBits = std::min(serverBits, bits);
+					serverBitsRequested = true;
+				}
+				else if (param.name == "client_max_window_bits" && (!param.hasValue || WindowBits(param, bits)))
+				{
+					clientBitsSupported = true;
+					if (param.hasValue)
+					{
+						clientBits = bits;
+					}
+				}
+				else
+				{
+					acceptable = false;
+				}
+			}
+			if (!acceptable)
+			{
+				continue;
+			}
+
+			response = EXTENSION_NAME;
+			if (!serverContextTakeover)
+			{
+				response += "; server_no_context_takeover";
+			}
+			if (!clientContextTakeover)
+			{
+				response += "; client_no_context_takeover";
+			}
+			if (serverBitsRequested)
+			{
+				response += "; server_max_window_bits=" + std::to_string(serverBits);
+			}
+			if (clientBitsSupported && ClampBits(options.peerWindowBits) < clientBits)
+			{
+				clientBits = ClampBits(options.peerWindowBits);
+				response += "; client_max_window_bits=" + std::to_string(clientBits);
+			}
+			deflate.reset(new PerMessageDeflate(options.level, serverBits, serverContextTakeover,
+				clientBits, clientContextTakeover, options.threshold));
+			return;
+		}
+	}
+
+	bool PerMessageDeflate::Deflate(std::string& message)
+	{
+#ifdef MIDDLEWARE_HAVE_ZLIB
+		if (message.size() < impl_->threshold)
+		{
+			impl_->messagesSkipped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		uint64_t start = ThreadNanos();
+		z_stream& stream = impl_->deflater;
+		std::string& out = impl_->scratch;
+		//room for the whole message in one pass, plus the flush marker
+		out.resize(deflateBound(&stream, (uLong)message.size()) + 16);
+		stream.next_in = (Bytef*)message.data();
+		stream.avail_in = (uInt)message.size();
+		size_t length = 0;
+		while (true)
+		{
+			stream.next_out = (Bytef*)&out[length];
+			stream.avail_out = (uInt)(out.size() - length);
+			int ret = deflate(&stream, Z_SYNC_FLUSH);
+			length = out.size() - stream.avail_out;
+			if (ret != Z_OK && ret != Z_BUF_ERROR)
+			{
+				return false;
+			}
+			if (stream.avail_out != 0)
+			{
+				break;
+			}
+			out.resize(out.size() * 2);
+		}
+		if (length >= 4 && memcmp(&out[length - 4], FLUSH_TAIL, 4) == 0)
+		{
+			length -= 4;
+		}
+		if (!impl_->deflateContextTakeover)
+		{
+			deflateReset(&stream);
+		}
+		out.resize(length);
+
+		impl_->messagesDeflated.fetch_add(1, std::memory_order_relaxed);
+		impl_->deflateBytesIn.fetch_add(message.size(), std::memory_order_relaxed);
+		impl_->deflateBytesOut.fetch_add(length, std::memory_order_relaxed);
+		message.swap(out);
+		impl_->deflateNanos.fetch_add(ThreadNanos() - start, std::memory_order_relaxed);
+		return true;
+#else
+		impl_->messagesSkipped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+#endif
+	}
+
+	bool PerMessageDeflate::Inflate(const char* data, size_t size, std::string& message)
+	{
+#ifdef MIDDLEWARE_HAVE_ZLIB
+		uint64_t start = ThreadNanos();
+		z_stream& stream = impl_->inflater;
+		message.resize(std::max<size_t>(size * 4, 256));
+		size_t length = 0;
+		const char* inputs[2] = { data, (const char*)FLUSH_TAIL };
+		size_t sizes[2] = { size, sizeof(FLUSH_TAIL) };
+		bool ended = false;
+		for (int i = 0; i != 2 && !ended; ++i)
+		{
+			stream.next_in = (Bytef*)inputs[i];
+			stream.avail_in = (uInt)sizes[i];
+			while (true)
+			{
+				if (length == message.size())
+				{
+					message.resize(message.size() * 2);
+				}
+				stream.next_out = (Bytef*)&message[length];
+				stream.avail_out = (uInt)(message.size() - length);
+				int ret = inflate(&stream, Z_SYNC_FLUSH);
+				length = message.size() - stream.avail_out;
+				if (ret == Z_STREAM_END)
+				{
+					//the peer set BFINAL, the next message starts a new stream
+					inflateReset(&stream);
+					ended = true;
+					break;
+				}
+				if (ret != Z_OK && ret != Z_BUF_ERROR)
+				{
+					inflateReset(&stream);
+					return false;
+				}
+				if (stream.avail_out != 0)
+				{
+					break;
+				}
+			}
+		}
+		message.resize(length);
+		if (!impl_->inflateContextTakeover && !ended)
+		{
+			inflateReset(&stream);
+		}
+
+		impl_->messagesInflated.fetch_add(1, std::memory_order_relaxed);
+		impl_->inflateBytesIn.fetch_add(size, std::memory_order_relaxed);
+		impl_->inflateBytesOut.fetch_add(length, std::memory_order_relaxed);
+		impl_->inflateNanos.fetch_add(ThreadNanos() - start, std::memory_order_relaxed);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void PerMessageDeflate::GetStats(DeflateStats& stats) const
+	{
+		stats.messagesDeflated = impl_->messagesDeflated.load(std::memory_order_relaxed);
+		stats.messagesSkipped = impl_->messagesSkipped.load(std::memory_order_relaxed);
+		stats.deflateBytesIn = impl_->deflateBytesIn.load(std::memory_order_relaxed);
+		stats.deflateBytesOut = impl_->deflateBytesOut.load(std::memory_order_relaxed);
+		stats.deflateNanos = impl_->deflateNanos.load(std::memory_order_relaxed);
+		stats.messagesInflated = impl_->messagesInflated.load(std::memory_order_relaxed);
+		stats.inflateBytesIn = impl_->inflateBytesIn.load(std::memory_order_relaxed);
+		stats.inflateBytesOut = impl_->inflateBytesOut.load(std::memory_order_relaxed);
+		stats.inflateNanos = impl_->inflateNanos.load(std::memory_order_relaxed);
+	}
+}
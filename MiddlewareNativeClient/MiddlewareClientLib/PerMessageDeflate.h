@@ -0,0 +1,54 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <memory>
+#include <string>
+
+namespace MiddlewareLib
+{
+	//permessage-deflate (RFC 7692) for one connection. Compresses the messages
+	//we send and inflates the ones the peer compressed. Deflate and Inflate are
+	//called from the thread that drives the connection, GetStats from any thread.
+	class MIDDLEWARE_EXP PerMessageDeflate
+	{
+	public:
+		//window bits are 9 to 15. Without context takeover the window is reset
+		//after every message.
+		PerMessageDeflate(int level, int deflateWindowBits, bool deflateContextTakeover,
+			int inflateWindowBits, bool inflateContextTakeover, size_t threshold);
+		~PerMessageDeflate();
+
+		//false if the library was built without zlib, nothing is then offered
+		static bool Available();
+
+		//client side. The Sec-WebSocket-Extensions value to offer, empty if
+		//deflate is not enabled or not available.
+		static std::string Offer(const DeflateOptions& options);
+		//client side. Check the Sec-WebSocket-Extensions value the server
+		//responded with against what Offer sent. deflate is set if deflate was
+		//negotiated, false means the response was invalid and the connection
+		//must fail.
+		static bool Accept(const DeflateOptions& options, const std::string& response, std::unique_ptr<PerMessageDeflate>& deflate);
+		//server side. Pick the first acceptable offer from the client's
+		//Sec-WebSocket-Extensions value. response is left empty and deflate
+		//unset if none was acceptable.
+		static void Respond(const DeflateOptions& options, const std::string& offers, std::string& response, std::unique_ptr<PerMessageDeflate>& deflate);
+
+		//compress message in place. Returns false, leaving it as it is, for
+		//messages under the threshold.
+		bool Deflate(std::string& message);
+		//inflate a compressed message into message. false if the data is not
+		//valid deflate, the connection should then be failed.
+		bool Inflate(const char* data, size_t size, std::string& message);
+
+		void GetStats(DeflateStats& stats) const;
+
+	private:
+		PerMessageDeflate(const PerMessageDeflate&);
+		PerMessageDeflate& operator=(const PerMessageDeflate&);
+
+		//zlib streams and counters, kept out of this header
+		struct Impl;
+		Impl* impl_;
+	};
+}
@@ -0,0 +1,432 @@
+#include "stdafx.h"
+#include "HashRing.h"
+#include "MiddlewareClientLib.h"
+#include "SessionContext.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//a session spread over several connections. Requests are routed to a
+	//connection by SessionForChannel, anything sent directly on the pooled
+	//session goes on the first connection.
+	class PooledSession : public ISession
+	{
+	public:
+		//blocking: StartDispatcher blocks until the session is destroyed, as
+		//the dispatcher of a session made by CreateSession(url) does
+		PooledSession(const PooledSessionOptions& options, bool blocking) :
+			ring_(options.connections, options.virtualNodes),
+			blocking_(blocking),
+			dispatching_(false),
+			stopping_(false),
+			pinned_(false)
+		{
+		}
+
+		virtual ~PooledSession()
+		{
+			//first, release a blocked dispatcher
+			{
+				std::unique_lock<std::mutex> lock(closedLock_);
+				stopping_ = true;
+				closed_.notify_all();
+				closed_.wait(lock, [this] { return !dispatching_; });
+			}
+
+			for (auto& connection : connections_)
+			{
+				DestroySession(connection->session);
+			}
+#ifdef _WIN32
+			for (auto& thread : threads_)
+			{
+				thread.join();
+			}
+#else
+			if (ownedPool_ != NULL)
+			{
+				DestroyReactorPool(ownedPool_);
+			}
+#endif
+		}
+
+		void Add(ISession* session)
+		{
+			connections_.push_back(ConnectionPtr_t(new Connection(session)));
+		}
+
+		void SendData(const std::string& data)
+		{
+			First()->SendData(data);
+		}
+
+		void SendData(std::string&& data)
+		{
+			First()->SendData(std::move(data));
+		}
+
+		void SendBinaryData(std::string&& data)
+		{
+			First()->SendBinaryData(std::move(data));
+		}
+
+		SendStatus TrySendData(std::string&& data, bool binary)
+		{
+			return First()->TrySendData(std::move(data), binary);
+		}
+
+		bool BinaryMessages() const
+		{
+			return First()->BinaryMessages();
+		}
+
+		size_t QueuedBytes() const
+		{
+			size_t queued = 0;
+			for (auto& connection : connections_)
+			{
+				queued += connection->session->QueuedBytes();
+			}
+			return queued;
+		}
+
+		//totals over the connections
+		bool GetDeflateStats(DeflateStats& stats) const
+		{
+			bool any = false;
+			for (auto& connection : connections_)
+			{
+				DeflateStats one;
+				if (!connection->session->GetDeflateStats(one))
+				{
+					continue;
+				}
+				any = true;
+				stats.messagesDeflated += one.messagesDeflated;
+				stats.messagesSkipped += one.messagesSkipped;
+				stats.deflateBytesIn += one.deflateBytesIn;
+				stats.deflateBytesOut += one.deflateBytesOut;
+				stats.deflateNanos += one.deflateNanos;
+				stats.messagesInflated += one.messagesInflated;
+				stats.inflateBytesIn += one.inflateBytesIn;
+				stats.inflateBytesOut += one.inflateBytesOut;
+				stats.inflateNanos += one.inflateNanos;
+			}
+			return any;
+		}
+
+		bool GetSendStats(SendStats& stats) const
+		{
+			bool any = false;
+			for (auto& connection : connections_)
+			{
+				SendStats one;
+				if (!connection->session->GetSendStats(one))
+				{
+					continue;
+				}
+				any = true;
+				stats.writes += one.writes;
+				stats.messages += one.messages;
+				stats.bytes += one.bytes;
+				stats.largestBatch = std::max(stats.largestBatch, one.largestBatch);
+				stats.rejected += one.rejected;
+				stats.dropped += one.dropped;
+				stats.queuedBytes += one.queuedBytes;
+			}
+			return any;
+		}
+
+		//the first connection's, see GetConnectionLoad for the others
+		bool GetConnectTimings(ConnectTimings& timings) const
+		{
+			return First()->GetConnectTimings(timings);
+		}
+
+		//the first connection's, see GetConnection for the others
+		bool GetTransportStats(TransportStats& stats) const
+		{
+			return First()->GetTransportStats(stats);
+		}
+
+		//pings every connection
+		bool SendPing()
+		{
+			bool any = false;
+			for (auto& connection : connections_)
+			{
+				any = connection->session->SendPing() || any;
+			}
+			return any;
+		}
+
+		ISession* SessionForChannel(std::string_view channel)
+		{
+			return connections_[Slot(channel)]->session;
+		}
+
+		ISession* SessionForRequest(std::string_view channel)
+		{
+			Connection& connection = *connections_[Slot(channel)];
+			connection.requests.fetch_add(1, std::memory_order_relaxed);
+			return connection.session;
+		}
+
+		void StartDispatcher(CALLBACK_FUNC handler)
+		{
+			StartDispatcher(handler, NULL);
+		}
+
+		void StartDispatcher(CALLBACK_FUNC handler, FRAME_CALLBACK_FUNC frameHandler)
+		{
+			if (!blocking_)
+			{
+				for (auto& connection : connections_)
+				{
+					connection->session->StartDispatcher(handler, frameHandler);
+				}
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(closedLock_);
+			if (stopping_)
+			{
+				return;
+			}
+			dispatching_ = true;
+			for (auto& connection : connections_)
+			{
+#ifdef _WIN32
+				//each connection's dispatcher blocks, so each needs a thread
+				ISession* session = connection->session;
+				threads_.push_back(std::thread([session, handler, frameHandler]()
+				{
+					session->StartDispatcher(handler, frameHandler);
+				}));
+#else
+				//attaches the connection to a thread of the owned pool
+				connection->session->StartDispatcher(handler, frameHandler);
+#endif
+			}
+
+			closed_.wait(lock, [this] { return stopping_; });
+			dispatching_ = false;
+			closed_.notify_all();
+		}
+
+		size_t Connections() const
+		{
+			return connections_.size();
+		}
+
+		ISession* GetConnection(size_t index) const
+		{
+			return index < connections_.size() ? connections_[index]->session : NULL;
+		}
+
+		bool GetLoad(size_t index, ConnectionLoad& load)
+		{
+			if (index >= connections_.size())
+			{
+				return false;
+			}
+
+			Connection& connection = *connections_[index];
+			load.requests = connection.requests.load(std::memory_order_relaxed);
+			load.pendingRequests = PendingRequestCount(connection.session);
+			load.connected = connection.session->GetSendStats(load.sent);
+			std::lock_guard<std::mutex> lock(pinsLock_);
+			load.pinnedChannels = std::count_if(pins_.begin(), pins_.end(),
+				[index](const Pins_t::value_type& pin) { return pin.second == index; });
+			return true;
+		}
+
+		//refused while the channel has handlers or a cached value on the
+		//connection it goes to now, as they would be left behind there
+		bool Pin(const std::string& channel, size_t index)
+		{
+			if (index >= connections_.size())
+			{
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(pinsLock_);
+			auto pin = pins_.find(channel);
+			size_t current = pin != pins_.end() ? pin->second : ring_.Find(channel);
+			if (current != index && InUse(connections_[current]->session, channel))
+			{
+				return false;
+			}
+			pins_[channel] = index;
+			pinned_ = true;
+			return true;
+		}
+
+#ifndef _WIN32
+		//destroyed with the session, after its connections
+		void Own(ReactorPool* pool)
+		{
+			ownedPool_ = pool;
+		}
+#endif
+
+	private:
+		struct Connection
+		{
+			explicit Connection(ISession* session) : session(session), requests(0) {}
+
+			ISession* session;
+			std::atomic<uint64_t> requests;
+		};
+
+		static bool InUse(ISession* connection, const std::string& channel)
+		{
+			SessionContext& context = *connection->context_;
+			Message cached;
+			return context.subscriptions_.Handlers(channel) > 0 ||
+				(context.lastValues_ && context.lastValues_->Get(channel, cached));
+		}
+
+		ISession* First() const
+		{
+			return connections_[0]->session;
+		}
+
+		size_t Slot(std::string_view channel)
+		{
+			//no lookup at all until something is pinned
+			if (pinned_.load(std::memory_order_acquire))
+			{
+				std::lock_guard<std::mutex> lock(pinsLock_);
+				auto pin = pins_.find(std::string(channel));
+				if (pin != pins_.end())
+				{
+					return pin->second;
+				}
+			}
+			return ring_.Find(channel);
+		}
+
+		typedef std::unique_ptr<Connection> ConnectionPtr_t;
+		typedef std::unordered_map<std::string, size_t> Pins_t;
+		std::vector<ConnectionPtr_t> connections_;
+		HashRing ring_;
+		bool blocking_;
+		std::mutex closedLock_;
+		std::condition_variable closed_;
+		bool dispatching_;
+		bool stopping_;
+		std::mutex pinsLock_;
+		Pins_t pins_;
+		std::atomic<bool> pinned_;
+#ifdef _WIN32
+		std::vector<std::thread> threads_;
+#else
+		ReactorPool* ownedPool_ = NULL;
+#endif
+	};
+
+	namespace
+	{
+		unsigned int connectionCount(const PooledSessionOptions& options)
+		{
+			return options.connections > 0 ? options.connections : 1;
+		}
+
+		//connecting blocks the caller until the handshake is done, so the
+		//connections are opened side by side rather than one after another
+		void addConnections(PooledSession* session, unsigned int count, const std::function<ISession*()>& connect)
+		{
+			std::vector<ISession*> connections(count);
+			std::vector<std::thread> threads;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				threads.push_back(std::thread([&connections, &connect, i]() { connections[i] = connect(); }));
+			}
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			for (auto connection : connections)
+			{
+				session->Add(connection);
+			}
+		}
+	}
+
+	MIDDLEWARE_EXP ISession* CreatePooledSession(char const* url, const PooledSessionOptions& options)
+	{
+		PooledSession* session = new PooledSession(options, true);
+#ifdef _WIN32
+		addConnections(session, connectionCount(options), [url, &options]() { return CreateSession(url, options.session); });
+#else
+		//a loop thread per connection, as each would have with CreateSession(url)
+		ReactorPool* pool = CreateReactorPool(connectionCount(options));
+		session->Own(pool);
+		addConnections(session, connectionCount(options), [pool, url, &options]() { return CreateSession(pool, url, options.session); });
+#endif
+		return session;
+	}
+
+#ifndef _WIN32
+	MIDDLEWARE_EXP ISession* CreatePooledSession(ReactorPool* pool, char const* url, const PooledSessionOptions& options)
+	{
+		if (pool == NULL)
+		{
+			return CreatePooledSession(url, options);
+		}
+
+		PooledSession* session = new PooledSession(options, false);
+		addConnections(session, connectionCount(options), [pool, url, &options]() { return CreateSession(pool, url, options.session); });
+		return session;
+	}
+#endif
+
+	size_t MIDDLEWARE_EXP ConnectionCount(ISession* session)
+	{
+		PooledSession* pooled = dynamic_cast<PooledSession*>(session);
+		return pooled != NULL ? pooled->Connections() : 1;
+	}
+
+	MIDDLEWARE_EXP ISession* GetConnection(ISession* session, size_t connection)
+	{
+		PooledSession* pooled = dynamic_cast<PooledSession*>(session);
+		if (pooled != NULL)
+		{
+			return pooled->GetConnection(connection);
+		}
+		return connection == 0 ? session : NULL;
+	}
+
+	bool MIDDLEWARE_EXP GetConnectionLoad(ISession* session, size_t connection, ConnectionLoad& load)
+	{
+		PooledSession* pooled = dynamic_cast<PooledSession*>(session);
+		if (pooled != NULL)
+		{
+			return pooled->GetLoad(connection, load);
+		}
+
+		//an ordinary session is its own only connection
+		if (connection != 0)
+		{
+			return false;
+		}
+		load.pendingRequests = PendingRequestCount(session);
+		load.connected = session->GetSendStats(load.sent);
+		return true;
+	}
+
+	bool MIDDLEWARE_EXP PinChannel(ISession* session, const std::string& channel, size_t connection)
+	{
+		PooledSession* pooled = dynamic_cast<PooledSession*>(session);
+		return pooled != NULL && pooled->Pin(channel, connection);
+	}
+}
@@ -0,0 +1,537 @@
+#include "stdafx.h"
+#include "easywsclient.hpp"
+#include "BinaryCodec.h"
+#include "EpollReactor.h"
+#include "MiddlewareClientLib.h"
+#include "MpscQueue.h"
+#include "TransmitLimit.h"
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <mutex>
+#include <sys/epoll.h>
+
+using namespace easywsclient;
+
+namespace MiddlewareLib
+{
+	//POSIX session. The socket is registered with an epoll reactor which either
+	//belongs to the session (CreateSession(url)) and runs inside StartDispatcher,
+	//or is shared with other sessions on a ReactorPool thread.
+	class ReactorSession : public ISession, public IReactorHandler
+	{
+	public:
+		ReactorSession(char const* url, const SessionOptions& options) :
+			ownedReactor_(new EpollReactor()),
+			reactor_(*ownedReactor_),
+			handler_(NULL),
+			frameHandler_(NULL),
+			events_(0),
+			dispatching_(false),
+			flushPosted_(false),
+			ticking_(false),
+			unflushed_(0),
+			limit_(options.transmitBuffer)
+		{
+			Connect(url, options);
+		}
+
+		ReactorSession(EpollReactor& reactor, char const* url, const SessionOptions& options) :
+			reactor_(reactor),
+			handler_(NULL),
+			frameHandler_(NULL),
+			events_(0),
+			dispatching_(false),
+			flushPosted_(false),
+			ticking_(false),
+			unflushed_(0),
+			limit_(options.transmitBuffer)
+		{
+			Connect(url, options);
+		}
+
+		virtual ~ReactorSession()
+		{
+			if (ownedReactor_)
+			{
+				//first, stop dispatching
+				std::unique_lock<std::mutex> lock(closedLock_);
+				if (dispatching_)
+				{
+					//the loop may be in a callback, which has to finish before
+					//anything is freed however long it takes
+					reactor_.Stop();
+					closed_.wait(lock, [this] { return !dispatching_; });
+				}
+				StopDispatchWorkers(this);
+				Close();
+			}
+			else
+			{
+				//before detaching, flushes posted by callbacks on the workers
+				//then run ahead of the detach
+				StopDispatchWorkers(this);
+				reactor_.Invoke([this]()
+				{
+					Detach();
+					Close();
+				});
+			}
+		}
+
+		void SendData(const std::string& data)
+		{
+			Send(std::string(data), false);
+		}
+
+		void SendData(std::string&& data)
+		{
+			Send(std::move(data), false);
+		}
+
+		void SendBinaryData(std::string&& data)
+		{
+			Send(std::move(data), true);
+		}
+
+		SendStatus TrySendData(std::string&& data, bool binary)
+		{
+			return Send(std::move(data), binary);
+		}
+
+		size_t QueuedBytes() const
+		{
+			return limit_.Depth();
+		}
+
+		bool BinaryMessages() const
+		{
+			return binary_;
+		}
+
+		bool GetDeflateStats(DeflateStats& stats) const
+		{
+			return connection_ != NULL && connection_->getDeflateStats(stats);
+		}
+
+		bool GetConnectTimings(ConnectTimings& timings) const
+		{
+			return connection_ != NULL && connection_->getConnectTimings(timings);
+		}
+
+		bool GetTransportStats(TransportStats& stats) const
+		{
+			return connection_ != NULL && connection_->getTransportStats(stats);
+		}
+
+		//the ping is written on the loop thread, like any other frame
+		bool SendPing()
+		{
+			if (connection_ == NULL)
+			{
+				return false;
+			}
+			reactor_.Post([this]()
+			{
+				unflushed_++;
+				connection_->sendPing();
+				ScheduleFlush();
+			});
+			return true;
+		}
+
+		bool GetSendStats(SendStats& stats) const
+		{
+			if (connection_ == NULL || !connection_->getSendStats(stats))
+			{
+				return false;
+			}
+			stats.rejected = limit_.Rejected();
+			stats.dropped = limit_.Dropped();
+			stats.queuedBytes = limit_.Depth();
+			return true;
+		}
+
+		void StartDispatcher(CALLBACK_FUNC handler)
+		{
+			StartDispatcher(handler, NULL);
+		}
+
+		//with a private reactor this call dispatches messages to and from the
+		//socket on this thread!! With a shared reactor it attaches the session to
+		//the pool thread and returns.
+		void StartDispatcher(CALLBACK_FUNC handler, FRAME_CALLBACK_FUNC frameHandler)
+		{
+			if (connection_ == NULL)
+			{
+				return;
+			}
+
+			if (ownedReactor_)
+			{
+				std::lock_guard<std::mutex> lock(closedLock_);
+				dispatching_ = true;
+			}
+
+			reactor_.Invoke([this, handler, frameHandler]()
+			{
+				handler_ = handler;
+				frameHandler_ = frameHandler;
+				Attach();
+			});
+
+			if (ownedReactor_)
+			{
+				reactor_.Run();
+
+				Detach();
+				Close();
+
+				std::lock_guard<std::mutex> lock(closedLock_);
+				dispatching_ = false;
+				closed_.notify_all();
+			}
+		}
+
+		void OnReady(uint32_t events)
+		{
+			connection_->poll();
+			if (frameHandler_)
+			{
+				connection_->dispatchFrame([this](char* data, size_t size, void* context)
+				{
+					frameHandler_((ReactorSession*)context, data, size);
+				}, this);
+			}
+			else
+			{
+				connection_->dispatch([this](const std::string& message, void* context)
+				{
+					auto session = (ReactorSession*)context;
+					if (session && handler_) {
+						handler_(session, message);
+					}
+				}, this);
+			}
+
+			if (Closed())
+			{
+				return;
+			}
+			limit_.Buffered(this, connection_->getBufferedAmount());
+			UpdateInterest();
+		}
+
+		//write what was queued since the last flush in as few writes as the
+		//batch limits allow
+		void OnFlush()
+		{
+			if (unflushed_ == 0)
+			{
+				return;
+			}
+			unflushed_ = 0;
+			lastFlush_ = std::chrono::steady_clock::now();
+			connection_->flush();
+			if (Closed())
+			{
+				return;
+			}
+			limit_.Buffered(this, connection_->getBufferedAmount());
+			UpdateInterest();
+		}
+
+		void OnTick()
+		{
+			ExpireRequests(this);
+			UpdateTicker();
+		}
+
+	private:
+		//a frame waiting for the loop thread
+		struct Outbound
+		{
+			std::string data;
+			bool binary;
+		};
+
+		void Connect(char const* url, const SessionOptions& options)
+		{
+			//offer the binary envelope, the peer's choice decides the encoding
+			std::string protocols = options.binaryMessages ? BinaryCodec::OFFERED_PROTOCOLS : "";
+			connection_ = WebSocketPtr_t(WebSocket::from_url(url, std::string(), options.receiveBufferSize, protocols, &options.deflate, &options.connect));
+			binary_ = connection_ != NULL && connection_->getProtocol() == BinaryCodec::BINARY_PROTOCOL;
+			if (connection_ != NULL)
+			{
+				connection_->setBatchLimits(options.coalescing.maxBatchMessages, options.coalescing.maxBatchBytes);
+			}
+			maxBatchMessages_ = options.coalescing.maxBatchMessages;
+			maxBatchBytes_ = options.coalescing.maxBatchBytes;
+			flushWindow_ = std::chrono::microseconds(options.coalescing.flushWindowMicros);
+			StartDispatchWorkers(this, options.dispatchWorkers);
+			EnableLastValueCache(this, options.lastValueCache);
+		}
+
+		//frames sent from other threads go on a lock free queue. Only the send
+		//that finds the queue idle posts a flush, so the loop thread drains a
+		//whole batch per wakeup however many threads are sending.
+		SendStatus Send(std::string&& data, bool binary)
+		{
+			if (connection_ == NULL)
+			{
+				return SEND_OK;
+			}
+
+			bool inLoop = reactor_.InLoopThread();
+			SendStatus status = limit_.Reserve(this, data.size(), !inLoop);
+			if (status != SEND_OK)
+			{
+				return status;
+			}
+
+			if (inLoop)
+			{
+				//a bounded buffer may have to drop what other threads queued
+				//ahead of this to make room, but this one has been sent
+				if (limit_.Options().highWatermark != 0)
+				{
+					Drain();
+				}
+				limit_.Take(data.size(), false);
+				Write(std::move(data), binary);
+				ScheduleFlush();
+				UpdateTicker();
+				return SEND_OK;
+			}
+
+			outbound_.Push(Outbound{ std::move(data), binary });
+			if (!flushPosted_.exchange(true, std::memory_order_acq_rel))
+			{
+				reactor_.Post([this]() { Flush(); });
+			}
+			return SEND_OK;
+		}
+
+		void Write(std::string&& data, bool binary)
+		{
+			unflushed_++;
+			if (binary)
+			{
+				connection_->sendBinary(std::move(data));
+			}
+			else
+			{
+				connection_->send(std::move(data));
+			}
+			limit_.Buffered(this, connection_->getBufferedAmount());
+		}
+
+		//loop thread only
+		void Flush()
+		{
+			//clear the flag first, a send that lands after the queue has been
+			//drained posts another flush
+			flushPosted_.exchange(false, std::memory_order_acq_rel);
+			Drain();
+			ScheduleFlush();
+			UpdateTicker();
+		}
+
+		//loop thread only. Tick only while there are requests to expire, so
+		//an idle session leaves the loop asleep. The request is added to the
+		//pending requests before it is sent, so the send that follows brings
+		//the session here. The first tick after the last deadline has gone stops it.
+		void UpdateTicker()
+		{
+			bool wanted = events_ != 0 && PendingDeadlineCount(this) > 0;
+			if (wanted == ticking_)
+			{
+				return;
+			}
+			ticking_ = wanted;
+			if (wanted)
+			{
+				reactor_.AddTicker(this);
+			}
+			else
+			{
+				reactor_.RemoveTicker(this);
+			}
+		}
+
+		//loop thread only
+		void Drain()
+		{
+			Outbound frame;
+			while (outbound_.Pop(frame))
+			{
+				if (limit_.Take(frame.data.size()))
+				{
+					Write(std::move(frame.data), frame.binary);
+				}
+				else
+				{
+					FailDroppedFrame(this, &frame.data[0], frame.data.size());
+				}
+			}
+		}
+
+		//loop thread only. Frames written during a cycle go out together at the
+		//end of it. Within the flush window of the last flush they are held
+		//until the window has passed, unless a full batch is already waiting.
+		//After a quiet spell the first frame goes straight out.
+		void ScheduleFlush()
+		{
+			auto delay = std::chrono::microseconds(0);
+			if (flushWindow_.count() > 0 && unflushed_ < maxBatchMessages_ &&
+				connection_->getBufferedAmount() < maxBatchBytes_)
+			{
+				auto now = std::chrono::steady_clock::now();
+				auto end = lastFlush_ + flushWindow_;
+				if (end > now)
+				{
+					delay = std::chrono::duration_cast<std::chrono::microseconds>(end - now);
+				}
+			}
+			reactor_.ScheduleFlush(this, delay);
+		}
+
+		//stop watching a connection that has closed. With a private reactor
+		//there is then nothing left to dispatch, so StartDispatcher returns.
+		bool Closed()
+		{
+			if (connection_->getReadyState() != WebSocket::CLOSED)
+			{
+				return false;
+			}
+			Detach();
+			if (ownedReactor_)
+			{
+				reactor_.Stop();
+			}
+			return true;
+		}
+
+		void Close()
+		{
+			if (connection_ != NULL)
+			{
+				connection_->close();
+				connection_->poll();
+			}
+		}
+
+		void Attach()
+		{
+			if (events_ != 0 || connection_->getReadyState() == WebSocket::CLOSED)
+			{
+				return;
+			}
+			events_ = WantedEvents();
+			reactor_.Add((int)connection_->getSocket(), events_, this);
+			UpdateTicker();
+			//frames that arrived with the handshake response are already
+			//buffered, the socket will not report them
+			OnReady(EPOLLIN);
+		}
+
+		void Detach()
+		{
+			reactor_.CancelFlush(this);
+			if (events_ == 0)
+			{
+				return;
+			}
+			reactor_.Remove((int)connection_->getSocket(), this);
+			reactor_.RemoveTicker(this);
+			ticking_ = false;
+			events_ = 0;
+		}
+
+		uint32_t WantedEvents() const
+		{
+			return (uint32_t)EPOLLIN | (connection_->getBufferedAmount() > 0 ? (uint32_t)EPOLLOUT : 0u);
+		}
+
+		//only ask for writability while there is something waiting to be sent
+		void UpdateInterest()
+		{
+			if (events_ == 0)
+			{
+				return;
+			}
+
+			uint32_t wanted = WantedEvents();
+			if (wanted != events_)
+			{
+				events_ = wanted;
+				reactor_.Modify((int)connection_->getSocket(), events_, this);
+			}
+		}
+
+		typedef boost::shared_ptr<WebSocket> WebSocketPtr_t;
+		typedef std::unique_ptr<EpollReactor> EpollReactorPtr_t;
+		EpollReactorPtr_t ownedReactor_;
+		EpollReactor& reactor_;
+		WebSocketPtr_t connection_;
+		CALLBACK_FUNC handler_;
+		FRAME_CALLBACK_FUNC frameHandler_;
+		uint32_t events_;
+		std::mutex closedLock_;
+		std::condition_variable closed_;
+		bool dispatching_;
+		MpscQueue<Outbound> outbound_;
+		std::atomic<bool> flushPosted_;
+		//registered with the reactor for OnTick, loop thread only
+		bool ticking_;
+		//coalescing, loop thread only. Frames written since the last flush.
+		unsigned int unflushed_;
+		unsigned int maxBatchMessages_;
+		size_t maxBatchBytes_;
+		std::chrono::microseconds flushWindow_;
+		std::chrono::steady_clock::time_point lastFlush_;
+		TransmitLimit limit_;
+		//the peer selected BinaryCodec::BINARY_PROTOCOL
+		bool binary_;
+	};
+
+	MIDDLEWARE_EXP ISession* CreateSession(char const* url)
+	{
+		return CreateSession(url, SessionOptions());
+	}
+
+	MIDDLEWARE_EXP ISession* CreateSession(char const* url, const SessionOptions& options)
+	{
+		return new ReactorSession(url, options);
+	}
+
+	void MIDDLEWARE_EXP DestroySession(ISession* session)
+	{
+		delete session;
+	}
+
+	MIDDLEWARE_EXP ReactorPool* CreateReactorPool(unsigned int threads)
+	{
+		return new ReactorPool(threads);
+	}
+
+	void MIDDLEWARE_EXP DestroyReactorPool(ReactorPool* pool)
+	{
+		delete pool;
+	}
+
+	MIDDLEWARE_EXP ISession* CreateSession(ReactorPool* pool, char const* url)
+	{
+		return CreateSession(pool, url, SessionOptions());
+	}
+
+	MIDDLEWARE_EXP ISession* CreateSession(ReactorPool* pool, char const* url, const SessionOptions& options)
+	{
+		if (pool == NULL)
+		{
+			return CreateSession(url, options);
+		}
+		return new ReactorSession(pool->Next(), url, options);
+	}
+}
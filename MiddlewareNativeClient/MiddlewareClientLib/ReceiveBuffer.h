@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//receive buffer for a socket. Bytes are read into the free space after the
+	//write cursor and frames are parsed in place from the read cursor, so
+	//consuming a frame only moves the cursor. The unread bytes are moved back to
+	//the start of the buffer only when the write cursor reaches the end and
+	//something has been consumed, which is at most once per capacity's worth of
+	//data. A frame larger than the capacity grows the buffer until it has been
+	//consumed.
+	class ReceiveBuffer
+	{
+	public:
+		static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+		explicit ReceiveBuffer(size_t capacity = DEFAULT_CAPACITY) :
+			capacity_(capacity > 0 ? capacity : DEFAULT_CAPACITY),
+			buffer_(capacity_),
+			read_(0),
+			write_(0)
+		{
+		}
+
+		//unread bytes, contiguous
+		char* Data() { return &buffer_[read_]; }
+		size_t Size() const { return write_ - read_; }
+
+		//free space to read into. Compacts the buffer first if the free space
+		//has run out, so Writable is only 0 when the buffer is full of unread data.
+		char* WritePtr()
+		{
+			if (write_ == buffer_.size() && read_ > 0)
+			{
+				Compact();
+			}
+			return &buffer_[0] + write_;
+		}
+		size_t Writable() const { return buffer_.size() - write_; }
+
+		//n bytes have been written at WritePtr
+		void Commit(size_t n)
+		{
+			write_ += n;
+		}
+
+		//n bytes have been processed at Data
+		void Consume(size_t n)
+		{
+			read_ += n;
+			if (read_ == write_)
+			{
+				read_ = write_ = 0;
+				if (buffer_.size() > capacity_)
+				{
+					//give back the memory taken by an oversized frame
+					std::vector<char>(capacity_).swap(buffer_);
+				}
+			}
+		}
+
+		//make room for a frame of size bytes starting at Data
+		void Reserve(size_t size)
+		{
+			if (read_ + size <= buffer_.size())
+			{
+				return;
+			}
+			Compact();
+			if (size > buffer_.size())
+			{
+				buffer_.resize(size);
+			}
+		}
+
+		size_t Capacity() const { return buffer_.size(); }
+
+	private:
+		void Compact()
+		{
+			size_t size = Size();
+			if (read_ > 0)
+			{
+				memmove(&buffer_[0], &buffer_[read_], size);
+			}
+			read_ = 0;
+			write_ = size;
+		}
+
+		size_t capacity_;
+		std::vector<char> buffer_;
+		size_t read_;
+		size_t write_;
+	};
+}
@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "RequestFuture.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace MiddlewareLib
+{
+	//shared by the futures and the pending request
+	class RequestFuture::State : public IRequestCompletion
+	{
+	public:
+		explicit State(const std::shared_ptr<IRequestCompletion>& next) : ready_(false), resume_(NULL), arg_(NULL), next_(next) {}
+
+		void Complete(ISession* session, bool success, std::string_view payload)
+		{
+			void(*resume)(void*) = NULL;
+			void* arg = NULL;
+			{
+				std::lock_guard<std::mutex> lock(lock_);
+				if (ready_)
+				{
+					return;
+				}
+				result_.success = success;
+				result_.payload.assign(payload.data(), payload.size());
+				ready_ = true;
+				resume = resume_;
+				arg = arg_;
+				completed_.notify_all();
+			}
+
+			//outside the lock, a resumed coroutine may well send another request
+			if (next_ != NULL)
+			{
+				next_->Complete(session, success, payload);
+			}
+			if (resume != NULL)
+			{
+				resume(arg);
+			}
+		}
+
+		bool Ready() const
+		{
+			return ready_;
+		}
+
+		bool WaitFor(std::chrono::milliseconds timeout)
+		{
+			std::unique_lock<std::mutex> lock(lock_);
+			return completed_.wait_for(lock, timeout, [this] { return ready_.load(); });
+		}
+
+		void Wait()
+		{
+			std::unique_lock<std::mutex> lock(lock_);
+			completed_.wait(lock, [this] { return ready_.load(); });
+		}
+
+		const RequestResult& Result() const
+		{
+			return result_;
+		}
+
+		bool ContinueWith(void(*resume)(void*), void* arg)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			if (ready_)
+			{
+				return false;
+			}
+			resume_ = resume;
+			arg_ = arg;
+			return true;
+		}
+
+	private:
+		std::mutex lock_;
+		std::condition_variable completed_;
+		std::atomic<bool> ready_;
+		RequestResult result_;
+		void(*resume_)(void*);
+		void* arg_;
+		//the completion params already had, completed after this
+		std::shared_ptr<IRequestCompletion> next_;
+	};
+
+	RequestFuture::RequestFuture()
+	{
+	}
+
+	RequestFuture::RequestFuture(const std::shared_ptr<State>& state) : state_(state)
+	{
+	}
+
+	RequestFuture RequestFuture::Attach(MiddlewareRequestParams& params)
+	{
+		std::shared_ptr<State> state = std::make_shared<State>(params.completion);
+		params.completion = state;
+		return RequestFuture(state);
+	}
+
+	bool RequestFuture::Ready() const
+	{
+		return state_ != NULL && state_->Ready();
+	}
+
+	void RequestFuture::Wait() const
+	{
+		state_->Wait();
+	}
+
+	bool RequestFuture::WaitFor(unsigned int timeoutMs) const
+	{
+		return state_->WaitFor(std::chrono::milliseconds(timeoutMs));
+	}
+
+	const RequestResult& RequestFuture::Get() const
+	{
+		state_->Wait();
+		return state_->Result();
+	}
+
+	bool RequestFuture::ContinueWith(void(*resume)(void*), void* arg) const
+	{
+		return state_->ContinueWith(resume, arg);
+	}
+
+	namespace
+	{
+		template<class Send>
+		RequestFuture sendAsync(ISession* session, const MiddlewareRequestParams& params, Send send)
+		{
+			MiddlewareRequestParams withFuture(params);
+			RequestFuture future = RequestFuture::Attach(withFuture);
+			if (!send(withFuture))
+			{
+				withFuture.completion->Complete(session, false, REQUEST_NOT_SENT);
+			}
+			return future;
+		}
+	}
+
+	MIDDLEWARE_EXP RequestFuture SubscribeToChannelAsync(ISession *session, const MiddlewareRequestParams& params)
+	{
+		return sendAsync(session, params, [session](const MiddlewareRequestParams& p)
+		{
+			return SubscribeToChannel(session, p);
+		});
+	}
+
+	MIDDLEWARE_EXP RequestFuture SendMessageToChannelAsync(ISession *session, const MiddlewareRequestParams& params, const std::string& payload, const std::string& destination)
+	{
+		return sendAsync(session, params, [session, &payload, &destination](const MiddlewareRequestParams& p)
+		{
+			return SendMessageToChannel(session, p, payload, destination);
+		});
+	}
+
+	MIDDLEWARE_EXP RequestFuture AddChannelListenerAsync(ISession *session, const MiddlewareRequestParams& params)
+	{
+		return sendAsync(session, params, [session](const MiddlewareRequestParams& p)
+		{
+			return AddChannelListener(session, p);
+		});
+	}
+
+	MIDDLEWARE_EXP RequestFuture SendRequestAsync(ISession *session, const MiddlewareRequestParams& params, const std::string& payload)
+	{
+		return sendAsync(session, params, [session, &payload](const MiddlewareRequestParams& p)
+		{
+			return SendRequest(session, p, payload);
+		});
+	}
+
+	MIDDLEWARE_EXP RequestFuture PublishMessageAsync(ISession *session, const MiddlewareRequestParams& params, const std::string& payload)
+	{
+		return sendAsync(session, params, [session, &payload](const MiddlewareRequestParams& p)
+		{
+			return PublishMessage(session, p, payload);
+		});
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <memory>
+#include <string>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define MIDDLEWARE_HAVE_COROUTINES
+#endif
+#endif
+
+namespace MiddlewareLib
+{
+	//the outcome of a request. On failure the payload is the error: the
+	//peer's, REQUEST_TIMED_OUT, REQUEST_NOT_SENT or REQUEST_CANCELLED.
+	struct RequestResult
+	{
+		bool success;
+		std::string payload;
+
+		RequestResult() : success(false) {}
+	};
+
+	//a handle on the response to a request, made by the ...Async functions.
+	//Like std::future it can be waited on, and from C++20 it can be awaited
+	//with co_await, which resumes the coroutine on the thread that handles
+	//the response rather than holding a thread per request. Copies share the
+	//same response. A request still pending when its session is destroyed
+	//fails with REQUEST_CANCELLED.
+	class MIDDLEWARE_EXP RequestFuture
+	{
+	public:
+		//not associated with a request
+		RequestFuture();
+
+		//set params.completion so that the request it is sent with completes
+		//the returned future. A completion params already had is completed
+		//too, after the future.
+		static RequestFuture Attach(MiddlewareRequestParams& params);
+
+		bool Valid() const { return state_ != NULL; }
+		bool Ready() const;
+		void Wait() const;
+		//false if the request is still pending after timeoutMs
+		bool WaitFor(unsigned int timeoutMs) const;
+		//waits for the response. The result lives as long as the future.
+		const RequestResult& Get() const;
+
+		//arrange for resume(arg) to be called once, on the thread that
+		//handles the response. False without calling it if the response has
+		//already arrived.
+		bool ContinueWith(void(*resume)(void*), void* arg) const;
+
+#ifdef MIDDLEWARE_HAVE_COROUTINES
+		struct Awaiter
+		{
+			const RequestFuture& future;
+
+			bool await_ready() const
+			{
+				return future.Ready();
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) const
+			{
+				return future.ContinueWith(Resume, handle.address());
+			}
+
+			RequestResult await_resume() const
+			{
+				return future.Get();
+			}
+
+			static void Resume(void* address)
+			{
+				std::coroutine_handle<>::from_address(address).resume();
+			}
+		};
+
+		Awaiter operator co_await() const
+		{
+			return Awaiter{ *this };
+		}
+#endif
+
+	private:
+		class State;
+		explicit RequestFuture(const std::shared_ptr<State>& state);
+
+		std::shared_ptr<State> state_;
+	};
+
+	//as the functions without Async, completing the future as well as
+	//calling any callbacks and completion in params. A request that could not be sent
+	//completes straight away with REQUEST_NOT_SENT.
+	MIDDLEWARE_EXP RequestFuture SubscribeToChannelAsync(ISession *session, const MiddlewareRequestParams& params);
+	MIDDLEWARE_EXP RequestFuture SendMessageToChannelAsync(ISession *session, const MiddlewareRequestParams& params, const std::string& payload, const std::string& destination);
+	MIDDLEWARE_EXP RequestFuture AddChannelListenerAsync(ISession *session, const MiddlewareRequestParams& params);
+	MIDDLEWARE_EXP RequestFuture SendRequestAsync(ISession *session, const MiddlewareRequestParams& params, const std::string& payload);
+	MIDDLEWARE_EXP RequestFuture PublishMessageAsync(ISession *session, const MiddlewareRequestParams& params, const std::string& payload);
+}
@@ -0,0 +1,85 @@
+#include "stdafx.h"
+#include "RequestId.h"
+#include <random>
+#include <string.h>
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		const char HexDigits[] = "0123456789abcdef";
+	}
+
+	RequestIdGenerator::RequestIdGenerator() : counter_(0)
+	{
+		std::random_device device;
+		for (size_t i = 0; i < sizeof(prefix_); i += 8)
+		{
+			uint32_t bits = device();
+			for (size_t j = 0; j < 8; j++)
+			{
+				prefix_[i + j] = HexDigits[bits & 0xF];
+				bits >>= 4;
+			}
+		}
+	}
+
+	size_t RequestIdGenerator::Next(char* out)
+	{
+		uint64_t counter;
+		return Next(out, counter);
+	}
+
+	size_t RequestIdGenerator::Next(char* out, uint64_t& counter)
+	{
+		uint64_t count = counter_.fetch_add(1, std::memory_order_relaxed) + 1;
+		counter = count;
+
+		memcpy(out, prefix_, sizeof(prefix_));
+		out[sizeof(prefix_)] = '-';
+
+		char digits[16];
+		size_t size = 0;
+		do
+		{
+			digits[size++] = HexDigits[count & 0xF];
+			count >>= 4;
+		} while (count != 0);
+
+		char* p = out + sizeof(prefix_) + 1;
+		while (size > 0)
+		{
+			*p++ = digits[--size];
+		}
+		return p - out;
+	}
+
+	bool RequestIdGenerator::Parse(std::string_view id, uint64_t& counter) const
+	{
+		const size_t prefix = sizeof(prefix_) + 1;
+		if (id.size() <= prefix || id.size() > MAX_SIZE ||
+			memcmp(id.data(), prefix_, sizeof(prefix_)) != 0 || id[sizeof(prefix_)] != '-')
+		{
+			return false;
+		}
+
+		counter = 0;
+		for (size_t i = prefix; i < id.size(); i++)
+		{
+			char c = id[i];
+			if (c >= '0' && c <= '9')
+			{
+				counter = (counter << 4) | (uint64_t)(c - '0');
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				counter = (counter << 4) | (uint64_t)(c - 'a' + 10);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
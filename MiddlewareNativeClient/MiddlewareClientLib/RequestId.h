@@ -0,0 +1,35 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <atomic>
+#include <string_view>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//request ids made of a random prefix, drawn once for the generator, and a
+	//counter. The prefix has 128 random bits so ids stay unique across sessions
+	//and processes without drawing a random number for every request.
+	class MIDDLEWARE_EXP RequestIdGenerator
+	{
+	public:
+		//32 hex digit prefix, a separator and up to 16 hex digits of counter
+		static const size_t MAX_SIZE = 32 + 1 + 16;
+
+		RequestIdGenerator();
+
+		//write the next id to out, which must have room for MAX_SIZE chars.
+		//Returns the length of the id. Safe to call from any thread.
+		size_t Next(char* out);
+		//as above, also returning the counter the id was made from
+		size_t Next(char* out, uint64_t& counter);
+
+		//recover the counter from an id made by this generator. False if the
+		//id came from somewhere else.
+		bool Parse(std::string_view id, uint64_t& counter) const;
+
+	private:
+		char prefix_[32];
+		std::atomic<uint64_t> counter_;
+	};
+}
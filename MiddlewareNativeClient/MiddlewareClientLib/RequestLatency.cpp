@@ -0,0 +1,125 @@
+#include "stdafx.h"
+#include "RequestLatency.h"
+#include <iomanip>
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		void WriteEscaped(std::ostream& out, const std::string& text)
+		{
+			for (char c : text)
+			{
+				switch (c)
+				{
+				case '&': out << "&amp;"; break;
+				case '<': out << "&lt;"; break;
+				case '>': out << "&gt;"; break;
+				case '"': out << "&quot;"; break;
+				case '\'': out << "&apos;"; break;
+				default: out << c; break;
+				}
+			}
+		}
+
+		void WriteLatency(std::ostream& out, const char* element, double nanoseconds)
+		{
+			out << "\t\t<" << element << ">" << nanoseconds / 1000.0 << "</" << element << ">\n";
+		}
+
+		void WriteHistograms(std::ostream& out, const char* list, const char* element, const std::map<std::string, LatencyHistogram>& histograms)
+		{
+			out << "<" << list << ">\n";
+			for (auto& named : histograms)
+			{
+				const LatencyHistogram& histogram = named.second;
+				out << "\t<" << element << ">\n\t\t<name>";
+				WriteEscaped(out, named.first);
+				out << "</name>\n\t\t<requests>" << histogram.Count() << "</requests>\n";
+				WriteLatency(out, "min-us", (double)histogram.Min());
+				WriteLatency(out, "mean-us", histogram.Mean());
+				WriteLatency(out, "p50-us", (double)histogram.ValueAtPercentile(50));
+				WriteLatency(out, "p90-us", (double)histogram.ValueAtPercentile(90));
+				WriteLatency(out, "p99-us", (double)histogram.ValueAtPercentile(99));
+				WriteLatency(out, "p999-us", (double)histogram.ValueAtPercentile(99.9));
+				WriteLatency(out, "max-us", (double)histogram.Max());
+				out << "\t</" << element << ">\n";
+			}
+			out << "</" << list << ">\n";
+		}
+	}
+
+	void RequestLatency::Start(const std::string& command, const std::string& channel, uint64_t now, RequestTiming& timing)
+	{
+		timing.sent = now;
+		//there are only a handful of commands
+		timing.command = Find(commands_, command, (size_t)-1);
+		timing.channel = Find(channels_, channel, MAX_CHANNELS);
+	}
+
+	void RequestLatency::Finish(const RequestTiming& timing, uint64_t now)
+	{
+		uint64_t elapsed = now > timing.sent ? now - timing.sent : 0;
+		if (timing.command != NULL)
+		{
+			timing.command->Record(elapsed);
+		}
+		if (timing.channel != NULL)
+		{
+			timing.channel->Record(elapsed);
+		}
+	}
+
+	void RequestLatency::Snapshot(RequestLatencySnapshot& snapshot, bool reset)
+	{
+		Copy(commands_, snapshot.commands, reset);
+		Copy(channels_, snapshot.channels, reset);
+	}
+
+	LatencyHistogram* RequestLatency::Find(Histograms_t& histograms, const std::string& name, size_t limit)
+	{
+		auto found = histograms.find(name);
+		if (found != histograms.end())
+		{
+			return found->second.get();
+		}
+		//a session sending on ever more names does not grow without bound
+		std::unique_ptr<LatencyHistogram>& histogram = histograms[histograms.size() < limit ? name : OTHER_CHANNELS];
+		if (histogram == NULL)
+		{
+			histogram.reset(new LatencyHistogram());
+		}
+		return histogram.get();
+	}
+
+	void RequestLatency::Copy(Histograms_t& histograms, std::map<std::string, LatencyHistogram>& copies, bool reset)
+	{
+		for (auto& named : histograms)
+		{
+			LatencyHistogram& copy = copies[named.first];
+			if (reset)
+			{
+				named.second->Drain(copy);
+			}
+			else
+			{
+				copy.Add(*named.second);
+			}
+		}
+	}
+
+	void MIDDLEWARE_EXP WriteRequestLatencyXml(const RequestLatencySnapshot& snapshot, std::ostream& out)
+	{
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+
+		out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<stats>\n";
+		WriteHistograms(out, "channels", "channel", snapshot.channels);
+		WriteHistograms(out, "commands", "command", snapshot.commands);
+		out << "</stats>\n";
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include "LatencyHistogram.h"
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace MiddlewareLib
+{
+	//when a request was sent and the histograms its round trip is recorded
+	//in, kept with it while it is pending
+	struct RequestTiming
+	{
+		uint64_t sent;
+		LatencyHistogram* command;
+		LatencyHistogram* channel;
+
+		RequestTiming() : sent(0), command(NULL), channel(NULL) {}
+	};
+
+	//copies of a session's round trip histograms by command and by channel
+	struct RequestLatencySnapshot
+	{
+		std::map<std::string, LatencyHistogram> commands;
+		std::map<std::string, LatencyHistogram> channels;
+	};
+
+	//the histogram the channels beyond RequestLatency::MAX_CHANNELS share
+	const char* const OTHER_CHANNELS = "(other)";
+
+	//the round trip times in nanoseconds of a session's requests, from being
+	//sent to the response that completes them, successful or not. A
+	//histogram is made the first time a command or channel is sent on and
+	//kept for the life of the session, so Start is a lookup and Finish only
+	//touches atomics. Once MAX_CHANNELS channels have one, the rest are
+	//recorded together under OTHER_CHANNELS. Start and Snapshot are not
+	//thread safe, the session calls them with its pending requests locked.
+	class MIDDLEWARE_EXP RequestLatency
+	{
+	public:
+		static const size_t MAX_CHANNELS = 128;
+
+		void Start(const std::string& command, const std::string& channel, uint64_t now, RequestTiming& timing);
+		//record the round trip of a request started with timing
+		static void Finish(const RequestTiming& timing, uint64_t now);
+
+		//add the histograms to those in snapshot. reset empties them.
+		void Snapshot(RequestLatencySnapshot& snapshot, bool reset);
+
+	private:
+		typedef std::unordered_map<std::string, std::unique_ptr<LatencyHistogram>> Histograms_t;
+
+		static LatencyHistogram* Find(Histograms_t& histograms, const std::string& name, size_t limit);
+		static void Copy(Histograms_t& histograms, std::map<std::string, LatencyHistogram>& copies, bool reset);
+
+		Histograms_t commands_;
+		Histograms_t channels_;
+	};
+
+	//add the round trip times of session's requests to snapshot, for a pooled
+	//session those of all its connections. reset empties the session's
+	//histograms, so the next snapshot has the requests completed since.
+	//False if there is no session.
+	bool MIDDLEWARE_EXP GetRequestLatency(ISession* session, RequestLatencySnapshot& snapshot, bool reset = false);
+
+	//write snapshot as XML in the shape of the broker's stats page, a
+	//<channel> element for each channel with its name and requests, then a
+	//<command> element for each command. Latencies are in microseconds.
+	void MIDDLEWARE_EXP WriteRequestLatencyXml(const RequestLatencySnapshot& snapshot, std::ostream& out);
+}
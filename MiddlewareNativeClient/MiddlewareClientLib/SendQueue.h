@@ -0,0 +1,113 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//outbound frames waiting for the socket. Each frame keeps its header inline
+	//next to the payload it was given, so queueing moves the payload rather than
+	//copying it, and the socket writes many frames per call by gathering them.
+	//A partial write only moves the offset into the front frame.
+	class SendQueue
+	{
+	public:
+		static const size_t MAX_HEADER_SIZE = 14;
+
+		//a contiguous piece of the queue for a gathered write
+		struct Segment
+		{
+			const char* data;
+			size_t size;
+		};
+
+		SendQueue() : offset_(0), size_(0) {}
+
+		void Push(const uint8_t* header, size_t headerSize, std::string&& payload)
+		{
+			frames_.emplace_back();
+			Frame& frame = frames_.back();
+			memcpy(frame.header, header, headerSize);
+			frame.headerSize = (uint8_t)headerSize;
+			frame.payload.swap(payload);
+			size_ += headerSize + frame.payload.size();
+		}
+
+		//fill out with up to max segments, and at most maxBytes, from the front
+		//of the queue and return how many were used. The last segment is cut
+		//short if it would go over maxBytes.
+		int Gather(Segment* out, int max, size_t maxBytes = (size_t)-1) const
+		{
+			int count = 0;
+			size_t offset = offset_;
+			for (auto it = frames_.begin(); it != frames_.end() && count < max && maxBytes > 0; ++it)
+			{
+				if (offset < it->headerSize)
+				{
+					Add(out, count, (const char*)it->header + offset, it->headerSize - offset, maxBytes);
+					offset = 0;
+				}
+				else
+				{
+					offset -= it->headerSize;
+				}
+
+				if (offset < it->payload.size() && count < max && maxBytes > 0)
+				{
+					Add(out, count, it->payload.data() + offset, it->payload.size() - offset, maxBytes);
+				}
+				offset = 0;
+			}
+			return count;
+		}
+
+		//n bytes from the front of the queue have been written. Returns the
+		//number of frames that are now completely written.
+		size_t Advance(size_t n)
+		{
+			size_t frames = 0;
+			size_ -= n;
+			n += offset_;
+			while (!frames_.empty())
+			{
+				size_t frameSize = frames_.front().headerSize + frames_.front().payload.size();
+				if (n < frameSize)
+				{
+					break;
+				}
+				n -= frameSize;
+				frames_.pop_front();
+				frames++;
+			}
+			offset_ = n;
+			return frames;
+		}
+
+		bool Empty() const { return frames_.empty(); }
+		//bytes queued but not yet written
+		size_t Size() const { return size_; }
+
+	private:
+		static void Add(Segment* out, int& count, const char* data, size_t size, size_t& maxBytes)
+		{
+			out[count].data = data;
+			out[count].size = size < maxBytes ? size : maxBytes;
+			maxBytes -= out[count].size;
+			count++;
+		}
+
+		struct Frame
+		{
+			uint8_t header[MAX_HEADER_SIZE];
+			uint8_t headerSize;
+			std::string payload;
+		};
+
+		std::deque<Frame> frames_;
+		//bytes of the front frame already written
+		size_t offset_;
+		size_t size_;
+	};
+}
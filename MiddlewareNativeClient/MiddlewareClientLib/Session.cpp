@@ -1,7 +1,12 @@
 #include "stdafx.h"
+#include "BinaryCodec.h"
 #include "easywsclient.hpp"
 #include "MiddlewareClientLib.h"
+#include "MpscQueue.h"
+#include "TransmitLimit.h"
 #include <boost/shared_ptr.hpp>
+#include <atomic>
+#include <thread>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <iostream>
@@ -13,7 +18,9 @@ namespace MiddlewareLib
 	class Session : public ISession
 	{
 	public:
-		Session(char const* url) : poll_(100)
+		static const DWORD TickMs = 10;
+
+		Session(char const* url, const SessionOptions& options) : sendPending_(false), pingPending_(false), limit_(options.transmitBuffer)
 		{
 			WSADATA wsaData;
 			int iResult;
@@ -24,7 +31,20 @@ namespace MiddlewareLib
 
 			hShutdownEvent_ = CreateEvent(NULL, FALSE, FALSE, NULL);
 			hClosedEvent_ = CreateEvent(NULL, FALSE, FALSE, NULL);
-			connection_ = WebSocketPtr_t(WebSocket::from_url(url));
+			hSendEvent_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+			hSocketEvent_ = WSACreateEvent();
+			//offer the binary envelope, the peer's choice decides the encoding
+			std::string protocols = options.binaryMessages ? BinaryCodec::OFFERED_PROTOCOLS : "";
+			connection_ = WebSocketPtr_t(WebSocket::from_url(url, std::string(), options.receiveBufferSize, protocols, &options.deflate, &options.connect));
+			binary_ = connection_ != NULL && connection_->getProtocol() == BinaryCodec::BINARY_PROTOCOL;
+			//the dispatcher already drains every queued send before it polls,
+			//so the batch limits are all that apply here
+			if (connection_ != NULL)
+			{
+				connection_->setBatchLimits(options.coalescing.maxBatchMessages, options.coalescing.maxBatchBytes);
+			}
+			StartDispatchWorkers(this, options.dispatchWorkers);
+			EnableLastValueCache(this, options.lastValueCache);
 		}
 
 		virtual ~Session()
@@ -32,45 +52,128 @@ namespace MiddlewareLib
 			//first, stop dispatching
 			SetEvent(hShutdownEvent_);
 			WaitForSingleObject(hClosedEvent_, 1000);
+			StopDispatchWorkers(this);
 			CloseHandle(hShutdownEvent_);
 			CloseHandle(hClosedEvent_);
+			CloseHandle(hSendEvent_);
+			WSACloseEvent(hSocketEvent_);
 			WSACleanup();
 		}
 
 		void SendData(const std::string& data)
 		{
-			if (connection_ != NULL)
+			Send(std::string(data), false);
+		}
+
+		void SendData(std::string&& data)
+		{
+			Send(std::move(data), false);
+		}
+
+		void SendBinaryData(std::string&& data)
+		{
+			Send(std::move(data), true);
+		}
+
+		SendStatus TrySendData(std::string&& data, bool binary)
+		{
+			return Send(std::move(data), binary);
+		}
+
+		size_t QueuedBytes() const
+		{
+			return limit_.Depth();
+		}
+
+		bool BinaryMessages() const
+		{
+			return binary_;
+		}
+
+		bool GetDeflateStats(DeflateStats& stats) const
+		{
+			return connection_ != NULL && connection_->getDeflateStats(stats);
+		}
+
+		bool GetConnectTimings(ConnectTimings& timings) const
+		{
+			return connection_ != NULL && connection_->getConnectTimings(timings);
+		}
+
+		bool GetTransportStats(TransportStats& stats) const
+		{
+			return connection_ != NULL && connection_->getTransportStats(stats);
+		}
+
+		//the dispatcher sends the ping the next time it drains
+		bool SendPing()
+		{
+			if (connection_ == NULL)
 			{
-				connection_->send(data);
+				return false;
 			}
+			pingPending_.store(true, std::memory_order_release);
+			SetEvent(hSendEvent_);
+			return true;
+		}
+
+		bool GetSendStats(SendStats& stats) const
+		{
+			if (connection_ == NULL || !connection_->getSendStats(stats))
+			{
+				return false;
+			}
+			stats.rejected = limit_.Rejected();
+			stats.dropped = limit_.Dropped();
+			stats.queuedBytes = limit_.Depth();
+			return true;
 		}
 
-		//this call will start dispatching messages to and from the socket
-		//on this thread!!
 		void StartDispatcher(CALLBACK_FUNC handler)
+		{
+			StartDispatcher(handler, NULL);
+		}
+
+		//this call will start dispatching messages to and from the socket
+		//on this thread!! The thread blocks until the socket is readable or
+		//writable, data is queued by SendData or the session is shutdown. While
+		//requests with a deadline are pending it also wakes every TickMs to
+		//expire them.
+		void StartDispatcher(CALLBACK_FUNC handler, FRAME_CALLBACK_FUNC frameHandler)
 		{
 			//_handler = handler;
 			if (connection_ != NULL)
 			{
-				while (WaitForSingleObject(hShutdownEvent_, poll_) == WAIT_TIMEOUT)
+				dispatcherThread_ = std::this_thread::get_id();
+				SOCKET sock = (SOCKET)connection_->getSocket();
+				WSAEventSelect(sock, hSocketEvent_, FD_READ | FD_WRITE | FD_CLOSE);
+
+				HANDLE handles[] = { hShutdownEvent_, hSocketEvent_, hSendEvent_ };
+				DWORD result = WAIT_OBJECT_0 + 2;
+				//first pass flushes anything sent before dispatching started
+				while (result == WAIT_OBJECT_0 + 1 || result == WAIT_OBJECT_0 + 2 || result == WAIT_TIMEOUT)
 				{
-					connection_->poll();
-					connection_->dispatch([handler](const std::string& message, void* context)
+					if (result == WAIT_OBJECT_0 + 1)
 					{
-						auto session = (Session*)context;
-						if (session) {
-							//CALLBACK_FUNC handler = session->GetHandler();
-							if (handler) {
-								handler(session, message);
-							}
+						WSANETWORKEVENTS networkEvents;
+						if (WSAEnumNetworkEvents(sock, hSocketEvent_, &networkEvents) != 0)
+						{
+							WSAResetEvent(hSocketEvent_);
 						}
-					}, this);
+					}
+
+					Dispatch(handler, frameHandler);
+					ExpireRequests(this);
+					//SendData sets the send event, so a new request recalculates the wait
+					DWORD timeout = PendingDeadlineCount(this) > 0 ? TickMs : INFINITE;
+					result = WaitForMultipleObjects(3, handles, FALSE, timeout);
 				}
 
 				if ((connection_->getReadyState() != WebSocket::CLOSED) &&
 					(connection_->getReadyState() != WebSocket::CLOSING))
 				{
 					connection_->close();
+					connection_->poll();
 
 					SetEvent(hClosedEvent_);
 				}
@@ -83,17 +186,121 @@ namespace MiddlewareLib
 		//}
 
 	private:
+		//a frame waiting for the dispatcher thread
+		struct Outbound
+		{
+			std::string data;
+			bool binary;
+			//false if sent on the dispatcher thread, which is never dropped
+			bool droppable;
+		};
+
+		//any thread may send, the frame is queued for the dispatcher thread which
+		//drains everything queued each time it wakes
+		SendStatus Send(std::string&& data, bool binary)
+		{
+			if (connection_ != NULL)
+			{
+				//the dispatcher cannot wait for itself to make room
+				bool canWait = dispatcherThread_.load() != std::this_thread::get_id();
+				SendStatus status = limit_.Reserve(this, data.size(), canWait);
+				if (status != SEND_OK)
+				{
+					return status;
+				}
+				outbound_.Push(Outbound{ std::move(data), binary, canWait });
+				//wake the dispatcher so the data is written straight away. Only
+				//the first send since the last drain needs to.
+				if (!sendPending_.exchange(true, std::memory_order_acq_rel))
+				{
+					SetEvent(hSendEvent_);
+				}
+			}
+			return SEND_OK;
+		}
+
+		void Dispatch(CALLBACK_FUNC handler, FRAME_CALLBACK_FUNC frameHandler)
+		{
+			sendPending_.exchange(false, std::memory_order_acq_rel);
+			Outbound frame;
+			while (outbound_.Pop(frame))
+			{
+				if (!limit_.Take(frame.data.size(), frame.droppable))
+				{
+					FailDroppedFrame(this, &frame.data[0], frame.data.size());
+					continue;
+				}
+				if (frame.binary)
+				{
+					connection_->sendBinary(std::move(frame.data));
+				}
+				else
+				{
+					connection_->send(std::move(frame.data));
+				}
+				limit_.Buffered(this, connection_->getBufferedAmount());
+			}
+			if (pingPending_.exchange(false, std::memory_order_acq_rel))
+			{
+				connection_->sendPing();
+			}
+
+			connection_->poll();
+			size_t queued = connection_->getBufferedAmount();
+			limit_.Buffered(this, queued);
+			if (frameHandler)
+			{
+				connection_->dispatchFrame([frameHandler](char* data, size_t size, void* context)
+				{
+					frameHandler((Session*)context, data, size);
+				}, this);
+			}
+			else
+			{
+				connection_->dispatch([handler](const std::string& message, void* context)
+				{
+					auto session = (Session*)context;
+					if (session) {
+						//CALLBACK_FUNC handler = session->GetHandler();
+						if (handler) {
+							handler(session, message);
+						}
+					}
+				}, this);
+			}
+
+			//go round again for anything queued while dispatching, e.g. pong frames.
+			//data left over from a would-block send is picked up by FD_WRITE.
+			if (connection_->getBufferedAmount() > queued)
+			{
+				SetEvent(hSendEvent_);
+			}
+		}
+
 		//CALLBACK_FUNC _handler;
 		typedef  boost::shared_ptr<WebSocket> WebSocketPtr_t;
 		WebSocketPtr_t connection_;
 		HANDLE hShutdownEvent_;
 		HANDLE hClosedEvent_;
-		DWORD poll_;
+		HANDLE hSendEvent_;
+		WSAEVENT hSocketEvent_;
+		MpscQueue<Outbound> outbound_;
+		std::atomic<bool> sendPending_;
+		std::atomic<bool> pingPending_;
+		TransmitLimit limit_;
+		std::atomic<std::thread::id> dispatcherThread_;
+		//the peer selected BinaryCodec::BINARY_PROTOCOL
+		bool binary_;
 	};
 
 	MIDDLEWARE_EXP ISession* CreateSession(char const* url)
 	{
-		return new Session(url);
+		return CreateSession(url, SessionOptions());
+	}
+
+	MIDDLEWARE_EXP ISession* CreateSession(char const* url, const SessionOptions& options)
+	{
+		return new Session(url, options);
 	}
 
 	void MIDDLEWARE_EXP DestroySession(ISession* session)
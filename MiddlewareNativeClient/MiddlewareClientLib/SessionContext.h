@@ -0,0 +1,52 @@
+#pragma once
+
+#include "LastValueCache.h"
+#include "PendingRequests.h"
+#include "RequestId.h"
+#include "RequestLatency.h"
+#include "SubscriptionRegistry.h"
+#include "WorkerPool.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace MiddlewareLib
+{
+	//what the library keeps for each session. Owned by the session through
+	//ISession::context_ and released with it.
+	class SessionContext
+	{
+	public:
+		SessionContext() : start_(std::chrono::steady_clock::now()) {}
+
+		//milliseconds since the context was made, the clock for request deadlines
+		uint64_t Now() const
+		{
+			return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - start_).count();
+		}
+
+		//nanoseconds since the context was made, the clock for round trips
+		uint64_t NowNs() const
+		{
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start_).count();
+		}
+
+		RequestIdGenerator requestIds_;
+		//requests are added by any thread and completed by the dispatcher
+		std::mutex pendingLock_;
+		PendingRequests pending_;
+		//round trips of the requests completed, also under pendingLock_
+		RequestLatency latency_;
+		//set when received frames are handled off the dispatcher thread
+		std::unique_ptr<WorkerPool> workers_;
+		//set when the latest UPDATE on each channel is kept
+		std::unique_ptr<LastValueCache> lastValues_;
+		//handlers added for channels, and the subscriptions they share
+		SubscriptionRegistry subscriptions_;
+
+	private:
+		std::chrono::steady_clock::time_point start_;
+	};
+}
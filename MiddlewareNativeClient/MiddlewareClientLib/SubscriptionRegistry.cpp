@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "SubscriptionRegistry.h"
+#include <algorithm>
+
+namespace MiddlewareLib
+{
+	namespace
+	{
+		//handles are the channel id and a serial unique across sessions, so
+		//a handle from one session is never mistaken for another's
+		std::atomic<uint32_t> nextSerial(0);
+	}
+
+	SubscriptionRegistry::SubscriptionRegistry() : active_(0)
+	{
+	}
+
+	ChannelId SubscriptionRegistry::Intern(std::string_view channel)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		return InternLocked(channel);
+	}
+
+	ChannelId SubscriptionRegistry::InternLocked(std::string_view channel)
+	{
+		auto id = ids_.find(channel);
+		if (id != ids_.end())
+		{
+			return id->second;
+		}
+
+		ChannelId next = (ChannelId)channels_.size();
+		channels_.push_back(Channel{ std::string(channel), HandlersPtr_t(new Handlers_t()), 0 });
+		ids_.emplace(std::string_view(channels_.back().name), next);
+		return next;
+	}
+
+	uint64_t SubscriptionRegistry::Add(std::string_view channel, CHANNEL_HANDLER_FUNC handler, void* context, bool& subscribe)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		ChannelId id = InternLocked(channel);
+		Channel& entry = channels_[id];
+		uint64_t handle = ((uint64_t)id << 32) | ++nextSerial;
+
+		std::shared_ptr<Handlers_t> handlers(new Handlers_t(*entry.handlers));
+		handlers->push_back(Handler{ handle, handler, context });
+		entry.handlers = handlers;
+		if (handlers->size() == 1)
+		{
+			active_++;
+		}
+		subscribe = entry.subscription == 0;
+		if (subscribe)
+		{
+			entry.subscription = handle;
+		}
+		return handle;
+	}
+
+	void SubscriptionRegistry::SubscribeFailed(uint64_t handle)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		ChannelId id = (ChannelId)(handle >> 32);
+		if (id < channels_.size() && channels_[id].subscription == handle)
+		{
+			channels_[id].subscription = 0;
+		}
+	}
+
+	bool SubscriptionRegistry::Remove(uint64_t handle, std::string& channel, bool& unsubscribe)
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		ChannelId id = (ChannelId)(handle >> 32);
+		if (id >= channels_.size())
+		{
+			return false;
+		}
+
+		Channel& entry = channels_[id];
+		auto found = std::find_if(entry.handlers->begin(), entry.handlers->end(),
+			[handle](const Handler& handler) { return handler.handle == handle; });
+		if (found == entry.handlers->end())
+		{
+			return false;
+		}
+
+		std::shared_ptr<Handlers_t> handlers(new Handlers_t(*entry.handlers));
+		handlers->erase(handlers->begin() + (found - entry.handlers->begin()));
+		entry.handlers = handlers;
+		channel = entry.name;
+		unsubscribe = false;
+		if (handlers->empty())
+		{
+			active_--;
+			unsubscribe = entry.subscription != 0;
+			entry.subscription = 0;
+		}
+		return true;
+	}
+
+	bool SubscriptionRegistry::Dispatch(ISession* session, const MessageView& message) const
+	{
+		if (Empty())
+		{
+			return false;
+		}
+
+		ChannelId id;
+		HandlersPtr_t handlers;
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			auto found = ids_.find(message.channel_);
+			if (found == ids_.end())
+			{
+				return false;
+			}
+			id = found->second;
+			handlers = channels_[id].handlers;
+		}
+
+		if (handlers->empty())
+		{
+			return false;
+		}
+		for (auto& handler : *handlers)
+		{
+			handler.func(session, id, message, handler.context);
+		}
+		return true;
+	}
+
+	size_t SubscriptionRegistry::Handlers(std::string_view channel) const
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		auto id = ids_.find(channel);
+		return id != ids_.end() ? channels_[id->second].handlers->size() : 0;
+	}
+
+	bool SubscriptionRegistry::Subscribed(std::string_view channel) const
+	{
+		std::lock_guard<std::mutex> lock(lock_);
+		auto id = ids_.find(channel);
+		return id != ids_.end() && channels_[id->second].subscription != 0;
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//the handlers added for the channels of one session. Channel names are
+	//interned to ids so routing a message is one hash lookup, and a channel's
+	//handlers share its upstream subscription: the first one added subscribes
+	//and the last one removed unsubscribes. A subscription that is refused or
+	//times out is forgotten, so the next handler added subscribes again.
+	//Handlers may be added and removed on any thread, including from a handler.
+	class MIDDLEWARE_EXP SubscriptionRegistry
+	{
+	public:
+		SubscriptionRegistry();
+
+		//the channel's id, made on first use and never given to another channel
+		ChannelId Intern(std::string_view channel);
+
+		//returns the handler's handle. subscribe is set if the channel is not
+		//subscribed to upstream, the caller then subscribes and reports a
+		//failure with SubscribeFailed.
+		uint64_t Add(std::string_view channel, CHANNEL_HANDLER_FUNC handler, void* context, bool& subscribe);
+
+		//the subscription sent for the handler with this handle was refused,
+		//timed out or not sent. Ignored if the channel has been unsubscribed
+		//or subscribed again since.
+		void SubscribeFailed(uint64_t handle);
+
+		//false if there is no such handler. Otherwise channel is set to the
+		//channel it was on and unsubscribe if no handlers remain and the
+		//channel is subscribed to upstream.
+		bool Remove(uint64_t handle, std::string& channel, bool& unsubscribe);
+
+		//call the handlers for the message's channel, false if it has none
+		bool Dispatch(ISession* session, const MessageView& message) const;
+
+		size_t Handlers(std::string_view channel) const;
+		//a subscription has been sent for the channel and not failed
+		bool Subscribed(std::string_view channel) const;
+		//no channel has a handler
+		bool Empty() const { return active_.load(std::memory_order_acquire) == 0; }
+
+	private:
+		struct Handler
+		{
+			uint64_t handle;
+			CHANNEL_HANDLER_FUNC func;
+			void* context;
+		};
+
+		typedef std::vector<Handler> Handlers_t;
+		typedef std::shared_ptr<const Handlers_t> HandlersPtr_t;
+
+		struct Channel
+		{
+			std::string name;
+			//replaced rather than changed, so dispatch can call the handlers
+			//outside the lock
+			HandlersPtr_t handlers;
+			//handle of the handler whose add subscribed, 0 if not subscribed
+			uint64_t subscription;
+		};
+
+		ChannelId InternLocked(std::string_view channel);
+
+		SubscriptionRegistry(const SubscriptionRegistry&);
+		SubscriptionRegistry& operator=(const SubscriptionRegistry&);
+
+		mutable std::mutex lock_;
+		//by id, a deque so the names the index refers to never move
+		std::deque<Channel> channels_;
+		std::unordered_map<std::string_view, ChannelId> ids_;
+		//channels with at least one handler
+		std::atomic<size_t> active_;
+	};
+}
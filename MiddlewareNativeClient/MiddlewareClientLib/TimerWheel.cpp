@@ -0,0 +1,127 @@
+#include "stdafx.h"
+#include "TimerWheel.h"
+
+namespace MiddlewareLib
+{
+	TimerWheel::TimerWheel(uint64_t now) :
+		slots_(LEVELS * SLOTS, NO_TIMER),
+		free_(NO_TIMER),
+		now_(now),
+		count_(0)
+	{
+	}
+
+	uint32_t TimerWheel::Schedule(uint64_t expiry, uint32_t cookie)
+	{
+		uint32_t timer = free_;
+		if (timer != NO_TIMER)
+		{
+			free_ = timers_[timer].slot;
+		}
+		else
+		{
+			timer = (uint32_t)timers_.size();
+			timers_.push_back(Timer());
+		}
+
+		//the slot for now has already been processed
+		timers_[timer].expiry = expiry > now_ ? expiry : now_ + 1;
+		timers_[timer].cookie = cookie;
+		Insert(timer);
+		count_++;
+		return timer;
+	}
+
+	void TimerWheel::Cancel(uint32_t timer)
+	{
+		Unlink(timer);
+		timers_[timer].slot = free_;
+		free_ = timer;
+		count_--;
+	}
+
+	void TimerWheel::Advance(uint64_t now, std::vector<uint32_t>& expired)
+	{
+		while (now_ < now)
+		{
+			if (count_ == 0)
+			{
+				//nothing can expire, so skip straight there
+				now_ = now;
+				return;
+			}
+
+			now_++;
+			//timers move down a level as the wheel reaches their slot, before
+			//the current slot on the lowest level is processed
+			for (int level = 1; level < LEVELS; level++)
+			{
+				if ((now_ & ((1ull << (level * SLOT_BITS)) - 1)) != 0)
+				{
+					break;
+				}
+				Cascade(level);
+			}
+
+			uint32_t& head = slots_[now_ & (SLOTS - 1)];
+			while (head != NO_TIMER)
+			{
+				uint32_t timer = head;
+				expired.push_back(timers_[timer].cookie);
+				Cancel(timer);
+			}
+		}
+	}
+
+	//the level is the lowest at which the expiry and now share all higher bits,
+	//which puts the timer in a slot the wheel has still to reach
+	void TimerWheel::Insert(uint32_t timer)
+	{
+		Timer& t = timers_[timer];
+		int level = 0;
+		while (level < LEVELS - 1 && (t.expiry >> ((level + 1) * SLOT_BITS)) != (now_ >> ((level + 1) * SLOT_BITS)))
+		{
+			level++;
+		}
+
+		uint32_t slot = level * SLOTS + (uint32_t)((t.expiry >> (level * SLOT_BITS)) & (SLOTS - 1));
+		t.slot = slot;
+		t.prev = NO_TIMER;
+		t.next = slots_[slot];
+		if (t.next != NO_TIMER)
+		{
+			timers_[t.next].prev = timer;
+		}
+		slots_[slot] = timer;
+	}
+
+	void TimerWheel::Unlink(uint32_t timer)
+	{
+		Timer& t = timers_[timer];
+		if (t.prev != NO_TIMER)
+		{
+			timers_[t.prev].next = t.next;
+		}
+		else
+		{
+			slots_[t.slot] = t.next;
+		}
+		if (t.next != NO_TIMER)
+		{
+			timers_[t.next].prev = t.prev;
+		}
+	}
+
+	void TimerWheel::Cascade(int level)
+	{
+		uint32_t slot = level * SLOTS + (uint32_t)((now_ >> (level * SLOT_BITS)) & (SLOTS - 1));
+		uint32_t timer = slots_[slot];
+		slots_[slot] = NO_TIMER;
+		while (timer != NO_TIMER)
+		{
+			uint32_t next = timers_[timer].next;
+			Insert(timer);
+			timer = next;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <vector>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//hierarchical timer wheel. Time is counted in ticks. Each level has 256
+	//slots covering 256 times the span of the level below, so five levels cover
+	//2^40 ticks. Scheduling and cancelling are O(1). A timer is moved down a
+	//level at most once per level, as the wheel reaches its slot.
+	class MIDDLEWARE_EXP TimerWheel
+	{
+	public:
+		static const uint32_t NO_TIMER = 0xFFFFFFFF;
+
+		explicit TimerWheel(uint64_t now = 0);
+
+		//expire at tick expiry, or on the next tick if that has already passed.
+		//cookie is handed back when the timer expires. Returns the timer.
+		uint32_t Schedule(uint64_t expiry, uint32_t cookie);
+		void Cancel(uint32_t timer);
+
+		//move the wheel on to tick now, appending the cookies of the timers that
+		//expired on the way to expired
+		void Advance(uint64_t now, std::vector<uint32_t>& expired);
+
+		uint64_t Now() const { return now_; }
+		size_t Size() const { return count_; }
+
+	private:
+		static const int LEVELS = 5;
+		static const int SLOT_BITS = 8;
+		static const uint32_t SLOTS = 1 << SLOT_BITS;
+
+		struct Timer
+		{
+			uint64_t expiry;
+			uint32_t cookie;
+			uint32_t prev;
+			uint32_t next;
+			//slot list the timer is on, or the next free timer when unused
+			uint32_t slot;
+		};
+
+		void Insert(uint32_t timer);
+		void Unlink(uint32_t timer);
+		void Cascade(int level);
+
+		std::vector<Timer> timers_;
+		std::vector<uint32_t> slots_;
+		uint32_t free_;
+		uint64_t now_;
+		size_t count_;
+	};
+}
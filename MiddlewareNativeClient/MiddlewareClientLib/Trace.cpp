@@ -0,0 +1,267 @@
+#include "stdafx.h"
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MIDDLEWARE_TRACE_TSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define MIDDLEWARE_TRACE_TSC
+#endif
+
+namespace MiddlewareLib
+{
+	namespace Trace
+	{
+		namespace
+		{
+			const uint64_t ArgMask = (1ULL << 56) - 1;
+
+			uint64_t SteadyNs()
+			{
+				return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			//the time stamp counter where there is one, it is far cheaper to
+			//read than the clock. Converted to nanoseconds when collected.
+			inline uint64_t Timestamp()
+			{
+#ifdef MIDDLEWARE_TRACE_TSC
+				return __rdtsc();
+#else
+				return SteadyNs();
+#endif
+			}
+
+			//a thread's events. Only the thread writes to it, head last, so
+			//a reader can tell which slots were overwritten while it read.
+			//Once the thread has finished the ring is free for the next
+			//thread to start recording.
+			struct Ring
+			{
+				struct Slot
+				{
+					std::atomic<uint64_t> time;
+					//the point in the top 8 bits, the arg below
+					std::atomic<uint64_t> event;
+				};
+
+				explicit Ring(uint32_t thread) : thread(thread), head(0), free(false) {}
+
+				uint32_t thread;
+				std::atomic<uint64_t> head;
+				std::atomic<bool> free;
+				Slot slots[RING_EVENTS];
+			};
+
+			//when the first event was recorded, on both clocks
+			struct Origin
+			{
+				Origin() : ticks(Timestamp()), ns(SteadyNs()) {}
+
+				uint64_t ticks;
+				uint64_t ns;
+			};
+
+			const Origin& TheOrigin()
+			{
+				static Origin origin;
+				return origin;
+			}
+
+			std::atomic<bool> enabled(true);
+			std::atomic<uint64_t> clearedAt(0);
+
+			//rings outlive their threads so the events of threads that have
+			//finished can still be collected, until another thread takes the
+			//ring over
+			std::mutex ringsLock;
+			std::vector<Ring*> rings;
+			uint32_t lastThread = 0;
+
+			thread_local Ring* threadRing = NULL;
+
+			//frees the thread's ring when the thread exits. Kept apart from
+			//threadRing so recording does not pay for a thread_local with a
+			//destructor.
+			struct RingRelease
+			{
+				~RingRelease()
+				{
+					if (threadRing != NULL)
+					{
+						threadRing->free.store(true, std::memory_order_release);
+						threadRing = NULL;
+					}
+				}
+			};
+
+			thread_local RingRelease ringRelease;
+
+			Ring* Register()
+			{
+				TheOrigin();
+				(void)ringRelease;
+				std::lock_guard<std::mutex> lock(ringsLock);
+				uint32_t thread = ++lastThread;
+				for (Ring* ring : rings)
+				{
+					if (ring->free.load(std::memory_order_acquire))
+					{
+						//the finished thread's events go with it
+						ring->thread = thread;
+						ring->head.store(0, std::memory_order_release);
+						ring->free.store(false, std::memory_order_relaxed);
+						return ring;
+					}
+				}
+				Ring* ring = new Ring(thread);
+				rings.push_back(ring);
+				return ring;
+			}
+
+			//the events in ring oldest first, leaving out those that may
+			//have been overwritten while they were copied
+			void Read(const Ring& ring, uint64_t since, double nsPerTick, std::vector<Event>& events)
+			{
+				const Origin& origin = TheOrigin();
+				uint64_t head = ring.head.load(std::memory_order_acquire);
+				uint64_t first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+				size_t start = events.size();
+				std::vector<uint64_t> indexes;
+				for (uint64_t i = first; i < head; i++)
+				{
+					const Ring::Slot& slot = ring.slots[i & (RING_EVENTS - 1)];
+					uint64_t time = slot.time.load(std::memory_order_acquire);
+					uint64_t event = slot.event.load(std::memory_order_acquire);
+					if (time < since || time < origin.ticks)
+					{
+						continue;
+					}
+					Event e;
+					e.thread = ring.thread;
+					e.point = (Point)(event >> 56);
+					e.time = (uint64_t)((double)(time - origin.ticks) * nsPerTick);
+					e.arg = event & ArgMask;
+					events.push_back(e);
+					indexes.push_back(i);
+				}
+
+				//the writer may have moved on over the oldest slots as they
+				//were read, in which case it is now at least a ring ahead
+				uint64_t now = ring.head.load(std::memory_order_acquire);
+				size_t keep = 0;
+				while (keep < indexes.size() && indexes[keep] + RING_EVENTS <= now)
+				{
+					keep++;
+				}
+				events.erase(events.begin() + start, events.begin() + start + keep);
+			}
+		}
+
+		void MIDDLEWARE_EXP Record(Point point, uint64_t arg)
+		{
+			if (!enabled.load(std::memory_order_relaxed))
+			{
+				return;
+			}
+			Ring* ring = threadRing;
+			if (ring == NULL)
+			{
+				ring = threadRing = Register();
+			}
+
+			uint64_t head = ring->head.load(std::memory_order_relaxed);
+			Ring::Slot& slot = ring->slots[head & (RING_EVENTS - 1)];
+			slot.time.store(Timestamp(), std::memory_order_release);
+			slot.event.store(((uint64_t)point << 56) | (arg & ArgMask), std::memory_order_release);
+			ring->head.store(head + 1, std::memory_order_release);
+		}
+
+		void MIDDLEWARE_EXP Enable(bool enable)
+		{
+			enabled.store(enable, std::memory_order_relaxed);
+		}
+
+		bool MIDDLEWARE_EXP Enabled()
+		{
+			return enabled.load(std::memory_order_relaxed);
+		}
+
+		void MIDDLEWARE_EXP Clear()
+		{
+			TheOrigin();
+			clearedAt.store(Timestamp(), std::memory_order_relaxed);
+		}
+
+		void MIDDLEWARE_EXP Collect(std::vector<Event>& events)
+		{
+			//how fast the time stamp counter has run since the first event
+			const Origin& origin = TheOrigin();
+			uint64_t ticks = Timestamp() - origin.ticks;
+			uint64_t ns = SteadyNs() - origin.ns;
+			double nsPerTick = ticks > 0 && ns > 0 ? (double)ns / (double)ticks : 1.0;
+
+			uint64_t since = clearedAt.load(std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock(ringsLock);
+			for (const Ring* ring : rings)
+			{
+				Read(*ring, since, nsPerTick, events);
+			}
+		}
+
+		size_t MIDDLEWARE_EXP Rings()
+		{
+			std::lock_guard<std::mutex> lock(ringsLock);
+			return rings.size();
+		}
+
+		void MIDDLEWARE_EXP WriteChromeTrace(std::ostream& out)
+		{
+			std::vector<Event> events;
+			Collect(events);
+
+			out << "{\"traceEvents\":[";
+			const char* separator = "\n";
+			for (const Event& event : events)
+			{
+				//callbacks are spans, everything else an instant
+				const char* phase = event.point == CALLBACK_START ? "B" : event.point == CALLBACK_END ? "E" : "i";
+				const char* name = event.point == CALLBACK_START || event.point == CALLBACK_END ? "callback" : PointName(event.point);
+				out << separator << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+					<< "\",\"pid\":1,\"tid\":" << event.thread
+					<< ",\"ts\":" << event.time / 1000 << "." << (char)('0' + event.time / 100 % 10) << (char)('0' + event.time / 10 % 10) << (char)('0' + event.time % 10);
+				if (*phase == 'i')
+				{
+					out << ",\"s\":\"t\"";
+				}
+				if (event.point != CALLBACK_END)
+				{
+					out << ",\"args\":{\"arg\":" << event.arg << "}";
+				}
+				out << "}";
+				separator = ",\n";
+			}
+			out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+		}
+
+		MIDDLEWARE_EXP const char* PointName(Point point)
+		{
+			switch (point)
+			{
+			case RECV: return "recv";
+			case FRAME_COMPLETE: return "frame complete";
+			case PARSE_COMPLETE: return "parse complete";
+			case CALLBACK_START: return "callback start";
+			case CALLBACK_END: return "callback end";
+			case SEND_ENQUEUE: return "send enqueue";
+			case SEND_FLUSH: return "send flush";
+			default: return "unknown";
+			}
+		}
+	}
+}
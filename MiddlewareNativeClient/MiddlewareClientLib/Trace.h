@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <ostream>
+#include <vector>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//an in memory trace of where messages are on their way from the socket to
+	//the callbacks and back. Each thread writes timestamped events into a
+	//ring of its own with no locks, so a trace point costs a few nanoseconds
+	//and can be left on in production. The rings keep the latest
+	//RING_EVENTS events of each thread, and of a finished thread until its
+	//ring is taken over by a new one, and are read on demand, e.g. written
+	//as a Chrome trace (chrome://tracing, ui.perfetto.dev) when a message was
+	//late. Build without MIDDLEWARE_TRACING to compile the trace points out.
+	namespace Trace
+	{
+		enum Point
+		{
+			RECV,			//bytes read from the socket, arg is the count
+			FRAME_COMPLETE,	//a whole message reassembled, arg is its size
+			PARSE_COMPLETE,	//a message decoded, arg is its MessageType
+			CALLBACK_START,	//the callbacks for a message, arg is its MessageType
+			CALLBACK_END,
+			SEND_ENQUEUE,	//a message handed to the session to send, arg is its size
+			SEND_FLUSH,		//queued frames written to the socket, arg is the bytes
+			POINTS
+		};
+
+		static const size_t RING_EVENTS = 8192;
+
+		struct Event
+		{
+			//the thread's trace id, 1 for the first thread to record
+			uint32_t thread;
+			Point point;
+			//nanoseconds since the first event of the process
+			uint64_t time;
+			uint64_t arg;
+		};
+
+		//record an event on the calling thread's ring, arg is kept to 56 bits
+		void MIDDLEWARE_EXP Record(Point point, uint64_t arg);
+
+		//events are recorded unless disabled, which costs a load per point
+		void MIDDLEWARE_EXP Enable(bool enabled);
+		bool MIDDLEWARE_EXP Enabled();
+		//leave out the events recorded so far from what is collected later
+		void MIDDLEWARE_EXP Clear();
+
+		//the events in every thread's ring, thread by thread and oldest first
+		//within a thread. Events that may be being overwritten as they are
+		//read are left out, so at most RING_EVENTS - 1 of each thread's.
+		void MIDDLEWARE_EXP Collect(std::vector<Event>& events);
+		//the rings allocated so far, at most one per thread recording at once
+		size_t MIDDLEWARE_EXP Rings();
+		//the collected events in the Chrome trace event format
+		void MIDDLEWARE_EXP WriteChromeTrace(std::ostream& out);
+		MIDDLEWARE_EXP const char* PointName(Point point);
+
+		//records CALLBACK_START and, when it goes out of scope, CALLBACK_END
+		class CallbackScope
+		{
+		public:
+			explicit CallbackScope(uint64_t arg) { Record(CALLBACK_START, arg); }
+			~CallbackScope() { Record(CALLBACK_END, 0); }
+		};
+	}
+}
+
+#ifdef MIDDLEWARE_TRACING
+#define MIDDLEWARE_TRACE(point, arg) ::MiddlewareLib::Trace::Record(::MiddlewareLib::Trace::point, (uint64_t)(arg))
+#define MIDDLEWARE_TRACE_CALLBACKS(arg) ::MiddlewareLib::Trace::CallbackScope traceCallbacks((uint64_t)(arg))
+#else
+#define MIDDLEWARE_TRACE(point, arg) ((void)0)
+#define MIDDLEWARE_TRACE_CALLBACKS(arg) ((void)0)
+#endif
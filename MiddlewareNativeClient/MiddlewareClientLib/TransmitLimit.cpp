@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "TransmitLimit.h"
+#include <chrono>
+
+namespace MiddlewareLib
+{
+	TransmitLimit::TransmitLimit(const TransmitBufferOptions& options) :
+		options_(options),
+		pending_(0),
+		buffered_(0),
+		full_(false),
+		rejected_(0),
+		dropped_(0),
+		waiting_(0)
+	{
+	}
+
+	SendStatus TransmitLimit::Reserve(ISession* session, size_t size, bool canWait)
+	{
+		if (Fits(size))
+		{
+			pending_ += size;
+			return SEND_OK;
+		}
+
+		Filled(session);
+		switch (options_.policy)
+		{
+		case OVERFLOW_DROP_NEWEST:
+			dropped_++;
+			return SEND_DROPPED;
+
+		case OVERFLOW_DROP_OLDEST:
+			//Take drops the older messages as the dispatcher reaches them
+			pending_ += size;
+			return SEND_OK;
+
+		case OVERFLOW_BLOCK:
+			if (canWait)
+			{
+				std::unique_lock<std::mutex> lock(lock_);
+				waiting_++;
+				bool fits = room_.wait_for(lock, std::chrono::milliseconds(options_.blockTimeoutMs),
+					[this, size] { return Fits(size); });
+				waiting_--;
+				if (fits)
+				{
+					pending_ += size;
+					return SEND_OK;
+				}
+				rejected_++;
+				return SEND_TIMED_OUT;
+			}
+			break;
+
+		default:
+			break;
+		}
+		rejected_++;
+		return SEND_WOULD_BLOCK;
+	}
+
+	bool TransmitLimit::Take(size_t size, bool canDrop)
+	{
+		pending_ -= size;
+		//everything reserved after this message still counts, so it goes if
+		//it does not fit in front of them
+		if (canDrop && options_.policy == OVERFLOW_DROP_OLDEST && !Fits(size))
+		{
+			dropped_++;
+			return false;
+		}
+		return true;
+	}
+
+	void TransmitLimit::Buffered(ISession* session, size_t bytes)
+	{
+		buffered_ = bytes;
+		//under the lock, so a sender cannot miss it between checking for room
+		//and starting to wait
+		if (waiting_ > 0)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			room_.notify_all();
+		}
+
+		if (full_ && Depth() <= options_.lowWatermark && full_.exchange(false))
+		{
+			if (options_.onWatermark != NULL)
+			{
+				options_.onWatermark(session, false, Depth());
+			}
+		}
+	}
+
+	//a message fits under the high watermark, or on its own however large.
+	//Senders on different threads may both see room and go over by a message.
+	bool TransmitLimit::Fits(size_t size) const
+	{
+		size_t depth = Depth();
+		return options_.highWatermark == 0 || depth == 0 || depth + size <= options_.highWatermark;
+	}
+
+	void TransmitLimit::Filled(ISession* session)
+	{
+		if (!full_.exchange(true) && options_.onWatermark != NULL)
+		{
+			options_.onWatermark(session, true, Depth());
+		}
+	}
+}
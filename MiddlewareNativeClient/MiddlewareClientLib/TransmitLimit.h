@@ -0,0 +1,59 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace MiddlewareLib
+{
+	//applies a session's TransmitBufferOptions. Counts the bytes sent but not
+	//yet taken by the dispatcher (pending) plus those it has framed but not
+	//yet written to the socket (buffered). Any thread may reserve room, the
+	//dispatcher thread takes messages and reports what is left buffered.
+	class MIDDLEWARE_EXP TransmitLimit
+	{
+	public:
+		explicit TransmitLimit(const TransmitBufferOptions& options);
+
+		//any thread. Make room for a message of size bytes. On SEND_OK the
+		//caller queues it and must Take it later. canWait is false on the
+		//dispatcher thread, which would never make room while waiting.
+		SendStatus Reserve(ISession* session, size_t size, bool canWait);
+
+		//dispatcher thread. A reserved message is being handed to the socket,
+		//false if it is to be dropped to make room for newer ones. canDrop is
+		//false for a message sent on the dispatcher thread, whose sender has
+		//already been told it was sent.
+		bool Take(size_t size, bool canDrop = true);
+
+		//dispatcher thread. The bytes not yet written to the socket, after
+		//each write. Wakes blocked senders and reports draining to the low
+		//watermark.
+		void Buffered(ISession* session, size_t bytes);
+
+		size_t Depth() const { return pending_ + buffered_; }
+		bool Full() const { return full_; }
+		const TransmitBufferOptions& Options() const { return options_; }
+		uint64_t Rejected() const { return rejected_; }
+		uint64_t Dropped() const { return dropped_; }
+
+	private:
+		bool Fits(size_t size) const;
+		void Filled(ISession* session);
+
+		TransmitLimit(const TransmitLimit&);
+		TransmitLimit& operator=(const TransmitLimit&);
+
+		TransmitBufferOptions options_;
+		std::atomic<size_t> pending_;
+		std::atomic<size_t> buffered_;
+		std::atomic<bool> full_;
+		std::atomic<uint64_t> rejected_;
+		std::atomic<uint64_t> dropped_;
+		//senders waiting for room under OVERFLOW_BLOCK
+		std::mutex lock_;
+		std::condition_variable room_;
+		std::atomic<unsigned int> waiting_;
+	};
+}
@@ -0,0 +1,96 @@
+#include "stdafx.h"
+#include "WorkerPool.h"
+
+namespace MiddlewareLib
+{
+	WorkerPool::WorkerPool(unsigned int threads)
+	{
+		if (threads == 0)
+		{
+			threads = 1;
+		}
+
+		for (unsigned int i = 0; i < threads; i++)
+		{
+			workers_.emplace_back(new Worker());
+			workers_.back()->stopping = false;
+		}
+
+		//start the threads once the vector no longer moves
+		for (auto& worker : workers_)
+		{
+			Worker* w = worker.get();
+			w->thread = std::thread([this, w]() { Run(*w); });
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		Stop();
+	}
+
+	void WorkerPool::Post(size_t key, FRAME_CALLBACK_FUNC handler, ISession* session, const char* data, size_t size)
+	{
+		Worker& worker = *workers_[key % workers_.size()];
+		bool wasEmpty;
+		{
+			std::lock_guard<std::mutex> lock(worker.lock);
+			if (worker.stopping)
+			{
+				return;
+			}
+			wasEmpty = worker.items.empty();
+			worker.items.push_back(Item{ handler, session, std::string(data, size) });
+		}
+
+		//the worker only sleeps once it has taken everything, so a non empty
+		//queue means it is awake already
+		if (wasEmpty)
+		{
+			worker.ready.notify_one();
+		}
+	}
+
+	void WorkerPool::Stop()
+	{
+		for (auto& worker : workers_)
+		{
+			{
+				std::lock_guard<std::mutex> lock(worker->lock);
+				worker->stopping = true;
+			}
+			worker->ready.notify_one();
+		}
+
+		for (auto& worker : workers_)
+		{
+			if (worker->thread.joinable())
+			{
+				worker->thread.join();
+			}
+		}
+	}
+
+	void WorkerPool::Run(Worker& worker)
+	{
+		std::vector<Item> batch;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(worker.lock);
+				worker.ready.wait(lock, [&worker] { return !worker.items.empty() || worker.stopping; });
+				if (worker.items.empty())
+				{
+					return;
+				}
+				batch.swap(worker.items);
+			}
+
+			for (auto& item : batch)
+			{
+				item.handler(item.session, &item.frame[0], item.frame.size());
+			}
+			batch.clear();
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//threads that take received frames off the dispatcher thread. A frame is
+	//queued to the worker chosen by its key, so frames with the same key are
+	//handled in the order they were posted while different keys run in parallel.
+	class MIDDLEWARE_EXP WorkerPool
+	{
+	public:
+		explicit WorkerPool(unsigned int threads);
+		//stops the pool, see Stop
+		~WorkerPool();
+
+		//copy the frame and queue it for the worker that owns key. handler is
+		//called on that worker with a private copy it may modify. Frames posted
+		//after Stop are dropped.
+		void Post(size_t key, FRAME_CALLBACK_FUNC handler, ISession* session, const char* data, size_t size);
+
+		//handle everything already queued, then end the threads. Not to be
+		//called from a handler.
+		void Stop();
+
+		unsigned int Size() const { return (unsigned int)workers_.size(); }
+
+	private:
+		struct Item
+		{
+			FRAME_CALLBACK_FUNC handler;
+			ISession* session;
+			std::string frame;
+		};
+
+		struct Worker
+		{
+			std::mutex lock;
+			std::condition_variable ready;
+			std::vector<Item> items;
+			bool stopping;
+			std::thread thread;
+		};
+
+		void Run(Worker& worker);
+
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		std::vector<std::unique_ptr<Worker>> workers_;
+	};
+}
@@ -27,6 +27,7 @@
     #ifndef snprintf
         #define snprintf _snprintf_s
     #endif
+    #define strncasecmp _strnicmp
     #if _MSC_VER >=1600
         // vs2010 or later
         #include <stdint.h>
@@ -41,16 +42,24 @@
     #define socketerrno WSAGetLastError()
     #define SOCKET_EAGAIN_EINPROGRESS WSAEINPROGRESS
     #define SOCKET_EWOULDBLOCK WSAEWOULDBLOCK
+    #define SOCKET_ECONNECTING WSAEWOULDBLOCK
+    #define SOCKET_EINTR WSAEINTR
+    #define SOCKET_SEND_FLAGS 0
+    typedef WSAPOLLFD pollfd_t;
+    #define socket_poll WSAPoll
 #else
     #include <fcntl.h>
     #include <netdb.h>
     #include <netinet/tcp.h>
+    #include <poll.h>
     #include <stdio.h>
     #include <stdlib.h>
     #include <string.h>
+    #include <strings.h>
     #include <sys/socket.h>
     #include <sys/time.h>
     #include <sys/types.h>
+    #include <sys/uio.h>
     #include <unistd.h>
     #include <stdint.h>
     #ifndef _SOCKET_T_DEFINED
@@ -68,24 +77,238 @@
     #define socketerrno errno
     #define SOCKET_EAGAIN_EINPROGRESS EAGAIN
     #define SOCKET_EWOULDBLOCK EWOULDBLOCK
+    #define SOCKET_ECONNECTING EINPROGRESS
+    #define SOCKET_EINTR EINTR
+    typedef struct pollfd pollfd_t;
+    #define socket_poll ::poll
+    #ifdef MSG_NOSIGNAL
+        #define SOCKET_SEND_FLAGS MSG_NOSIGNAL // report EPIPE instead of raising SIGPIPE
+    #else
+        #define SOCKET_SEND_FLAGS 0
+    #endif
 #endif
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <vector>
 #include <string>
 
 #include "easywsclient.hpp"
+#include "Handshake.h"
+#include "Masking.h"
+#include "Trace.h"
+#include "MiddlewareClientLib.h"
+#include "PerMessageDeflate.h"
+#include "ReceiveBuffer.h"
+#include "SendQueue.h"
 
 using easywsclient::Callback_Imp;
 using easywsclient::BytesCallback_Imp;
+using easywsclient::FrameCallback_Imp;
+using MiddlewareLib::ReceiveBuffer;
+using MiddlewareLib::Masking::KeyGenerator;
+using MiddlewareLib::PerMessageDeflate;
+using MiddlewareLib::SendQueue;
 
 namespace { // private module-only namespace
 
-socket_t hostname_connect(const std::string& hostname, int port) {
+const int MAX_SEND_SEGMENTS = 1024; // header and payload of 512 frames per send, IOV_MAX on Linux
+const size_t MAX_HANDSHAKE_RESPONSE = 8192;
+
+typedef std::chrono::steady_clock Clock;
+
+// Write as much of the front of the queue as the socket takes in a single
+// gathered send, up to maxSegments segments and maxBytes bytes. offered is
+// set to the bytes handed to the socket.
+// Returns the number of bytes written, or -1 with socketerrno set.
+ssize_t send_queued(socket_t sockfd, const SendQueue& queue, int maxSegments, size_t maxBytes, size_t& offered) {
+    SendQueue::Segment segments[MAX_SEND_SEGMENTS];
+    int count = queue.Gather(segments, maxSegments < MAX_SEND_SEGMENTS ? maxSegments : MAX_SEND_SEGMENTS, maxBytes);
+    offered = 0;
+    for (int i = 0; i < count; ++i) { offered += segments[i].size; }
+#ifdef _WIN32
+    WSABUF buffers[MAX_SEND_SEGMENTS];
+    for (int i = 0; i < count; ++i) {
+        buffers[i].buf = (CHAR*)segments[i].data;
+        buffers[i].len = (ULONG)segments[i].size;
+    }
+    DWORD sent = 0;
+    if (WSASend(sockfd, buffers, (DWORD)count, &sent, 0, NULL, NULL) == SOCKET_ERROR) { return -1; }
+    return (ssize_t)sent;
+#else
+    struct iovec buffers[MAX_SEND_SEGMENTS];
+    for (int i = 0; i < count; ++i) {
+        buffers[i].iov_base = (void*)segments[i].data;
+        buffers[i].iov_len = segments[i].size;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = count;
+    return sendmsg(sockfd, &msg, SOCKET_SEND_FLAGS);
+#endif
+}
+
+uint64_t micros_between(Clock::time_point from, Clock::time_point to) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+// Milliseconds until due, rounded up so a wait does not end early. 0 once it has passed.
+int millis_until(Clock::time_point due) {
+    Clock::time_point now = Clock::now();
+    if (due <= now) { return 0; }
+    return (int)((micros_between(now, due) + 999) / 1000);
+}
+
+uint64_t nanos_of(Clock::time_point time) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+// The counters behind MiddlewareLib::TransportStats. Only the thread that
+// polls a connection sends and receives on it, so they are bumped with a
+// load and a store rather than a locked add. Any thread may read them, the
+// fields of a TCP_INFO sample may then mix with those of the next.
+struct TransportCounters {
+    typedef std::atomic<uint64_t> Counter;
+    static const size_t OPCODES = MiddlewareLib::TransportStats::OPCODES;
+
+    Counter framesIn[OPCODES];
+    Counter bytesIn[OPCODES];
+    Counter framesOut[OPCODES];
+    Counter bytesOut[OPCODES];
+    Counter recvCalls;
+    Counter recvBytes;
+    Counter sendCalls;
+    Counter sendBytes;
+    Counter partialWrites;
+    Counter rxbufHighWater;
+    Counter txbufHighWater;
+    std::atomic<int> closeError;
+    Counter pingsSent;
+    Counter pongsReceived;
+    Counter lastPingNanos;
+    Counter minPingNanos;
+    Counter maxPingNanos;
+    Counter tcpInfoSamples;
+    Counter tcpInfoSampledAt; // nanos_of the sample
+    std::atomic<uint32_t> tcpInfo[8]; // in TransportStats order, rttMicros to totalRetrans
+
+    TransportCounters() {
+        for (size_t i = 0; i < OPCODES; ++i) { framesIn[i] = 0; bytesIn[i] = 0; framesOut[i] = 0; bytesOut[i] = 0; }
+        for (size_t i = 0; i < 8; ++i) { tcpInfo[i] = 0; }
+        recvCalls = 0; recvBytes = 0; sendCalls = 0; sendBytes = 0; partialWrites = 0;
+        rxbufHighWater = 0; txbufHighWater = 0; closeError = 0;
+        pingsSent = 0; pongsReceived = 0; lastPingNanos = 0; minPingNanos = 0; maxPingNanos = 0;
+        tcpInfoSamples = 0; tcpInfoSampledAt = 0;
+    }
+
+    static void add(Counter& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static void raise(Counter& counter, uint64_t n) {
+        if (n > counter.load(std::memory_order_relaxed)) { counter.store(n, std::memory_order_relaxed); }
+    }
+
+    void frame(Counter* frames, Counter* bytes, int opcode, uint64_t size) {
+        add(frames[opcode & 0x0f], 1);
+        add(bytes[opcode & 0x0f], size);
+    }
+
+    void pong(uint64_t nanos) {
+        add(pongsReceived, 1);
+        lastPingNanos.store(nanos, std::memory_order_relaxed);
+        uint64_t min = minPingNanos.load(std::memory_order_relaxed);
+        if (min == 0 || nanos < min) { minPingNanos.store(nanos, std::memory_order_relaxed); }
+        raise(maxPingNanos, nanos);
+    }
+
+    void copy(MiddlewareLib::TransportStats& stats) const {
+        for (size_t i = 0; i < OPCODES; ++i) {
+            stats.framesIn[i] = framesIn[i].load(std::memory_order_relaxed);
+            stats.bytesIn[i] = bytesIn[i].load(std::memory_order_relaxed);
+            stats.framesOut[i] = framesOut[i].load(std::memory_order_relaxed);
+            stats.bytesOut[i] = bytesOut[i].load(std::memory_order_relaxed);
+        }
+        stats.recvCalls = recvCalls.load(std::memory_order_relaxed);
+        stats.recvBytes = recvBytes.load(std::memory_order_relaxed);
+        stats.sendCalls = sendCalls.load(std::memory_order_relaxed);
+        stats.sendBytes = sendBytes.load(std::memory_order_relaxed);
+        stats.partialWrites = partialWrites.load(std::memory_order_relaxed);
+        stats.rxbufHighWater = rxbufHighWater.load(std::memory_order_relaxed);
+        stats.txbufHighWater = txbufHighWater.load(std::memory_order_relaxed);
+        stats.closeError = closeError.load(std::memory_order_relaxed);
+        stats.pingsSent = pingsSent.load(std::memory_order_relaxed);
+        stats.pongsReceived = pongsReceived.load(std::memory_order_relaxed);
+        stats.lastPingMicros = lastPingNanos.load(std::memory_order_relaxed) / 1000;
+        stats.minPingMicros = minPingNanos.load(std::memory_order_relaxed) / 1000;
+        stats.maxPingMicros = maxPingNanos.load(std::memory_order_relaxed) / 1000;
+        stats.tcpInfoSamples = tcpInfoSamples.load(std::memory_order_relaxed);
+        if (stats.tcpInfoSamples > 0) {
+            uint64_t now = nanos_of(Clock::now());
+            uint64_t sampledAt = tcpInfoSampledAt.load(std::memory_order_relaxed);
+            stats.tcpInfoAgeMicros = now > sampledAt ? (now - sampledAt) / 1000 : 0;
+        }
+        stats.rttMicros = tcpInfo[0].load(std::memory_order_relaxed);
+        stats.rttVarMicros = tcpInfo[1].load(std::memory_order_relaxed);
+        stats.sndCwnd = tcpInfo[2].load(std::memory_order_relaxed);
+        stats.sndMss = tcpInfo[3].load(std::memory_order_relaxed);
+        stats.unacked = tcpInfo[4].load(std::memory_order_relaxed);
+        stats.lost = tcpInfo[5].load(std::memory_order_relaxed);
+        stats.retransmits = tcpInfo[6].load(std::memory_order_relaxed);
+        stats.totalRetrans = tcpInfo[7].load(std::memory_order_relaxed);
+    }
+};
+
+bool set_nonblocking(socket_t sockfd) {
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket(sockfd, FIONBIO, &on) == 0;
+#else
+    return fcntl(sockfd, F_SETFL, O_NONBLOCK) == 0;
+#endif
+}
+
+// Wait until the socket is ready for events or deadline passes.
+bool wait_socket(socket_t sockfd, short events, Clock::time_point deadline) {
+    while (true) {
+        pollfd_t fd;
+        fd.fd = sockfd;
+        fd.events = events;
+        fd.revents = 0;
+        int ret = socket_poll(&fd, 1, millis_until(deadline));
+        if (ret > 0) { return true; }
+        if (ret == 0 || socketerrno != SOCKET_EINTR) { return false; }
+    }
+}
+
+// Order addresses for happy eyeballs (RFC 8305 section 4): alternate the
+// address families, starting with the resolver's first choice.
+std::vector<struct addrinfo*> interleave_families(struct addrinfo* result) {
+    std::vector<struct addrinfo*> preferred;
+    std::vector<struct addrinfo*> others;
+    for (struct addrinfo* p = result; p != NULL; p = p->ai_next) {
+        (p->ai_family == result->ai_family ? preferred : others).push_back(p);
+    }
+    std::vector<struct addrinfo*> order;
+    for (size_t i = 0; i < preferred.size() || i < others.size(); ++i) {
+        if (i < preferred.size()) { order.push_back(preferred[i]); }
+        if (i < others.size()) { order.push_back(others[i]); }
+    }
+    return order;
+}
+
+// Connect to whichever of the host's addresses accepts first. A new attempt
+// starts every attemptDelay, or as soon as one fails, while the earlier ones
+// carry on, so a dead address costs attemptDelay rather than its full timeout.
+// The socket returned is non-blocking, but the caller blocks here until one
+// connects or the deadline passes, and in getaddrinfo before that.
+socket_t hostname_connect(const std::string& hostname, int port, Clock::time_point deadline, std::chrono::milliseconds attemptDelay, MiddlewareLib::ConnectTimings& timings) {
+    Clock::time_point start = Clock::now();
     struct addrinfo hints;
     struct addrinfo *result;
-    struct addrinfo *p;
     int ret;
-    socket_t sockfd = INVALID_SOCKET;
     char sport[16];
     memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
@@ -94,35 +317,157 @@ socket_t hostname_connect(const std::string& hostname, int port) {
     if ((ret = getaddrinfo(hostname.c_str(), sport, &hints, &result)) != 0)
     {
       fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(ret));
-      return 1;
+      return INVALID_SOCKET;
     }
-    for(p = result; p != NULL; p = p->ai_next)
-    {
-        sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (sockfd == INVALID_SOCKET) { continue; }
-        if (connect(sockfd, p->ai_addr, p->ai_addrlen) != SOCKET_ERROR) {
-            break;
+    Clock::time_point resolved = Clock::now();
+    timings.resolveMicros = micros_between(start, resolved);
+    std::vector<struct addrinfo*> order = interleave_families(result);
+    timings.addresses = (unsigned int)order.size();
+
+    socket_t sockfd = INVALID_SOCKET;
+    std::vector<pollfd_t> attempts;
+    size_t next = 0;
+    Clock::time_point nextAttempt = resolved;
+    while (sockfd == INVALID_SOCKET) {
+        Clock::time_point now = Clock::now();
+        if (now >= deadline) { break; }
+        if (next < order.size() && (now >= nextAttempt || attempts.empty())) {
+            struct addrinfo* p = order[next++];
+            socket_t fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if (fd == INVALID_SOCKET) { continue; }
+            timings.attempts++;
+            if (!set_nonblocking(fd)) { closesocket(fd); continue; }
+            if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) { sockfd = fd; break; }
+            if (socketerrno != SOCKET_ECONNECTING) { closesocket(fd); continue; }
+            pollfd_t attempt;
+            attempt.fd = fd;
+            attempt.events = POLLOUT;
+            attempt.revents = 0;
+            attempts.push_back(attempt);
+            nextAttempt = now + attemptDelay;
+            continue;
+        }
+        if (attempts.empty()) { break; } // every address refused straight away
+
+        Clock::time_point wake = next < order.size() && nextAttempt < deadline ? nextAttempt : deadline;
+        ret = socket_poll(&attempts[0], (unsigned int)attempts.size(), millis_until(wake));
+        if (ret < 0 && socketerrno != SOCKET_EINTR) { break; }
+        for (size_t i = 0; ret > 0 && i < attempts.size(); ) {
+            if (attempts[i].revents == 0) { ++i; continue; }
+            socket_t fd = attempts[i].fd;
+            bool writable = (attempts[i].revents & POLLOUT) != 0;
+            attempts.erase(attempts.begin() + i);
+            int error = 0;
+            socklen_t size = sizeof(error);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&error, &size);
+            if (false) { }
+            else if (error == 0 && writable && sockfd == INVALID_SOCKET) {
+                sockfd = fd;
+            }
+            else {
+                closesocket(fd);
+                nextAttempt = Clock::now(); // a failure starts the next attempt straight away
+            }
         }
-        closesocket(sockfd);
-        sockfd = INVALID_SOCKET;
+    }
+    for (size_t i = 0; i < attempts.size(); ++i) {
+        closesocket(attempts[i].fd);
     }
     freeaddrinfo(result);
+    timings.connectMicros = micros_between(resolved, Clock::now());
     return sockfd;
 }
 
+// Send all of data on a non-blocking socket before deadline.
+bool send_all(socket_t sockfd, const std::string& data, Clock::time_point deadline) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t ret = ::send(sockfd, data.data() + sent, (int)(data.size() - sent), SOCKET_SEND_FLAGS);
+        if (false) { }
+        else if (ret > 0) {
+            sent += (size_t)ret;
+        }
+        else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS) && wait_socket(sockfd, POLLOUT, deadline)) {
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read the response to the upgrade request up to the blank line that ends its
+// headers, before deadline. Any frames the server sent straight after it are
+// left in extra.
+bool read_response(socket_t sockfd, std::string& response, std::string& extra, Clock::time_point deadline) {
+    char buf[4096];
+    while (true) {
+        size_t end = response.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            extra.assign(response, end + 4, std::string::npos);
+            response.resize(end + 4);
+            return true;
+        }
+        if (response.size() > MAX_HANDSHAKE_RESPONSE) { return false; }
+        ssize_t ret = recv(sockfd, buf, sizeof(buf), 0);
+        if (false) { }
+        else if (ret > 0) {
+            response.append(buf, (size_t)ret);
+        }
+        else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS) && wait_socket(sockfd, POLLIN, deadline)) {
+        }
+        else {
+            return false;
+        }
+    }
+}
+
+// Value of the named response header, name in lower case. Repeated headers
+// are joined with commas as they form one list. Empty if it is missing.
+std::string response_header(const std::string& response, const char* name) {
+    std::string value;
+    size_t nameSize = strlen(name);
+    size_t line = response.find("\r\n");
+    while (line != std::string::npos) {
+        size_t begin = line + 2;
+        line = response.find("\r\n", begin);
+        if (line == std::string::npos || line == begin) { break; }
+        if (line - begin > nameSize && response[begin + nameSize] == ':' && strncasecmp(response.c_str() + begin, name, nameSize) == 0) {
+            size_t first = response.find_first_not_of(' ', begin + nameSize + 1);
+            size_t last = response.find_last_not_of(' ', line - 1);
+            if (first >= line || last < first) { continue; }
+            if (!value.empty()) { value += ", "; }
+            value.append(response, first, last - first + 1);
+        }
+    }
+    return value;
+}
+
 
 class _DummyWebSocket : public easywsclient::WebSocket
 {
   public:
     void poll(int timeout) { }
     void send(const std::string& message) { }
+    void send(std::string&& message) { }
     void sendBinary(const std::string& message) { }
     void sendBinary(const std::vector<uint8_t>& message) { }
+    void sendBinary(std::string&& message) { }
     void sendPing() { }
     void close() { } 
     readyStateValues getReadyState() const { return CLOSED; }
+    intptr_t getSocket() const { return -1; }
+    size_t getBufferedAmount() const { return 0; }
+    std::string getProtocol() const { return std::string(); }
+    bool getDeflateStats(MiddlewareLib::DeflateStats& stats) const { return false; }
+    void flush() { }
+    void setBatchLimits(unsigned int maxFrames, size_t maxBytes) { }
+    bool getSendStats(MiddlewareLib::SendStats& stats) const { return false; }
+    bool getTransportStats(MiddlewareLib::TransportStats& stats) const { return false; }
+    bool getConnectTimings(MiddlewareLib::ConnectTimings& timings) const { return false; }
     void _dispatch(Callback_Imp & callable) { }
     void _dispatchBinary(BytesCallback_Imp& callable) { }
+    void _dispatchFrame(FrameCallback_Imp& callable) { }
 };
 
 
@@ -152,6 +497,7 @@ class _RealWebSocket : public easywsclient::WebSocket
     struct wsheader_type {
         unsigned header_size;
         bool fin;
+        bool rsv1; // set on the first frame of a compressed message
         bool mask;
         enum opcode_type {
             CONTINUATION = 0x0,
@@ -166,21 +512,85 @@ class _RealWebSocket : public easywsclient::WebSocket
         uint8_t masking_key[4];
     };
 
-    std::vector<uint8_t> rxbuf;
-    std::vector<uint8_t> txbuf;
+    ReceiveBuffer rxbuf;
+    SendQueue txqueue;
+    KeyGenerator keys;
     std::vector<uint8_t> receivedData;
 
     socket_t sockfd;
     readyStateValues readyState;
     bool useMask;
+    std::string protocol;
+    std::unique_ptr<PerMessageDeflate> deflater; // NULL unless permessage-deflate was negotiated
+    bool compressedMessage; // the message being received was compressed
+    std::string inflated; // the last compressed message received, inflated
+    int maxSendSegments; // header and payload segments per write
+    size_t maxSendBytes;
+    // written by the thread that sends, read by any
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> framesWritten;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> largestBatch;
+    TransportCounters counters;
+    uint64_t firstPing; // nanos_of the first ping sent, pongs echoing an earlier time are not ours
+    Clock::time_point nextTcpInfo;
+
+    MiddlewareLib::ConnectTimings connectTimings;
 
-    _RealWebSocket(socket_t sockfd, bool useMask) : sockfd(sockfd), readyState(OPEN), useMask(useMask) {
+    // received: bytes read with the handshake response that belong to the first frames
+    _RealWebSocket(socket_t sockfd, bool useMask, size_t receiveBufferSize, const std::string& protocol, std::unique_ptr<PerMessageDeflate>&& deflater, const std::string& received) : rxbuf(receiveBufferSize), sockfd(sockfd), readyState(OPEN), useMask(useMask), protocol(protocol), deflater(std::move(deflater)), compressedMessage(false), maxSendSegments(128), maxSendBytes(256 * 1024), writes(0), framesWritten(0), bytesWritten(0), largestBatch(0), firstPing(0) {
+        if (!received.empty()) {
+            rxbuf.Reserve(received.size());
+            memcpy(rxbuf.WritePtr(), received.data(), received.size());
+            rxbuf.Commit(received.size());
+        }
     }
 
     readyStateValues getReadyState() const {
       return readyState;
     }
 
+    intptr_t getSocket() const {
+      return (intptr_t)sockfd;
+    }
+
+    size_t getBufferedAmount() const {
+      return txqueue.Size();
+    }
+
+    std::string getProtocol() const {
+      return protocol;
+    }
+
+    bool getDeflateStats(MiddlewareLib::DeflateStats& stats) const {
+      if (!deflater) { return false; }
+      deflater->GetStats(stats);
+      return true;
+    }
+
+    void setBatchLimits(unsigned int maxFrames, size_t maxBytes) {
+      maxSendSegments = 2 * (int)(maxFrames < 1 ? 1 : maxFrames > MAX_SEND_SEGMENTS / 2 ? MAX_SEND_SEGMENTS / 2 : maxFrames);
+      maxSendBytes = maxBytes > 0 ? maxBytes : 1;
+    }
+
+    bool getConnectTimings(MiddlewareLib::ConnectTimings& timings) const {
+      timings = connectTimings;
+      return true;
+    }
+
+    bool getTransportStats(MiddlewareLib::TransportStats& stats) const {
+      counters.copy(stats);
+      return true;
+    }
+
+    bool getSendStats(MiddlewareLib::SendStats& stats) const {
+      stats.writes = writes.load(std::memory_order_relaxed);
+      stats.messages = framesWritten.load(std::memory_order_relaxed);
+      stats.bytes = bytesWritten.load(std::memory_order_relaxed);
+      stats.largestBatch = largestBatch.load(std::memory_order_relaxed);
+      return true;
+    }
+
     void poll(int timeout) { // timeout in milliseconds
         if (readyState == CLOSED) {
             if (timeout > 0) {
@@ -196,48 +606,76 @@ class _RealWebSocket : public easywsclient::WebSocket
             FD_ZERO(&rfds);
             FD_ZERO(&wfds);
             FD_SET(sockfd, &rfds);
-            if (txbuf.size()) { FD_SET(sockfd, &wfds); }
+            if (!txqueue.Empty()) { FD_SET(sockfd, &wfds); }
             select(sockfd + 1, &rfds, &wfds, 0, timeout > 0 ? &tv : 0);
         }
+#if defined(__linux__) && defined(TCP_INFO)
+        Clock::time_point now = Clock::now();
+        if (now >= nextTcpInfo) {
+            sampleTcpInfo(now);
+            nextTcpInfo = now + std::chrono::milliseconds(MiddlewareLib::TransportStats::TCP_INFO_INTERVAL_MS);
+        }
+#endif
         while (true) {
             // FD_ISSET(0, &rfds) will be true
-            int N = rxbuf.size();
-            ssize_t ret;
-            rxbuf.resize(N + 1500);
-            ret = recv(sockfd, (char*)&rxbuf[0] + N, 1500, 0);
+            // Read as much as fits. Once the buffer is full the rest stays in the
+            // socket until the buffered frames have been dispatched.
+            char* buf = rxbuf.WritePtr();
+            size_t available = rxbuf.Writable();
+            if (available == 0) { break; }
+            ssize_t ret = recv(sockfd, buf, (int)available, 0);
             if (false) { }
             else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS)) {
-                rxbuf.resize(N);
                 break;
             }
             else if (ret <= 0) {
-                rxbuf.resize(N);
+                if (ret < 0) { counters.closeError.store(socketerrno, std::memory_order_relaxed); }
                 closesocket(sockfd);
                 readyState = CLOSED;
                 fputs(ret < 0 ? "Connection error!\n" : "Connection closed!\n", stderr);
                 break;
             }
             else {
-                rxbuf.resize(N + ret);
+                rxbuf.Commit((size_t)ret);
+                MIDDLEWARE_TRACE(RECV, ret);
+                TransportCounters::add(counters.recvCalls, 1);
+                TransportCounters::add(counters.recvBytes, (uint64_t)ret);
+                TransportCounters::raise(counters.rxbufHighWater, rxbuf.Size());
+                if ((size_t)ret < available) { break; } // drained the socket
             }
         }
-        while (txbuf.size()) {
-            int ret = ::send(sockfd, (char*)&txbuf[0], txbuf.size(), 0);
+        flush();
+    }
+
+    void flush() {
+        if (readyState == CLOSED) { return; }
+        while (!txqueue.Empty()) {
+            size_t offered;
+            ssize_t ret = send_queued(sockfd, txqueue, maxSendSegments, maxSendBytes, offered);
             if (false) { } // ??
             else if (ret < 0 && (socketerrno == SOCKET_EWOULDBLOCK || socketerrno == SOCKET_EAGAIN_EINPROGRESS)) {
                 break;
             }
             else if (ret <= 0) {
+                if (ret < 0) { counters.closeError.store(socketerrno, std::memory_order_relaxed); }
                 closesocket(sockfd);
                 readyState = CLOSED;
                 fputs(ret < 0 ? "Connection error!\n" : "Connection closed!\n", stderr);
                 break;
             }
             else {
-                txbuf.erase(txbuf.begin(), txbuf.begin() + ret);
+                uint64_t frames = txqueue.Advance((size_t)ret);
+                MIDDLEWARE_TRACE(SEND_FLUSH, ret);
+                writes.fetch_add(1, std::memory_order_relaxed);
+                framesWritten.fetch_add(frames, std::memory_order_relaxed);
+                bytesWritten.fetch_add((uint64_t)ret, std::memory_order_relaxed);
+                if (frames > largestBatch.load(std::memory_order_relaxed)) { largestBatch.store(frames, std::memory_order_relaxed); }
+                TransportCounters::add(counters.sendCalls, 1);
+                TransportCounters::add(counters.sendBytes, (uint64_t)ret);
+                if ((size_t)ret < offered) { TransportCounters::add(counters.partialWrites, 1); }
             }
         }
-        if (!txbuf.size() && readyState == CLOSING) {
+        if (txqueue.Empty() && readyState == CLOSING) {
             closesocket(sockfd);
             readyState = CLOSED;
         }
@@ -249,32 +687,49 @@ class _RealWebSocket : public easywsclient::WebSocket
     //template<class Callable>
     //void dispatch(Callable callable)
     virtual void _dispatch(Callback_Imp & callable) {
-        struct CallbackAdapter : public BytesCallback_Imp
-            // Adapt void(const std::string<uint8_t>&) to void(const std::string&)
+        struct CallbackAdapter : public FrameCallback_Imp
+            // Adapt void(char*, size_t) to void(const std::string&)
         {
             Callback_Imp& callable;
             CallbackAdapter(Callback_Imp& callable) : callable(callable) { }
-            void operator()(const std::vector<uint8_t>& message) {
-                std::string stringMessage(message.begin(), message.end());
+            void operator()(char* data, size_t size) {
+                std::string stringMessage(data, size);
                 callable(stringMessage);
             }
         };
-        CallbackAdapter bytesCallback(callable);
-        _dispatchBinary(bytesCallback);
+        CallbackAdapter frameCallback(callable);
+        _dispatchFrame(frameCallback);
     }
 
     virtual void _dispatchBinary(BytesCallback_Imp & callable) {
+        struct CallbackAdapter : public FrameCallback_Imp
+            // Adapt void(char*, size_t) to void(const std::vector<uint8_t>&)
+        {
+            BytesCallback_Imp& callable;
+            CallbackAdapter(BytesCallback_Imp& callable) : callable(callable) { }
+            void operator()(char* data, size_t size) {
+                std::vector<uint8_t> message(data, data + size);
+                callable(message);
+            }
+        };
+        CallbackAdapter frameCallback(callable);
+        _dispatchFrame(frameCallback);
+    }
+
+    virtual void _dispatchFrame(FrameCallback_Imp & callable) {
         // TODO: consider acquiring a lock on rxbuf...
         while (true) {
             wsheader_type ws;
-            if (rxbuf.size() < 2) { return; /* Need at least 2 */ }
-            const uint8_t * data = (uint8_t *) &rxbuf[0]; // peek, but don't consume
+            size_t size = rxbuf.Size();
+            if (size < 2) { return; /* Need at least 2 */ }
+            uint8_t * data = (uint8_t *) rxbuf.Data(); // peek, but don't consume
             ws.fin = (data[0] & 0x80) == 0x80;
+            ws.rsv1 = (data[0] & 0x40) == 0x40;
             ws.opcode = (wsheader_type::opcode_type) (data[0] & 0x0f);
             ws.mask = (data[1] & 0x80) == 0x80;
             ws.N0 = (data[1] & 0x7f);
             ws.header_size = 2 + (ws.N0 == 126? 2 : 0) + (ws.N0 == 127? 8 : 0) + (ws.mask? 4 : 0);
-            if (rxbuf.size() < ws.header_size) { return; /* Need: ws.header_size - rxbuf.size() */ }
+            if (size < ws.header_size) { return; /* Need: ws.header_size - size */ }
             int i = 0;
             if (ws.N0 < 126) {
                 ws.N = ws.N0;
@@ -310,65 +765,139 @@ class _RealWebSocket : public easywsclient::WebSocket
                 ws.masking_key[2] = 0;
                 ws.masking_key[3] = 0;
             }
-            if (rxbuf.size() < ws.header_size+ws.N) { return; /* Need: ws.header_size+ws.N - rxbuf.size() */ }
+            if (size < ws.header_size+ws.N) {
+                // make sure the rest of the frame fits behind what we have
+                rxbuf.Reserve(ws.header_size+(size_t)ws.N);
+                return;
+            }
+            uint8_t * payload = data + ws.header_size;
+            counters.frame(counters.framesIn, counters.bytesIn, ws.opcode, ws.N);
 
             // We got a whole message, now do something with it:
             if (false) { }
+            else if ((data[0] & 0x30) != 0 || (ws.rsv1 && (!deflater || (ws.opcode != wsheader_type::TEXT_FRAME && ws.opcode != wsheader_type::BINARY_FRAME)))) {
+                // RSV1 only means compressed on the first frame of a message, and
+                // only once permessage-deflate is negotiated
+                fprintf(stderr, "ERROR: Got WebSocket frame with unexpected RSV bits.\n");
+                close();
+            }
             else if (
                    ws.opcode == wsheader_type::TEXT_FRAME 
                 || ws.opcode == wsheader_type::BINARY_FRAME
                 || ws.opcode == wsheader_type::CONTINUATION
             ) {
-                if (ws.mask) { for (size_t i = 0; i != ws.N; ++i) { rxbuf[i+ws.header_size] ^= ws.masking_key[i&0x3]; } }
-                receivedData.insert(receivedData.end(), rxbuf.begin()+ws.header_size, rxbuf.begin()+ws.header_size+(size_t)ws.N);// just feed
-                if (ws.fin) {
-                    callable((const std::vector<uint8_t>) receivedData);
-                    receivedData.erase(receivedData.begin(), receivedData.end());
-                    std::vector<uint8_t> ().swap(receivedData);// free memory
+                if (ws.mask) { MiddlewareLib::Masking::Mask(payload, (size_t)ws.N, ws.masking_key); }
+                if (ws.opcode != wsheader_type::CONTINUATION) { compressedMessage = ws.rsv1; }
+                if (ws.fin && receivedData.empty()) {
+                    // unfragmented message, hand it over straight from rxbuf
+                    deliver(callable, (char*)payload, (size_t)ws.N);
+                }
+                else {
+                    receivedData.insert(receivedData.end(), payload, payload+(size_t)ws.N);// just feed
+                    if (ws.fin) {
+                        deliver(callable, (char*)receivedData.data(), receivedData.size());
+                        receivedData.erase(receivedData.begin(), receivedData.end());
+                        std::vector<uint8_t> ().swap(receivedData);// free memory
+                    }
                 }
             }
             else if (ws.opcode == wsheader_type::PING) {
-                if (ws.mask) { for (size_t i = 0; i != ws.N; ++i) { rxbuf[i+ws.header_size] ^= ws.masking_key[i&0x3]; } }
-                std::string data(rxbuf.begin()+ws.header_size, rxbuf.begin()+ws.header_size+(size_t)ws.N);
-                sendData(wsheader_type::PONG, data.size(), data.begin(), data.end());
+                if (ws.mask) { MiddlewareLib::Masking::Mask(payload, (size_t)ws.N, ws.masking_key); }
+                sendData(wsheader_type::PONG, std::string((char*)payload, (size_t)ws.N));
+            }
+            else if (ws.opcode == wsheader_type::PONG) {
+                if (ws.mask) { MiddlewareLib::Masking::Mask(payload, (size_t)ws.N, ws.masking_key); }
+                pong(payload, (size_t)ws.N);
             }
-            else if (ws.opcode == wsheader_type::PONG) { }
             else if (ws.opcode == wsheader_type::CLOSE) { close(); }
             else { fprintf(stderr, "ERROR: Got unexpected WebSocket message.\n"); close(); }
 
-            rxbuf.erase(rxbuf.begin(), rxbuf.begin() + ws.header_size+(size_t)ws.N);
+            rxbuf.Consume(ws.header_size+(size_t)ws.N);
         }
     }
 
+    // Hand a complete message to callable, inflating it first if it was compressed.
+    void deliver(FrameCallback_Imp & callable, char* data, size_t size) {
+        MIDDLEWARE_TRACE(FRAME_COMPLETE, size);
+        if (!compressedMessage) {
+            callable(data, size);
+        }
+        else if (deflater->Inflate(data, size, inflated)) {
+            callable(&inflated[0], inflated.size());
+        }
+        else {
+            fprintf(stderr, "ERROR: Got invalid compressed WebSocket message.\n");
+            close();
+        }
+    }
+
+    // The payload is the time the ping was sent, which the pong echoes back.
     void sendPing() {
-        std::string empty;
-        sendData(wsheader_type::PING, empty.size(), empty.begin(), empty.end());
+        uint64_t sent = nanos_of(Clock::now());
+        if (firstPing == 0) { firstPing = sent; }
+        TransportCounters::add(counters.pingsSent, 1);
+        sendData(wsheader_type::PING, std::string((const char*)&sent, sizeof(sent)));
+    }
+
+    // Record the round trip of a ping sent by sendPing. Unsolicited pongs are ignored.
+    void pong(const uint8_t* payload, size_t size) {
+        uint64_t sent;
+        if (size != sizeof(sent) || firstPing == 0) { return; }
+        memcpy(&sent, payload, sizeof(sent));
+        uint64_t now = nanos_of(Clock::now());
+        if (sent < firstPing || sent > now) { return; }
+        counters.pong(now - sent);
+    }
+
+#if defined(__linux__) && defined(TCP_INFO)
+    void sampleTcpInfo(Clock::time_point now) {
+        struct tcp_info info;
+        socklen_t size = sizeof(info);
+        if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &size) != 0) { return; }
+        const uint32_t fields[8] = { info.tcpi_rtt, info.tcpi_rttvar, info.tcpi_snd_cwnd, info.tcpi_snd_mss,
+            info.tcpi_unacked, info.tcpi_lost, info.tcpi_retransmits, info.tcpi_total_retrans };
+        for (size_t i = 0; i < 8; ++i) { counters.tcpInfo[i].store(fields[i], std::memory_order_relaxed); }
+        counters.tcpInfoSampledAt.store(nanos_of(now), std::memory_order_relaxed);
+        TransportCounters::add(counters.tcpInfoSamples, 1);
     }
+#endif
 
     void send(const std::string& message) {
-        sendData(wsheader_type::TEXT_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::TEXT_FRAME, std::string(message));
+    }
+
+    void send(std::string&& message) {
+        sendData(wsheader_type::TEXT_FRAME, std::move(message));
     }
 
     void sendBinary(const std::string& message) {
-        sendData(wsheader_type::BINARY_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::BINARY_FRAME, std::string(message));
     }
 
     void sendBinary(const std::vector<uint8_t>& message) {
-        sendData(wsheader_type::BINARY_FRAME, message.size(), message.begin(), message.end());
+        sendData(wsheader_type::BINARY_FRAME, std::string(message.begin(), message.end()));
+    }
+
+    void sendBinary(std::string&& message) {
+        sendData(wsheader_type::BINARY_FRAME, std::move(message));
     }
 
-    template<class Iterator>
-    void sendData(wsheader_type::opcode_type type, uint64_t message_size, Iterator message_begin, Iterator message_end) {
-        // TODO:
-        // Masking key should (must) be derived from a high quality random
-        // number generator, to mitigate attacks on non-WebSocket friendly
-        // middleware:
-        const uint8_t masking_key[4] = { 0x12, 0x34, 0x56, 0x78 };
-        // TODO: consider acquiring a lock on txbuf...
+    // Takes ownership of message, so it is masked in place and queued without
+    // another copy. Only the session's dispatcher thread calls this, other
+    // threads hand their frames to it through the session's MPSC queue, so
+    // txbuf and txqueue need no lock.
+    void sendData(wsheader_type::opcode_type type, std::string&& message) {
         if (readyState == CLOSING || readyState == CLOSED) { return; }
-        std::vector<uint8_t> header;
-        header.assign(2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) + (useMask ? 4 : 0), 0);
-        header[0] = 0x80 | type;
+        // A new key for every frame, as RFC 6455 requires, so that
+        // intermediaries can not predict the bytes on the wire
+        uint8_t masking_key[4];
+        if (useMask) { keys.Next(masking_key); }
+        // control frames are never compressed, data frames under the threshold are sent as they are
+        bool compressed = deflater && (type == wsheader_type::TEXT_FRAME || type == wsheader_type::BINARY_FRAME) && deflater->Deflate(message);
+        uint64_t message_size = message.size();
+        uint8_t header[SendQueue::MAX_HEADER_SIZE];
+        size_t header_size = 2 + (message_size >= 126 ? 2 : 0) + (message_size >= 65536 ? 6 : 0) + (useMask ? 4 : 0);
+        header[0] = 0x80 | (compressed ? 0x40 : 0) | type;
         if (false) { }
         else if (message_size < 126) {
             header[1] = (message_size & 0xff) | (useMask ? 0x80 : 0);
@@ -407,26 +936,46 @@ class _RealWebSocket : public easywsclient::WebSocket
                 header[13] = masking_key[3];
             }
         }
-        // N.B. - txbuf will keep growing until it can be transmitted over the socket:
-        txbuf.insert(txbuf.end(), header.begin(), header.end());
-        txbuf.insert(txbuf.end(), message_begin, message_end);
         if (useMask) {
-            for (size_t i = 0; i != message_size; ++i) { *(txbuf.end() - message_size + i) ^= masking_key[i&0x3]; }
+            MiddlewareLib::Masking::Mask((uint8_t*)&message[0], (size_t)message_size, masking_key);
         }
+        // N.B. - txqueue grows until it can be transmitted over the socket, the
+        // session bounds it with MiddlewareLib::TransmitBufferOptions:
+        txqueue.Push(header, header_size, std::move(message));
+        counters.frame(counters.framesOut, counters.bytesOut, type, message_size);
+        TransportCounters::raise(counters.txbufHighWater, txqueue.Size());
     }
 
     void close() {
         if(readyState == CLOSING || readyState == CLOSED) { return; }
         readyState = CLOSING;
         uint8_t closeFrame[6] = {0x88, 0x80, 0x00, 0x00, 0x00, 0x00}; // last 4 bytes are a masking key
-        std::vector<uint8_t> header(closeFrame, closeFrame+6);
-        txbuf.insert(txbuf.end(), header.begin(), header.end());
+        keys.Next(closeFrame + 2);
+        txqueue.Push(closeFrame, 6, std::string());
+        counters.frame(counters.framesOut, counters.bytesOut, wsheader_type::CLOSE, 0);
+        TransportCounters::raise(counters.txbufHighWater, txqueue.Size());
     }
 
 };
 
 
-easywsclient::WebSocket::pointer from_url(const std::string& url, bool useMask, const std::string& origin) {
+// true if the comma separated list contains protocol
+bool offered(const std::string& protocols, const std::string& protocol) {
+    size_t begin = 0;
+    while (begin < protocols.size()) {
+        size_t end = protocols.find(',', begin);
+        if (end == std::string::npos) { end = protocols.size(); }
+        size_t first = protocols.find_first_not_of(' ', begin);
+        size_t last = protocols.find_last_not_of(' ', end - 1);
+        if (first < end && last != std::string::npos && last >= first && protocols.compare(first, last - first + 1, protocol) == 0) {
+            return true;
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+easywsclient::WebSocket::pointer from_url(const std::string& url, bool useMask, const std::string& origin, size_t receiveBufferSize, const std::string& protocols, const MiddlewareLib::DeflateOptions* deflate, const MiddlewareLib::ConnectOptions* connect) {
     char host[128];
     int port;
     char path[128];
@@ -434,21 +983,18 @@ easywsclient::WebSocket::pointer from_url(const std::string& url, bool useMask,
       fprintf(stderr, "ERROR: url size limit exceeded: %s\n", url.c_str());
       return NULL;
     }
-    if (origin.size() >= 200) {
-      fprintf(stderr, "ERROR: origin size limit exceeded: %s\n", origin.c_str());
-      return NULL;
+    std::string extensions = deflate ? PerMessageDeflate::Offer(*deflate) : std::string();
+    // N.B. the url size check above keeps each field within its 128 byte buffer
+    if (false) { }
+    else if (sscanf(url.c_str(), "ws://%[^:/]:%d/%s", host, &port, path) == 3) {
     }
-    //if (false) { }
-	if (sscanf_s(url.c_str(), "ws://%[^:/]:%d", host, (unsigned)_countof(host), &port, sizeof(int)) == 2) {
-		path[0] = '\0';
-	}
-    else if (sscanf_s(url.c_str(), "ws://%[^:/]/%s", host, (unsigned)_countof(host), path, (unsigned)_countof(path)) == 2) {
+    else if (sscanf(url.c_str(), "ws://%[^:/]:%d", host, &port) == 2) {
+        path[0] = '\0';
+    }
+    else if (sscanf(url.c_str(), "ws://%[^:/]/%s", host, path) == 2) {
         port = 80;
     }
-	else if (sscanf_s(url.c_str(), "ws://%[^:/]:%d/%s", host, (unsigned)_countof(host), &port, sizeof(int), path, (unsigned)_countof(path)) == 3) {
-	}
-
-    else if (sscanf_s(url.c_str(), "ws://%[^:/]", host, (unsigned)_countof(host)) == 1) {
+    else if (sscanf(url.c_str(), "ws://%[^:/]", host) == 1) {
         port = 80;
         path[0] = '\0';
     }
@@ -456,52 +1002,85 @@ easywsclient::WebSocket::pointer from_url(const std::string& url, bool useMask,
         fprintf(stderr, "ERROR: Could not parse WebSocket url: %s\n", url.c_str());
         return NULL;
     }
+    MiddlewareLib::ConnectOptions defaults;
+    if (connect == NULL) { connect = &defaults; }
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::milliseconds(connect->timeoutMs);
+    MiddlewareLib::ConnectTimings timings;
     fprintf(stderr, "easywsclient: connecting: host=%s port=%d path=/%s\n", host, port, path);
-    socket_t sockfd = hostname_connect(host, port);
+    socket_t sockfd = hostname_connect(host, port, deadline, std::chrono::milliseconds(connect->attemptDelayMs), timings);
     if (sockfd == INVALID_SOCKET) {
         fprintf(stderr, "Unable to connect to %s:%d\n", host, port);
         return NULL;
     }
-    {
-        // XXX: this should be done non-blocking,
-        char line[256];
-        int status;
-        int i;
-        snprintf(line, 256, "GET /%s HTTP/1.1\r\n", path); ::send(sockfd, line, strlen(line), 0);
-        if (port == 80) {
-            snprintf(line, 256, "Host: %s\r\n", host); ::send(sockfd, line, strlen(line), 0);
-        }
-        else {
-            snprintf(line, 256, "Host: %s:%d\r\n", host, port); ::send(sockfd, line, strlen(line), 0);
-        }
-        snprintf(line, 256, "Upgrade: websocket\r\n"); ::send(sockfd, line, strlen(line), 0);
-        snprintf(line, 256, "Connection: Upgrade\r\n"); ::send(sockfd, line, strlen(line), 0);
-        if (!origin.empty()) {
-            snprintf(line, 256, "Origin: %s\r\n", origin.c_str()); ::send(sockfd, line, strlen(line), 0);
-        }
-        snprintf(line, 256, "Sec-WebSocket-Key: x3JJHMbDL1EzLkh9GBhXDw==\r\n"); ::send(sockfd, line, strlen(line), 0);
-        snprintf(line, 256, "Sec-WebSocket-Version: 13\r\n"); ::send(sockfd, line, strlen(line), 0);
-        snprintf(line, 256, "\r\n"); ::send(sockfd, line, strlen(line), 0);
-        for (i = 0; i < 2 || (i < 255 && line[i-2] != '\r' && line[i-1] != '\n'); ++i) { if (recv(sockfd, line+i, 1, 0) == 0) { return NULL; } }
-        line[i] = 0;
-        if (i == 255) { fprintf(stderr, "ERROR: Got invalid status line connecting to: %s\n", url.c_str()); return NULL; }
-        if (sscanf_s(line, "HTTP/1.1 %d", &status) != 1 || status != 101) { fprintf(stderr, "ERROR: Got bad status connecting to %s: %s", url.c_str(), line); return NULL; }
-        // TODO: verify response headers,
-        while (true) {
-            for (i = 0; i < 2 || (i < 255 && line[i-2] != '\r' && line[i-1] != '\n'); ++i) { if (recv(sockfd, line+i, 1, 0) == 0) { return NULL; } }
-            if (line[0] == '\r' && line[1] == '\n') { break; }
-        }
-    }
     int flag = 1;
     setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (char*) &flag, sizeof(flag)); // Disable Nagle's algorithm
-#ifdef _WIN32
-    u_long on = 1;
-    ioctlsocket(sockfd, FIONBIO, &on);
-#else
-    fcntl(sockfd, F_SETFL, O_NONBLOCK);
-#endif
+
+    // the whole upgrade request goes in one write
+    std::string key = MiddlewareLib::Handshake::CreateKey();
+    std::string request;
+    request.reserve(512);
+    request += "GET /";
+    request += path;
+    request += " HTTP/1.1\r\nHost: ";
+    request += host;
+    if (port != 80) {
+        request += ":" + std::to_string(port);
+    }
+    request += "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n";
+    if (!origin.empty()) {
+        request += "Origin: " + origin + "\r\n";
+    }
+    request += "Sec-WebSocket-Key: " + key + "\r\nSec-WebSocket-Version: 13\r\n";
+    if (!protocols.empty()) {
+        request += "Sec-WebSocket-Protocol: " + protocols + "\r\n";
+    }
+    if (!extensions.empty()) {
+        request += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+    }
+    request += "\r\n";
+
+    Clock::time_point handshakeStart = Clock::now();
+    std::string response;
+    std::string received;
+    if (!send_all(sockfd, request, deadline) || !read_response(sockfd, response, received, deadline)) {
+        fprintf(stderr, "ERROR: No handshake response connecting to %s\n", url.c_str());
+        closesocket(sockfd);
+        return NULL;
+    }
+    timings.handshakeMicros = micros_between(handshakeStart, Clock::now());
+    int status;
+    if (sscanf(response.c_str(), "HTTP/1.1 %d", &status) != 1 || status != 101) {
+        fprintf(stderr, "ERROR: Got bad status connecting to %s: %s\n", url.c_str(), response.substr(0, response.find("\r\n")).c_str());
+        closesocket(sockfd);
+        return NULL;
+    }
+    // proves the server read our request rather than replaying an old response
+    if (response_header(response, "sec-websocket-accept") != MiddlewareLib::Handshake::Accept(key)) {
+        fprintf(stderr, "ERROR: Server did not accept the upgrade request to %s\n", url.c_str());
+        closesocket(sockfd);
+        return NULL;
+    }
+    // the server may only select a protocol that was offered
+    std::string protocol = response_header(response, "sec-websocket-protocol");
+    if (!protocol.empty() && !offered(protocols, protocol)) {
+        fprintf(stderr, "ERROR: Server selected a protocol that was not offered: %s\n", protocol.c_str());
+        closesocket(sockfd);
+        return NULL;
+    }
+    // the server may only accept the extensions that were offered
+    std::string extensionsResponse = response_header(response, "sec-websocket-extensions");
+    std::unique_ptr<PerMessageDeflate> deflater;
+    if (!PerMessageDeflate::Accept(deflate ? *deflate : MiddlewareLib::DeflateOptions(), extensionsResponse, deflater)) {
+        fprintf(stderr, "ERROR: Server responded with unexpected extensions: %s\n", extensionsResponse.c_str());
+        closesocket(sockfd);
+        return NULL;
+    }
+    timings.totalMicros = micros_between(start, Clock::now());
     fprintf(stderr, "Connected to: %s\n", url.c_str());
-    return easywsclient::WebSocket::pointer(new _RealWebSocket(sockfd, useMask));
+    _RealWebSocket* ws = new _RealWebSocket(sockfd, useMask, receiveBufferSize, protocol, std::move(deflater), received);
+    ws->connectTimings = timings;
+    return easywsclient::WebSocket::pointer(ws);
 }
 
 } // end of module-only namespace
@@ -516,12 +1095,12 @@ WebSocket::pointer WebSocket::create_dummy() {
 }
 
 
-WebSocket::pointer WebSocket::from_url(const std::string& url, const std::string& origin) {
-    return ::from_url(url, true, origin);
+WebSocket::pointer WebSocket::from_url(const std::string& url, const std::string& origin, size_t receiveBufferSize, const std::string& protocols, const MiddlewareLib::DeflateOptions* deflate, const MiddlewareLib::ConnectOptions* connect) {
+    return ::from_url(url, true, origin, receiveBufferSize, protocols, deflate, connect);
 }
 
-WebSocket::pointer WebSocket::from_url_no_mask(const std::string& url, const std::string& origin) {
-    return ::from_url(url, false, origin);
+WebSocket::pointer WebSocket::from_url_no_mask(const std::string& url, const std::string& origin, size_t receiveBufferSize, const std::string& protocols, const MiddlewareLib::DeflateOptions* deflate, const MiddlewareLib::ConnectOptions* connect) {
+    return ::from_url(url, false, origin, receiveBufferSize, protocols, deflate, connect);
 }
 
 
@@ -10,11 +10,22 @@
 
 #include <string>
 #include <vector>
+#include <stdint.h>
+
+namespace MiddlewareLib {
+struct DeflateOptions;
+struct DeflateStats;
+struct SendStats;
+struct ConnectOptions;
+struct ConnectTimings;
+struct TransportStats;
+}
 
 namespace easywsclient {
 
 struct Callback_Imp { virtual void operator()(const std::string& message) = 0; };
 struct BytesCallback_Imp { virtual void operator()(const std::vector<uint8_t>& message) = 0; };
+struct FrameCallback_Imp { virtual void operator()(char* data, size_t size) = 0; };
 
 class WebSocket {
   public:
@@ -23,18 +34,36 @@ class WebSocket {
 
     // Factories:
     static pointer create_dummy();
-    static pointer from_url(const std::string& url, const std::string& origin = std::string());
-    static pointer from_url_no_mask(const std::string& url, const std::string& origin = std::string());
+    // from_url connects synchronously: it resolves the host, connects and
+    // completes the upgrade handshake on the calling thread, and returns
+    // once the socket is open or has failed, within connect->timeoutMs.
+    // receiveBufferSize: bytes read from the socket ahead of dispatch, 0 for the default
+    // protocols: comma separated subprotocols to offer, the server may select one
+    // deflate: offer permessage-deflate with these settings, NULL not to
+    // connect: deadline and happy eyeballs delay, NULL for the defaults
+    static pointer from_url(const std::string& url, const std::string& origin = std::string(), size_t receiveBufferSize = 0, const std::string& protocols = std::string(), const MiddlewareLib::DeflateOptions* deflate = NULL, const MiddlewareLib::ConnectOptions* connect = NULL);
+    static pointer from_url_no_mask(const std::string& url, const std::string& origin = std::string(), size_t receiveBufferSize = 0, const std::string& protocols = std::string(), const MiddlewareLib::DeflateOptions* deflate = NULL, const MiddlewareLib::ConnectOptions* connect = NULL);
 
     // Interfaces:
     virtual ~WebSocket() { }
     virtual void poll(int timeout = 0) = 0; // timeout in milliseconds
     virtual void send(const std::string& message) = 0;
+    virtual void send(std::string&& message) = 0; // takes the message rather than copying it
     virtual void sendBinary(const std::string& message) = 0;
     virtual void sendBinary(const std::vector<uint8_t>& message) = 0;
+    virtual void sendBinary(std::string&& message) = 0; // takes the message rather than copying it
     virtual void sendPing() = 0;
     virtual void close() = 0;
     virtual readyStateValues getReadyState() const = 0;
+    virtual intptr_t getSocket() const = 0; // for registering with an external event loop
+    virtual size_t getBufferedAmount() const = 0; // bytes queued but not yet written to the socket
+    virtual std::string getProtocol() const = 0; // subprotocol selected by the server, empty if none
+    virtual bool getDeflateStats(MiddlewareLib::DeflateStats& stats) const = 0; // false if permessage-deflate was not negotiated
+    virtual void flush() = 0; // write queued frames without waiting for poll, for callers that batch sends
+    virtual void setBatchLimits(unsigned int maxFrames, size_t maxBytes) = 0; // most frames and bytes per socket write
+    virtual bool getSendStats(MiddlewareLib::SendStats& stats) const = 0;
+    virtual bool getConnectTimings(MiddlewareLib::ConnectTimings& timings) const = 0;
+    virtual bool getTransportStats(MiddlewareLib::TransportStats& stats) const = 0; // any thread may read them
 
     template<class Callable>
     void dispatch(Callable callable, void* context)
@@ -56,17 +85,34 @@ class WebSocket {
     { // N.B. this is compatible with both C++11 lambdas, functors and C function pointers
         struct _Callback : public BytesCallback_Imp {
             Callable& callable;
+            void* _context;
             _Callback(Callable& callable, void* context) : callable(callable), _context(context) { }
             void operator()(const std::vector<uint8_t>& message) { callable(message, _context); }
         };
         _Callback callback(callable, context);
-		void* _context;
         _dispatchBinary(callback);
     }
 
+    template<class Callable>
+    void dispatchFrame(Callable callable, void* context)
+        // For callbacks that accept a (char* data, size_t size) argument pair.
+        // data points into the receive buffer, so no copy is made of unfragmented
+        // messages. It may be modified but is only valid during the callback.
+    {
+        struct _Callback : public FrameCallback_Imp {
+            Callable& callable;
+            void* _context;
+            _Callback(Callable& callable, void* context) : callable(callable), _context(context) { }
+            void operator()(char* data, size_t size) { callable(data, size, _context); }
+        };
+        _Callback callback(callable, context);
+        _dispatchFrame(callback);
+    }
+
   protected:
     virtual void _dispatch(Callback_Imp& callable) = 0;
     virtual void _dispatchBinary(BytesCallback_Imp& callable) = 0;
+    virtual void _dispatchFrame(FrameCallback_Imp& callable) = 0;
 };
 
 } // namespace easywsclient
@@ -0,0 +1,193 @@
+#include <benchmark/benchmark.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <sstream>
+#include "MiddlewareClientLib.h"
+#include "BinaryCodec.h"
+#include "MessageCodec.h"
+
+namespace pt = boost::property_tree;
+
+namespace
+{
+	//the property_tree implementation the codec replaced, kept as the baseline
+	MiddlewareLib::Message PropertyTreeFromJSON(const std::string& data)
+	{
+		MiddlewareLib::Message msg;
+		pt::ptree tree;
+
+		std::istringstream in(data);
+		pt::read_json(in, tree);
+		msg.type_ = (MiddlewareLib::MessageType)tree.get<int>("Type");
+		msg.requestId_ = tree.get<std::string>("RequestId");
+		msg.command_ = tree.get<std::string>("Command");
+		msg.channel_ = tree.get<std::string>("Channel");
+		msg.destinationId_ = tree.get<std::string>("DestinationId");
+		msg.sourceId_ = tree.get<std::string>("SourceId");
+		msg.payload_ = tree.get<std::string>("Payload");
+		return msg;
+	}
+
+	std::string PropertyTreeToJSON(const MiddlewareLib::Message& msg)
+	{
+		pt::ptree tree;
+		tree.put("Type", (int)msg.type_);
+		tree.put("RequestId", msg.requestId_);
+		tree.put("Command", msg.command_);
+		tree.put("Channel", msg.channel_);
+		tree.put("SourceId", msg.sourceId_);
+		tree.put("DestinationId", msg.destinationId_);
+		tree.put("Payload", msg.payload_);
+
+		std::ostringstream out;
+		pt::write_json(out, tree);
+		return out.str();
+	}
+
+	//a JSON payload nested in the message, as our channels carry
+	MiddlewareLib::Message CreateMessage(size_t payloadSize)
+	{
+		MiddlewareLib::Message msg;
+		msg.type_ = MiddlewareLib::UPDATE;
+		msg.requestId_ = "7d7e3b3c-2a5e-4c8e-9a6d-0b1f2e3d4c5b";
+		msg.command_ = "PUBLISHMESSAGE";
+		msg.channel_ = "MarketData.EURUSD";
+		msg.sourceId_ = "d9811f62-e737-4e79-a2b3-e39219b681ec";
+		msg.destinationId_ = "6bbafd6e-1141-4b58-bbc4-9c65a6baa412";
+		while (msg.payload_.size() < payloadSize)
+		{
+			msg.payload_ += "{\"bid\":1.17345,\"ask\":1.17352,\"src\":\"feed\"},";
+		}
+		msg.payload_.resize(payloadSize);
+		return msg;
+	}
+
+	void BM_PropertyTreeToJSON(benchmark::State& state)
+	{
+		MiddlewareLib::Message msg = CreateMessage((size_t)state.range(0));
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(PropertyTreeToJSON(msg));
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_CodecEncode(benchmark::State& state)
+	{
+		MiddlewareLib::Message msg = CreateMessage((size_t)state.range(0));
+		std::string out;
+		for (auto _ : state)
+		{
+			MiddlewareLib::MessageCodec::Encode(msg, out);
+			benchmark::DoNotOptimize(out.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_PropertyTreeFromJSON(benchmark::State& state)
+	{
+		std::string data = PropertyTreeToJSON(CreateMessage((size_t)state.range(0)));
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(PropertyTreeFromJSON(data));
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_CodecDecode(benchmark::State& state)
+	{
+		std::string data;
+		MiddlewareLib::MessageCodec::Encode(CreateMessage((size_t)state.range(0)), data);
+		MiddlewareLib::Message msg;
+		for (auto _ : state)
+		{
+			MiddlewareLib::MessageCodec::Decode(data.data(), data.size(), msg);
+			benchmark::DoNotOptimize(msg.payload_.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	//payload without escapes, so decoding a view leaves the frame untouched and
+	//the same frame can be decoded repeatedly
+	std::string CreatePlainFrame(size_t payloadSize)
+	{
+		MiddlewareLib::Message msg = CreateMessage(0);
+		msg.payload_.assign(payloadSize, 'x');
+		std::string data;
+		MiddlewareLib::MessageCodec::Encode(msg, data);
+		return data;
+	}
+
+	void BM_CodecDecodePlain(benchmark::State& state)
+	{
+		std::string data = CreatePlainFrame((size_t)state.range(0));
+		MiddlewareLib::Message msg;
+		for (auto _ : state)
+		{
+			MiddlewareLib::MessageCodec::Decode(data.data(), data.size(), msg);
+			benchmark::DoNotOptimize(msg.payload_.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_CodecDecodeViewPlain(benchmark::State& state)
+	{
+		std::string data = CreatePlainFrame((size_t)state.range(0));
+		MiddlewareLib::MessageView view;
+		for (auto _ : state)
+		{
+			MiddlewareLib::MessageCodec::DecodeView(&data[0], data.size(), view);
+			benchmark::DoNotOptimize(view.payload_.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	//the binary envelope with the same nested JSON payload, carried unescaped
+	void BM_BinaryEncode(benchmark::State& state)
+	{
+		MiddlewareLib::Message msg = CreateMessage((size_t)state.range(0));
+		std::string out;
+		for (auto _ : state)
+		{
+			MiddlewareLib::BinaryCodec::Encode(msg, out);
+			benchmark::DoNotOptimize(out.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_BinaryDecode(benchmark::State& state)
+	{
+		std::string data;
+		MiddlewareLib::BinaryCodec::Encode(CreateMessage((size_t)state.range(0)), data);
+		MiddlewareLib::Message msg;
+		for (auto _ : state)
+		{
+			MiddlewareLib::BinaryCodec::Decode(data.data(), data.size(), msg);
+			benchmark::DoNotOptimize(msg.payload_.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_BinaryDecodeView(benchmark::State& state)
+	{
+		std::string data;
+		MiddlewareLib::BinaryCodec::Encode(CreateMessage((size_t)state.range(0)), data);
+		MiddlewareLib::MessageView view;
+		for (auto _ : state)
+		{
+			MiddlewareLib::BinaryCodec::DecodeView(data.data(), data.size(), view);
+			benchmark::DoNotOptimize(view.payload_.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+}
+
+BENCHMARK(BM_PropertyTreeToJSON)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_CodecEncode)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_PropertyTreeFromJSON)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_CodecDecode)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_CodecDecodePlain)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_CodecDecodeViewPlain)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_BinaryEncode)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_BinaryDecode)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_BinaryDecodeView)->Arg(64)->Arg(1024)->Arg(16384);
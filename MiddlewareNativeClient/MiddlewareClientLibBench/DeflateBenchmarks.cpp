@@ -0,0 +1,104 @@
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include "MiddlewareClientLib.h"
+#include "MessageCodec.h"
+#include "PerMessageDeflate.h"
+
+namespace
+{
+	//encoded updates carrying quotes that change from one message to the next,
+	//so each message is like but not the same as the one before
+	std::vector<std::string> CreateFrames(size_t payloadSize)
+	{
+		std::vector<std::string> frames;
+		for (int i = 0; i < 64; i++)
+		{
+			MiddlewareLib::Message msg;
+			msg.type_ = MiddlewareLib::UPDATE;
+			msg.requestId_ = "7d7e3b3c-2a5e-4c8e-9a6d-" + std::to_string(100000000000 + i);
+			msg.command_ = "PUBLISHMESSAGE";
+			msg.channel_ = "MarketData.EURUSD";
+			msg.sourceId_ = "d9811f62-e737-4e79-a2b3-e39219b681ec";
+			msg.destinationId_ = "";
+			unsigned int seed = 2463534242u + i;
+			while (msg.payload_.size() < payloadSize)
+			{
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+				msg.payload_ += "{\"bid\":1.17" + std::to_string(seed % 1000) + ",\"ask\":1.17" + std::to_string((seed >> 10) % 1000) + "},";
+			}
+			msg.payload_.resize(payloadSize);
+			std::string frame;
+			MiddlewareLib::MessageCodec::Encode(msg, frame);
+			frames.push_back(frame);
+		}
+		return frames;
+	}
+
+	void ReportStats(benchmark::State& state, const MiddlewareLib::PerMessageDeflate& deflate, bool inflating)
+	{
+		MiddlewareLib::DeflateStats stats;
+		deflate.GetStats(stats);
+		state.counters["ratio"] = inflating ? stats.InflateRatio() : stats.DeflateRatio();
+		state.counters["cpu_ns_per_msg"] = inflating ? stats.InflateNanosPerMessage() : stats.DeflateNanosPerMessage();
+	}
+
+	//args: payload size, context takeover
+	void BM_Deflate(benchmark::State& state)
+	{
+		if (!MiddlewareLib::PerMessageDeflate::Available())
+		{
+			state.SkipWithError("built without zlib");
+			return;
+		}
+		std::vector<std::string> frames = CreateFrames((size_t)state.range(0));
+		MiddlewareLib::PerMessageDeflate deflate(6, 15, state.range(1) != 0, 15, true, 0);
+		std::string message;
+		size_t bytes = 0;
+		size_t i = 0;
+		for (auto _ : state)
+		{
+			message = frames[i++ % frames.size()];
+			bytes += message.size();
+			deflate.Deflate(message);
+			benchmark::DoNotOptimize(message.data());
+		}
+		state.SetBytesProcessed((int64_t)bytes);
+		ReportStats(state, deflate, false);
+	}
+
+	void BM_Inflate(benchmark::State& state)
+	{
+		if (!MiddlewareLib::PerMessageDeflate::Available())
+		{
+			state.SkipWithError("built without zlib");
+			return;
+		}
+		//compress one pass over the frames, then inflate them over and over.
+		//Without context takeover every message inflates on its own, so the
+		//compressed frames can be replayed in any order.
+		std::vector<std::string> frames = CreateFrames((size_t)state.range(0));
+		MiddlewareLib::PerMessageDeflate deflate(6, 15, false, 15, false, 0);
+		for (std::string& frame : frames)
+		{
+			deflate.Deflate(frame);
+		}
+		std::string message;
+		size_t bytes = 0;
+		size_t i = 0;
+		for (auto _ : state)
+		{
+			const std::string& frame = frames[i++ % frames.size()];
+			deflate.Inflate(frame.data(), frame.size(), message);
+			bytes += message.size();
+			benchmark::DoNotOptimize(message.data());
+		}
+		state.SetBytesProcessed((int64_t)bytes);
+		ReportStats(state, deflate, true);
+	}
+}
+
+BENCHMARK(BM_Deflate)->ArgsProduct({ { 256, 1024, 16384 }, { 0, 1 } });
+BENCHMARK(BM_Inflate)->Arg(256)->Arg(1024)->Arg(16384);
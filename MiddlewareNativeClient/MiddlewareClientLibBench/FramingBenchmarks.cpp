@@ -0,0 +1,239 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "easywsclient.hpp"
+#include "Handshake.h"
+
+using easywsclient::WebSocket;
+
+namespace
+{
+	//the far end of one WebSocket over loopback. It answers the upgrade and
+	//then either discards what it reads or writes what the benchmark gives it.
+	class LoopbackServer
+	{
+	public:
+		explicit LoopbackServer(bool discard) : discard_(discard), fd_(-1)
+		{
+			listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t size = sizeof(addr);
+			bind(listenFd_, (sockaddr*)&addr, sizeof(addr));
+			listen(listenFd_, 1);
+			getsockname(listenFd_, (sockaddr*)&addr, &size);
+			port_ = ntohs(addr.sin_port);
+			thread_ = std::thread([this]() { Serve(); });
+		}
+
+		~LoopbackServer()
+		{
+			::shutdown(listenFd_, SHUT_RDWR);
+			if (fd_ >= 0)
+			{
+				::shutdown(fd_, SHUT_RDWR);
+			}
+			thread_.join();
+			::close(fd_);
+			::close(listenFd_);
+		}
+
+		std::string Url() const
+		{
+			return "ws://127.0.0.1:" + std::to_string(port_);
+		}
+
+		//once connected, blocks until data is in the socket
+		void Write(const std::string& data)
+		{
+			size_t sent = 0;
+			while (sent < data.size())
+			{
+				ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0)
+				{
+					return;
+				}
+				sent += (size_t)n;
+			}
+		}
+
+	private:
+		void Serve()
+		{
+			int fd = ::accept(listenFd_, NULL, NULL);
+			if (fd < 0)
+			{
+				return;
+			}
+			int buffer = 4 * 1024 * 1024;
+			setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+			std::string request;
+			char data[64 * 1024];
+			ssize_t n;
+			while (request.find("\r\n\r\n") == std::string::npos && (n = ::recv(fd, data, sizeof(data), 0)) > 0)
+			{
+				request.append(data, (size_t)n);
+			}
+			const std::string name("Sec-WebSocket-Key: ");
+			size_t begin = request.find(name) + name.size();
+			std::string key = request.substr(begin, request.find("\r\n", begin) - begin);
+			std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " +
+				MiddlewareLib::Handshake::Accept(key) + "\r\n\r\n";
+			::send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+			fd_ = fd;
+
+			while (discard_ && ::recv(fd, data, sizeof(data), 0) > 0) {}
+		}
+
+		bool discard_;
+		int listenFd_;
+		int port_;
+		std::atomic<int> fd_;
+		std::thread thread_;
+	};
+
+	std::string CreatePayload(size_t size)
+	{
+		std::string payload;
+		while (payload.size() < size)
+		{
+			payload += "{\"bid\":1.17345,\"ask\":1.17352,\"src\":\"feed\"},";
+		}
+		payload.resize(size);
+		return payload;
+	}
+
+	//sendData: framing range(0) bytes of payload and, with range(1), masking
+	//it with a new key per frame. The frames are written to the socket outside
+	//the timing, so this is the cost of queueing a message on the dispatcher.
+	//Writing takes far longer than queueing, hence the manual timing and the
+	//fixed number of iterations.
+	void BM_SendFraming(benchmark::State& state)
+	{
+		const int batch = (int)std::min((int64_t)256, std::max((int64_t)1, (256 * 1024) / state.range(0)));
+		LoopbackServer server(true);
+		std::unique_ptr<WebSocket> ws(state.range(1) != 0 ?
+			WebSocket::from_url(server.Url()) : WebSocket::from_url_no_mask(server.Url()));
+		if (!ws)
+		{
+			state.SkipWithError("unable to connect");
+			return;
+		}
+
+		std::string payload = CreatePayload((size_t)state.range(0));
+		std::vector<std::string> messages(batch);
+		for (auto _ : state)
+		{
+			for (auto& message : messages)
+			{
+				message = payload;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			for (auto& message : messages)
+			{
+				ws->send(std::move(message));
+			}
+			state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+			while (ws->getBufferedAmount() > 0 && ws->getReadyState() == WebSocket::OPEN)
+			{
+				ws->poll(1);
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * batch);
+		state.SetBytesProcessed(state.iterations() * batch * state.range(0));
+	}
+
+	//_dispatchFrame: reading and parsing a backlog of unmasked frames of
+	//range(0) bytes, the backlog already waiting in the socket. It is kept
+	//small enough to fit in the loopback socket buffers.
+	void BM_DispatchFrames(benchmark::State& state)
+	{
+		size_t size = (size_t)state.range(0);
+		size_t frames = std::max((size_t)1, (size_t)(64 * 1024) / size);
+		std::string frame;
+		frame.push_back((char)0x81);
+		if (size < 126)
+		{
+			frame.push_back((char)size);
+		}
+		else if (size < 65536)
+		{
+			frame.push_back((char)126);
+			frame.push_back((char)(size >> 8));
+			frame.push_back((char)size);
+		}
+		else
+		{
+			frame.push_back((char)127);
+			for (int shift = 56; shift >= 0; shift -= 8)
+			{
+				frame.push_back((char)((uint64_t)size >> shift));
+			}
+		}
+		frame += CreatePayload(size);
+		std::string backlog;
+		for (size_t i = 0; i < frames; i++)
+		{
+			backlog += frame;
+		}
+
+		LoopbackServer server(false);
+		std::unique_ptr<WebSocket> ws(WebSocket::from_url(server.Url(), std::string(), backlog.size()));
+		if (!ws)
+		{
+			state.SkipWithError("unable to connect");
+			return;
+		}
+		int fd = (int)ws->getSocket();
+		int buffer = 4 * 1024 * 1024;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+		size_t dispatched = 0;
+		auto count = [&dispatched](char* data, size_t size, void*)
+		{
+			benchmark::DoNotOptimize(data);
+			dispatched++;
+		};
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			server.Write(backlog);
+			//whatever has not arrived in time is read in the timing
+			int waiting = 0;
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+			while (ioctl(fd, FIONREAD, &waiting) == 0 && (size_t)waiting < backlog.size() &&
+				std::chrono::steady_clock::now() < deadline)
+			{
+				std::this_thread::yield();
+			}
+			dispatched = 0;
+			state.ResumeTiming();
+
+			while (dispatched < frames && ws->getReadyState() == WebSocket::OPEN)
+			{
+				ws->poll();
+				ws->dispatchFrame(count, NULL);
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * frames);
+		state.SetBytesProcessed(state.iterations() * backlog.size());
+	}
+}
+
+BENCHMARK(BM_SendFraming)->ArgsProduct({ { 64, 1024, 16384, 65536 }, { 0, 1 } })->UseManualTime()->Iterations(2000);
+BENCHMARK(BM_DispatchFrames)->Arg(64)->Arg(1024)->Arg(16384)->Arg(65536);
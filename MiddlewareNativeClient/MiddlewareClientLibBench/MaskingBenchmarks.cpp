@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "Masking.h"
+
+namespace
+{
+	const uint8_t Key[4] = { 0xA5, 0x3C, 0x0F, 0x81 };
+
+	template<void(*Kernel)(uint8_t*, size_t, const uint8_t*)>
+	void BM_Mask(benchmark::State& state)
+	{
+		std::vector<uint8_t> data((size_t)state.range(0), 'x');
+		for (auto _ : state)
+		{
+			Kernel(&data[0], data.size(), Key);
+			benchmark::DoNotOptimize(data.data());
+		}
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_MaskAVX2(benchmark::State& state)
+	{
+		if (!MiddlewareLib::Masking::HasAVX2())
+		{
+			state.SkipWithError("AVX2 not supported");
+			return;
+		}
+		BM_Mask<MiddlewareLib::Masking::MaskAVX2>(state);
+	}
+
+	void BM_MaskKey(benchmark::State& state)
+	{
+		MiddlewareLib::Masking::KeyGenerator keys;
+		uint8_t key[4];
+		for (auto _ : state)
+		{
+			keys.Next(key);
+			benchmark::DoNotOptimize(key);
+		}
+	}
+}
+
+BENCHMARK_TEMPLATE(BM_Mask, MiddlewareLib::Masking::MaskScalar)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(BM_Mask, MiddlewareLib::Masking::MaskWord)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(BM_Mask, MiddlewareLib::Masking::MaskSSE2)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_MaskAVX2)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK_TEMPLATE(BM_Mask, MiddlewareLib::Masking::Mask)->Arg(64)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_MaskKey);
@@ -0,0 +1,210 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MiddlewareClientLib.h"
+#include "RequestFuture.h"
+#include "StandInPeer.h"
+
+namespace
+{
+	std::atomic<int64_t> g_responses(0);
+
+	void OnResponse(MiddlewareLib::ISession*, const std::string&)
+	{
+		g_responses++;
+	}
+
+	//a nested JSON payload as our channels carry
+	std::string CreatePayload(size_t size)
+	{
+		std::string payload;
+		while (payload.size() < size)
+		{
+			payload += "{\"bid\":1.17345,\"ask\":1.17352,\"src\":\"feed\"},";
+		}
+		payload.resize(size);
+		return payload;
+	}
+
+	//requests to a stand in peer over loopback, range(0) bytes of payload and
+	//range(1) selecting the binary envelope. Each iteration sends a batch of
+	//requests and waits for all the responses.
+	void BM_PeerRoundTrip(benchmark::State& state)
+	{
+		const int batch = 256;
+		bool binary = state.range(1) != 0;
+		MiddlewareLib::StandInPeer peer;
+		if (!peer.Start())
+		{
+			state.SkipWithError("unable to start the stand in peer");
+			return;
+		}
+
+		MiddlewareLib::SessionOptions options;
+		options.binaryMessages = binary;
+		MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+		MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(pool, peer.Url().c_str(), options);
+		MiddlewareLib::StartDispatching(session);
+
+		std::string payload = CreatePayload((size_t)state.range(0));
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD", OnResponse, OnResponse, 0, NULL };
+		g_responses = 0;
+		int64_t expected = 0;
+		for (auto _ : state)
+		{
+			for (int i = 0; i < batch; i++)
+			{
+				MiddlewareLib::SendRequest(session, params, payload);
+			}
+			expected += batch;
+			while (g_responses < expected)
+			{
+				std::this_thread::yield();
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * batch);
+		state.SetBytesProcessed(state.iterations() * batch * state.range(0));
+
+		MiddlewareLib::DestroySession(session);
+		MiddlewareLib::DestroyReactorPool(pool);
+	}
+
+	//range(0) requests fanned out through futures then waited for, to set
+	//against the callbacks of BM_PeerRoundTrip
+	void BM_PeerFutureFanOut(benchmark::State& state)
+	{
+		const int batch = (int)state.range(0);
+		MiddlewareLib::StandInPeer peer;
+		if (!peer.Start())
+		{
+			state.SkipWithError("unable to start the stand in peer");
+			return;
+		}
+
+		MiddlewareLib::SessionOptions options;
+		options.binaryMessages = true;
+		MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+		MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(pool, peer.Url().c_str(), options);
+		MiddlewareLib::StartDispatching(session);
+
+		std::string payload = CreatePayload(64);
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD", NULL, NULL, 0, NULL };
+		std::vector<MiddlewareLib::RequestFuture> futures;
+		futures.reserve(batch);
+		for (auto _ : state)
+		{
+			futures.clear();
+			for (int i = 0; i < batch; i++)
+			{
+				futures.push_back(MiddlewareLib::SendRequestAsync(session, params, payload));
+			}
+			for (auto& future : futures)
+			{
+				if (!future.Get().success)
+				{
+					state.SkipWithError("request failed");
+				}
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * batch);
+
+		MiddlewareLib::DestroySession(session);
+		MiddlewareLib::DestroyReactorPool(pool);
+	}
+
+	MiddlewareLib::ISession* CreateCoalescingSession(MiddlewareLib::ReactorPool* pool, const MiddlewareLib::StandInPeer& peer,
+		unsigned int maxBatchMessages, unsigned int flushWindowMicros)
+	{
+		MiddlewareLib::SessionOptions options;
+		options.binaryMessages = true;
+		options.coalescing.maxBatchMessages = maxBatchMessages;
+		options.coalescing.flushWindowMicros = flushWindowMicros;
+		MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(pool, peer.Url().c_str(), options);
+		MiddlewareLib::StartDispatching(session);
+		return session;
+	}
+
+	//bursts of 500 small requests. range(0) is the most messages per write
+	//and range(1) the flush window in microseconds.
+	void BM_PeerBurst(benchmark::State& state)
+	{
+		MiddlewareLib::StandInPeer peer;
+		if (!peer.Start())
+		{
+			state.SkipWithError("unable to start the stand in peer");
+			return;
+		}
+
+		MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+		MiddlewareLib::ISession* session = CreateCoalescingSession(pool, peer, (unsigned int)state.range(0), (unsigned int)state.range(1));
+
+		const int burst = 500;
+		std::string payload = CreatePayload(64);
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD", OnResponse, OnResponse, 0, NULL };
+		g_responses = 0;
+		int64_t expected = 0;
+		for (auto _ : state)
+		{
+			for (int i = 0; i < burst; i++)
+			{
+				MiddlewareLib::SendRequest(session, params, payload);
+			}
+			expected += burst;
+			while (g_responses < expected)
+			{
+				std::this_thread::yield();
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * burst);
+
+		MiddlewareLib::SendStats stats;
+		session->GetSendStats(stats);
+		state.counters["msgs_per_write"] = stats.MessagesPerWrite();
+
+		MiddlewareLib::DestroySession(session);
+		MiddlewareLib::DestroyReactorPool(pool);
+	}
+
+	//round trip time of a request sent after a quiet spell, range(0) is the
+	//flush window in microseconds
+	void BM_PeerIsolatedRequest(benchmark::State& state)
+	{
+		MiddlewareLib::StandInPeer peer;
+		if (!peer.Start())
+		{
+			state.SkipWithError("unable to start the stand in peer");
+			return;
+		}
+
+		MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+		MiddlewareLib::ISession* session = CreateCoalescingSession(pool, peer, 64, (unsigned int)state.range(0));
+
+		std::string payload = CreatePayload(64);
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD", OnResponse, OnResponse, 0, NULL };
+		g_responses = 0;
+		int64_t expected = 0;
+		for (auto _ : state)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			auto start = std::chrono::steady_clock::now();
+			MiddlewareLib::SendRequest(session, params, payload);
+			expected++;
+			while (g_responses < expected)
+			{
+				std::this_thread::yield();
+			}
+			state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		MiddlewareLib::DestroySession(session);
+		MiddlewareLib::DestroyReactorPool(pool);
+	}
+}
+
+BENCHMARK(BM_PeerRoundTrip)->ArgsProduct({ { 64, 1024, 16384 }, { 0, 1 } })->UseRealTime();
+BENCHMARK(BM_PeerFutureFanOut)->Arg(256)->Arg(4096)->UseRealTime();
+BENCHMARK(BM_PeerBurst)->ArgsProduct({ { 1, 64 }, { 0, 50, 200 } })->UseRealTime();
+BENCHMARK(BM_PeerIsolatedRequest)->Arg(0)->Arg(200)->UseManualTime()->Iterations(500);
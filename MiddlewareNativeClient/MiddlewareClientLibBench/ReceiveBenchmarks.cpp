@@ -0,0 +1,89 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <string.h>
+#include <vector>
+#include "ReceiveBuffer.h"
+
+namespace
+{
+	const size_t PayloadSize = 64;
+
+	//a backlog of unmasked server frames, as they arrive on the socket
+	std::vector<char> CreateBacklog(size_t frames)
+	{
+		std::vector<char> backlog;
+		for (size_t i = 0; i < frames; i++)
+		{
+			backlog.push_back((char)0x81);
+			backlog.push_back((char)PayloadSize);
+			backlog.insert(backlog.end(), PayloadSize, 'x');
+		}
+		return backlog;
+	}
+
+	//size of the complete frame at data, or 0 if more bytes are needed
+	size_t FrameSize(const char* data, size_t size)
+	{
+		if (size < 2)
+		{
+			return 0;
+		}
+		size_t frame = 2 + (data[1] & 0x7f);
+		return size < frame ? 0 : frame;
+	}
+
+	//the previous receive path: the whole backlog is read 1500 bytes at a time
+	//and every frame is erased from the front of the vector
+	void BM_VectorEraseReceive(benchmark::State& state)
+	{
+		std::vector<char> backlog = CreateBacklog((size_t)state.range(0));
+		std::vector<char> rxbuf;
+		for (auto _ : state)
+		{
+			for (size_t offset = 0; offset < backlog.size(); offset += 1500)
+			{
+				size_t N = rxbuf.size();
+				size_t read = std::min((size_t)1500, backlog.size() - offset);
+				rxbuf.resize(N + 1500);
+				memcpy(&rxbuf[N], &backlog[offset], read);
+				rxbuf.resize(N + read);
+			}
+			size_t frame;
+			while ((frame = FrameSize(rxbuf.data(), rxbuf.size())) != 0)
+			{
+				benchmark::DoNotOptimize(rxbuf.data() + 2);
+				rxbuf.erase(rxbuf.begin(), rxbuf.begin() + frame);
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	void BM_ReceiveBuffer(benchmark::State& state)
+	{
+		std::vector<char> backlog = CreateBacklog((size_t)state.range(0));
+		MiddlewareLib::ReceiveBuffer rxbuf;
+		for (auto _ : state)
+		{
+			size_t offset = 0;
+			while (offset < backlog.size())
+			{
+				char* out = rxbuf.WritePtr();
+				size_t read = std::min(rxbuf.Writable(), backlog.size() - offset);
+				memcpy(out, &backlog[offset], read);
+				rxbuf.Commit(read);
+				offset += read;
+
+				size_t frame;
+				while ((frame = FrameSize(rxbuf.Data(), rxbuf.Size())) != 0)
+				{
+					benchmark::DoNotOptimize(rxbuf.Data() + 2);
+					rxbuf.Consume(frame);
+				}
+			}
+		}
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+}
+
+BENCHMARK(BM_VectorEraseReceive)->Arg(100)->Arg(1000)->Arg(10000);
+BENCHMARK(BM_ReceiveBuffer)->Arg(100)->Arg(1000)->Arg(10000);
@@ -0,0 +1,156 @@
+#include <benchmark/benchmark.h>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <deque>
+#include <map>
+#include <string.h>
+#include "MiddlewareClientLib.h"
+#include "PendingRequests.h"
+#include "RequestId.h"
+
+namespace
+{
+	//answers every request straight away with a success response
+	class EchoSession : public MiddlewareLib::ISession
+	{
+	public:
+		EchoSession() : frameHandler_(NULL), silent_(false) {}
+
+		void SendData(const std::string& data)
+		{
+			if (silent_)
+			{
+				return;
+			}
+			response_ = data;
+			response_[response_.find("\"Type\":0") + 7] = '3';
+			frameHandler_(this, &response_[0], response_.size());
+		}
+
+		void StartDispatcher(MiddlewareLib::CALLBACK_FUNC handler)
+		{
+		}
+
+		void StartDispatcher(MiddlewareLib::CALLBACK_FUNC handler, MiddlewareLib::FRAME_CALLBACK_FUNC frameHandler)
+		{
+			frameHandler_ = frameHandler;
+		}
+
+		//leave requests unanswered, so they stay pending
+		void Silent(bool silent)
+		{
+			silent_ = silent;
+		}
+
+	private:
+		MiddlewareLib::FRAME_CALLBACK_FUNC frameHandler_;
+		std::string response_;
+		bool silent_;
+	};
+
+	//how doRequestInternal used to make request ids, seeding a new generator
+	//from the OS for every request
+	void BM_UuidRequestId(benchmark::State& state)
+	{
+		for (auto _ : state)
+		{
+			boost::uuids::random_generator gen;
+			boost::uuids::uuid u = gen();
+			benchmark::DoNotOptimize(boost::uuids::to_string(u));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	void BM_RequestIdGenerator(benchmark::State& state)
+	{
+		MiddlewareLib::RequestIdGenerator generator;
+		char id[MiddlewareLib::RequestIdGenerator::MAX_SIZE];
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(generator.Next(id));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	//the global map of pending calls the table replaced. With range(0) requests
+	//in flight, each iteration adds a request and completes the oldest.
+	void BM_PendingMap(benchmark::State& state)
+	{
+		std::map<std::string, MiddlewareLib::MiddlewareRequestParams, std::less<>> pending;
+		std::deque<std::string> inFlight;
+		MiddlewareLib::RequestIdGenerator generator;
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD", NULL, NULL, 0, NULL };
+		char id[MiddlewareLib::RequestIdGenerator::MAX_SIZE];
+		for (int64_t i = 0; i < state.range(0); i++)
+		{
+			inFlight.push_back(std::string(id, generator.Next(id)));
+			pending.insert(std::make_pair(inFlight.back(), params));
+		}
+
+		for (auto _ : state)
+		{
+			inFlight.push_back(std::string(id, generator.Next(id)));
+			pending.insert(std::make_pair(inFlight.back(), params));
+			auto it = pending.find(inFlight.front());
+			pending.erase(it);
+			inFlight.pop_front();
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	void BM_PendingRequests(benchmark::State& state)
+	{
+		MiddlewareLib::PendingRequests pending;
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD", NULL, NULL, 0, NULL };
+		uint64_t next = 1;
+		uint64_t oldest = 1;
+		//deadlines a few seconds out, spread over the lower levels of the wheel
+		for (int64_t i = 0; i < state.range(0); i++, next++)
+		{
+			pending.Add(next, params, 5000 + next % 1000);
+		}
+
+		std::vector<MiddlewareLib::MiddlewareRequestParams> expired;
+		for (auto _ : state)
+		{
+			pending.Add(next, params, 5000 + next % 1000);
+			next++;
+			pending.Complete(oldest++, params);
+			if ((next & 1023) == 0)
+			{
+				pending.Expire(next >> 10, expired);
+			}
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	//request, response and completion callback on one thread, matching the
+	//response among range(0) other requests still waiting for theirs
+	void BM_RequestRoundTrip(benchmark::State& state)
+	{
+		EchoSession session;
+		MiddlewareLib::StartDispatching(&session);
+		MiddlewareLib::MiddlewareRequestParams params{ "MarketData.EURUSD",
+			[](MiddlewareLib::ISession*, const std::string&) {}, NULL, 0, NULL };
+		std::string payload(64, 'x');
+		session.Silent(true);
+		for (int64_t i = 0; i < state.range(0); i++)
+		{
+			MiddlewareLib::SendRequest(&session, params, payload);
+		}
+		session.Silent(false);
+
+		for (auto _ : state)
+		{
+			MiddlewareLib::SendRequest(&session, params, payload);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+}
+
+BENCHMARK(BM_UuidRequestId);
+BENCHMARK(BM_RequestIdGenerator);
+BENCHMARK(BM_PendingMap)->Arg(1000)->Arg(100000)->Arg(300000);
+BENCHMARK(BM_PendingRequests)->Arg(1000)->Arg(100000)->Arg(300000);
+BENCHMARK(BM_RequestRoundTrip)->Arg(0)->Arg(100000);
@@ -0,0 +1,116 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "MiddlewareClientLib.h"
+#include "EpollReactor.h"
+#include "MessageCodec.h"
+#include "MpscQueue.h"
+
+namespace
+{
+	//a reactor running on its own thread standing in for a session's
+	//dispatcher. It counts the bytes handed to it in place of the socket.
+	struct Dispatcher
+	{
+		Dispatcher() : flushPosted(false), bytes(0)
+		{
+			thread = std::thread([this]() { reactor.Run(); });
+		}
+
+		~Dispatcher()
+		{
+			//tasks run in order, so everything posted before this has been handled
+			reactor.Invoke([]() {});
+			reactor.Stop();
+			thread.join();
+		}
+
+		MiddlewareLib::EpollReactor reactor;
+		std::thread thread;
+		MiddlewareLib::MpscQueue<std::string> queue;
+		std::atomic<bool> flushPosted;
+		size_t bytes;
+	};
+
+	Dispatcher* g_dispatcher = NULL;
+
+	//serialise a publish on the calling thread, as doRequestInternal does
+	std::string Encode(int thread)
+	{
+		static thread_local MiddlewareLib::Message msg;
+		msg.type_ = MiddlewareLib::REQUEST;
+		msg.command_ = "PUBLISHMESSAGE";
+		msg.channel_ = "MarketData.EURUSD";
+		msg.requestId_ = "c0ffee00c0ffee00c0ffee00c0ffee00-" + std::to_string(thread);
+		msg.payload_ = "{\"bid\":1.08421,\"ask\":1.08424}";
+		std::string frame;
+		MiddlewareLib::MessageCodec::Encode(msg, frame);
+		return frame;
+	}
+
+	//how sends from other threads used to reach the loop: one locked post and
+	//one eventfd write per message
+	void BM_PostPerSend(benchmark::State& state)
+	{
+		if (state.thread_index() == 0)
+		{
+			g_dispatcher = new Dispatcher();
+		}
+
+		for (auto _ : state)
+		{
+			std::string frame = Encode(state.thread_index());
+			Dispatcher* dispatcher = g_dispatcher;
+			dispatcher->reactor.Post([dispatcher, frame]() mutable
+			{
+				dispatcher->bytes += frame.size();
+			});
+		}
+		state.SetItemsProcessed(state.iterations());
+
+		if (state.thread_index() == 0)
+		{
+			delete g_dispatcher;
+			g_dispatcher = NULL;
+		}
+	}
+
+	//the lock free submission queue. Only a send that finds the queue idle
+	//posts a flush, which drains the whole batch.
+	void BM_QueuedSend(benchmark::State& state)
+	{
+		if (state.thread_index() == 0)
+		{
+			g_dispatcher = new Dispatcher();
+		}
+
+		for (auto _ : state)
+		{
+			Dispatcher* dispatcher = g_dispatcher;
+			dispatcher->queue.Push(Encode(state.thread_index()));
+			if (!dispatcher->flushPosted.exchange(true, std::memory_order_acq_rel))
+			{
+				dispatcher->reactor.Post([dispatcher]()
+				{
+					dispatcher->flushPosted.exchange(false, std::memory_order_acq_rel);
+					std::string frame;
+					while (dispatcher->queue.Pop(frame))
+					{
+						dispatcher->bytes += frame.size();
+					}
+				});
+			}
+		}
+		state.SetItemsProcessed(state.iterations());
+
+		if (state.thread_index() == 0)
+		{
+			delete g_dispatcher;
+			g_dispatcher = NULL;
+		}
+	}
+}
+
+BENCHMARK(BM_PostPerSend)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_QueuedSend)->ThreadRange(1, 16)->UseRealTime();
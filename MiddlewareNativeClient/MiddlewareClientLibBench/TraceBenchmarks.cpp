@@ -0,0 +1,20 @@
+#include <benchmark/benchmark.h>
+#include "Trace.h"
+
+namespace
+{
+	//the cost of a trace point on the hot path, with tracing on and off
+	void BM_TraceRecord(benchmark::State& state)
+	{
+		MiddlewareLib::Trace::Enable(state.range(0) != 0);
+		uint64_t arg = 0;
+		for (auto _ : state)
+		{
+			MiddlewareLib::Trace::Record(MiddlewareLib::Trace::RECV, arg++);
+		}
+		MiddlewareLib::Trace::Enable(true);
+		state.SetItemsProcessed(state.iterations());
+	}
+}
+
+BENCHMARK(BM_TraceRecord)->Arg(1)->Arg(0);
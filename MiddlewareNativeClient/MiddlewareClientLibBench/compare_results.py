@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Compare two MiddlewareClientLibBench JSON result files.
+
+Run the bench target (or the executable with --benchmark_out=... and
+--benchmark_out_format=json) before and after a change, then
+
+    compare_results.py baseline.json current.json [--threshold 0.10]
+
+Prints every benchmark found in both files with the change in CPU time and
+exits with 1 if any is slower than the baseline by more than the threshold.
+With repetitions the medians are compared.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        results = json.load(f)["benchmarks"]
+
+    times = {}
+    for result in results:
+        # with repetitions only the median aggregate is used
+        if result.get("run_type") == "aggregate" and result.get("aggregate_name") != "median":
+            continue
+        name = result.get("run_name", result["name"])
+        if result.get("run_type") == "aggregate" or name not in times:
+            times[name] = result["cpu_time"]
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compare benchmark results")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="fraction slower that counts as a regression")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+    for name in sorted(set(baseline) & set(current)):
+        change = current[name] / baseline[name] - 1.0 if baseline[name] else 0.0
+        regressed = change > args.threshold
+        regressions += regressed
+        print("%-60s %+7.1f%%%s" % (name, change * 100.0, "  REGRESSION" if regressed else ""))
+
+    for name in sorted(set(baseline) ^ set(current)):
+        print("%-60s only in %s" % (name, "baseline" if name in baseline else "current"))
+
+    print("%d regression(s) over %.0f%%" % (regressions, args.threshold * 100.0))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
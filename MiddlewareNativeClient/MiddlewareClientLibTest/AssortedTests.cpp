@@ -1,5 +1,5 @@
 #include "stdafx.h"
-#include <boost\test\unit_test.hpp>
+#include <boost/test/unit_test.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/algorithm/string/replace.hpp>
 
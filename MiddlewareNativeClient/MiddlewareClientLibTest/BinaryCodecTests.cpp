@@ -0,0 +1,99 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "BinaryCodec.h"
+#include <string>
+
+namespace
+{
+	MiddlewareLib::Message CreateMessage()
+	{
+		MiddlewareLib::Message msg;
+		msg.type_ = MiddlewareLib::UPDATE;
+		msg.requestId_ = "c0ffee-1";
+		msg.command_ = "PUBLISHMESSAGE";
+		msg.channel_ = "MarketData.EURUSD";
+		msg.sourceId_ = "";
+		msg.destinationId_ = "xyz";
+		//raw bytes, including ones JSON would have to escape
+		msg.payload_ = std::string("{\"bid\":1.5}\0\x01\xff\\", 16);
+		return msg;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(binary_codec_tests)
+
+BOOST_AUTO_TEST_CASE(when_a_message_is_encoded_and_decoded)
+{
+	MiddlewareLib::Message msg = CreateMessage();
+	std::string frame;
+	MiddlewareLib::BinaryCodec::Encode(msg, frame);
+	BOOST_CHECK(MiddlewareLib::BinaryCodec::IsBinary(frame.data(), frame.size()));
+
+	MiddlewareLib::Message decoded;
+	BOOST_REQUIRE(MiddlewareLib::BinaryCodec::Decode(frame.data(), frame.size(), decoded));
+	BOOST_CHECK_EQUAL((int)decoded.type_, (int)msg.type_);
+	BOOST_CHECK(decoded.requestId_ == msg.requestId_);
+	BOOST_CHECK(decoded.command_ == msg.command_);
+	BOOST_CHECK(decoded.channel_ == msg.channel_);
+	BOOST_CHECK(decoded.sourceId_.empty());
+	BOOST_CHECK(decoded.destinationId_ == msg.destinationId_);
+	BOOST_CHECK(decoded.payload_ == msg.payload_);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_message_is_decoded_as_a_view)
+{
+	MiddlewareLib::Message msg = CreateMessage();
+	std::string frame;
+	MiddlewareLib::BinaryCodec::Encode(msg, frame);
+
+	MiddlewareLib::MessageView view;
+	BOOST_REQUIRE(MiddlewareLib::BinaryCodec::DecodeView(frame.data(), frame.size(), view));
+	BOOST_CHECK(view.channel_ == msg.channel_);
+	BOOST_CHECK(view.payload_ == msg.payload_);
+	//the view refers to the frame
+	BOOST_CHECK(view.payload_.data() > frame.data() && view.payload_.data() < frame.data() + frame.size());
+}
+
+BOOST_AUTO_TEST_CASE(when_a_field_needs_a_long_length)
+{
+	MiddlewareLib::Message msg = CreateMessage();
+	msg.payload_.assign(100000, 'p');
+	std::string frame;
+	MiddlewareLib::BinaryCodec::Encode(msg, frame);
+
+	MiddlewareLib::Message decoded;
+	BOOST_REQUIRE(MiddlewareLib::BinaryCodec::Decode(frame.data(), frame.size(), decoded));
+	BOOST_CHECK(decoded.payload_ == msg.payload_);
+	BOOST_CHECK(decoded.channel_ == msg.channel_);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_envelope_is_not_valid)
+{
+	MiddlewareLib::Message msg = CreateMessage();
+	std::string frame;
+	MiddlewareLib::BinaryCodec::Encode(msg, frame);
+	MiddlewareLib::Message decoded;
+
+	//every truncation is rejected
+	for (size_t size = 0; size < frame.size(); size++)
+	{
+		BOOST_CHECK(!MiddlewareLib::BinaryCodec::Decode(frame.data(), size, decoded));
+	}
+
+	std::string trailing = frame + "x";
+	BOOST_CHECK(!MiddlewareLib::BinaryCodec::Decode(trailing.data(), trailing.size(), decoded));
+
+	std::string version = frame;
+	version[1] = 2;
+	BOOST_CHECK(!MiddlewareLib::BinaryCodec::Decode(version.data(), version.size(), decoded));
+
+	std::string type = frame;
+	type[2] = 9;
+	BOOST_CHECK(!MiddlewareLib::BinaryCodec::Decode(type.data(), type.size(), decoded));
+
+	//JSON is never taken for an envelope
+	std::string json = "{\"Type\":1}";
+	BOOST_CHECK(!MiddlewareLib::BinaryCodec::IsBinary(json.data(), json.size()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
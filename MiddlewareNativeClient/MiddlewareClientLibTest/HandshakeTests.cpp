@@ -0,0 +1,37 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "Handshake.h"
+
+BOOST_AUTO_TEST_SUITE(handshake_tests)
+
+BOOST_AUTO_TEST_CASE(when_hashing_with_sha1)
+{
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64(MiddlewareLib::Handshake::Sha1("abc")), "qZk+NkcGgWq6PiVxeFDCbJzQ2J0=");
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64(MiddlewareLib::Handshake::Sha1("")), "2jmj7l5rSw0yVb/vlWAYkK/YBwk=");
+}
+
+BOOST_AUTO_TEST_CASE(when_encoding_base64)
+{
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64(""), "");
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64("f"), "Zg==");
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64("fo"), "Zm8=");
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64("foo"), "Zm9v");
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Base64("foobar"), "Zm9vYmFy");
+}
+
+BOOST_AUTO_TEST_CASE(when_accepting_a_key)
+{
+	//the example in RFC 6455 section 1.3
+	BOOST_CHECK_EQUAL(MiddlewareLib::Handshake::Accept("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+BOOST_AUTO_TEST_CASE(when_creating_keys)
+{
+	std::string key = MiddlewareLib::Handshake::CreateKey();
+	//16 bytes in base64
+	BOOST_CHECK_EQUAL(key.size(), 24u);
+	BOOST_CHECK(key.compare(22, 2, "==") == 0);
+	BOOST_CHECK(MiddlewareLib::Handshake::CreateKey() != key);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
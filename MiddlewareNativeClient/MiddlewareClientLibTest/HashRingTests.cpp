@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "HashRing.h"
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(hash_ring_tests)
+
+BOOST_AUTO_TEST_CASE(when_there_is_one_slot)
+{
+	MiddlewareLib::HashRing ring(1, 64);
+	BOOST_CHECK_EQUAL(ring.Find("Channel"), 0u);
+	BOOST_CHECK_EQUAL(ring.Find(""), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_keys_are_spread_over_slots)
+{
+	MiddlewareLib::HashRing ring(4, 64);
+	std::vector<int> counts(4);
+	for (int i = 0; i < 4000; i++)
+	{
+		size_t slot = ring.Find("Channel" + std::to_string(i));
+		BOOST_REQUIRE_LT(slot, 4u);
+		counts[slot]++;
+	}
+
+	//within half of an even share
+	for (int count : counts)
+	{
+		BOOST_CHECK_GT(count, 500);
+		BOOST_CHECK_LT(count, 1500);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(when_the_same_key_is_found_again)
+{
+	MiddlewareLib::HashRing ring(8, 64);
+	MiddlewareLib::HashRing other(8, 64);
+	for (int i = 0; i < 100; i++)
+	{
+		std::string key = "Channel" + std::to_string(i);
+		BOOST_CHECK_EQUAL(ring.Find(key), ring.Find(key));
+		BOOST_CHECK_EQUAL(ring.Find(key), other.Find(key));
+	}
+	BOOST_CHECK_EQUAL(MiddlewareLib::HashRing::Hash("Channel"), MiddlewareLib::HashRing::Hash("Channel"));
+	BOOST_CHECK_NE(MiddlewareLib::HashRing::Hash("Channel1"), MiddlewareLib::HashRing::Hash("Channel2"));
+}
+
+BOOST_AUTO_TEST_CASE(when_a_slot_is_added_only_its_keys_move)
+{
+	MiddlewareLib::HashRing four(4, 64);
+	MiddlewareLib::HashRing five(5, 64);
+	int moved = 0;
+	for (int i = 0; i < 4000; i++)
+	{
+		std::string key = "Channel" + std::to_string(i);
+		size_t before = four.Find(key);
+		size_t after = five.Find(key);
+		if (before != after)
+		{
+			//only to the new slot
+			BOOST_CHECK_EQUAL(after, 4u);
+			moved++;
+		}
+	}
+
+	//about a fifth, where rehashing modulo the count would move four fifths
+	BOOST_CHECK_GT(moved, 400);
+	BOOST_CHECK_LT(moved, 1400);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "LastValueCache.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+	MiddlewareLib::Message CreateUpdate(const std::string& channel, const std::string& payload)
+	{
+		MiddlewareLib::Message msg;
+		msg.type_ = MiddlewareLib::UPDATE;
+		msg.channel_ = channel;
+		msg.payload_ = payload;
+		return msg;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(last_value_cache_tests)
+
+BOOST_AUTO_TEST_CASE(when_not_conflating)
+{
+	MiddlewareLib::LastValueCache cache(false);
+	cache.Update(CreateUpdate("A", "1"));
+	cache.Update(CreateUpdate("A", "2"));
+
+	MiddlewareLib::Message msg;
+	BOOST_REQUIRE(cache.Get("A", msg));
+	BOOST_CHECK(msg.payload_ == "2");
+	BOOST_CHECK(!cache.Get("B", msg));
+
+	//nothing is held for draining
+	std::vector<MiddlewareLib::Message> out;
+	BOOST_CHECK_EQUAL(cache.Drain(out, 0), 0u);
+	MiddlewareLib::ConflationStats stats;
+	cache.GetStats(stats);
+	BOOST_CHECK_EQUAL(stats.updates, 2u);
+	BOOST_CHECK_EQUAL(stats.conflated, 0u);
+	BOOST_CHECK_EQUAL(stats.channels, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_draining_in_the_order_channels_changed)
+{
+	MiddlewareLib::LastValueCache cache(true);
+	cache.Update(CreateUpdate("B", "1"));
+	cache.Update(CreateUpdate("A", "1"));
+	cache.Update(CreateUpdate("C", "1"));
+	cache.Update(CreateUpdate("B", "2"));
+
+	std::vector<MiddlewareLib::Message> out;
+	BOOST_CHECK_EQUAL(cache.Drain(out, 2), 2u);
+	BOOST_REQUIRE_EQUAL(out.size(), 2u);
+	BOOST_CHECK(out[0].channel_ == "B" && out[0].payload_ == "2");
+	BOOST_CHECK(out[1].channel_ == "A");
+
+	//a drained channel that changes again goes to the back
+	cache.Update(CreateUpdate("B", "3"));
+	out.clear();
+	BOOST_CHECK_EQUAL(cache.Drain(out, 0), 2u);
+	BOOST_REQUIRE_EQUAL(out.size(), 2u);
+	BOOST_CHECK(out[0].channel_ == "C");
+	BOOST_CHECK(out[1].channel_ == "B" && out[1].payload_ == "3");
+
+	MiddlewareLib::ConflationStats stats;
+	cache.GetStats(stats);
+	BOOST_CHECK_EQUAL(stats.updates, 5u);
+	BOOST_CHECK_EQUAL(stats.conflated, 1u);
+	BOOST_CHECK_EQUAL(stats.delivered, 4u);
+	BOOST_CHECK_EQUAL(stats.waiting, 0u);
+	BOOST_CHECK_EQUAL(stats.channels, 3u);
+
+	//drained values stay cached
+	MiddlewareLib::Message msg;
+	BOOST_REQUIRE(cache.Get("A", msg));
+	BOOST_CHECK(msg.payload_ == "1");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "LatencyHistogram.h"
+#include <thread>
+#include <vector>
+
+using MiddlewareLib::LatencyHistogram;
+
+BOOST_AUTO_TEST_SUITE(latency_histogram_tests)
+
+BOOST_AUTO_TEST_CASE(when_nothing_is_recorded)
+{
+	LatencyHistogram histogram;
+	BOOST_CHECK_EQUAL(histogram.Count(), 0u);
+	BOOST_CHECK_EQUAL(histogram.Min(), 0u);
+	BOOST_CHECK_EQUAL(histogram.Max(), 0u);
+	BOOST_CHECK_EQUAL(histogram.Mean(), 0.0);
+	BOOST_CHECK_EQUAL(histogram.ValueAtPercentile(50), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_small_values_are_recorded_exactly)
+{
+	for (uint64_t value = 0; value < LatencyHistogram::SUB_BUCKETS; value++)
+	{
+		BOOST_CHECK_EQUAL(LatencyHistogram::BucketIndex(value), value);
+		BOOST_CHECK_EQUAL(LatencyHistogram::BucketLimit(value), value);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(when_a_value_is_within_its_bucket)
+{
+	for (uint64_t value = 1; value < (1ULL << 39); value = value * 3 + 7)
+	{
+		size_t index = LatencyHistogram::BucketIndex(value);
+		BOOST_REQUIRE_LT(index, LatencyHistogram::BUCKETS);
+		uint64_t limit = LatencyHistogram::BucketLimit(index);
+		BOOST_CHECK_GE(limit, value);
+		//within one sub bucket of the value
+		BOOST_CHECK_LE(limit - value, value / LatencyHistogram::SUB_BUCKETS);
+		if (index > 0)
+		{
+			BOOST_CHECK_LT(LatencyHistogram::BucketLimit(index - 1), value);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(when_values_are_too_large)
+{
+	LatencyHistogram histogram;
+	histogram.Record(1ULL << 50);
+	BOOST_CHECK_EQUAL(LatencyHistogram::BucketIndex(1ULL << 50), LatencyHistogram::BUCKETS - 1);
+	BOOST_CHECK_EQUAL(histogram.Max(), 1ULL << 50);
+	BOOST_CHECK_EQUAL(histogram.ValueAtPercentile(50), 1ULL << 50);
+}
+
+BOOST_AUTO_TEST_CASE(when_percentiles_are_read)
+{
+	LatencyHistogram histogram;
+	for (uint64_t value = 1; value <= 10000; value++)
+	{
+		histogram.Record(value * 1000);
+	}
+
+	BOOST_CHECK_EQUAL(histogram.Count(), 10000u);
+	BOOST_CHECK_EQUAL(histogram.Min(), 1000u);
+	BOOST_CHECK_EQUAL(histogram.Max(), 10000000u);
+	BOOST_CHECK_CLOSE(histogram.Mean(), 5000500.0, 0.001);
+	BOOST_CHECK_CLOSE((double)histogram.ValueAtPercentile(50), 5000000.0, 100.0 / LatencyHistogram::SUB_BUCKETS);
+	BOOST_CHECK_CLOSE((double)histogram.ValueAtPercentile(99), 9900000.0, 100.0 / LatencyHistogram::SUB_BUCKETS);
+	BOOST_CHECK_CLOSE((double)histogram.ValueAtPercentile(99.9), 9990000.0, 100.0 / LatencyHistogram::SUB_BUCKETS);
+	BOOST_CHECK_EQUAL(histogram.ValueAtPercentile(100), 10000000u);
+}
+
+BOOST_AUTO_TEST_CASE(when_histograms_are_added_and_reset)
+{
+	LatencyHistogram first;
+	LatencyHistogram second;
+	first.Record(10);
+	second.Record(5);
+	second.Record(2000);
+
+	LatencyHistogram copy(first);
+	copy.Add(second);
+	BOOST_CHECK_EQUAL(copy.Count(), 3u);
+	BOOST_CHECK_EQUAL(copy.Min(), 5u);
+	BOOST_CHECK_EQUAL(copy.Max(), 2000u);
+	BOOST_CHECK_EQUAL(first.Count(), 1u);
+
+	copy.Reset();
+	BOOST_CHECK_EQUAL(copy.Count(), 0u);
+	BOOST_CHECK_EQUAL(copy.ValueAtPercentile(99), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_histogram_is_drained)
+{
+	LatencyHistogram histogram;
+	histogram.Record(100);
+	histogram.Record(300);
+	LatencyHistogram into;
+	into.Record(50);
+
+	histogram.Drain(into);
+	BOOST_CHECK_EQUAL(histogram.Count(), 0u);
+	BOOST_CHECK_EQUAL(histogram.Max(), 0u);
+	BOOST_CHECK_EQUAL(histogram.Min(), 0u);
+	BOOST_CHECK_EQUAL(into.Count(), 3u);
+	BOOST_CHECK_EQUAL(into.Min(), 50u);
+	BOOST_CHECK_EQUAL(into.Max(), 300u);
+	BOOST_CHECK_CLOSE(into.Mean(), 150.0, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(when_values_are_recorded_from_several_threads)
+{
+	LatencyHistogram histogram;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.push_back(std::thread([&histogram, t]()
+		{
+			for (uint64_t value = 0; value < 10000; value++)
+			{
+				histogram.Record(value + (uint64_t)t);
+			}
+		}));
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	BOOST_CHECK_EQUAL(histogram.Count(), 40000u);
+	BOOST_CHECK_EQUAL(histogram.Min(), 0u);
+	BOOST_CHECK_EQUAL(histogram.Max(), 10002u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,85 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "Masking.h"
+#include <set>
+#include <vector>
+
+namespace
+{
+	typedef void(*MaskFunc_t)(uint8_t* data, size_t size, const uint8_t key[4]);
+
+	//every size up to a few vectors and every alignment of the start, so each
+	//kernel's main loop and tail are both covered
+	void CheckAgainstScalar(MaskFunc_t kernel)
+	{
+		const uint8_t key[4] = { 0xA5, 0x3C, 0x0F, 0x81 };
+		std::vector<uint8_t> source(300);
+		for (size_t i = 0; i < source.size(); i++)
+		{
+			source[i] = (uint8_t)(i * 31 + 7);
+		}
+
+		for (size_t offset = 0; offset < 4; offset++)
+		{
+			for (size_t size = 0; size + offset <= source.size(); size++)
+			{
+				std::vector<uint8_t> expected(source);
+				std::vector<uint8_t> actual(source);
+				MiddlewareLib::Masking::MaskScalar(&expected[offset], size, key);
+				kernel(&actual[offset], size, key);
+				BOOST_REQUIRE(expected == actual);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(masking_tests)
+
+BOOST_AUTO_TEST_CASE(when_masking_with_the_word_kernel)
+{
+	CheckAgainstScalar(MiddlewareLib::Masking::MaskWord);
+}
+
+BOOST_AUTO_TEST_CASE(when_masking_with_the_sse2_kernel)
+{
+	CheckAgainstScalar(MiddlewareLib::Masking::MaskSSE2);
+}
+
+BOOST_AUTO_TEST_CASE(when_masking_with_the_avx2_kernel)
+{
+	if (!MiddlewareLib::Masking::HasAVX2())
+	{
+		BOOST_TEST_MESSAGE("AVX2 not supported, skipping");
+		return;
+	}
+	CheckAgainstScalar(MiddlewareLib::Masking::MaskAVX2);
+}
+
+BOOST_AUTO_TEST_CASE(when_masking_twice)
+{
+	const uint8_t key[4] = { 1, 2, 3, 4 };
+	std::vector<uint8_t> data(1000, 'x');
+	MiddlewareLib::Masking::Mask(&data[0], data.size(), key);
+	BOOST_CHECK(data[0] == ('x' ^ 1) && data[999] == ('x' ^ 4));
+	MiddlewareLib::Masking::Mask(&data[0], data.size(), key);
+	BOOST_CHECK(data == std::vector<uint8_t>(1000, 'x'));
+}
+
+BOOST_AUTO_TEST_CASE(when_generating_keys)
+{
+	MiddlewareLib::Masking::KeyGenerator first;
+	MiddlewareLib::Masking::KeyGenerator second;
+	std::set<uint32_t> keys;
+	for (int i = 0; i < 1000; i++)
+	{
+		uint8_t key[4];
+		first.Next(key);
+		keys.insert((uint32_t)key[0] | (uint32_t)key[1] << 8 | (uint32_t)key[2] << 16 | (uint32_t)key[3] << 24);
+		second.Next(key);
+		keys.insert((uint32_t)key[0] | (uint32_t)key[1] << 8 | (uint32_t)key[2] << 16 | (uint32_t)key[3] << 24);
+	}
+	//independently seeded generators do not repeat each other
+	BOOST_CHECK(keys.size() > 1990);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
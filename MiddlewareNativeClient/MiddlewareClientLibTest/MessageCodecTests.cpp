@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "MiddlewareClientLib.h"
+#include "MessageCodec.h"
+
+namespace
+{
+	MiddlewareLib::Message CreateTestMessage()
+	{
+		MiddlewareLib::Message msg;
+		msg.type_ = MiddlewareLib::REQUEST;
+		msg.requestId_ = "7d7e3b3c-2a5e-4c8e-9a6d-0b1f2e3d4c5b";
+		msg.command_ = "PUBLISHMESSAGE";
+		msg.channel_ = "TestChannel";
+		msg.sourceId_ = "";
+		msg.destinationId_ = "";
+		msg.payload_ = "hello";
+		return msg;
+	}
+
+	MiddlewareLib::Message Decode(const std::string& data)
+	{
+		MiddlewareLib::Message msg;
+		BOOST_REQUIRE(MiddlewareLib::MessageCodec::Decode(data.data(), data.size(), msg));
+		return msg;
+	}
+
+	bool IsValid(const std::string& data)
+	{
+		MiddlewareLib::Message msg;
+		return MiddlewareLib::MessageCodec::Decode(data.data(), data.size(), msg);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(message_codec_tests)
+
+BOOST_AUTO_TEST_CASE(when_encoding_a_message)
+{
+	std::string out;
+	MiddlewareLib::MessageCodec::Encode(CreateTestMessage(), out);
+
+	//what JsonConvert.SerializeObject produces for the same C# Message
+	BOOST_CHECK_EQUAL(out, "{\"Type\":0,\"RequestId\":\"7d7e3b3c-2a5e-4c8e-9a6d-0b1f2e3d4c5b\","
+		"\"Command\":\"PUBLISHMESSAGE\",\"Channel\":\"TestChannel\",\"SourceId\":null,"
+		"\"DestinationId\":null,\"Payload\":\"hello\",\"BinaryPayload\":null}");
+}
+
+BOOST_AUTO_TEST_CASE(when_encoding_characters_that_need_escaping)
+{
+	MiddlewareLib::Message msg = CreateTestMessage();
+	msg.payload_ = "{\"a\":\"b\\c\"}\r\n\t\b\f\x01\x1f/\xc3\xa9\xe2\x80\xa8\xc2\x85 and a long tail to cross a vector block";
+
+	std::string out;
+	MiddlewareLib::MessageCodec::Encode(msg, out);
+	BOOST_CHECK(out.find("\"Payload\":\"{\\\"a\\\":\\\"b\\\\c\\\"}\\r\\n\\t\\b\\f\\u0001\\u001f/\xc3\xa9\\u2028\\u0085 and a long tail") != std::string::npos);
+
+	BOOST_CHECK(Decode(out).payload_ == msg.payload_);
+}
+
+BOOST_AUTO_TEST_CASE(when_encoding_into_a_reused_buffer)
+{
+	std::string out;
+	MiddlewareLib::Message msg = CreateTestMessage();
+	msg.payload_ = std::string(1000, 'x');
+	MiddlewareLib::MessageCodec::Encode(msg, out);
+	const char* buffer = out.data();
+
+	MiddlewareLib::MessageCodec::Encode(CreateTestMessage(), out);
+	BOOST_CHECK(out.data() == buffer);
+	BOOST_CHECK(Decode(out).payload_ == "hello");
+}
+
+BOOST_AUTO_TEST_CASE(when_decoding_an_encoded_message)
+{
+	MiddlewareLib::Message msg = CreateTestMessage();
+	msg.type_ = MiddlewareLib::RESPONSE_SUCCESS;
+	msg.sourceId_ = "source";
+	msg.destinationId_ = "destination";
+
+	std::string out;
+	MiddlewareLib::MessageCodec::Encode(msg, out);
+	MiddlewareLib::Message result = Decode(out);
+	BOOST_CHECK(result.type_ == msg.type_);
+	BOOST_CHECK(result.requestId_ == msg.requestId_);
+	BOOST_CHECK(result.command_ == msg.command_);
+	BOOST_CHECK(result.channel_ == msg.channel_);
+	BOOST_CHECK(result.sourceId_ == msg.sourceId_);
+	BOOST_CHECK(result.destinationId_ == msg.destinationId_);
+	BOOST_CHECK(result.payload_ == msg.payload_);
+}
+
+BOOST_AUTO_TEST_CASE(when_decoding_the_property_tree_format)
+{
+	MiddlewareLib::Message result = Decode("{\n    \"Type\": \"1\",\n    \"RequestId\": \"123\",\n"
+		"    \"Command\": \"PUBLISHMESSAGE\",\n    \"Channel\": \"TestChannel\",\n    \"SourceId\": \"\",\n"
+		"    \"DestinationId\": \"\",\n    \"Payload\": \"goodbye\"\n}\n");
+	BOOST_CHECK(result.type_ == MiddlewareLib::UPDATE);
+	BOOST_CHECK(result.requestId_ == "123");
+	BOOST_CHECK(result.sourceId_.empty());
+	BOOST_CHECK(result.payload_ == "goodbye");
+}
+
+BOOST_AUTO_TEST_CASE(when_decoding_members_in_any_order_with_unknown_members)
+{
+	MiddlewareLib::Message result = Decode("{\"Payload\":\"p\",\"Extra\":{\"a\":[1,2.5e3,true,false,null,\"x\"]},"
+		"\"Channel\":\"c\",\"BinaryPayload\":\"AAEC\",\"Type\":3,\"Command\":null}");
+	BOOST_CHECK(result.type_ == MiddlewareLib::RESPONSE_SUCCESS);
+	BOOST_CHECK(result.payload_ == "p");
+	BOOST_CHECK(result.channel_ == "c");
+	BOOST_CHECK(result.command_.empty());
+	BOOST_CHECK(result.requestId_.empty());
+}
+
+BOOST_AUTO_TEST_CASE(when_decoding_unicode_escapes)
+{
+	MiddlewareLib::Message result = Decode("{\"Type\":1,\"Payload\":\"\\u00e9\\u20ac\\ud83d\\ude00\\/\\ud800x\"}");
+	BOOST_CHECK(result.payload_ == "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80/\xef\xbf\xbdx");
+}
+
+BOOST_AUTO_TEST_CASE(when_decoding_a_view_in_place)
+{
+	std::string data = "{\"Type\":1,\"Channel\":\"c\",\"Payload\":\"a\\\"b\\u00e9\"}";
+	MiddlewareLib::MessageView view;
+	BOOST_REQUIRE(MiddlewareLib::MessageCodec::DecodeView(&data[0], data.size(), view));
+
+	BOOST_CHECK(view.type_ == MiddlewareLib::UPDATE);
+	BOOST_CHECK(view.channel_ == "c");
+	BOOST_CHECK(view.payload_ == "a\"b\xc3\xa9");
+	BOOST_CHECK(view.payload_.data() >= data.data() && view.payload_.data() < data.data() + data.size());
+	BOOST_CHECK(view.requestId_.empty());
+}
+
+BOOST_AUTO_TEST_CASE(when_decoding_malformed_documents)
+{
+	BOOST_CHECK(!IsValid(""));
+	BOOST_CHECK(!IsValid("{}"));
+	BOOST_CHECK(!IsValid("{\"Payload\":\"p\"}"));
+	BOOST_CHECK(!IsValid("{\"Type\":1,\"Payload\":\"unterminated}"));
+	BOOST_CHECK(!IsValid("{\"Type\":1,\"Payload\":42}"));
+	BOOST_CHECK(!IsValid("{\"Type\":1,}"));
+	BOOST_CHECK(!IsValid("{\"Type\":1} trailing"));
+	BOOST_CHECK(!IsValid("{\"Type\":x}"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
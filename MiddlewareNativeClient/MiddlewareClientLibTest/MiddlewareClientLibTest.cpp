@@ -5,7 +5,11 @@
 
 #include <boost/test/included/unit_test.hpp>
 
+#ifdef _WIN32
 static const char* test_file_name = ".\\middleware_tests.xml";
+#else
+static const char* test_file_name = "./middleware_tests.xml";
+#endif
 
 #include "test_redirector.h"
 
@@ -1,8 +1,11 @@
 #include "stdafx.h"
-#include <boost\test\unit_test.hpp>
+#include <boost/test/unit_test.hpp>
 #include "MiddlewareClientLib.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 namespace
 {
@@ -31,13 +34,25 @@ namespace
 	std::string TestPayload = "tes payload data";
 	std::string TestSendRequestMessage = "{\"Type\": \"0\", \"RequestId\": \"123\", \"Command\": \"SENDREQUEST\", \"Channel\": \"TestChannel\", \"DestinationId\": \"xyz\", \"SourceId\": \"1234\", \"Payload\": \"hello\"}";
 	std::string TestPublishUpdateMessage = "{\"Type\": \"1\", \"RequestId\": \"123\", \"Command\": \"PUBLISHMESSAGE\", \"Channel\": \"TestChannel\", \"DestinationId\": \"xyz\", \"SourceId\": \"1234\", \"Payload\": \"goodbye\"}";
+	std::string TestEscapedUpdateMessage = "{\"Type\":1,\"RequestId\":\"123\",\"Command\":\"PUBLISHMESSAGE\",\"Channel\":\"TestChannel\",\"SourceId\":null,\"DestinationId\":null,\"Payload\":\"{\\\"bid\\\":1.5}\"}";
 	std::string receivedPayload;
 	std::string receivedCommand;
+	std::string receivedViewPayload;
+	std::string receivedViewCommand;
+	std::string receivedError;
+	std::thread::id receivedThread;
 
 	static void handler_callback(MiddlewareLib::ISession* session, const MiddlewareLib::Message& message)
 	{
 		receivedCommand = message.command_;
 		receivedPayload = message.payload_;
+		receivedThread = std::this_thread::get_id();
+	}
+
+	static void view_handler_callback(MiddlewareLib::ISession* session, const MiddlewareLib::MessageView& message)
+	{
+		receivedViewCommand = std::string(message.command_);
+		receivedViewPayload = std::string(message.payload_);
 	}
 
 	TestSessionPtr_t CreateTestSession()
@@ -90,7 +105,7 @@ BOOST_AUTO_TEST_CASE(when_subscribing_to_a_channel_with_success)
 	bool success = MiddlewareLib::SubscribeToChannel(session.get(), params);
 	BOOST_CHECK(success);
 
-	boost::replace_first(session->data_, "\"0\"", "\"3\"");
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":3");
 	session->_handler(session.get(), session->data_);
 }
 
@@ -106,7 +121,7 @@ BOOST_AUTO_TEST_CASE(when_subscribing_to_a_channel_with_failure)
 	bool success = MiddlewareLib::SubscribeToChannel(session.get(), params);
 	BOOST_CHECK(success);
 
-	boost::replace_first(session->data_, "\"0\"", "\"2\"");
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":2");
 	//std::string newMsg = replaceMessageChars(session->data_, "\"0\"", "\"2\"");
 	session->_handler(session.get(), session->data_);
 }
@@ -124,7 +139,7 @@ BOOST_AUTO_TEST_CASE(when_Adding_listener_to_a_channel_with_success)
 	BOOST_CHECK(success);
 
 	//std::string newMsg = replaceMessageChars(session->data_, "\"0\"", "\"3\"");
-	boost::replace_first(session->data_, "\"0\"", "\"3\"");
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":3");
 	session->_handler(session.get(), session->data_);
 }
 
@@ -141,7 +156,7 @@ BOOST_AUTO_TEST_CASE(when_Adding_listener_to_a_channel_with_failure)
 	BOOST_CHECK(success);
 
 	//std::string newMsg = replaceMessageChars(session->data_, "\"0\"", "\"2\"");
-	boost::replace_first(session->data_, "\"0\"", "\"2\"");
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":2");
 	session->_handler(session.get(), session->data_);
 }
 
@@ -159,7 +174,7 @@ BOOST_AUTO_TEST_CASE(when_sending_message_to_a_channel_with_success)
 	bool success = MiddlewareLib::SendMessageToChannel(session.get(), params, TestPayload, "1234");
 	BOOST_CHECK(success);
 
-	boost::replace_first(session->data_, "\"0\"", "\"3\""); 
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":3"); 
 	//std::string newMsg = replaceMessageChars(session->data_, "\"0\"", "\"3\"");
 	session->_handler(session.get(), session->data_);
 }
@@ -176,7 +191,7 @@ BOOST_AUTO_TEST_CASE(when_sending_message_to_a_channel_with_failure)
 	bool success = MiddlewareLib::SendMessageToChannel(session.get(), params, TestPayload, "1234");
 	BOOST_CHECK(success);
 
-	boost::replace_first(session->data_, "\"0\"", "\"2\"");
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":2");
 	//std::string newMsg = replaceMessageChars(session->data_, "\"0\"", "\"2\"");
 	session->_handler(session.get(), session->data_);
 }
@@ -197,4 +212,219 @@ BOOST_AUTO_TEST_CASE(when_receiving_a_publish_update_message)
 	BOOST_CHECK(receivedPayload == "goodbye");
 }
 
+BOOST_AUTO_TEST_CASE(when_receiving_a_publish_update_message_as_a_view)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	MiddlewareLib::RegisterMessageViewCallbackFunction(view_handler_callback);
+	session->_handler(session.get(), TestEscapedUpdateMessage);
+	MiddlewareLib::RegisterMessageViewCallbackFunction(NULL);
+
+	BOOST_CHECK(receivedViewCommand == "PUBLISHMESSAGE");
+	BOOST_CHECK(receivedViewPayload == "{\"bid\":1.5}");
+	BOOST_CHECK(receivedPayload == "{\"bid\":1.5}");
+}
+
+BOOST_AUTO_TEST_CASE(when_a_response_completes_the_pending_request)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	MiddlewareLib::MiddlewareRequestParams params{ TestChannel, NULL, NULL, 1000 };
+	MiddlewareLib::SubscribeToChannel(session.get(), params);
+	MiddlewareLib::SubscribeToChannel(session.get(), params);
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(session.get()), 2u);
+
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":3");
+	session->_handler(session.get(), session->data_);
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(session.get()), 1u);
+
+	//responses are matched per session
+	TestSessionPtr_t other = CreateTestSession();
+	other->_handler(other.get(), session->data_);
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(session.get()), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_request_passes_its_deadline)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	receivedError.clear();
+	MiddlewareLib::MiddlewareRequestParams params{ TestChannel,
+		[](MiddlewareLib::ISession*, const std::string& data) -> void { BOOST_CHECK(false); },
+		[](MiddlewareLib::ISession*, const std::string& data) -> void { receivedError = data; },
+		20 };
+
+	MiddlewareLib::SubscribeToChannel(session.get(), params);
+	MiddlewareLib::ExpireRequests(session.get());
+	BOOST_CHECK(receivedError.empty());
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	MiddlewareLib::ExpireRequests(session.get());
+	BOOST_CHECK(receivedError == MiddlewareLib::REQUEST_TIMED_OUT);
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(session.get()), 0u);
+
+	//a late response is dropped
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":3");
+	session->_handler(session.get(), session->data_);
+}
+
+BOOST_AUTO_TEST_CASE(when_dispatching_on_workers)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	MiddlewareLib::StartDispatchWorkers(session.get(), 2);
+	receivedPayload.clear();
+
+	session->_handler(session.get(), TestPublishUpdateMessage);
+	//stopping waits for the queued message to be handled
+	MiddlewareLib::StopDispatchWorkers(session.get());
+
+	BOOST_CHECK(receivedCommand == "PUBLISHMESSAGE");
+	BOOST_CHECK(receivedPayload == "goodbye");
+	BOOST_CHECK(receivedThread != std::this_thread::get_id());
+
+	//nothing is dispatched once the workers have stopped
+	receivedPayload.clear();
+	session->_handler(session.get(), TestPublishUpdateMessage);
+	BOOST_CHECK(receivedPayload.empty());
+}
+
+BOOST_AUTO_TEST_CASE(when_updates_are_cached)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	MiddlewareLib::Message msg;
+	MiddlewareLib::ConflationStats stats;
+	BOOST_CHECK(!MiddlewareLib::GetLastValue(session.get(), TestChannel, msg));
+	BOOST_CHECK(!MiddlewareLib::GetConflationStats(session.get(), stats));
+
+	MiddlewareLib::LastValueCacheOptions options;
+	options.enabled = true;
+	MiddlewareLib::EnableLastValueCache(session.get(), options);
+	receivedPayload.clear();
+	session->_handler(session.get(), TestPublishUpdateMessage);
+
+	//still delivered as it arrives
+	BOOST_CHECK(receivedPayload == "goodbye");
+	BOOST_REQUIRE(MiddlewareLib::GetLastValue(session.get(), TestChannel, msg));
+	BOOST_CHECK(msg.payload_ == "goodbye");
+	BOOST_CHECK(!MiddlewareLib::GetLastValue(session.get(), "OtherChannel", msg));
+
+	//requests are not cached
+	session->_handler(session.get(), TestSendRequestMessage);
+	BOOST_REQUIRE(MiddlewareLib::GetLastValue(session.get(), TestChannel, msg));
+	BOOST_CHECK(msg.payload_ == "goodbye");
+	BOOST_CHECK_EQUAL(MiddlewareLib::DeliverConflated(session.get()), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_updates_are_conflated)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	MiddlewareLib::LastValueCacheOptions options;
+	options.enabled = true;
+	options.conflate = true;
+	MiddlewareLib::EnableLastValueCache(session.get(), options);
+	MiddlewareLib::RegisterMessageViewCallbackFunction(view_handler_callback);
+	receivedPayload.clear();
+	receivedViewPayload.clear();
+
+	session->_handler(session.get(), TestPublishUpdateMessage);
+	session->_handler(session.get(), boost::replace_first_copy(TestPublishUpdateMessage, "goodbye", "later"));
+	session->_handler(session.get(), boost::replace_first_copy(TestPublishUpdateMessage, "goodbye", "latest"));
+	BOOST_CHECK(receivedPayload.empty());
+
+	//only the latest value is handed over, once
+	BOOST_CHECK_EQUAL(MiddlewareLib::DeliverConflated(session.get()), 1u);
+	BOOST_CHECK(receivedPayload == "latest");
+	BOOST_CHECK(receivedViewPayload == "latest");
+	BOOST_CHECK_EQUAL(MiddlewareLib::DeliverConflated(session.get()), 0u);
+	MiddlewareLib::RegisterMessageViewCallbackFunction(NULL);
+
+	MiddlewareLib::ConflationStats stats;
+	BOOST_REQUIRE(MiddlewareLib::GetConflationStats(session.get(), stats));
+	BOOST_CHECK_EQUAL(stats.updates, 3u);
+	BOOST_CHECK_EQUAL(stats.conflated, 2u);
+	BOOST_CHECK_EQUAL(stats.delivered, 1u);
+	BOOST_CHECK_EQUAL(stats.waiting, 0u);
+	BOOST_CHECK_EQUAL(stats.channels, 1u);
+
+	//requests are never held back
+	session->_handler(session.get(), TestSendRequestMessage);
+	BOOST_CHECK(receivedPayload == "hello");
+}
+
+BOOST_AUTO_TEST_CASE(when_channel_handlers_share_a_subscription)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	std::vector<std::string> first;
+	std::vector<std::string> second;
+	MiddlewareLib::CHANNEL_HANDLER_FUNC handler = [](MiddlewareLib::ISession*, MiddlewareLib::ChannelId, const MiddlewareLib::MessageView& message, void* context)
+	{
+		((std::vector<std::string>*)context)->push_back(std::string(message.payload_));
+	};
+	MiddlewareLib::MiddlewareRequestParams params{ TestChannel, NULL, NULL };
+
+	uint64_t one = MiddlewareLib::AddChannelHandler(session.get(), params, handler, &first);
+	BOOST_CHECK(one != 0);
+	BOOST_CHECK(session->data_.find("SUBSCRIBETOCHANNEL") != std::string::npos);
+	session->data_.clear();
+	uint64_t two = MiddlewareLib::AddChannelHandler(session.get(), params, handler, &second);
+	BOOST_CHECK(two != 0);
+	BOOST_CHECK(session->data_.empty());
+
+	//the channel's messages go to its handlers rather than the callback
+	receivedPayload.clear();
+	session->_handler(session.get(), TestPublishUpdateMessage);
+	BOOST_CHECK(receivedPayload.empty());
+	BOOST_REQUIRE_EQUAL(first.size(), 1u);
+	BOOST_REQUIRE_EQUAL(second.size(), 1u);
+	BOOST_CHECK(first[0] == "goodbye");
+
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(session.get(), one));
+	BOOST_CHECK(session->data_.empty());
+	BOOST_CHECK(!MiddlewareLib::RemoveChannelHandler(session.get(), one));
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(session.get(), two));
+	BOOST_CHECK(session->data_.find("REMOVESUBSCRIPTION") != std::string::npos);
+
+	session->_handler(session.get(), TestPublishUpdateMessage);
+	BOOST_CHECK(receivedPayload == "goodbye");
+	BOOST_CHECK_EQUAL(first.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_channel_handler_subscription_fails)
+{
+	TestSessionPtr_t session = CreateTestSession();
+	MiddlewareLib::CHANNEL_HANDLER_FUNC handler = [](MiddlewareLib::ISession*, MiddlewareLib::ChannelId, const MiddlewareLib::MessageView&, void*) {};
+	receivedError.clear();
+	MiddlewareLib::MiddlewareRequestParams params{ TestChannel, NULL,
+		[](MiddlewareLib::ISession*, const std::string& data) -> void { receivedError = data; },
+		20 };
+
+	//refused
+	uint64_t one = MiddlewareLib::AddChannelHandler(session.get(), params, handler, NULL);
+	BOOST_REQUIRE(one != 0);
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":2");
+	session->_handler(session.get(), session->data_);
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(session.get()), 0u);
+
+	//so the next handler subscribes again, and times out
+	session->data_.clear();
+	uint64_t two = MiddlewareLib::AddChannelHandler(session.get(), params, handler, NULL);
+	BOOST_REQUIRE(two != 0);
+	BOOST_CHECK(session->data_.find("SUBSCRIBETOCHANNEL") != std::string::npos);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	MiddlewareLib::ExpireRequests(session.get());
+	BOOST_CHECK(receivedError == MiddlewareLib::REQUEST_TIMED_OUT);
+
+	//nothing upstream to remove
+	session->data_.clear();
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(session.get(), one));
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(session.get(), two));
+	BOOST_CHECK(session->data_.empty());
+
+	//a subscription that succeeds is removed as before
+	uint64_t three = MiddlewareLib::AddChannelHandler(session.get(), params, handler, NULL);
+	BOOST_REQUIRE(three != 0);
+	boost::replace_first(session->data_, "\"Type\":0", "\"Type\":3");
+	session->_handler(session.get(), session->data_);
+	session->data_.clear();
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(session.get(), three));
+	BOOST_CHECK(session->data_.find("REMOVESUBSCRIPTION") != std::string::npos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "MpscQueue.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(mpsc_queue_tests)
+
+BOOST_AUTO_TEST_CASE(when_popping_from_an_empty_queue)
+{
+	MiddlewareLib::MpscQueue<std::string> queue;
+	std::string value;
+	BOOST_CHECK(!queue.Pop(value));
+}
+
+BOOST_AUTO_TEST_CASE(when_items_are_pushed_they_are_popped_in_order)
+{
+	MiddlewareLib::MpscQueue<std::string> queue;
+	queue.Push(std::string("one"));
+	queue.Push(std::string("two"));
+
+	std::string value;
+	BOOST_REQUIRE(queue.Pop(value));
+	BOOST_CHECK_EQUAL(value, "one");
+
+	queue.Push(std::string("three"));
+	BOOST_REQUIRE(queue.Pop(value));
+	BOOST_CHECK_EQUAL(value, "two");
+	BOOST_REQUIRE(queue.Pop(value));
+	BOOST_CHECK_EQUAL(value, "three");
+	BOOST_CHECK(!queue.Pop(value));
+
+	//the queue is reusable once drained
+	queue.Push(std::string("four"));
+	BOOST_REQUIRE(queue.Pop(value));
+	BOOST_CHECK_EQUAL(value, "four");
+}
+
+BOOST_AUTO_TEST_CASE(when_items_are_left_in_the_queue_on_destruction)
+{
+	MiddlewareLib::MpscQueue<std::string> queue;
+	queue.Push(std::string(1000, 'x'));
+	queue.Push(std::string(1000, 'y'));
+}
+
+BOOST_AUTO_TEST_CASE(when_many_threads_push_concurrently)
+{
+	const int producers = 4;
+	const int perProducer = 20000;
+	MiddlewareLib::MpscQueue<std::string> queue;
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++)
+	{
+		threads.emplace_back([&queue, p]()
+		{
+			for (int i = 0; i < perProducer; i++)
+			{
+				queue.Push(std::to_string(p) + ":" + std::to_string(i));
+			}
+		});
+	}
+
+	//every item arrives once and each producer's items keep their order
+	std::vector<int> next(producers, 0);
+	int received = 0;
+	std::string value;
+	while (received < producers * perProducer)
+	{
+		if (!queue.Pop(value))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		size_t colon = value.find(':');
+		int p = std::stoi(value.substr(0, colon));
+		int i = std::stoi(value.substr(colon + 1));
+		BOOST_REQUIRE_EQUAL(i, next[p]);
+		next[p]++;
+		received++;
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	BOOST_CHECK(!queue.Pop(value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "PendingRequests.h"
+#include <random>
+#include <set>
+#include <vector>
+
+namespace
+{
+	MiddlewareLib::MiddlewareRequestParams CreateParams(uint64_t id)
+	{
+		MiddlewareLib::MiddlewareRequestParams params{ "channel" + std::to_string(id), NULL, NULL };
+		return params;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(pending_requests_tests)
+
+BOOST_AUTO_TEST_CASE(when_completing_a_request)
+{
+	MiddlewareLib::PendingRequests pending;
+	pending.Add(1, CreateParams(1), 0);
+	pending.Add(2, CreateParams(2), 0);
+
+	MiddlewareLib::MiddlewareRequestParams params;
+	BOOST_REQUIRE(pending.Complete(2, params));
+	BOOST_CHECK(params.channel == "channel2");
+	BOOST_CHECK(!pending.Complete(2, params));
+	BOOST_CHECK(!pending.Complete(3, params));
+	BOOST_CHECK_EQUAL(pending.Size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_request_passes_its_deadline)
+{
+	MiddlewareLib::PendingRequests pending;
+	pending.Add(1, CreateParams(1), 100);
+	pending.Add(2, CreateParams(2), 0);
+	pending.Add(3, CreateParams(3), 200);
+
+	std::vector<MiddlewareLib::MiddlewareRequestParams> expired;
+	pending.Expire(150, expired);
+	BOOST_REQUIRE_EQUAL(expired.size(), 1u);
+	BOOST_CHECK(expired[0].channel == "channel1");
+
+	MiddlewareLib::MiddlewareRequestParams params;
+	BOOST_CHECK(!pending.Complete(1, params));
+	BOOST_CHECK(pending.Complete(3, params));
+
+	//a completed request does not expire as well
+	expired.clear();
+	pending.Expire(1000, expired);
+	BOOST_CHECK(expired.empty());
+	BOOST_CHECK_EQUAL(pending.Size(), 1u);
+}
+
+//random adds and completions against a reference set, enough to make the
+//table grow and to exercise deletion from long probe runs
+BOOST_AUTO_TEST_CASE(when_many_requests_are_in_flight)
+{
+	MiddlewareLib::PendingRequests pending;
+	std::set<uint64_t> reference;
+	std::mt19937_64 random(11);
+	uint64_t next = 1;
+	MiddlewareLib::MiddlewareRequestParams params;
+
+	for (int i = 0; i < 200000; i++)
+	{
+		if (reference.empty() || random() % 3 != 0)
+		{
+			pending.Add(next, CreateParams(next), 0);
+			reference.insert(next++);
+		}
+		else
+		{
+			uint64_t id = 1 + random() % next;
+			bool expected = reference.erase(id) != 0;
+			BOOST_REQUIRE(pending.Complete(id, params) == expected);
+			if (expected)
+			{
+				BOOST_REQUIRE(params.channel == "channel" + std::to_string(id));
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL(pending.Size(), reference.size());
+
+	for (uint64_t id : reference)
+	{
+		BOOST_REQUIRE(pending.Complete(id, params));
+	}
+	BOOST_CHECK_EQUAL(pending.Size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_requests_are_cleared)
+{
+	MiddlewareLib::PendingRequests pending;
+	pending.Add(1, CreateParams(1), 100);
+	pending.Add(2, CreateParams(2), 0);
+
+	std::vector<MiddlewareLib::MiddlewareRequestParams> removed;
+	pending.Clear(removed);
+	BOOST_CHECK_EQUAL(pending.Size(), 0u);
+	BOOST_CHECK_EQUAL(pending.Deadlines(), 0u);
+	BOOST_REQUIRE_EQUAL(removed.size(), 2u);
+
+	//the table is still usable and the cleared deadline no longer expires
+	MiddlewareLib::MiddlewareRequestParams params;
+	BOOST_CHECK(!pending.Complete(1, params));
+	pending.Add(3, CreateParams(3), 0);
+	std::vector<MiddlewareLib::MiddlewareRequestParams> expired;
+	pending.Expire(200, expired);
+	BOOST_CHECK(expired.empty());
+	BOOST_REQUIRE(pending.Complete(3, params));
+	BOOST_CHECK_EQUAL(params.channel, "channel3");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
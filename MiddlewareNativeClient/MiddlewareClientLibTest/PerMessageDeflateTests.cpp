@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "PerMessageDeflate.h"
+#include <memory>
+#include <string>
+
+using MiddlewareLib::DeflateOptions;
+using MiddlewareLib::DeflateStats;
+using MiddlewareLib::PerMessageDeflate;
+
+namespace
+{
+	DeflateOptions Enabled()
+	{
+		DeflateOptions options;
+		options.enabled = true;
+		return options;
+	}
+
+	std::string Quotes(int count)
+	{
+		std::string quotes;
+		for (int i = 0; i < count; i++)
+		{
+			quotes += "{\"channel\":\"MarketData.EURUSD\",\"bid\":1.08" + std::to_string(i % 10) + ",\"ask\":1.09" + std::to_string(i % 7) + "}";
+		}
+		return quotes;
+	}
+
+	//a client and server that negotiated with the given options
+	struct Negotiated
+	{
+		Negotiated(const DeflateOptions& clientOptions, const DeflateOptions& serverOptions)
+		{
+			std::string response;
+			PerMessageDeflate::Respond(serverOptions, PerMessageDeflate::Offer(clientOptions), response, server);
+			BOOST_REQUIRE(server);
+			BOOST_REQUIRE(PerMessageDeflate::Accept(clientOptions, response, client));
+			BOOST_REQUIRE(client);
+		}
+
+		std::unique_ptr<PerMessageDeflate> client;
+		std::unique_ptr<PerMessageDeflate> server;
+	};
+}
+
+BOOST_AUTO_TEST_SUITE(per_message_deflate_tests)
+
+BOOST_AUTO_TEST_CASE(when_deflate_is_offered)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	BOOST_CHECK(PerMessageDeflate::Offer(DeflateOptions()).empty());
+	BOOST_CHECK_EQUAL(PerMessageDeflate::Offer(Enabled()), "permessage-deflate; client_max_window_bits");
+
+	DeflateOptions options = Enabled();
+	options.windowBits = 10;
+	options.peerWindowBits = 12;
+	options.contextTakeover = false;
+	options.peerContextTakeover = false;
+	BOOST_CHECK_EQUAL(PerMessageDeflate::Offer(options),
+		"permessage-deflate; client_max_window_bits=10; server_max_window_bits=12; client_no_context_takeover; server_no_context_takeover");
+}
+
+BOOST_AUTO_TEST_CASE(when_the_server_responds_to_the_offer)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	DeflateOptions options = Enabled();
+	options.peerWindowBits = 12;
+	std::unique_ptr<PerMessageDeflate> deflate;
+
+	//declined
+	BOOST_CHECK(PerMessageDeflate::Accept(options, "", deflate));
+	BOOST_CHECK(!deflate);
+
+	BOOST_CHECK(PerMessageDeflate::Accept(options, "permessage-deflate; server_no_context_takeover; client_max_window_bits=10; server_max_window_bits=\"11\"", deflate));
+	BOOST_CHECK(deflate);
+
+	//not what was offered
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "x-webkit-deflate-frame", deflate));
+	BOOST_CHECK(!deflate);
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "permessage-deflate; unknown", deflate));
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "permessage-deflate, permessage-deflate", deflate));
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "permessage-deflate; server_no_context_takeover; server_no_context_takeover", deflate));
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "permessage-deflate; server_max_window_bits=15", deflate));
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "permessage-deflate; client_max_window_bits=16", deflate));
+	//zlib can not compress with an 8 bit window
+	BOOST_CHECK(!PerMessageDeflate::Accept(options, "permessage-deflate; client_max_window_bits=8", deflate));
+	BOOST_CHECK(!PerMessageDeflate::Accept(DeflateOptions(), "permessage-deflate", deflate));
+}
+
+BOOST_AUTO_TEST_CASE(when_the_server_picks_an_offer)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	DeflateOptions options = Enabled();
+	options.peerWindowBits = 10;
+	std::string response;
+	std::unique_ptr<PerMessageDeflate> deflate;
+
+	PerMessageDeflate::Respond(options, "permessage-deflate; unknown, permessage-deflate; client_max_window_bits; server_no_context_takeover", response, deflate);
+	BOOST_CHECK_EQUAL(response, "permessage-deflate; server_no_context_takeover; client_max_window_bits=10");
+	BOOST_CHECK(deflate);
+
+	PerMessageDeflate::Respond(options, "x-webkit-deflate-frame", response, deflate);
+	BOOST_CHECK(response.empty());
+	BOOST_CHECK(!deflate);
+
+	PerMessageDeflate::Respond(DeflateOptions(), "permessage-deflate", response, deflate);
+	BOOST_CHECK(response.empty());
+}
+
+BOOST_AUTO_TEST_CASE(when_messages_are_compressed_with_context_takeover)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	Negotiated negotiated(Enabled(), Enabled());
+	std::string original = Quotes(20);
+
+	std::string first = original;
+	BOOST_REQUIRE(negotiated.client->Deflate(first));
+	BOOST_CHECK_LT(first.size(), original.size() / 4);
+	std::string second = original;
+	BOOST_REQUIRE(negotiated.client->Deflate(second));
+	//the second refers back to the first
+	BOOST_CHECK_LT(second.size(), first.size());
+
+	std::string inflated;
+	BOOST_REQUIRE(negotiated.server->Inflate(first.data(), first.size(), inflated));
+	BOOST_CHECK(inflated == original);
+	BOOST_REQUIRE(negotiated.server->Inflate(second.data(), second.size(), inflated));
+	BOOST_CHECK(inflated == original);
+
+	//and the other way
+	std::string reply = original;
+	BOOST_REQUIRE(negotiated.server->Deflate(reply));
+	BOOST_REQUIRE(negotiated.client->Inflate(reply.data(), reply.size(), inflated));
+	BOOST_CHECK(inflated == original);
+}
+
+BOOST_AUTO_TEST_CASE(when_messages_are_compressed_without_context_takeover)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	DeflateOptions options = Enabled();
+	options.windowBits = 9;
+	options.contextTakeover = false;
+	Negotiated negotiated(options, Enabled());
+	std::string original = Quotes(20);
+
+	std::string first = original;
+	BOOST_REQUIRE(negotiated.client->Deflate(first));
+	std::string second = original;
+	BOOST_REQUIRE(negotiated.client->Deflate(second));
+	BOOST_CHECK(first == second);
+
+	//each inflates on its own
+	std::unique_ptr<PerMessageDeflate> fresh(new PerMessageDeflate(6, 15, true, 15, true, 0));
+	std::string inflated;
+	BOOST_REQUIRE(fresh->Inflate(second.data(), second.size(), inflated));
+	BOOST_CHECK(inflated == original);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_message_is_under_the_threshold)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	PerMessageDeflate deflate(6, 15, true, 15, true, 256);
+	std::string message = Quotes(1);
+	BOOST_CHECK(!deflate.Deflate(message));
+	BOOST_CHECK(message == Quotes(1));
+
+	DeflateStats stats;
+	deflate.GetStats(stats);
+	BOOST_CHECK_EQUAL(stats.messagesSkipped, 1u);
+	BOOST_CHECK_EQUAL(stats.messagesDeflated, 0u);
+	BOOST_CHECK_EQUAL(stats.DeflateRatio(), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(when_stats_are_taken)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	Negotiated negotiated(Enabled(), Enabled());
+	std::string original = Quotes(50);
+	std::string message = original;
+	BOOST_REQUIRE(negotiated.client->Deflate(message));
+	std::string inflated;
+	BOOST_REQUIRE(negotiated.server->Inflate(message.data(), message.size(), inflated));
+
+	DeflateStats stats;
+	negotiated.client->GetStats(stats);
+	BOOST_CHECK_EQUAL(stats.messagesDeflated, 1u);
+	BOOST_CHECK_EQUAL(stats.deflateBytesIn, original.size());
+	BOOST_CHECK_EQUAL(stats.deflateBytesOut, message.size());
+	BOOST_CHECK_GT(stats.DeflateRatio(), 4.0);
+	negotiated.server->GetStats(stats);
+	BOOST_CHECK_EQUAL(stats.messagesInflated, 1u);
+	BOOST_CHECK_EQUAL(stats.inflateBytesIn, message.size());
+	BOOST_CHECK_EQUAL(stats.inflateBytesOut, original.size());
+}
+
+BOOST_AUTO_TEST_CASE(when_compressed_data_is_invalid)
+{
+	if (!PerMessageDeflate::Available())
+	{
+		return;
+	}
+	PerMessageDeflate deflate(6, 15, true, 15, true, 0);
+	std::string inflated;
+	BOOST_CHECK(!deflate.Inflate("\xff\xff\xff\xff", 4, inflated));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,329 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "EpollReactor.h"
+#include "MiddlewareClientLib.h"
+#include "StandInPeer.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	class TestHandler : public MiddlewareLib::IReactorHandler
+	{
+	public:
+		TestHandler(int fd) : fd_(fd), count_(0), ticks_(0), flushes_(0) {}
+
+		virtual void OnReady(uint32_t events)
+		{
+			char buffer[64];
+			if (events & EPOLLIN)
+			{
+				while (::read(fd_, buffer, sizeof(buffer)) > 0) {}
+				count_++;
+			}
+		}
+
+		virtual void OnTick()
+		{
+			ticks_++;
+		}
+
+		virtual void OnFlush()
+		{
+			flushes_++;
+			flushed_ = std::chrono::steady_clock::now();
+		}
+
+		int fd_;
+		std::atomic<int> count_;
+		std::atomic<int> ticks_;
+		std::atomic<int> flushes_;
+		std::chrono::steady_clock::time_point flushed_;
+	};
+
+	std::atomic<int> timedOut(0);
+
+	void on_timed_out(MiddlewareLib::ISession* session, const std::string& error)
+	{
+		timedOut++;
+	}
+
+	struct RunningReactor
+	{
+		RunningReactor()
+		{
+			thread_ = std::thread([this]() { reactor_.Run(); });
+			while (!reactor_.IsRunning())
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		~RunningReactor()
+		{
+			reactor_.Stop();
+			thread_.join();
+		}
+
+		MiddlewareLib::EpollReactor reactor_;
+		std::thread thread_;
+	};
+}
+
+BOOST_AUTO_TEST_SUITE(reactor_tests)
+
+BOOST_AUTO_TEST_CASE(when_invoking_a_task_on_a_running_reactor)
+{
+	RunningReactor running;
+	std::thread::id taskThread;
+	running.reactor_.Invoke([&taskThread]() { taskThread = std::this_thread::get_id(); });
+	BOOST_CHECK(taskThread == running.thread_.get_id());
+}
+
+BOOST_AUTO_TEST_CASE(when_invoking_a_task_on_a_stopped_reactor)
+{
+	MiddlewareLib::EpollReactor reactor;
+	std::thread::id taskThread;
+	reactor.Invoke([&taskThread]() { taskThread = std::this_thread::get_id(); });
+	BOOST_CHECK(taskThread == std::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE(when_a_ticker_is_added)
+{
+	TestHandler handler(-1);
+	RunningReactor running;
+	running.reactor_.Invoke([&]() { running.reactor_.AddTicker(&handler); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(5 * MiddlewareLib::EpollReactor::TICK_MS));
+	running.reactor_.Invoke([&]() { running.reactor_.RemoveTicker(&handler); });
+
+	int ticks = handler.ticks_;
+	BOOST_CHECK(ticks >= 2);
+	std::this_thread::sleep_for(std::chrono::milliseconds(3 * MiddlewareLib::EpollReactor::TICK_MS));
+	BOOST_CHECK_EQUAL(handler.ticks_, ticks);
+}
+
+BOOST_AUTO_TEST_CASE(when_flushes_are_scheduled_during_a_cycle)
+{
+	TestHandler handler(-1);
+	RunningReactor running;
+	int flushesInCycle = -1;
+	running.reactor_.Invoke([&]()
+	{
+		running.reactor_.ScheduleFlush(&handler);
+		running.reactor_.ScheduleFlush(&handler);
+		flushesInCycle = handler.flushes_;
+	});
+	running.reactor_.Invoke([]() {});
+
+	//once, after the task that scheduled it
+	BOOST_CHECK_EQUAL(flushesInCycle, 0);
+	BOOST_CHECK_EQUAL(handler.flushes_, 1);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_flush_is_delayed)
+{
+	TestHandler handler(-1);
+	RunningReactor running;
+	auto scheduled = std::chrono::steady_clock::now();
+	running.reactor_.Invoke([&]()
+	{
+		running.reactor_.ScheduleFlush(&handler, std::chrono::microseconds(2000));
+		running.reactor_.ScheduleFlush(&handler, std::chrono::microseconds(500000));
+	});
+	for (int i = 0; i < 1000 && handler.flushes_ == 0; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	running.reactor_.Invoke([]() {});
+
+	//the earlier of the two
+	BOOST_REQUIRE_EQUAL(handler.flushes_, 1);
+	auto waited = handler.flushed_ - scheduled;
+	BOOST_CHECK(waited >= std::chrono::microseconds(2000));
+	BOOST_CHECK(waited < std::chrono::milliseconds(400));
+}
+
+BOOST_AUTO_TEST_CASE(when_a_scheduled_flush_is_cancelled)
+{
+	TestHandler handler(-1);
+	RunningReactor running;
+	running.reactor_.Invoke([&]()
+	{
+		running.reactor_.ScheduleFlush(&handler, std::chrono::microseconds(1000));
+		running.reactor_.CancelFlush(&handler);
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	BOOST_CHECK_EQUAL(handler.flushes_, 0);
+}
+
+BOOST_AUTO_TEST_CASE(when_many_handlers_schedule_flushes)
+{
+	const int Handlers = 200;
+	std::vector<std::unique_ptr<TestHandler>> handlers;
+	for (int i = 0; i < Handlers; i++)
+	{
+		handlers.push_back(std::unique_ptr<TestHandler>(new TestHandler(-1)));
+	}
+
+	RunningReactor running;
+	running.reactor_.Invoke([&]()
+	{
+		//in reverse, so the earliest is scheduled last
+		for (int i = Handlers - 1; i >= 0; i--)
+		{
+			running.reactor_.ScheduleFlush(handlers[i].get(), std::chrono::microseconds(1000 + i * 100));
+		}
+		//every other one again, sooner
+		for (int i = 0; i < Handlers; i += 2)
+		{
+			running.reactor_.ScheduleFlush(handlers[i].get(), std::chrono::microseconds(500));
+		}
+		for (int i = 1; i < Handlers; i += 4)
+		{
+			running.reactor_.CancelFlush(handlers[i].get());
+		}
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	running.reactor_.Invoke([]() {});
+
+	//the rest once each, the odd ones in the order they were due
+	for (int i = 0; i < Handlers; i++)
+	{
+		BOOST_CHECK_EQUAL(handlers[i]->flushes_, i % 4 == 1 ? 0 : 1);
+	}
+	for (int i = 7; i < Handlers; i += 4)
+	{
+		BOOST_CHECK(handlers[i - 4]->flushed_ <= handlers[i]->flushed_);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(when_a_registered_descriptor_becomes_readable)
+{
+	int fds[2];
+	BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+
+	TestHandler handler(fds[0]);
+	{
+		RunningReactor running;
+		running.reactor_.Invoke([&]() { BOOST_CHECK(running.reactor_.Add(fds[0], EPOLLIN, &handler)); });
+
+		BOOST_CHECK(::write(fds[1], "x", 1) == 1);
+		for (int i = 0; i < 1000 && handler.count_ == 0; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		BOOST_CHECK(handler.count_ == 1);
+
+		running.reactor_.Invoke([&]() { running.reactor_.Remove(fds[0], &handler); });
+	}
+
+	::close(fds[0]);
+	::close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(when_one_reactor_drives_many_descriptors)
+{
+	const int Connections = 500;
+	std::vector<int> fds(Connections * 2);
+	std::vector<std::unique_ptr<TestHandler>> handlers;
+
+	RunningReactor running;
+	for (int i = 0; i < Connections; i++)
+	{
+		BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[i * 2]) == 0);
+		handlers.push_back(std::unique_ptr<TestHandler>(new TestHandler(fds[i * 2])));
+		TestHandler* handler = handlers.back().get();
+		running.reactor_.Invoke([&, handler]() { running.reactor_.Add(handler->fd_, EPOLLIN, handler); });
+	}
+
+	for (int i = 0; i < Connections; i++)
+	{
+		BOOST_CHECK(::write(fds[i * 2 + 1], "x", 1) == 1);
+	}
+
+	int ready = 0;
+	for (int wait = 0; wait < 1000 && ready != Connections; wait++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		ready = 0;
+		for (auto& handler : handlers)
+		{
+			ready += handler->count_ > 0 ? 1 : 0;
+		}
+	}
+	BOOST_CHECK(ready == Connections);
+
+	running.reactor_.Invoke([&]()
+	{
+		for (auto& handler : handlers)
+		{
+			running.reactor_.Remove(handler->fd_, handler.get());
+		}
+	});
+
+	for (int fd : fds)
+	{
+		::close(fd);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(when_handing_out_reactors_from_a_pool)
+{
+	MiddlewareLib::ReactorPool pool(2);
+	MiddlewareLib::EpollReactor* first = &pool.Next();
+	MiddlewareLib::EpollReactor* second = &pool.Next();
+	BOOST_CHECK(first != second);
+	BOOST_CHECK(first == &pool.Next());
+	BOOST_CHECK(first->IsRunning());
+	BOOST_CHECK(second->IsRunning());
+}
+
+BOOST_AUTO_TEST_CASE(when_an_attached_session_is_idle_the_loop_sleeps)
+{
+	MiddlewareLib::StandInPeer peer;
+	BOOST_REQUIRE(peer.Start());
+	MiddlewareLib::ReactorPool pool(1);
+	MiddlewareLib::EpollReactor& reactor = pool.Next();
+	MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(&pool, peer.Url().c_str());
+	MiddlewareLib::StartDispatching(session);
+	std::this_thread::sleep_for(std::chrono::milliseconds(2 * MiddlewareLib::EpollReactor::TICK_MS));
+
+	uint64_t wakeups = reactor.Wakeups();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10 * MiddlewareLib::EpollReactor::TICK_MS));
+	BOOST_CHECK_EQUAL(reactor.Wakeups(), wakeups);
+
+	//a request with a deadline ticks the loop until it has expired. The
+	//peer may answer a request or so before it notices the pause.
+	peer.Pause(true);
+	timedOut = 0;
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", NULL, on_timed_out, 3 * MiddlewareLib::EpollReactor::TICK_MS };
+	for (int attempt = 0; attempt < 10 && timedOut == 0; attempt++)
+	{
+		wakeups = reactor.Wakeups();
+		BOOST_REQUIRE(MiddlewareLib::SendRequest(session, params, "stalled"));
+		for (int i = 0; i < 200 && MiddlewareLib::PendingRequestCount(session) > 0; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(MiddlewareLib::EpollReactor::TICK_MS));
+		}
+	}
+	BOOST_REQUIRE_EQUAL(timedOut, 1);
+	BOOST_REQUIRE_EQUAL(MiddlewareLib::PendingRequestCount(session), 0u);
+	BOOST_CHECK_GE(reactor.Wakeups(), wakeups + 3);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(2 * MiddlewareLib::EpollReactor::TICK_MS));
+	wakeups = reactor.Wakeups();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10 * MiddlewareLib::EpollReactor::TICK_MS));
+	BOOST_CHECK_EQUAL(reactor.Wakeups(), wakeups);
+
+	peer.Pause(false);
+	MiddlewareLib::DestroySession(session);
+	peer.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "ReceiveBuffer.h"
+#include <string>
+
+namespace
+{
+	void Write(MiddlewareLib::ReceiveBuffer& buffer, const std::string& data)
+	{
+		char* out = buffer.WritePtr();
+		BOOST_REQUIRE(buffer.Writable() >= data.size());
+		memcpy(out, data.data(), data.size());
+		buffer.Commit(data.size());
+	}
+
+	std::string Read(MiddlewareLib::ReceiveBuffer& buffer, size_t size)
+	{
+		BOOST_REQUIRE(buffer.Size() >= size);
+		std::string data(buffer.Data(), size);
+		buffer.Consume(size);
+		return data;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(receive_buffer_tests)
+
+BOOST_AUTO_TEST_CASE(when_consuming_without_moving_data)
+{
+	MiddlewareLib::ReceiveBuffer buffer(16);
+	Write(buffer, "aaaabbbb");
+	const char* second = buffer.Data() + 4;
+
+	BOOST_CHECK(Read(buffer, 4) == "aaaa");
+	BOOST_CHECK(buffer.Data() == second);
+	BOOST_CHECK_EQUAL(buffer.Size(), 4u);
+	BOOST_CHECK_EQUAL(buffer.Writable(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_write_cursor_reaches_the_end)
+{
+	MiddlewareLib::ReceiveBuffer buffer(16);
+	Write(buffer, "0123456789abcdef");
+	BOOST_CHECK_EQUAL(buffer.Writable(), 0u);
+	Read(buffer, 10);
+
+	//the unread bytes move to the front to make room
+	buffer.WritePtr();
+	BOOST_CHECK_EQUAL(buffer.Writable(), 10u);
+	Write(buffer, "ghij");
+	BOOST_CHECK(Read(buffer, 10) == "abcdefghij");
+}
+
+BOOST_AUTO_TEST_CASE(when_the_buffer_is_full_of_unread_data)
+{
+	MiddlewareLib::ReceiveBuffer buffer(8);
+	Write(buffer, "01234567");
+	buffer.WritePtr();
+	BOOST_CHECK_EQUAL(buffer.Writable(), 0u);
+	BOOST_CHECK_EQUAL(buffer.Size(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(when_reserving_a_frame_larger_than_the_capacity)
+{
+	MiddlewareLib::ReceiveBuffer buffer(8);
+	Write(buffer, "xx0123");
+	Read(buffer, 2);
+
+	buffer.Reserve(20);
+	BOOST_CHECK_EQUAL(buffer.Capacity(), 20u);
+	Write(buffer, "456789abcdefghij");
+	BOOST_CHECK(Read(buffer, 20) == "0123456789abcdefghij");
+
+	//back to the configured size once the frame has gone
+	BOOST_CHECK_EQUAL(buffer.Capacity(), 8u);
+	BOOST_CHECK_EQUAL(buffer.Size(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "RequestFuture.h"
+#include <thread>
+
+namespace
+{
+	int resumed = 0;
+
+	void resume(void* arg)
+	{
+		resumed++;
+	}
+
+#ifdef MIDDLEWARE_HAVE_COROUTINES
+	//a coroutine that runs until its first suspension when called
+	struct Task
+	{
+		struct promise_type
+		{
+			Task get_return_object() { return Task(); }
+			std::suspend_never initial_suspend() { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { throw; }
+		};
+	};
+
+	Task Await(MiddlewareLib::RequestFuture future, MiddlewareLib::RequestResult& result, bool& done)
+	{
+		result = co_await future;
+		done = true;
+	}
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE(request_future_tests)
+
+BOOST_AUTO_TEST_CASE(when_a_future_is_not_attached)
+{
+	MiddlewareLib::RequestFuture future;
+	BOOST_CHECK(!future.Valid());
+	BOOST_CHECK(!future.Ready());
+}
+
+BOOST_AUTO_TEST_CASE(when_the_request_succeeds)
+{
+	MiddlewareLib::MiddlewareRequestParams params;
+	MiddlewareLib::RequestFuture future = MiddlewareLib::RequestFuture::Attach(params);
+	BOOST_REQUIRE(params.completion != NULL);
+	BOOST_CHECK(future.Valid());
+	BOOST_CHECK(!future.Ready());
+	BOOST_CHECK(!future.WaitFor(1));
+
+	params.completion->Complete(NULL, true, "payload");
+	BOOST_CHECK(future.Ready());
+	BOOST_CHECK(future.Get().success);
+	BOOST_CHECK_EQUAL(future.Get().payload, "payload");
+
+	//only the first outcome counts
+	params.completion->Complete(NULL, false, MiddlewareLib::REQUEST_TIMED_OUT);
+	BOOST_CHECK(future.Get().success);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_response_arrives_on_another_thread)
+{
+	MiddlewareLib::MiddlewareRequestParams params;
+	MiddlewareLib::RequestFuture future = MiddlewareLib::RequestFuture::Attach(params);
+	MiddlewareLib::RequestFuture copy(future);
+	std::thread dispatcher([&params]()
+	{
+		params.completion->Complete(NULL, false, "failed");
+	});
+	BOOST_CHECK(!copy.Get().success);
+	BOOST_CHECK_EQUAL(copy.Get().payload, "failed");
+	dispatcher.join();
+	BOOST_CHECK(future.Ready());
+}
+
+BOOST_AUTO_TEST_CASE(when_a_continuation_is_set)
+{
+	resumed = 0;
+	MiddlewareLib::MiddlewareRequestParams params;
+	MiddlewareLib::RequestFuture future = MiddlewareLib::RequestFuture::Attach(params);
+	BOOST_CHECK(future.ContinueWith(resume, NULL));
+	BOOST_CHECK_EQUAL(resumed, 0);
+	params.completion->Complete(NULL, true, "");
+	BOOST_CHECK_EQUAL(resumed, 1);
+
+	//too late, the caller carries on itself
+	BOOST_CHECK(!future.ContinueWith(resume, NULL));
+	BOOST_CHECK_EQUAL(resumed, 1);
+}
+
+BOOST_AUTO_TEST_CASE(when_futures_are_attached_to_the_same_params)
+{
+	MiddlewareLib::MiddlewareRequestParams params;
+	MiddlewareLib::RequestFuture first = MiddlewareLib::RequestFuture::Attach(params);
+	MiddlewareLib::RequestFuture second = MiddlewareLib::RequestFuture::Attach(params);
+
+	//the first is chained rather than replaced
+	params.completion->Complete(NULL, false, "failed");
+	BOOST_REQUIRE(first.Ready());
+	BOOST_REQUIRE(second.Ready());
+	BOOST_CHECK_EQUAL(first.Get().payload, "failed");
+	BOOST_CHECK_EQUAL(second.Get().payload, "failed");
+}
+
+#ifdef MIDDLEWARE_HAVE_COROUTINES
+BOOST_AUTO_TEST_CASE(when_a_coroutine_awaits_the_response)
+{
+	MiddlewareLib::MiddlewareRequestParams params;
+	MiddlewareLib::RequestFuture future = MiddlewareLib::RequestFuture::Attach(params);
+	MiddlewareLib::RequestResult result;
+	bool done = false;
+	Await(future, result, done);
+	BOOST_CHECK(!done);
+
+	//resumed by the completion
+	params.completion->Complete(NULL, true, "awaited");
+	BOOST_CHECK(done);
+	BOOST_CHECK(result.success);
+	BOOST_CHECK_EQUAL(result.payload, "awaited");
+
+	//already complete, so it does not suspend
+	done = false;
+	Await(future, result, done);
+	BOOST_CHECK(done);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,54 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "RequestId.h"
+#include <set>
+#include <string>
+
+namespace
+{
+	std::string NextId(MiddlewareLib::RequestIdGenerator& generator)
+	{
+		char id[MiddlewareLib::RequestIdGenerator::MAX_SIZE];
+		size_t size = generator.Next(id);
+		BOOST_REQUIRE(size <= MiddlewareLib::RequestIdGenerator::MAX_SIZE);
+		return std::string(id, size);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(request_id_tests)
+
+BOOST_AUTO_TEST_CASE(when_generating_request_ids)
+{
+	MiddlewareLib::RequestIdGenerator generator;
+	std::string first = NextId(generator);
+	std::string second = NextId(generator);
+
+	BOOST_CHECK_EQUAL(first.size(), 34u);
+	BOOST_CHECK(first.find_first_not_of("0123456789abcdef-") == std::string::npos);
+	BOOST_CHECK(first.substr(0, 33) == second.substr(0, 33));
+	BOOST_CHECK(first.substr(32) == "-1");
+	BOOST_CHECK(second.substr(32) == "-2");
+}
+
+BOOST_AUTO_TEST_CASE(when_the_counter_needs_more_digits)
+{
+	MiddlewareLib::RequestIdGenerator generator;
+	std::set<std::string> ids;
+	std::string id;
+	for (int i = 0; i < 256; i++)
+	{
+		id = NextId(generator);
+		ids.insert(id);
+	}
+	BOOST_CHECK_EQUAL(ids.size(), 256u);
+	BOOST_CHECK(id.substr(32) == "-100");
+}
+
+BOOST_AUTO_TEST_CASE(when_generators_are_independent)
+{
+	MiddlewareLib::RequestIdGenerator first;
+	MiddlewareLib::RequestIdGenerator second;
+	BOOST_CHECK(NextId(first) != NextId(second));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
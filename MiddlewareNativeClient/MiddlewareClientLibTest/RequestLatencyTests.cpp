@@ -0,0 +1,136 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "RequestLatency.h"
+#include "PendingRequests.h"
+#include <sstream>
+#include <string>
+
+using MiddlewareLib::RequestLatency;
+using MiddlewareLib::RequestLatencySnapshot;
+using MiddlewareLib::RequestTiming;
+
+BOOST_AUTO_TEST_SUITE(request_latency_tests)
+
+BOOST_AUTO_TEST_CASE(when_a_request_completes)
+{
+	RequestLatency latency;
+	RequestTiming timing;
+	latency.Start("SENDREQUEST", "Channel", 1000, timing);
+	BOOST_CHECK_EQUAL(timing.sent, 1000u);
+	RequestLatency::Finish(timing, 6000);
+
+	RequestLatencySnapshot snapshot;
+	latency.Snapshot(snapshot, false);
+	BOOST_REQUIRE_EQUAL(snapshot.commands.size(), 1u);
+	BOOST_REQUIRE_EQUAL(snapshot.channels.size(), 1u);
+	BOOST_CHECK_EQUAL(snapshot.commands["SENDREQUEST"].Count(), 1u);
+	BOOST_CHECK_EQUAL(snapshot.commands["SENDREQUEST"].Max(), 5000u);
+	BOOST_CHECK_EQUAL(snapshot.channels["Channel"].Count(), 1u);
+	BOOST_CHECK_EQUAL(snapshot.channels["Channel"].Min(), 5000u);
+}
+
+BOOST_AUTO_TEST_CASE(when_commands_and_channels_are_kept_apart)
+{
+	RequestLatency latency;
+	RequestTiming timing;
+	latency.Start("SENDREQUEST", "First", 0, timing);
+	RequestLatency::Finish(timing, 100);
+	latency.Start("SENDREQUEST", "Second", 0, timing);
+	RequestLatency::Finish(timing, 200);
+	latency.Start("PUBLISHMESSAGE", "First", 0, timing);
+	RequestLatency::Finish(timing, 300);
+
+	RequestLatencySnapshot snapshot;
+	latency.Snapshot(snapshot, false);
+	BOOST_CHECK_EQUAL(snapshot.commands["SENDREQUEST"].Count(), 2u);
+	BOOST_CHECK_EQUAL(snapshot.commands["PUBLISHMESSAGE"].Count(), 1u);
+	BOOST_CHECK_EQUAL(snapshot.channels["First"].Count(), 2u);
+	BOOST_CHECK_EQUAL(snapshot.channels["First"].Max(), 300u);
+	BOOST_CHECK_EQUAL(snapshot.channels["Second"].Count(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_snapshot_resets_the_histograms)
+{
+	RequestLatency latency;
+	RequestTiming timing;
+	latency.Start("SENDREQUEST", "Channel", 0, timing);
+	RequestLatency::Finish(timing, 100);
+
+	RequestLatencySnapshot first;
+	latency.Snapshot(first, true);
+	BOOST_CHECK_EQUAL(first.channels["Channel"].Count(), 1u);
+
+	//the histograms are kept, empty
+	RequestLatencySnapshot second;
+	latency.Snapshot(second, false);
+	BOOST_REQUIRE_EQUAL(second.channels.size(), 1u);
+	BOOST_CHECK_EQUAL(second.channels["Channel"].Count(), 0u);
+
+	//requests still pending are recorded when they complete
+	RequestLatency::Finish(timing, 200);
+	RequestLatencySnapshot third;
+	latency.Snapshot(third, false);
+	BOOST_CHECK_EQUAL(third.channels["Channel"].Count(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_requests_are_sent_on_too_many_channels)
+{
+	RequestLatency latency;
+	RequestTiming timing;
+	for (size_t i = 0; i < RequestLatency::MAX_CHANNELS + 10; i++)
+	{
+		latency.Start("SENDREQUEST", "Channel" + std::to_string(i), 0, timing);
+		RequestLatency::Finish(timing, 100);
+	}
+	//known channels still have their own
+	latency.Start("SENDREQUEST", "Channel0", 0, timing);
+	RequestLatency::Finish(timing, 100);
+
+	RequestLatencySnapshot snapshot;
+	latency.Snapshot(snapshot, false);
+	BOOST_CHECK_EQUAL(snapshot.channels.size(), RequestLatency::MAX_CHANNELS + 1);
+	BOOST_CHECK_EQUAL(snapshot.channels["Channel0"].Count(), 2u);
+	BOOST_CHECK_EQUAL(snapshot.channels[MiddlewareLib::OTHER_CHANNELS].Count(), 10u);
+	BOOST_CHECK_EQUAL(snapshot.commands["SENDREQUEST"].Count(), RequestLatency::MAX_CHANNELS + 11);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_timing_is_kept_with_the_pending_request)
+{
+	RequestLatency latency;
+	MiddlewareLib::PendingRequests pending;
+	MiddlewareLib::MiddlewareRequestParams params{ "Channel", NULL, NULL };
+	RequestTiming timing;
+	latency.Start("SENDREQUEST", params.channel, 500, timing);
+	pending.Add(1, params, 0, timing);
+
+	RequestTiming completed;
+	BOOST_REQUIRE(pending.Complete(1, params, &completed));
+	BOOST_CHECK_EQUAL(completed.sent, 500u);
+	BOOST_CHECK(completed.command == timing.command);
+	BOOST_CHECK(completed.channel == timing.channel);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_snapshot_is_written_as_xml)
+{
+	RequestLatency latency;
+	RequestTiming timing;
+	latency.Start("SENDREQUEST", "Prices<EUR&USD>", 0, timing);
+	RequestLatency::Finish(timing, 2500);
+
+	RequestLatencySnapshot snapshot;
+	latency.Snapshot(snapshot, false);
+	std::ostringstream out;
+	MiddlewareLib::WriteRequestLatencyXml(snapshot, out);
+	std::string xml = out.str();
+
+	BOOST_CHECK(xml.find("<stats>\n<channels>\n\t<channel>\n\t\t<name>Prices&lt;EUR&amp;USD&gt;</name>\n\t\t<requests>1</requests>\n") != std::string::npos);
+	BOOST_CHECK(xml.find("<max-us>2.500</max-us>") != std::string::npos);
+	BOOST_CHECK(xml.find("<commands>\n\t<command>\n\t\t<name>SENDREQUEST</name>") != std::string::npos);
+	BOOST_CHECK(xml.find("</commands>\n</stats>\n") != std::string::npos);
+
+	//the stream's formatting is left as it was
+	out << 1.5;
+	BOOST_CHECK(out.str().substr(xml.size()) == "1.5");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "SendQueue.h"
+#include <string>
+
+namespace
+{
+	void Push(MiddlewareLib::SendQueue& queue, const char* header, const std::string& payload)
+	{
+		queue.Push((const uint8_t*)header, strlen(header), std::string(payload));
+	}
+
+	//what a gathered write of the whole queue would send
+	std::string Gathered(const MiddlewareLib::SendQueue& queue, int max = 16, size_t maxBytes = (size_t)-1)
+	{
+		MiddlewareLib::SendQueue::Segment segments[16];
+		int count = queue.Gather(segments, max, maxBytes);
+		std::string data;
+		for (int i = 0; i < count; i++)
+		{
+			data.append(segments[i].data, segments[i].size);
+		}
+		return data;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(send_queue_tests)
+
+BOOST_AUTO_TEST_CASE(when_gathering_queued_frames)
+{
+	MiddlewareLib::SendQueue queue;
+	Push(queue, "h1", "payload1");
+	Push(queue, "h2", "");
+	Push(queue, "h3", "payload3");
+
+	BOOST_CHECK_EQUAL(queue.Size(), 22u);
+	BOOST_CHECK(Gathered(queue) == "h1payload1h2h3payload3");
+}
+
+BOOST_AUTO_TEST_CASE(when_the_payload_is_moved_into_the_queue)
+{
+	MiddlewareLib::SendQueue queue;
+	std::string payload(1000, 'x');
+	const char* data = payload.data();
+	queue.Push((const uint8_t*)"h", 1, std::move(payload));
+
+	MiddlewareLib::SendQueue::Segment segments[2];
+	BOOST_REQUIRE_EQUAL(queue.Gather(segments, 2), 2);
+	BOOST_CHECK(segments[1].data == data);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_write_is_partial)
+{
+	MiddlewareLib::SendQueue queue;
+	Push(queue, "h1", "payload1");
+	Push(queue, "h2", "payload2");
+
+	queue.Advance(1);
+	BOOST_CHECK(Gathered(queue) == "1payload1h2payload2");
+	queue.Advance(5);
+	BOOST_CHECK(Gathered(queue) == "oad1h2payload2");
+	queue.Advance(6);
+	BOOST_CHECK(Gathered(queue) == "payload2");
+	BOOST_CHECK_EQUAL(queue.Size(), 8u);
+
+	queue.Advance(8);
+	BOOST_CHECK(queue.Empty());
+	BOOST_CHECK_EQUAL(queue.Size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_there_are_more_segments_than_fit)
+{
+	MiddlewareLib::SendQueue queue;
+	Push(queue, "h1", "p1");
+	Push(queue, "h2", "p2");
+
+	BOOST_CHECK(Gathered(queue, 3) == "h1p1h2");
+}
+
+BOOST_AUTO_TEST_CASE(when_a_write_is_limited_in_bytes)
+{
+	MiddlewareLib::SendQueue queue;
+	Push(queue, "h1", "payload1");
+	Push(queue, "h2", "payload2");
+
+	BOOST_CHECK(Gathered(queue, 16, 10) == "h1payload1");
+	BOOST_CHECK(Gathered(queue, 16, 13) == "h1payload1h2p");
+	BOOST_CHECK(Gathered(queue, 16, 1) == "h");
+}
+
+BOOST_AUTO_TEST_CASE(when_frames_are_completely_written)
+{
+	MiddlewareLib::SendQueue queue;
+	Push(queue, "h1", "p1");
+	Push(queue, "h2", "p2");
+	Push(queue, "h3", "p3");
+
+	BOOST_CHECK_EQUAL(queue.Advance(3), 0u);
+	BOOST_CHECK_EQUAL(queue.Advance(5), 2u);
+	BOOST_CHECK_EQUAL(queue.Advance(4), 1u);
+	BOOST_CHECK(queue.Empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,819 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "MiddlewareClientLib.h"
+#include "Handshake.h"
+#include "MessageCodec.h"
+#include "RequestFuture.h"
+#include "RequestLatency.h"
+#include "StandInPeer.h"
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	std::mutex responseLock;
+	std::string response;
+	std::atomic<int> responses(0);
+
+	void on_success(MiddlewareLib::ISession* session, const std::string& data)
+	{
+		std::lock_guard<std::mutex> lock(responseLock);
+		response = data;
+		responses++;
+	}
+
+	void on_error(MiddlewareLib::ISession* session, const std::string& data)
+	{
+		BOOST_ERROR("request failed: " + data);
+	}
+
+	std::atomic<int> filled(0);
+	std::atomic<int> drained(0);
+
+	void on_watermark(MiddlewareLib::ISession* session, bool full, size_t queuedBytes)
+	{
+		(full ? filled : drained)++;
+	}
+
+	bool WaitForResponses(int count)
+	{
+		for (int i = 0; i < 2000 && responses < count; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return responses >= count;
+	}
+
+	//a session on a pool thread connected to a stand in peer
+	struct Connected
+	{
+		Connected(bool peerBinary, bool offerBinary, bool deflate = false,
+			const MiddlewareLib::CoalescingOptions& coalescing = MiddlewareLib::CoalescingOptions(),
+			const MiddlewareLib::TransmitBufferOptions& transmitBuffer = MiddlewareLib::TransmitBufferOptions()) : peer(peerBinary)
+		{
+			MiddlewareLib::SessionOptions options;
+			options.binaryMessages = offerBinary;
+			options.coalescing = coalescing;
+			options.transmitBuffer = transmitBuffer;
+			options.deflate.enabled = deflate;
+			peer.SetDeflate(options.deflate);
+			BOOST_REQUIRE(peer.Start());
+			pool = MiddlewareLib::CreateReactorPool(1);
+			session = MiddlewareLib::CreateSession(pool, peer.Url().c_str(), options);
+			MiddlewareLib::StartDispatching(session);
+			responses = 0;
+		}
+
+		~Connected()
+		{
+			MiddlewareLib::DestroySession(session);
+			MiddlewareLib::DestroyReactorPool(pool);
+			peer.Stop();
+		}
+
+		std::string Request(const std::string& payload)
+		{
+			int expected = responses + 1;
+			MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", on_success, on_error, 2000 };
+			BOOST_CHECK(MiddlewareLib::SendRequest(session, params, payload));
+			BOOST_REQUIRE(WaitForResponses(expected));
+			std::lock_guard<std::mutex> lock(responseLock);
+			return response;
+		}
+
+		MiddlewareLib::StandInPeer peer;
+		MiddlewareLib::ReactorPool* pool;
+		MiddlewareLib::ISession* session;
+	};
+}
+
+namespace
+{
+	//accepts one connection and answers its upgrade request with whatever the
+	//test returns, for handshakes the stand in peer gets right
+	class ScriptedPeer
+	{
+	public:
+		typedef std::function<std::string(const std::string& request)> Answer_t;
+
+		//an empty answer never replies
+		explicit ScriptedPeer(Answer_t answer) : answer_(answer), connectionFd_(-1)
+		{
+			listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t size = sizeof(addr);
+			BOOST_REQUIRE(bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) == 0);
+			BOOST_REQUIRE(listen(listenFd_, 1) == 0);
+			getsockname(listenFd_, (sockaddr*)&addr, &size);
+			port_ = ntohs(addr.sin_port);
+			thread_ = std::thread([this]() { Serve(); });
+		}
+
+		~ScriptedPeer()
+		{
+			::shutdown(listenFd_, SHUT_RDWR);
+			if (connectionFd_ >= 0)
+			{
+				::shutdown(connectionFd_, SHUT_RDWR);
+			}
+			thread_.join();
+			::close(connectionFd_);
+			::close(listenFd_);
+		}
+
+		std::string Url() const
+		{
+			return "ws://127.0.0.1:" + std::to_string(port_);
+		}
+
+		//the accept a correct server would send for request
+		static std::string Accept(const std::string& request)
+		{
+			const std::string name("Sec-WebSocket-Key: ");
+			size_t begin = request.find(name) + name.size();
+			return MiddlewareLib::Handshake::Accept(request.substr(begin, request.find("\r\n", begin) - begin));
+		}
+
+	private:
+		void Serve()
+		{
+			connectionFd_ = ::accept(listenFd_, NULL, NULL);
+			if (connectionFd_ < 0)
+			{
+				return;
+			}
+			std::string request;
+			char buffer[4096];
+			ssize_t n;
+			while (request.find("\r\n\r\n") == std::string::npos &&
+				(n = ::recv(connectionFd_, buffer, sizeof(buffer), 0)) > 0)
+			{
+				request.append(buffer, (size_t)n);
+			}
+			std::string answer = answer_(request);
+			if (!answer.empty())
+			{
+				::send(connectionFd_, answer.data(), answer.size(), MSG_NOSIGNAL);
+			}
+			//hold the connection open until the test is done
+			while (::recv(connectionFd_, buffer, sizeof(buffer), 0) > 0) {}
+		}
+
+		Answer_t answer_;
+		int listenFd_;
+		std::atomic<int> connectionFd_;
+		int port_;
+		std::thread thread_;
+	};
+
+	std::string Switching(const std::string& accept)
+	{
+		return "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " + accept + "\r\n\r\n";
+	}
+
+	std::mutex updateLock;
+	std::string update;
+
+	void on_update(MiddlewareLib::ISession* session, const MiddlewareLib::MessageView& message)
+	{
+		std::lock_guard<std::mutex> lock(updateLock);
+		update.assign(message.payload_.data(), message.payload_.size());
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(session_tests)
+
+BOOST_AUTO_TEST_CASE(when_the_peer_selects_the_binary_envelope)
+{
+	Connected connected(true, true);
+	BOOST_CHECK(connected.session->BinaryMessages());
+
+	//any bytes make the round trip
+	std::string payload("raw\0\x01\xff\"\\", 8);
+	BOOST_CHECK(connected.Request(payload) == payload);
+	BOOST_CHECK_EQUAL(connected.peer.Received(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_peer_only_speaks_json)
+{
+	Connected connected(false, true);
+	BOOST_CHECK(!connected.session->BinaryMessages());
+	BOOST_CHECK(connected.Request("{\"bid\":1.5}") == "{\"bid\":1.5}");
+}
+
+BOOST_AUTO_TEST_CASE(when_binary_is_not_offered)
+{
+	Connected connected(true, false);
+	BOOST_CHECK(!connected.session->BinaryMessages());
+	BOOST_CHECK(connected.Request("hello") == "hello");
+}
+
+BOOST_AUTO_TEST_CASE(when_deflate_is_negotiated)
+{
+	Connected connected(true, true, true);
+	MiddlewareLib::DeflateStats stats;
+	if (!connected.session->GetDeflateStats(stats))
+	{
+		//built without zlib
+		return;
+	}
+
+	std::string payload;
+	for (int i = 0; i < 100; i++)
+	{
+		payload += "{\"bid\":1.5,\"ask\":1.6}";
+	}
+	BOOST_CHECK(connected.Request(payload) == payload);
+	BOOST_CHECK(connected.Request("small") == "small");
+
+	BOOST_REQUIRE(connected.session->GetDeflateStats(stats));
+	BOOST_CHECK_EQUAL(stats.messagesDeflated, 1u);
+	BOOST_CHECK_EQUAL(stats.messagesSkipped, 1u);
+	BOOST_CHECK_EQUAL(stats.messagesInflated, 1u);
+	BOOST_CHECK_GT(stats.DeflateRatio(), 4.0);
+}
+
+BOOST_AUTO_TEST_CASE(when_many_requests_are_in_flight)
+{
+	Connected connected(true, true);
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", on_success, on_error, 2000 };
+	for (int i = 0; i < 1000; i++)
+	{
+		MiddlewareLib::SendRequest(connected.session, params, std::to_string(i));
+	}
+	BOOST_CHECK(WaitForResponses(1000));
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(connected.session), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_requests_are_awaited_through_futures)
+{
+	Connected connected(true, true);
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", NULL, NULL, 2000 };
+	std::vector<MiddlewareLib::RequestFuture> futures;
+	for (int i = 0; i < 1000; i++)
+	{
+		futures.push_back(MiddlewareLib::SendRequestAsync(connected.session, params, std::to_string(i)));
+	}
+	for (int i = 0; i < 1000; i++)
+	{
+		BOOST_REQUIRE(futures[i].WaitFor(2000));
+		BOOST_CHECK(futures[i].Get().success);
+		BOOST_CHECK_EQUAL(futures[i].Get().payload, std::to_string(i));
+	}
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(connected.session), 0u);
+
+	//nothing to send on
+	MiddlewareLib::RequestFuture future = MiddlewareLib::SendRequestAsync(NULL, params, "lost");
+	BOOST_REQUIRE(future.Ready());
+	BOOST_CHECK(!future.Get().success);
+	BOOST_CHECK_EQUAL(future.Get().payload, MiddlewareLib::REQUEST_NOT_SENT);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_future_request_times_out)
+{
+	Connected connected(true, true);
+	connected.peer.Pause(true);
+	//the peer answers what it has read before noticing the pause
+	connected.Request("before");
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", NULL, NULL, 20 };
+	MiddlewareLib::RequestFuture future = MiddlewareLib::SendRequestAsync(connected.session, params, "stalled");
+	BOOST_REQUIRE(future.WaitFor(2000));
+	BOOST_CHECK(!future.Get().success);
+	BOOST_CHECK_EQUAL(future.Get().payload, MiddlewareLib::REQUEST_TIMED_OUT);
+	connected.peer.Pause(false);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_session_is_destroyed_with_a_request_pending)
+{
+	MiddlewareLib::StandInPeer peer;
+	BOOST_REQUIRE(peer.Start());
+	MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+	MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(pool, peer.Url().c_str());
+	MiddlewareLib::StartDispatching(session);
+
+	//the peer may answer a request or so before it notices the pause
+	peer.Pause(true);
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", NULL, NULL };
+	MiddlewareLib::RequestFuture future = MiddlewareLib::SendRequestAsync(session, params, "never answered");
+	for (int attempt = 0; attempt < 10 && future.WaitFor(20); attempt++)
+	{
+		future = MiddlewareLib::SendRequestAsync(session, params, "never answered");
+	}
+	BOOST_REQUIRE(!future.Ready());
+
+	MiddlewareLib::DestroySession(session);
+	BOOST_REQUIRE(future.Ready());
+	BOOST_CHECK(!future.Get().success);
+	BOOST_CHECK_EQUAL(future.Get().payload, MiddlewareLib::REQUEST_CANCELLED);
+
+	peer.Pause(false);
+	MiddlewareLib::DestroyReactorPool(pool);
+	peer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(when_a_burst_of_requests_is_sent)
+{
+	Connected connected(true, true);
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", on_success, on_error, 2000 };
+	for (int i = 0; i < 500; i++)
+	{
+		MiddlewareLib::SendRequest(connected.session, params, std::to_string(i));
+	}
+	BOOST_REQUIRE(WaitForResponses(500));
+
+	MiddlewareLib::SendStats stats;
+	BOOST_REQUIRE(connected.session->GetSendStats(stats));
+	BOOST_CHECK_EQUAL(stats.messages, 500u);
+	BOOST_CHECK_LT(stats.writes, 500u);
+	BOOST_CHECK_LE(stats.largestBatch, 64u);
+	BOOST_CHECK_GT(stats.MessagesPerWrite(), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(when_batches_are_limited_to_one_message)
+{
+	MiddlewareLib::CoalescingOptions coalescing;
+	coalescing.maxBatchMessages = 1;
+	Connected connected(true, true, false, coalescing);
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", on_success, on_error, 2000 };
+	for (int i = 0; i < 100; i++)
+	{
+		MiddlewareLib::SendRequest(connected.session, params, std::to_string(i));
+	}
+	BOOST_REQUIRE(WaitForResponses(100));
+
+	MiddlewareLib::SendStats stats;
+	BOOST_REQUIRE(connected.session->GetSendStats(stats));
+	BOOST_CHECK_EQUAL(stats.messages, 100u);
+	BOOST_CHECK_EQUAL(stats.largestBatch, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_there_is_a_flush_window)
+{
+	MiddlewareLib::CoalescingOptions coalescing;
+	coalescing.flushWindowMicros = 200;
+	Connected connected(true, true, false, coalescing);
+
+	//an isolated request is not held
+	BOOST_CHECK(connected.Request("first") == "first");
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", on_success, on_error, 2000 };
+	for (int i = 0; i < 500; i++)
+	{
+		MiddlewareLib::SendRequest(connected.session, params, std::to_string(i));
+	}
+	BOOST_REQUIRE(WaitForResponses(501));
+
+	MiddlewareLib::SendStats stats;
+	BOOST_REQUIRE(connected.session->GetSendStats(stats));
+	BOOST_CHECK_EQUAL(stats.messages, 501u);
+	BOOST_CHECK_GT(stats.MessagesPerWrite(), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_peer_stalls_the_transmit_buffer_fills)
+{
+	MiddlewareLib::TransmitBufferOptions transmitBuffer;
+	transmitBuffer.highWatermark = 256 * 1024;
+	transmitBuffer.lowWatermark = 64 * 1024;
+	transmitBuffer.onWatermark = on_watermark;
+	filled = 0;
+	drained = 0;
+	Connected connected(true, true, false, MiddlewareLib::CoalescingOptions(), transmitBuffer);
+	connected.peer.Pause(true);
+
+	//keep sending until the socket buffers are full and the session has
+	//refused everything for a while
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", on_success, on_error, 0 };
+	std::string payload(16 * 1024, 'x');
+	int sent = 0;
+	int refused = 0;
+	int refusedInARow = 0;
+	while (sent < 10000 && refusedInARow < 100)
+	{
+		if (MiddlewareLib::SendRequest(connected.session, params, payload))
+		{
+			sent++;
+			refusedInARow = 0;
+			continue;
+		}
+		refused++;
+		refusedInARow++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BOOST_REQUIRE_LT(sent, 10000);
+	BOOST_CHECK_EQUAL(filled, drained + 1);
+	BOOST_CHECK_GT(connected.session->QueuedBytes(), transmitBuffer.highWatermark - payload.size());
+	//refused requests are not left waiting for a response. The peer may
+	//have answered what it read before noticing the pause.
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(connected.session) + responses, (size_t)sent);
+
+	connected.peer.Pause(false);
+	BOOST_REQUIRE(WaitForResponses(sent));
+	BOOST_CHECK_EQUAL(filled, drained);
+
+	MiddlewareLib::SendStats stats;
+	BOOST_REQUIRE(connected.session->GetSendStats(stats));
+	BOOST_CHECK_EQUAL(stats.rejected, (uint64_t)refused);
+	BOOST_CHECK_EQUAL(stats.queuedBytes, 0u);
+	BOOST_CHECK(connected.Request("after") == "after");
+}
+
+BOOST_AUTO_TEST_CASE(when_the_peer_stalls_the_oldest_requests_are_dropped)
+{
+	MiddlewareLib::TransmitBufferOptions transmitBuffer;
+	transmitBuffer.highWatermark = 64 * 1024;
+	transmitBuffer.lowWatermark = 16 * 1024;
+	transmitBuffer.policy = MiddlewareLib::OVERFLOW_DROP_OLDEST;
+	Connected connected(true, true, false, MiddlewareLib::CoalescingOptions(), transmitBuffer);
+	connected.peer.Pause(true);
+
+	//far more than the socket buffers hold, every send is accepted
+	MiddlewareLib::MiddlewareRequestParams params{ "TestChannel", NULL, NULL, 0 };
+	std::string payload(16 * 1024, 'x');
+	std::vector<MiddlewareLib::RequestFuture> futures;
+	for (int i = 0; i < 2000; i++)
+	{
+		futures.push_back(MiddlewareLib::SendRequestAsync(connected.session, params, payload));
+	}
+	connected.peer.Pause(false);
+
+	//the dropped requests fail rather than wait for ever for a response
+	uint64_t dropped = 0;
+	for (auto& future : futures)
+	{
+		BOOST_REQUIRE(future.WaitFor(5000));
+		if (!future.Get().success)
+		{
+			BOOST_CHECK_EQUAL(future.Get().payload, MiddlewareLib::REQUEST_NOT_SENT);
+			dropped++;
+		}
+	}
+	BOOST_CHECK_GT(dropped, 0u);
+	BOOST_CHECK_EQUAL(MiddlewareLib::PendingRequestCount(connected.session), 0u);
+	MiddlewareLib::SendStats stats;
+	BOOST_REQUIRE(connected.session->GetSendStats(stats));
+	BOOST_CHECK_EQUAL(stats.dropped, dropped);
+}
+
+BOOST_AUTO_TEST_CASE(when_channels_are_spread_over_pooled_connections)
+{
+	MiddlewareLib::StandInPeer peer;
+	BOOST_REQUIRE(peer.Start());
+	MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(2);
+	MiddlewareLib::PooledSessionOptions options;
+	options.connections = 4;
+	MiddlewareLib::ISession* session = MiddlewareLib::CreatePooledSession(pool, peer.Url().c_str(), options);
+	MiddlewareLib::StartDispatching(session);
+	responses = 0;
+
+	const int channels = 64;
+	for (int i = 0; i < channels; i++)
+	{
+		MiddlewareLib::MiddlewareRequestParams params{ "Channel" + std::to_string(i), on_success, on_error, 2000 };
+		BOOST_CHECK(MiddlewareLib::SendRequest(session, params, "payload"));
+	}
+	BOOST_REQUIRE(WaitForResponses(channels));
+
+	//each channel has its own connection, the same one every time
+	BOOST_REQUIRE_EQUAL(MiddlewareLib::ConnectionCount(session), 4u);
+	MiddlewareLib::ISession* connection = session->SessionForChannel("Channel0");
+	BOOST_CHECK(connection != session);
+	BOOST_CHECK(session->SessionForChannel("Channel0") == connection);
+
+	uint64_t requests = 0;
+	uint64_t messages = 0;
+	for (size_t i = 0; i < 4; i++)
+	{
+		MiddlewareLib::ConnectionLoad load;
+		BOOST_REQUIRE(MiddlewareLib::GetConnectionLoad(session, i, load));
+		BOOST_CHECK(load.connected);
+		BOOST_CHECK_GT(load.requests, 0u);
+		BOOST_CHECK_EQUAL(load.pendingRequests, 0u);
+		requests += load.requests;
+		messages += load.sent.messages;
+	}
+	BOOST_CHECK_EQUAL(requests, (uint64_t)channels);
+	BOOST_CHECK_EQUAL(messages, (uint64_t)channels);
+	MiddlewareLib::ConnectionLoad load;
+	BOOST_CHECK(!MiddlewareLib::GetConnectionLoad(session, 4, load));
+
+	MiddlewareLib::DestroySession(session);
+	MiddlewareLib::DestroyReactorPool(pool);
+	peer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(when_a_channel_is_pinned_to_a_connection)
+{
+	MiddlewareLib::StandInPeer peer;
+	BOOST_REQUIRE(peer.Start());
+	MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+	MiddlewareLib::PooledSessionOptions options;
+	options.connections = 3;
+	MiddlewareLib::ISession* session = MiddlewareLib::CreatePooledSession(pool, peer.Url().c_str(), options);
+	MiddlewareLib::StartDispatching(session);
+	responses = 0;
+
+	BOOST_CHECK(!MiddlewareLib::PinChannel(session, "Heavy", 3));
+	BOOST_REQUIRE(MiddlewareLib::PinChannel(session, "Heavy", 2));
+	for (int i = 0; i < 10; i++)
+	{
+		MiddlewareLib::MiddlewareRequestParams params{ "Heavy", on_success, on_error, 2000 };
+		BOOST_CHECK(MiddlewareLib::PublishMessage(session, params, "payload"));
+	}
+	BOOST_REQUIRE(WaitForResponses(10));
+
+	//looking the channel up does not count as a request
+	MiddlewareLib::Message cached;
+	BOOST_CHECK(!MiddlewareLib::GetLastValue(session, "Heavy", cached));
+	MiddlewareLib::InternChannel(session, "Heavy");
+
+	MiddlewareLib::ConnectionLoad load;
+	BOOST_REQUIRE(MiddlewareLib::GetConnectionLoad(session, 2, load));
+	BOOST_CHECK_EQUAL(load.requests, 10u);
+	BOOST_CHECK_EQUAL(load.pinnedChannels, 1u);
+	BOOST_CHECK_EQUAL(load.sent.messages, 10u);
+
+	//an ordinary session is one connection and has nothing to pin
+	MiddlewareLib::ISession* connection = session->SessionForChannel("Heavy");
+	BOOST_CHECK(!MiddlewareLib::PinChannel(connection, "Heavy", 0));
+	BOOST_CHECK_EQUAL(MiddlewareLib::ConnectionCount(connection), 1u);
+
+	MiddlewareLib::DestroySession(session);
+	MiddlewareLib::DestroyReactorPool(pool);
+	peer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(when_a_channel_in_use_is_pinned)
+{
+	MiddlewareLib::StandInPeer peer;
+	BOOST_REQUIRE(peer.Start());
+	MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+	MiddlewareLib::PooledSessionOptions options;
+	options.connections = 2;
+	MiddlewareLib::ISession* session = MiddlewareLib::CreatePooledSession(pool, peer.Url().c_str(), options);
+	MiddlewareLib::StartDispatching(session);
+	responses = 0;
+
+	MiddlewareLib::ISession* home = session->SessionForChannel("Prices");
+	size_t here = MiddlewareLib::GetConnection(session, 0) == home ? 0 : 1;
+	size_t other = 1 - here;
+	MiddlewareLib::CHANNEL_HANDLER_FUNC handler = [](MiddlewareLib::ISession*, MiddlewareLib::ChannelId, const MiddlewareLib::MessageView&, void*) {};
+	MiddlewareLib::MiddlewareRequestParams params{ "Prices", on_success, on_error, 2000 };
+	uint64_t handle = MiddlewareLib::AddChannelHandler(session, params, handler, NULL);
+	BOOST_REQUIRE(handle != 0);
+	BOOST_REQUIRE(WaitForResponses(1));
+
+	//the subscription would be left behind on its connection
+	BOOST_CHECK(!MiddlewareLib::PinChannel(session, "Prices", other));
+	BOOST_CHECK(session->SessionForChannel("Prices") == home);
+	//pinning it where it already is moves nothing
+	BOOST_CHECK(MiddlewareLib::PinChannel(session, "Prices", here));
+
+	BOOST_REQUIRE(MiddlewareLib::RemoveChannelHandler(session, handle));
+	BOOST_CHECK(MiddlewareLib::PinChannel(session, "Prices", other));
+	BOOST_CHECK(session->SessionForChannel("Prices") == MiddlewareLib::GetConnection(session, other));
+
+	MiddlewareLib::DestroySession(session);
+	MiddlewareLib::DestroyReactorPool(pool);
+	peer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(when_a_pooled_session_dispatches_on_its_own_threads)
+{
+	MiddlewareLib::StandInPeer peer;
+	BOOST_REQUIRE(peer.Start());
+	MiddlewareLib::PooledSessionOptions options;
+	options.connections = 2;
+	MiddlewareLib::ISession* session = MiddlewareLib::CreatePooledSession(peer.Url().c_str(), options);
+	std::thread dispatcher([session]() { MiddlewareLib::StartDispatching(session); });
+	responses = 0;
+
+	for (int i = 0; i < 8; i++)
+	{
+		MiddlewareLib::MiddlewareRequestParams params{ "Channel" + std::to_string(i), on_success, on_error, 2000 };
+		BOOST_CHECK(MiddlewareLib::SendRequest(session, params, "payload"));
+	}
+	BOOST_CHECK(WaitForResponses(8));
+
+	//releases the blocked dispatcher
+	MiddlewareLib::DestroySession(session);
+	dispatcher.join();
+	peer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(when_channel_handlers_share_an_upstream_subscription)
+{
+	Connected connected(true, true);
+	std::atomic<int> first(0);
+	std::atomic<int> second(0);
+	MiddlewareLib::CHANNEL_HANDLER_FUNC handler = [](MiddlewareLib::ISession*, MiddlewareLib::ChannelId, const MiddlewareLib::MessageView& message, void* context)
+	{
+		if (message.type_ == MiddlewareLib::UPDATE && message.payload_ == "tick")
+		{
+			(*(std::atomic<int>*)context)++;
+		}
+	};
+
+	MiddlewareLib::MiddlewareRequestParams params{ "Prices", on_success, on_error, 2000 };
+	uint64_t one = MiddlewareLib::AddChannelHandler(connected.session, params, handler, &first);
+	uint64_t two = MiddlewareLib::AddChannelHandler(connected.session, params, handler, &second);
+	BOOST_REQUIRE(one != 0 && two != 0);
+	//only the first handler subscribes
+	BOOST_REQUIRE(WaitForResponses(1));
+	BOOST_CHECK_EQUAL(connected.peer.Subscriptions("Prices"), 1u);
+
+	BOOST_CHECK(MiddlewareLib::PublishMessage(connected.session, params, "tick"));
+	BOOST_REQUIRE(WaitForResponses(2));
+	for (int i = 0; i < 2000 && (first < 1 || second < 1); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BOOST_CHECK_EQUAL(first, 1);
+	BOOST_CHECK_EQUAL(second, 1);
+
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(connected.session, one));
+	BOOST_CHECK(MiddlewareLib::RemoveChannelHandler(connected.session, two));
+	for (int i = 0; i < 2000 && connected.peer.Subscriptions("Prices") > 0; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BOOST_CHECK_EQUAL(connected.peer.Subscriptions("Prices"), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_request_round_trips_are_recorded)
+{
+	Connected connected(true, true);
+	MiddlewareLib::MiddlewareRequestParams first{ "First", on_success, on_error, 2000 };
+	MiddlewareLib::MiddlewareRequestParams second{ "Second", on_success, on_error, 2000 };
+	for (int i = 0; i < 10; i++)
+	{
+		MiddlewareLib::SendRequest(connected.session, first, "payload");
+	}
+	MiddlewareLib::PublishMessage(connected.session, second, "payload");
+	BOOST_REQUIRE(WaitForResponses(11));
+
+	MiddlewareLib::RequestLatencySnapshot snapshot;
+	BOOST_REQUIRE(MiddlewareLib::GetRequestLatency(connected.session, snapshot, true));
+	BOOST_CHECK_EQUAL(snapshot.commands["SENDREQUEST"].Count(), 10u);
+	BOOST_CHECK_EQUAL(snapshot.commands["PUBLISHMESSAGE"].Count(), 1u);
+	BOOST_CHECK_EQUAL(snapshot.channels["First"].Count(), 10u);
+	BOOST_CHECK_EQUAL(snapshot.channels["Second"].Count(), 1u);
+	BOOST_CHECK_GT(snapshot.channels["First"].Min(), 0u);
+	//well within the deadline
+	BOOST_CHECK_LT(snapshot.channels["First"].Max(), 2000000000u);
+
+	MiddlewareLib::RequestLatencySnapshot after;
+	BOOST_REQUIRE(MiddlewareLib::GetRequestLatency(connected.session, after));
+	BOOST_CHECK_EQUAL(after.channels["First"].Count(), 0u);
+	BOOST_CHECK(!MiddlewareLib::GetRequestLatency(NULL, after));
+}
+
+#ifdef MIDDLEWARE_TRACING
+BOOST_AUTO_TEST_CASE(when_a_request_is_traced)
+{
+	Connected connected(true, true);
+	MiddlewareLib::Trace::Clear();
+	BOOST_CHECK_EQUAL(connected.Request("traced"), "traced");
+
+	std::vector<MiddlewareLib::Trace::Event> events;
+	MiddlewareLib::Trace::Collect(events);
+	std::vector<int> seen(MiddlewareLib::Trace::POINTS);
+	for (auto& event : events)
+	{
+		seen[event.point]++;
+	}
+	for (int point = 0; point < MiddlewareLib::Trace::POINTS; point++)
+	{
+		BOOST_CHECK_MESSAGE(seen[point] > 0, MiddlewareLib::Trace::PointName((MiddlewareLib::Trace::Point)point));
+	}
+	BOOST_CHECK_EQUAL(seen[MiddlewareLib::Trace::CALLBACK_START], seen[MiddlewareLib::Trace::CALLBACK_END]);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(when_transport_stats_are_kept)
+{
+	typedef MiddlewareLib::TransportStats TransportStats;
+	Connected connected(true, true);
+	BOOST_CHECK_EQUAL(connected.Request("counted"), "counted");
+	BOOST_REQUIRE(connected.session->SendPing());
+
+	TransportStats stats;
+	for (int i = 0; i < 2000 && stats.pongsReceived == 0; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		BOOST_REQUIRE(connected.session->GetTransportStats(stats));
+	}
+	BOOST_REQUIRE_EQUAL(stats.pongsReceived, 1u);
+	BOOST_CHECK_EQUAL(stats.pingsSent, 1u);
+	BOOST_CHECK_EQUAL(stats.framesOut[TransportStats::PING], 1u);
+	BOOST_CHECK_EQUAL(stats.framesIn[TransportStats::PONG], 1u);
+	BOOST_CHECK_EQUAL(stats.bytesIn[TransportStats::PONG], 8u);
+	BOOST_CHECK_EQUAL(stats.minPingMicros, stats.lastPingMicros);
+	BOOST_CHECK_LT(stats.maxPingMicros, 2000000u);
+
+	//the request and its response, each in one binary frame
+	BOOST_CHECK_EQUAL(stats.framesOut[TransportStats::BINARY], 1u);
+	BOOST_CHECK_EQUAL(stats.framesIn[TransportStats::BINARY], 1u);
+	BOOST_CHECK_GT(stats.bytesIn[TransportStats::BINARY], 0u);
+	BOOST_CHECK_EQUAL(stats.framesOut[TransportStats::TEXT], 0u);
+	BOOST_CHECK_GE(stats.recvCalls, 2u);
+	BOOST_CHECK_GE(stats.recvBytes, stats.bytesIn[TransportStats::BINARY] + 8u);
+	BOOST_CHECK_GE(stats.sendCalls, 2u);
+	BOOST_CHECK_EQUAL(stats.partialWrites, 0u);
+	BOOST_CHECK_GT(stats.rxbufHighWater, 0u);
+	BOOST_CHECK_GT(stats.txbufHighWater, 0u);
+	BOOST_CHECK_EQUAL(stats.closeError, 0);
+#ifdef __linux__
+	BOOST_CHECK_GE(stats.tcpInfoSamples, 1u);
+	BOOST_CHECK_GT(stats.sndMss, 0u);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(when_connecting_the_timings_are_recorded)
+{
+	Connected connected(true, true);
+	MiddlewareLib::ConnectTimings timings;
+	BOOST_REQUIRE(connected.session->GetConnectTimings(timings));
+	BOOST_CHECK_GE(timings.addresses, 1u);
+	BOOST_CHECK_EQUAL(timings.attempts, 1u);
+	BOOST_CHECK_GT(timings.handshakeMicros, 0u);
+	BOOST_CHECK_GE(timings.totalMicros, timings.resolveMicros + timings.connectMicros + timings.handshakeMicros);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_handshake_is_never_answered)
+{
+	ScriptedPeer peer([](const std::string&) { return std::string(); });
+	MiddlewareLib::SessionOptions options;
+	options.connect.timeoutMs = 100;
+	auto start = std::chrono::steady_clock::now();
+	MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(peer.Url().c_str(), options);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	//the deadline applies rather than the socket blocking for ever
+	MiddlewareLib::ConnectTimings timings;
+	BOOST_CHECK(!session->GetConnectTimings(timings));
+	BOOST_CHECK(elapsed >= std::chrono::milliseconds(100));
+	BOOST_CHECK(elapsed < std::chrono::milliseconds(2000));
+	MiddlewareLib::DestroySession(session);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_accept_key_is_wrong)
+{
+	ScriptedPeer peer([](const std::string&) { return Switching("s3pPLMBiTxaQ9kYGzzhZRbK+xOo="); });
+	MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(peer.Url().c_str());
+	MiddlewareLib::ConnectTimings timings;
+	BOOST_CHECK(!session->GetConnectTimings(timings));
+	MiddlewareLib::DestroySession(session);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_frame_arrives_with_the_handshake_response)
+{
+	ScriptedPeer peer([](const std::string& request)
+	{
+		MiddlewareLib::Message msg;
+		msg.type_ = MiddlewareLib::UPDATE;
+		msg.channel_ = "TestChannel";
+		msg.payload_ = "welcome";
+		std::string encoded;
+		MiddlewareLib::MessageCodec::Encode(msg, encoded);
+		//an unmasked text frame in the same write as the response
+		std::string frame;
+		frame.push_back((char)0x81);
+		frame.push_back((char)126);
+		frame.push_back((char)(encoded.size() >> 8));
+		frame.push_back((char)(encoded.size() & 0xff));
+		return Switching(ScriptedPeer::Accept(request)) + frame + encoded;
+	});
+
+	update.clear();
+	MiddlewareLib::RegisterMessageViewCallbackFunction(on_update);
+	MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(1);
+	MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(pool, peer.Url().c_str());
+	MiddlewareLib::ConnectTimings timings;
+	BOOST_CHECK(session->GetConnectTimings(timings));
+	MiddlewareLib::StartDispatching(session);
+
+	bool received = false;
+	for (int i = 0; i < 2000 && !received; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::lock_guard<std::mutex> lock(updateLock);
+		received = update == "welcome";
+	}
+	BOOST_CHECK(received);
+	MiddlewareLib::DestroySession(session);
+	MiddlewareLib::DestroyReactorPool(pool);
+	MiddlewareLib::RegisterMessageViewCallbackFunction(NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
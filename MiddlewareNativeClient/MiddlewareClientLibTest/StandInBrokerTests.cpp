@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "MiddlewareClientLib.h"
+#include "RequestFuture.h"
+#include "StandInBroker.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	//what a session's channel handlers were sent
+	struct Inbox
+	{
+		Inbox() : count(0) {}
+
+		std::mutex lock;
+		std::vector<MiddlewareLib::Message> messages;
+		std::atomic<size_t> count;
+
+		bool WaitFor(size_t expected)
+		{
+			for (int i = 0; i < 2000 && count < expected; i++)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			return count >= expected;
+		}
+	};
+
+	void on_channel(MiddlewareLib::ISession* session, MiddlewareLib::ChannelId channel, const MiddlewareLib::MessageView& view, void* context)
+	{
+		Inbox* inbox = (Inbox*)context;
+		MiddlewareLib::Message msg;
+		msg.type_ = view.type_;
+		msg.command_ = std::string(view.command_);
+		msg.channel_ = std::string(view.channel_);
+		msg.sourceId_ = std::string(view.sourceId_);
+		msg.destinationId_ = std::string(view.destinationId_);
+		msg.payload_ = std::string(view.payload_);
+		std::lock_guard<std::mutex> lock(inbox->lock);
+		inbox->messages.push_back(msg);
+		inbox->count++;
+	}
+
+	//answers the requests for its channel with a message back to the sender
+	void on_request(MiddlewareLib::ISession* session, MiddlewareLib::ChannelId channel, const MiddlewareLib::MessageView& view, void* context)
+	{
+		if (view.type_ != MiddlewareLib::REQUEST || view.command_ != "SENDREQUEST")
+		{
+			return;
+		}
+		MiddlewareLib::MiddlewareRequestParams params{ std::string(view.channel_), NULL, NULL };
+		MiddlewareLib::SendMessageToChannel(session, params, "re: " + std::string(view.payload_), std::string(view.sourceId_));
+	}
+
+	MiddlewareLib::RequestResult Wait(const MiddlewareLib::RequestFuture& future)
+	{
+		BOOST_REQUIRE(future.WaitFor(2000));
+		return future.Get();
+	}
+
+	bool WaitForSubscriptions(const MiddlewareLib::StandInBroker& broker, const std::string& channel, size_t expected)
+	{
+		for (int i = 0; i < 2000 && broker.Subscriptions(channel) != expected; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return broker.Subscriptions(channel) == expected;
+	}
+
+	//sessions on a pool thread connected to a broker with two shards
+	struct Brokered
+	{
+		Brokered() : broker(2)
+		{
+			BOOST_REQUIRE(broker.Start());
+			pool = MiddlewareLib::CreateReactorPool(1);
+		}
+
+		~Brokered()
+		{
+			for (auto session : sessions)
+			{
+				MiddlewareLib::DestroySession(session);
+			}
+			MiddlewareLib::DestroyReactorPool(pool);
+			broker.Stop();
+		}
+
+		MiddlewareLib::ISession* Connect(bool binary = true)
+		{
+			MiddlewareLib::SessionOptions options;
+			options.binaryMessages = binary;
+			MiddlewareLib::ISession* session = MiddlewareLib::CreateSession(pool, broker.Url().c_str(), options);
+			MiddlewareLib::StartDispatching(session);
+			sessions.push_back(session);
+			return session;
+		}
+
+		//add a handler, waiting for the subscription to be accepted
+		void Subscribe(MiddlewareLib::ISession* session, const std::string& channel, MiddlewareLib::CHANNEL_HANDLER_FUNC handler, void* context)
+		{
+			MiddlewareLib::MiddlewareRequestParams params{ channel, NULL, NULL };
+			MiddlewareLib::RequestFuture subscribed = MiddlewareLib::RequestFuture::Attach(params);
+			BOOST_REQUIRE(MiddlewareLib::AddChannelHandler(session, params, handler, context) != 0);
+			BOOST_REQUIRE(Wait(subscribed).success);
+		}
+
+		MiddlewareLib::StandInBroker broker;
+		MiddlewareLib::ReactorPool* pool;
+		std::vector<MiddlewareLib::ISession*> sessions;
+	};
+}
+
+BOOST_AUTO_TEST_SUITE(stand_in_broker_tests)
+
+BOOST_AUTO_TEST_CASE(when_messages_are_published_through_the_broker)
+{
+	Brokered brokered;
+	MiddlewareLib::ISession* binary = brokered.Connect(true);
+	MiddlewareLib::ISession* json = brokered.Connect(false);
+	MiddlewareLib::ISession* publisher = brokered.Connect(true);
+
+	//enough channels to land on both shards
+	const size_t channels = 8;
+	Inbox binaryInbox;
+	Inbox jsonInbox;
+	for (size_t i = 0; i < channels; i++)
+	{
+		std::string channel = "Channel" + std::to_string(i);
+		brokered.Subscribe(binary, channel, on_channel, &binaryInbox);
+		brokered.Subscribe(json, channel, on_channel, &jsonInbox);
+		BOOST_CHECK_EQUAL(brokered.broker.Subscriptions(channel), 2u);
+	}
+
+	for (size_t i = 0; i < channels; i++)
+	{
+		MiddlewareLib::MiddlewareRequestParams params{ "Channel" + std::to_string(i), NULL, NULL };
+		MiddlewareLib::RequestResult result = Wait(MiddlewareLib::PublishMessageAsync(publisher, params, "price " + std::to_string(i)));
+		BOOST_CHECK(result.success);
+		BOOST_CHECK(result.payload == "price " + std::to_string(i));
+	}
+
+	//every subscriber gets every update, in each channel's order
+	BOOST_REQUIRE(binaryInbox.WaitFor(channels));
+	BOOST_REQUIRE(jsonInbox.WaitFor(channels));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	BOOST_CHECK_EQUAL(binaryInbox.count, channels);
+	BOOST_CHECK_EQUAL(jsonInbox.count, channels);
+	{
+		std::lock_guard<std::mutex> lock(jsonInbox.lock);
+		for (auto& msg : jsonInbox.messages)
+		{
+			BOOST_CHECK_EQUAL(msg.type_, MiddlewareLib::UPDATE);
+			BOOST_CHECK(msg.command_ == "PUBLISHMESSAGE");
+			BOOST_CHECK(msg.payload_ == "price " + msg.channel_.substr(7));
+		}
+	}
+
+	//unsubscribed connections are left out
+	MiddlewareLib::MiddlewareRequestParams params{ "Channel0", NULL, NULL };
+	MiddlewareLib::MiddlewareRequestParams removal = params;
+	MiddlewareLib::RequestFuture removed = MiddlewareLib::RequestFuture::Attach(removal);
+	BOOST_REQUIRE(MiddlewareLib::RemoveSubscription(json, removal));
+	BOOST_REQUIRE(Wait(removed).success);
+	BOOST_CHECK_EQUAL(brokered.broker.Subscriptions("Channel0"), 1u);
+	BOOST_REQUIRE(Wait(MiddlewareLib::PublishMessageAsync(publisher, params, "again")).success);
+	BOOST_REQUIRE(binaryInbox.WaitFor(channels + 1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	BOOST_CHECK_EQUAL(jsonInbox.count, channels);
+	//the subscriptions, publishes and removal
+	BOOST_CHECK_EQUAL(brokered.broker.Received(), channels * 3 + 2);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_request_is_sent_to_a_channel_listener)
+{
+	Brokered brokered;
+	MiddlewareLib::ISession* listener = brokered.Connect(false);
+	MiddlewareLib::ISession* requester = brokered.Connect(true);
+
+	//nobody to answer yet
+	MiddlewareLib::MiddlewareRequestParams params{ "Quotes", NULL, NULL };
+	MiddlewareLib::RequestResult result = Wait(MiddlewareLib::SendRequestAsync(requester, params, "EURUSD"));
+	BOOST_CHECK(!result.success);
+	BOOST_CHECK(result.payload == "error on entity Quotes. No Listener specified for channel.");
+
+	BOOST_REQUIRE(Wait(MiddlewareLib::AddChannelListenerAsync(listener, params)).success);
+	brokered.Subscribe(listener, "Quotes", on_request, NULL);
+	//the answer is sent to the requester as a subscriber of the channel
+	Inbox inbox;
+	brokered.Subscribe(requester, "Quotes", on_channel, &inbox);
+
+	result = Wait(MiddlewareLib::SendRequestAsync(requester, params, "EURUSD"));
+	BOOST_CHECK(result.success);
+	BOOST_REQUIRE(inbox.WaitFor(1));
+	std::lock_guard<std::mutex> lock(inbox.lock);
+	BOOST_CHECK(inbox.messages[0].command_ == "SENDMESSAGE");
+	BOOST_CHECK(inbox.messages[0].payload_ == "re: EURUSD");
+	BOOST_CHECK(!inbox.messages[0].sourceId_.empty());
+	BOOST_CHECK(inbox.messages[0].sourceId_ != inbox.messages[0].destinationId_);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_connection_leaves_the_broker)
+{
+	Brokered brokered;
+	MiddlewareLib::ISession* listener = brokered.Connect(true);
+	MiddlewareLib::ISession* sender = brokered.Connect(true);
+
+	MiddlewareLib::MiddlewareRequestParams params{ "Orders", NULL, NULL };
+	BOOST_REQUIRE(Wait(MiddlewareLib::AddChannelListenerAsync(listener, params)).success);
+	Inbox inbox;
+	brokered.Subscribe(listener, "Orders", on_channel, &inbox);
+	BOOST_CHECK_EQUAL(brokered.broker.Subscriptions("Orders"), 1u);
+
+	//only subscribers can be sent to
+	MiddlewareLib::RequestResult result = Wait(MiddlewareLib::SendMessageToChannelAsync(sender, params, "order", "42"));
+	BOOST_CHECK(!result.success);
+	BOOST_CHECK(result.payload == "error on entity Orders. Invalid Destination endpoint : 42.");
+
+	//its subscriptions and listener go with it
+	brokered.sessions.erase(brokered.sessions.begin());
+	MiddlewareLib::DestroySession(listener);
+	BOOST_CHECK(WaitForSubscriptions(brokered.broker, "Orders", 0));
+	result = Wait(MiddlewareLib::SendRequestAsync(sender, params, "order"));
+	BOOST_CHECK(!result.success);
+
+	//every request needs a channel
+	result = Wait(MiddlewareLib::PublishMessageAsync(sender, MiddlewareLib::MiddlewareRequestParams{ "", NULL, NULL }, "nowhere"));
+	BOOST_CHECK(!result.success);
+	BOOST_CHECK(result.payload == "no channel specified!");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,125 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "SubscriptionRegistry.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Received
+	{
+		std::vector<MiddlewareLib::ChannelId> channels;
+		std::vector<std::string> payloads;
+	};
+
+	void on_channel(MiddlewareLib::ISession* session, MiddlewareLib::ChannelId channel, const MiddlewareLib::MessageView& message, void* context)
+	{
+		Received* received = (Received*)context;
+		received->channels.push_back(channel);
+		received->payloads.push_back(std::string(message.payload_));
+	}
+
+	MiddlewareLib::MessageView CreateUpdate(const char* channel, const char* payload)
+	{
+		MiddlewareLib::MessageView view = {};
+		view.type_ = MiddlewareLib::UPDATE;
+		view.channel_ = channel;
+		view.payload_ = payload;
+		return view;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(subscription_registry_tests)
+
+BOOST_AUTO_TEST_CASE(when_interning_channels)
+{
+	MiddlewareLib::SubscriptionRegistry registry;
+	MiddlewareLib::ChannelId prices = registry.Intern("Prices");
+	MiddlewareLib::ChannelId orders = registry.Intern("Orders");
+	BOOST_CHECK_NE(prices, orders);
+	BOOST_CHECK_EQUAL(registry.Intern(std::string("Pri") + "ces"), prices);
+	BOOST_CHECK(registry.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(when_handlers_share_a_channel)
+{
+	MiddlewareLib::SubscriptionRegistry registry;
+	Received first;
+	Received second;
+	bool subscribe;
+	uint64_t one = registry.Add("Prices", on_channel, &first, subscribe);
+	BOOST_CHECK(subscribe);
+	uint64_t two = registry.Add("Prices", on_channel, &second, subscribe);
+	BOOST_CHECK(!subscribe);
+	BOOST_CHECK_NE(one, two);
+	BOOST_CHECK_EQUAL(registry.Handlers("Prices"), 2u);
+
+	BOOST_CHECK(registry.Dispatch(NULL, CreateUpdate("Prices", "1.5")));
+	BOOST_CHECK(!registry.Dispatch(NULL, CreateUpdate("Orders", "2")));
+	BOOST_REQUIRE_EQUAL(first.payloads.size(), 1u);
+	BOOST_REQUIRE_EQUAL(second.payloads.size(), 1u);
+	BOOST_CHECK(first.payloads[0] == "1.5");
+	BOOST_CHECK_EQUAL(first.channels[0], registry.Intern("Prices"));
+
+	//the subscription goes with the last handler
+	std::string channel;
+	bool unsubscribe;
+	BOOST_REQUIRE(registry.Remove(one, channel, unsubscribe));
+	BOOST_CHECK(channel == "Prices");
+	BOOST_CHECK(!unsubscribe);
+	BOOST_CHECK(!registry.Remove(one, channel, unsubscribe));
+	BOOST_REQUIRE(registry.Remove(two, channel, unsubscribe));
+	BOOST_CHECK(unsubscribe);
+	BOOST_CHECK(!registry.Subscribed("Prices"));
+	BOOST_CHECK(registry.Empty());
+	BOOST_CHECK(!registry.Dispatch(NULL, CreateUpdate("Prices", "1.6")));
+	BOOST_CHECK_EQUAL(first.payloads.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_handle_is_from_another_registry)
+{
+	MiddlewareLib::SubscriptionRegistry registry;
+	MiddlewareLib::SubscriptionRegistry other;
+	Received received;
+	bool subscribe;
+	registry.Add("Prices", on_channel, &received, subscribe);
+	uint64_t handle = other.Add("Prices", on_channel, &received, subscribe);
+
+	std::string channel;
+	bool unsubscribe;
+	BOOST_CHECK(!registry.Remove(handle, channel, unsubscribe));
+	BOOST_CHECK_EQUAL(registry.Handlers("Prices"), 1u);
+	BOOST_CHECK(!registry.Remove(0xffffffff00000001ULL, channel, unsubscribe));
+	registry.SubscribeFailed(0xffffffff00000001ULL);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_subscription_fails)
+{
+	MiddlewareLib::SubscriptionRegistry registry;
+	Received received;
+	bool subscribe;
+	uint64_t one = registry.Add("Prices", on_channel, &received, subscribe);
+	BOOST_REQUIRE(subscribe);
+	BOOST_CHECK(registry.Subscribed("Prices"));
+	registry.SubscribeFailed(one);
+	BOOST_CHECK(!registry.Subscribed("Prices"));
+	//the handler stays, the next one added subscribes again
+	BOOST_CHECK_EQUAL(registry.Handlers("Prices"), 1u);
+	uint64_t two = registry.Add("Prices", on_channel, &received, subscribe);
+	BOOST_CHECK(subscribe);
+
+	//a late failure of the first subscription does not undo the second
+	registry.SubscribeFailed(one);
+	BOOST_CHECK(registry.Subscribed("Prices"));
+	registry.SubscribeFailed(two);
+
+	//nothing to unsubscribe from once the last handler goes
+	std::string channel;
+	bool unsubscribe;
+	BOOST_REQUIRE(registry.Remove(one, channel, unsubscribe));
+	BOOST_REQUIRE(registry.Remove(two, channel, unsubscribe));
+	BOOST_CHECK(!unsubscribe);
+	BOOST_CHECK(registry.Empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
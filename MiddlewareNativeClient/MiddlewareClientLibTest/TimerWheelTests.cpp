@@ -0,0 +1,85 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "TimerWheel.h"
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(timer_wheel_tests)
+
+BOOST_AUTO_TEST_CASE(when_a_timer_expires)
+{
+	MiddlewareLib::TimerWheel wheel;
+	std::vector<uint32_t> expired;
+	wheel.Schedule(5, 42);
+
+	wheel.Advance(4, expired);
+	BOOST_CHECK(expired.empty());
+	wheel.Advance(5, expired);
+	BOOST_REQUIRE_EQUAL(expired.size(), 1u);
+	BOOST_CHECK_EQUAL(expired[0], 42u);
+	BOOST_CHECK_EQUAL(wheel.Size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_timer_is_cancelled)
+{
+	MiddlewareLib::TimerWheel wheel;
+	std::vector<uint32_t> expired;
+	uint32_t timer = wheel.Schedule(300, 1);
+	wheel.Schedule(300, 2);
+	wheel.Cancel(timer);
+
+	wheel.Advance(1000, expired);
+	BOOST_REQUIRE_EQUAL(expired.size(), 1u);
+	BOOST_CHECK_EQUAL(expired[0], 2u);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_timer_is_scheduled_in_the_past)
+{
+	MiddlewareLib::TimerWheel wheel(100);
+	std::vector<uint32_t> expired;
+	wheel.Schedule(50, 1);
+
+	wheel.Advance(101, expired);
+	BOOST_CHECK_EQUAL(expired.size(), 1u);
+}
+
+//timers spread over every level, checked against a sorted reference. The
+//wheel starts just short of 2^32 ticks so the top levels cascade too.
+BOOST_AUTO_TEST_CASE(when_timers_span_the_levels)
+{
+	const uint64_t start = (1ull << 32) - 5000000;
+	MiddlewareLib::TimerWheel wheel(start);
+	std::mt19937_64 random(7);
+	std::multimap<uint64_t, uint32_t> reference;
+	const uint64_t spans[] = { 200, 60000, 3000000, 20000000 };
+	for (uint32_t i = 0; i < 4000; i++)
+	{
+		uint64_t expiry = start + 1 + random() % spans[i % 4];
+		wheel.Schedule(expiry, i);
+		reference.insert(std::make_pair(expiry, i));
+	}
+
+	std::vector<uint32_t> expired;
+	uint64_t now = start;
+	while (!reference.empty())
+	{
+		now += 1 + random() % 50000;
+		expired.clear();
+		wheel.Advance(now, expired);
+
+		std::vector<uint32_t> due;
+		while (!reference.empty() && reference.begin()->first <= now)
+		{
+			due.push_back(reference.begin()->second);
+			reference.erase(reference.begin());
+		}
+		std::sort(expired.begin(), expired.end());
+		std::sort(due.begin(), due.end());
+		BOOST_REQUIRE(expired == due);
+	}
+	BOOST_CHECK_EQUAL(wheel.Size(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
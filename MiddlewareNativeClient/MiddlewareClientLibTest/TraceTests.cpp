@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "Trace.h"
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Trace = MiddlewareLib::Trace;
+
+namespace
+{
+	//the collected events with an arg in [low, high), so events recorded
+	//by the library in other tests are left out
+	std::vector<Trace::Event> CollectArgs(uint64_t low, uint64_t high)
+	{
+		std::vector<Trace::Event> events;
+		Trace::Collect(events);
+		std::vector<Trace::Event> found;
+		for (auto& event : events)
+		{
+			if (event.arg >= low && event.arg < high)
+			{
+				found.push_back(event);
+			}
+		}
+		return found;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(trace_tests)
+
+BOOST_AUTO_TEST_CASE(when_events_are_recorded)
+{
+	Trace::Clear();
+	Trace::Record(Trace::RECV, 1000001);
+	Trace::Record(Trace::FRAME_COMPLETE, 1000002);
+	Trace::Record(Trace::PARSE_COMPLETE, 1000003);
+
+	std::vector<Trace::Event> events = CollectArgs(1000001, 1000004);
+	BOOST_REQUIRE_EQUAL(events.size(), 3u);
+	BOOST_CHECK_EQUAL(events[0].point, Trace::RECV);
+	BOOST_CHECK_EQUAL(events[1].point, Trace::FRAME_COMPLETE);
+	BOOST_CHECK_EQUAL(events[2].point, Trace::PARSE_COMPLETE);
+	BOOST_CHECK_EQUAL(events[0].thread, events[2].thread);
+	BOOST_CHECK_LE(events[0].time, events[1].time);
+	BOOST_CHECK_LE(events[1].time, events[2].time);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_trace_is_cleared)
+{
+	Trace::Record(Trace::RECV, 2000001);
+	Trace::Clear();
+	Trace::Record(Trace::RECV, 2000002);
+
+	std::vector<Trace::Event> events = CollectArgs(2000001, 2000003);
+	BOOST_REQUIRE_EQUAL(events.size(), 1u);
+	BOOST_CHECK_EQUAL(events[0].arg, 2000002u);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_ring_wraps)
+{
+	Trace::Clear();
+	const uint64_t base = 3000000;
+	for (uint64_t i = 0; i < Trace::RING_EVENTS + 100; i++)
+	{
+		Trace::Record(Trace::SEND_FLUSH, base + i);
+	}
+
+	//the latest are kept, less the slot the next event is written to
+	std::vector<Trace::Event> events = CollectArgs(base, base + Trace::RING_EVENTS + 100);
+	BOOST_REQUIRE_EQUAL(events.size(), Trace::RING_EVENTS - 1);
+	BOOST_CHECK_EQUAL(events.front().arg, base + 101);
+	BOOST_CHECK_EQUAL(events.back().arg, base + Trace::RING_EVENTS + 99);
+}
+
+BOOST_AUTO_TEST_CASE(when_events_are_recorded_on_several_threads)
+{
+	Trace::Clear();
+	Trace::Record(Trace::SEND_ENQUEUE, 4000001);
+	std::thread other([]() { Trace::Record(Trace::SEND_ENQUEUE, 4000002); });
+	other.join();
+
+	//the thread's ring is kept after it has finished
+	std::vector<Trace::Event> events = CollectArgs(4000001, 4000003);
+	BOOST_REQUIRE_EQUAL(events.size(), 2u);
+	BOOST_CHECK_NE(events[0].thread, events[1].thread);
+}
+
+BOOST_AUTO_TEST_CASE(when_threads_come_and_go)
+{
+	Trace::Record(Trace::RECV, 7000000);
+	size_t rings = Trace::Rings();
+	for (uint64_t i = 1; i <= 20; i++)
+	{
+		std::thread other([i]() { Trace::Record(Trace::RECV, 7000000 + i); });
+		other.join();
+	}
+
+	//each thread takes over the ring of the one before
+	BOOST_CHECK_LE(Trace::Rings(), rings + 1);
+	std::vector<Trace::Event> events = CollectArgs(7000001, 7000021);
+	BOOST_REQUIRE(!events.empty());
+	BOOST_CHECK_EQUAL(events.back().arg, 7000020u);
+}
+
+BOOST_AUTO_TEST_CASE(when_tracing_is_disabled)
+{
+	Trace::Clear();
+	Trace::Enable(false);
+	BOOST_CHECK(!Trace::Enabled());
+	Trace::Record(Trace::RECV, 5000001);
+	Trace::Enable(true);
+	BOOST_CHECK(Trace::Enabled());
+	BOOST_CHECK(CollectArgs(5000001, 5000002).empty());
+}
+
+BOOST_AUTO_TEST_CASE(when_a_chrome_trace_is_written)
+{
+	Trace::Clear();
+	{
+		Trace::CallbackScope scope(6000001);
+		Trace::Record(Trace::SEND_ENQUEUE, 6000002);
+	}
+
+	std::ostringstream out;
+	Trace::WriteChromeTrace(out);
+	std::string trace = out.str();
+	BOOST_CHECK_EQUAL(trace.find("{\"traceEvents\":["), 0u);
+	BOOST_CHECK(trace.find("{\"name\":\"callback\",\"ph\":\"B\"") != std::string::npos);
+	BOOST_CHECK(trace.find("\"args\":{\"arg\":6000001}") != std::string::npos);
+	BOOST_CHECK(trace.find("{\"name\":\"send enqueue\",\"ph\":\"i\"") != std::string::npos);
+	BOOST_CHECK(trace.find("{\"name\":\"callback\",\"ph\":\"E\"") != std::string::npos);
+	BOOST_CHECK(trace.find("],\"displayTimeUnit\":\"ns\"}") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
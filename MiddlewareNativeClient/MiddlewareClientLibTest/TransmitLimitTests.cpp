@@ -0,0 +1,151 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "TransmitLimit.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::vector<bool> watermarks;
+
+	void on_watermark(MiddlewareLib::ISession* session, bool full, size_t queuedBytes)
+	{
+		watermarks.push_back(full);
+	}
+
+	MiddlewareLib::TransmitBufferOptions CreateOptions(MiddlewareLib::OverflowPolicy policy)
+	{
+		MiddlewareLib::TransmitBufferOptions options;
+		options.highWatermark = 1000;
+		options.lowWatermark = 400;
+		options.policy = policy;
+		options.blockTimeoutMs = 20;
+		options.onWatermark = on_watermark;
+		watermarks.clear();
+		return options;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(transmit_limit_tests)
+
+BOOST_AUTO_TEST_CASE(when_there_is_no_high_watermark)
+{
+	MiddlewareLib::TransmitLimit limit((MiddlewareLib::TransmitBufferOptions()));
+	for (int i = 0; i < 100; i++)
+	{
+		BOOST_CHECK_EQUAL(limit.Reserve(NULL, 1000000, true), MiddlewareLib::SEND_OK);
+	}
+	BOOST_CHECK_EQUAL(limit.Depth(), 100000000u);
+	BOOST_CHECK(!limit.Full());
+}
+
+BOOST_AUTO_TEST_CASE(when_the_buffer_fills_sends_are_refused)
+{
+	MiddlewareLib::TransmitLimit limit(CreateOptions(MiddlewareLib::OVERFLOW_REJECT));
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 600, false), MiddlewareLib::SEND_OK);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 400, false), MiddlewareLib::SEND_OK);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 1, false), MiddlewareLib::SEND_WOULD_BLOCK);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 1, false), MiddlewareLib::SEND_WOULD_BLOCK);
+	BOOST_CHECK_EQUAL(limit.Depth(), 1000u);
+	BOOST_CHECK_EQUAL(limit.Rejected(), 2u);
+	BOOST_CHECK(limit.Full());
+	//reported once
+	BOOST_REQUIRE_EQUAL(watermarks.size(), 1u);
+	BOOST_CHECK(watermarks[0]);
+
+	//taken by the dispatcher, the bytes are still queued until written
+	BOOST_CHECK(limit.Take(600));
+	BOOST_CHECK(limit.Take(400));
+	limit.Buffered(NULL, 1000);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 1, false), MiddlewareLib::SEND_WOULD_BLOCK);
+
+	//not empty again until drained to the low watermark
+	limit.Buffered(NULL, 500);
+	BOOST_CHECK(limit.Full());
+	limit.Buffered(NULL, 400);
+	BOOST_CHECK(!limit.Full());
+	BOOST_REQUIRE_EQUAL(watermarks.size(), 2u);
+	BOOST_CHECK(!watermarks[1]);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 600, false), MiddlewareLib::SEND_OK);
+}
+
+BOOST_AUTO_TEST_CASE(when_a_message_is_larger_than_the_buffer)
+{
+	MiddlewareLib::TransmitLimit limit(CreateOptions(MiddlewareLib::OVERFLOW_REJECT));
+	//on its own it is sent
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 5000, false), MiddlewareLib::SEND_OK);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 1, false), MiddlewareLib::SEND_WOULD_BLOCK);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_newest_messages_are_dropped)
+{
+	MiddlewareLib::TransmitLimit limit(CreateOptions(MiddlewareLib::OVERFLOW_DROP_NEWEST));
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 800, false), MiddlewareLib::SEND_OK);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 300, false), MiddlewareLib::SEND_DROPPED);
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 200, false), MiddlewareLib::SEND_OK);
+	BOOST_CHECK_EQUAL(limit.Dropped(), 1u);
+	BOOST_CHECK_EQUAL(limit.Rejected(), 0u);
+	BOOST_CHECK_EQUAL(limit.Depth(), 1000u);
+}
+
+BOOST_AUTO_TEST_CASE(when_the_oldest_messages_are_dropped)
+{
+	MiddlewareLib::TransmitLimit limit(CreateOptions(MiddlewareLib::OVERFLOW_DROP_OLDEST));
+	for (int i = 0; i < 5; i++)
+	{
+		BOOST_CHECK_EQUAL(limit.Reserve(NULL, 300, false), MiddlewareLib::SEND_OK);
+	}
+	BOOST_CHECK_EQUAL(limit.Depth(), 1500u);
+	BOOST_CHECK(limit.Full());
+
+	//the first two make way for the newer three
+	BOOST_CHECK(!limit.Take(300));
+	BOOST_CHECK(!limit.Take(300));
+	size_t buffered = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		BOOST_CHECK(limit.Take(300));
+		buffered += 310;
+		limit.Buffered(NULL, buffered);
+	}
+	BOOST_CHECK_EQUAL(limit.Dropped(), 2u);
+	BOOST_CHECK_EQUAL(limit.Depth(), 930u);
+
+	//a message sent on the dispatcher thread is kept whatever the room
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 300, false), MiddlewareLib::SEND_OK);
+	BOOST_CHECK(limit.Take(300, false));
+	BOOST_CHECK_EQUAL(limit.Dropped(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(when_senders_block_until_there_is_room)
+{
+	MiddlewareLib::TransmitLimit limit(CreateOptions(MiddlewareLib::OVERFLOW_BLOCK));
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 1000, true), MiddlewareLib::SEND_OK);
+	BOOST_CHECK(limit.Take(1000));
+	limit.Buffered(NULL, 1000);
+
+	//nothing is written, the wait times out
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 100, true), MiddlewareLib::SEND_TIMED_OUT);
+	//the dispatcher thread may not wait
+	BOOST_CHECK_EQUAL(limit.Reserve(NULL, 100, false), MiddlewareLib::SEND_WOULD_BLOCK);
+	BOOST_CHECK_EQUAL(limit.Rejected(), 2u);
+
+	//the wait ends as soon as a write makes room
+	MiddlewareLib::TransmitBufferOptions options = CreateOptions(MiddlewareLib::OVERFLOW_BLOCK);
+	options.blockTimeoutMs = 5000;
+	MiddlewareLib::TransmitLimit waiting(options);
+	BOOST_CHECK_EQUAL(waiting.Reserve(NULL, 1000, true), MiddlewareLib::SEND_OK);
+	BOOST_CHECK(waiting.Take(1000));
+	waiting.Buffered(NULL, 1000);
+	std::thread writer([&waiting]()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		waiting.Buffered(NULL, 0);
+	});
+	BOOST_CHECK_EQUAL(waiting.Reserve(NULL, 100, true), MiddlewareLib::SEND_OK);
+	writer.join();
+	BOOST_CHECK_EQUAL(waiting.Depth(), 100u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
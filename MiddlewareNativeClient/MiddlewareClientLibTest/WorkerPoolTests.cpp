@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include <boost/test/unit_test.hpp>
+#include "WorkerPool.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::mutex receivedLock;
+	std::vector<std::string> received;
+	std::atomic<bool> released(false);
+	std::atomic<int> handled(0);
+
+	void Record(MiddlewareLib::ISession*, char* data, size_t size)
+	{
+		//the worker has its own copy of the frame
+		data[0] = 'x';
+		std::lock_guard<std::mutex> lock(receivedLock);
+		received.push_back(std::string(data, size));
+	}
+
+	//holds its worker until released
+	void Block(MiddlewareLib::ISession*, char*, size_t)
+	{
+		while (!released)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void Count(MiddlewareLib::ISession*, char*, size_t)
+	{
+		handled++;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(worker_pool_tests)
+
+BOOST_AUTO_TEST_CASE(when_frames_share_a_key_they_are_handled_in_order)
+{
+	received.clear();
+	std::vector<std::string> expected;
+	{
+		MiddlewareLib::WorkerPool pool(4);
+		BOOST_CHECK_EQUAL(pool.Size(), 4u);
+		for (int i = 0; i < 1000; i++)
+		{
+			std::string frame = "f" + std::to_string(i);
+			pool.Post(7, Record, NULL, frame.data(), frame.size());
+			BOOST_CHECK(frame[0] == 'f');
+			expected.push_back("x" + std::to_string(i));
+		}
+		pool.Stop();
+	}
+	BOOST_CHECK(received == expected);
+}
+
+BOOST_AUTO_TEST_CASE(when_one_key_is_blocked_other_keys_are_handled)
+{
+	released = false;
+	handled = 0;
+	MiddlewareLib::WorkerPool pool(2);
+	pool.Post(0, Block, NULL, "b", 1);
+	for (int i = 0; i < 10; i++)
+	{
+		pool.Post(1, Count, NULL, "c", 1);
+	}
+
+	for (int i = 0; i < 1000 && handled < 10; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BOOST_CHECK_EQUAL(handled.load(), 10);
+
+	released = true;
+	pool.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(when_the_pool_is_stopped)
+{
+	handled = 0;
+	MiddlewareLib::WorkerPool pool(2);
+	for (int i = 0; i < 100; i++)
+	{
+		pool.Post(i, Count, NULL, "c", 1);
+	}
+	pool.Stop();
+	BOOST_CHECK_EQUAL(handled.load(), 100);
+
+	//later frames are dropped
+	pool.Post(0, Count, NULL, "c", 1);
+	pool.Stop();
+	BOOST_CHECK_EQUAL(handled.load(), 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,795 @@
+#include "StandInBroker.h"
+#include "BinaryCodec.h"
+#include "MessageCodec.h"
+#include "WebSocketFraming.h"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace MiddlewareLib
+{
+	using namespace WebSocketFraming;
+
+	namespace
+	{
+		const int MaxEvents = 64;
+
+		//the .NET server's MiddlewareException message
+		std::string EntityError(const std::string& name, const std::string& reason)
+		{
+			return "error on entity " + name + ". " + reason + ".";
+		}
+	}
+
+	//a client connection. Read by the shard it was given to, written to by
+	//any shard that routes a message to it.
+	struct StandInBroker::Connection
+	{
+		Connection(int fd, uint64_t id, Shard* owner) :
+			fd(fd), id(std::to_string(id)), owner(owner), upgraded(false), binary(false), closed(false)
+		{
+		}
+
+		//send what the socket takes now and leave the rest for the owner to
+		//write when it is writable. Nothing is sent once closed.
+		void Send(const char* data, size_t size);
+		//the owner, when the socket is writable again
+		void Flush();
+
+		//changed by the owner, under the lock once the connection is open
+		int fd;
+		//the SourceId of its messages
+		const std::string id;
+		Shard* const owner;
+
+		//the owner's alone
+		bool upgraded;
+		std::string in;
+		FrameReader reader;
+		//set when upgraded, before any other shard can know the connection
+		bool binary;
+
+		std::mutex lock;
+		bool closed;
+		//what the socket would not take yet
+		std::string out;
+	};
+
+	//a thread owning the channels that hash to it and serving the
+	//connections it is given
+	class StandInBroker::Shard
+	{
+	public:
+		struct Task
+		{
+			enum Kind
+			{
+				ADOPT,		//start serving the connection
+				REQUEST,	//handle msg, read from the connection
+				DROP		//the connection has closed
+			};
+
+			Kind kind;
+			std::shared_ptr<Connection> connection;
+			Message msg;
+		};
+
+		Shard(StandInBroker& broker, size_t index, size_t shards) :
+			broker_(broker), index_(index), epollFd_(-1), wakeFd_(-1), received_(0), outbox_(shards)
+		{
+		}
+
+		~Shard()
+		{
+			Stop();
+			Clear();
+		}
+
+		bool Start()
+		{
+			epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+			wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (epollFd_ < 0 || wakeFd_ < 0)
+			{
+				return false;
+			}
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			event.data.ptr = NULL;
+			if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event) != 0)
+			{
+				return false;
+			}
+			thread_ = std::thread([this]() { Run(); });
+			return true;
+		}
+
+		//the broker is stopping, so the loop ends once woken
+		void Stop()
+		{
+			if (thread_.joinable())
+			{
+				Wake();
+				thread_.join();
+			}
+		}
+
+		//close the connections once no shard is running to route to them
+		void Clear()
+		{
+			for (auto& connection : connections_)
+			{
+				Close(*connection.second, false);
+			}
+			connections_.clear();
+			channels_.clear();
+			mailbox_.clear();
+			{
+				std::lock_guard<std::mutex> lock(countsLock_);
+				counts_.clear();
+			}
+			if (wakeFd_ >= 0)
+			{
+				::close(wakeFd_);
+				wakeFd_ = -1;
+			}
+			if (epollFd_ >= 0)
+			{
+				::close(epollFd_);
+				epollFd_ = -1;
+			}
+		}
+
+		//serve a connection the broker has accepted
+		void Adopt(int fd, uint64_t id)
+		{
+			std::vector<Task> tasks;
+			tasks.push_back(Task{ Task::ADOPT, std::make_shared<Connection>(fd, id, this), Message() });
+			Post(tasks);
+		}
+
+		//hand tasks over to the shard's thread, leaving tasks empty
+		void Post(std::vector<Task>& tasks)
+		{
+			bool wake;
+			{
+				std::lock_guard<std::mutex> lock(mailboxLock_);
+				wake = mailbox_.empty();
+				for (auto& task : tasks)
+				{
+					mailbox_.push_back(std::move(task));
+				}
+			}
+			tasks.clear();
+			if (wake)
+			{
+				Wake();
+			}
+		}
+
+		//watch the connection's socket for being writable as well as readable
+		void Watch(Connection& connection, bool writable)
+		{
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = (uint32_t)EPOLLIN | (writable ? (uint32_t)EPOLLOUT : 0u);
+			event.data.ptr = &connection;
+			::epoll_ctl(epollFd_, EPOLL_CTL_MOD, connection.fd, &event);
+		}
+
+		size_t Received() const
+		{
+			return received_.load(std::memory_order_relaxed);
+		}
+
+		size_t Subscriptions(const std::string& channel) const
+		{
+			std::lock_guard<std::mutex> lock(countsLock_);
+			auto found = counts_.find(channel);
+			return found != counts_.end() ? found->second : 0;
+		}
+
+	private:
+		struct Channel
+		{
+			//by connection id, as SENDMESSAGE finds them
+			std::unordered_map<std::string, std::shared_ptr<Connection>> subscribers;
+			std::shared_ptr<Connection> listener;
+		};
+
+		//frames for one connection from the tasks and reads being handled,
+		//sent together once they are all done
+		struct Staged
+		{
+			std::shared_ptr<Connection> connection;
+			std::string frames;
+		};
+
+		void Wake()
+		{
+			uint64_t one = 1;
+			ssize_t written = ::write(wakeFd_, &one, sizeof(one));
+			(void)written;
+		}
+
+		void Run()
+		{
+			epoll_event events[MaxEvents];
+			std::vector<Task> tasks;
+			while (!broker_.stopping_)
+			{
+				int count = ::epoll_wait(epollFd_, events, MaxEvents, -1);
+				if (count < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					break;
+				}
+
+				for (int i = 0; i < count; i++)
+				{
+					if (events[i].data.ptr == NULL)
+					{
+						//read the count before taking the tasks, so a post
+						//made after taking them wakes us again
+						uint64_t posted;
+						ssize_t got = ::read(wakeFd_, &posted, sizeof(posted));
+						(void)got;
+						{
+							std::lock_guard<std::mutex> lock(mailboxLock_);
+							tasks.swap(mailbox_);
+						}
+						for (auto& task : tasks)
+						{
+							RunTask(task);
+						}
+						tasks.clear();
+						continue;
+					}
+
+					auto found = connections_.find((Connection*)events[i].data.ptr);
+					if (found == connections_.end() || found->second->fd < 0)
+					{
+						continue;
+					}
+					if (events[i].events & EPOLLOUT)
+					{
+						found->second->Flush();
+					}
+					if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+					{
+						Read(found->second);
+					}
+				}
+				SendStaged();
+			}
+		}
+
+		void RunTask(Task& task)
+		{
+			switch (task.kind)
+			{
+			case Task::ADOPT:
+			{
+				Connection* connection = task.connection.get();
+				connections_[connection] = task.connection;
+				epoll_event event;
+				memset(&event, 0, sizeof(event));
+				event.events = EPOLLIN;
+				event.data.ptr = connection;
+				if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, connection->fd, &event) != 0)
+				{
+					Close(*connection, true);
+				}
+				break;
+			}
+			case Task::REQUEST:
+				Handle(task.connection, task.msg);
+				break;
+			case Task::DROP:
+				Drop(*task.connection);
+				break;
+			}
+		}
+
+		//one read per readiness, so the shard's other connections get a
+		//turn between reads of a busy one
+		void Read(const std::shared_ptr<Connection>& connection)
+		{
+			Connection& c = *connection;
+			char buffer[64 * 1024];
+			ssize_t n = ::recv(c.fd, buffer, sizeof(buffer), 0);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			{
+				return;
+			}
+			if (n <= 0)
+			{
+				Close(c, true);
+				return;
+			}
+			c.in.append(buffer, (size_t)n);
+
+			if (!c.upgraded)
+			{
+				size_t end = c.in.find("\r\n\r\n");
+				if (end == std::string::npos)
+				{
+					if (c.in.size() > MaxRequestSize)
+					{
+						Close(c, true);
+					}
+					return;
+				}
+				std::unique_ptr<PerMessageDeflate> deflater;
+				std::string response = Upgrade(c.in.substr(0, end + 2), broker_.binary_, DeflateOptions(), c.binary, deflater);
+				c.in.erase(0, end + 4);
+				c.upgraded = true;
+				c.Send(response.data(), response.size());
+			}
+
+			std::string control;
+			bool closed;
+			size_t offset = c.reader.Read(&c.in[0], c.in.size(), control, NULL, closed, [&](const char* message, size_t size, bool binary)
+			{
+				bool decoded = binary ?
+					BinaryCodec::Decode(message, size, msg_) :
+					MessageCodec::Decode(message, size, msg_);
+				if (!decoded)
+				{
+					return;
+				}
+				received_.fetch_add(1, std::memory_order_relaxed);
+
+				Shard& shard = broker_.ShardFor(msg_.channel_);
+				if (&shard == this)
+				{
+					Handle(connection, msg_);
+				}
+				else
+				{
+					outbox_[shard.index_].push_back(Task{ Task::REQUEST, connection, std::move(msg_) });
+				}
+			});
+			c.in.erase(0, offset);
+			if (!control.empty())
+			{
+				c.Send(control.data(), control.size());
+			}
+			if (closed)
+			{
+				Close(c, true);
+			}
+		}
+
+		//a request for one of the shard's channels, as Channels does it
+		void Handle(const std::shared_ptr<Connection>& source, Message& msg)
+		{
+			if (msg.type_ != REQUEST)
+			{
+				return;
+			}
+			msg.sourceId_ = source->id;
+
+			std::string error;
+			if (msg.channel_.empty())
+			{
+				error = "no channel specified!";
+			}
+			else
+			{
+				Channel& channel = channels_[msg.channel_];
+				if (msg.command_ == "SUBSCRIBETOCHANNEL")
+				{
+					if (channel.subscribers.emplace(source->id, source).second)
+					{
+						Count(msg.channel_, 1);
+					}
+				}
+				else if (msg.command_ == "REMOVESUBSCRIPTION")
+				{
+					if (channel.subscribers.erase(source->id) > 0)
+					{
+						Count(msg.channel_, -1);
+					}
+				}
+				else if (msg.command_ == "ADDLISTENER")
+				{
+					channel.listener = source;
+				}
+				else if (msg.command_ == "SENDREQUEST")
+				{
+					if (channel.listener == NULL)
+					{
+						error = EntityError(msg.channel_, "No Listener specified for channel");
+					}
+					else
+					{
+						msg.destinationId_ = channel.listener->id;
+						Stage(channel.listener, msg);
+					}
+				}
+				else if (msg.command_ == "SENDMESSAGE")
+				{
+					auto destination = channel.subscribers.find(msg.destinationId_);
+					if (destination == channel.subscribers.end())
+					{
+						error = EntityError(msg.channel_, "Invalid Destination endpoint : " + msg.destinationId_);
+					}
+					else
+					{
+						Stage(destination->second, msg);
+					}
+				}
+				else if (msg.command_ == "PUBLISHMESSAGE")
+				{
+					Publish(channel, msg);
+				}
+				else
+				{
+					error = "Invalid command. " + msg.command_;
+				}
+			}
+
+			Message response;
+			response.requestId_ = msg.requestId_;
+			if (error.empty())
+			{
+				response.type_ = RESPONSE_SUCCESS;
+				response.channel_ = msg.channel_;
+				response.command_ = msg.command_;
+				response.payload_ = msg.payload_;
+			}
+			else
+			{
+				response.type_ = RESPONSE_ERROR;
+				response.payload_ = error;
+			}
+			Stage(source, response);
+		}
+
+		//an UPDATE to every subscriber, encoded once for each encoding
+		void Publish(const Channel& channel, const Message& msg)
+		{
+			Message update = msg;
+			update.type_ = UPDATE;
+			update.requestId_.clear();
+			std::string frames[2];
+			for (auto& subscriber : channel.subscribers)
+			{
+				std::string& frame = frames[subscriber.second->binary ? 1 : 0];
+				if (frame.empty())
+				{
+					AppendMessage(frame, update, subscriber.second->binary, encoded_);
+				}
+				StagedFor(subscriber.second).append(frame);
+			}
+		}
+
+		void Stage(const std::shared_ptr<Connection>& to, const Message& msg)
+		{
+			AppendMessage(StagedFor(to), msg, to->binary, encoded_);
+		}
+
+		std::string& StagedFor(const std::shared_ptr<Connection>& to)
+		{
+			Staged& staged = staged_[to.get()];
+			if (staged.connection == NULL)
+			{
+				staged.connection = to;
+			}
+			return staged.frames;
+		}
+
+		//hand the requests read for other shards over and write what was
+		//routed to each connection
+		void SendStaged()
+		{
+			for (size_t i = 0; i < outbox_.size(); i++)
+			{
+				if (!outbox_[i].empty())
+				{
+					broker_.shards_[i]->Post(outbox_[i]);
+				}
+			}
+			for (auto& staged : staged_)
+			{
+				staged.second.connection->Send(staged.second.frames.data(), staged.second.frames.size());
+			}
+			staged_.clear();
+			for (Connection* connection : closing_)
+			{
+				connections_.erase(connection);
+			}
+			closing_.clear();
+		}
+
+		//the connection is gone from the shard's channels
+		void Drop(const Connection& connection)
+		{
+			for (auto& channel : channels_)
+			{
+				if (channel.second.subscribers.erase(connection.id) > 0)
+				{
+					Count(channel.first, -1);
+				}
+				if (channel.second.listener.get() == &connection)
+				{
+					channel.second.listener.reset();
+				}
+			}
+		}
+
+		//close a connection the shard owns. Unless stopping every shard drops
+		//it from its channels, after anything it read before closing.
+		void Close(Connection& connection, bool drop)
+		{
+			{
+				std::lock_guard<std::mutex> lock(connection.lock);
+				if (connection.fd < 0)
+				{
+					return;
+				}
+				connection.closed = true;
+				connection.out.clear();
+				::epoll_ctl(epollFd_, EPOLL_CTL_DEL, connection.fd, NULL);
+				::close(connection.fd);
+				connection.fd = -1;
+			}
+			if (!drop)
+			{
+				return;
+			}
+
+			std::shared_ptr<Connection> closed = connections_[&connection];
+			for (size_t i = 0; i < outbox_.size(); i++)
+			{
+				if (i == index_)
+				{
+					Drop(connection);
+				}
+				else
+				{
+					outbox_[i].push_back(Task{ Task::DROP, closed, Message() });
+				}
+			}
+			closing_.push_back(&connection);
+		}
+
+		void Count(const std::string& channel, int change)
+		{
+			std::lock_guard<std::mutex> lock(countsLock_);
+			size_t& count = counts_[channel];
+			count += change;
+			if (count == 0)
+			{
+				counts_.erase(channel);
+			}
+		}
+
+		Shard(const Shard&);
+		Shard& operator=(const Shard&);
+
+		StandInBroker& broker_;
+		const size_t index_;
+		int epollFd_;
+		int wakeFd_;
+		std::thread thread_;
+		std::atomic<size_t> received_;
+
+		std::mutex mailboxLock_;
+		std::vector<Task> mailbox_;
+
+		//the rest is the shard thread's alone
+		std::unordered_map<Connection*, std::shared_ptr<Connection>> connections_;
+		std::vector<Connection*> closing_;
+		std::unordered_map<std::string, Channel> channels_;
+		//requests read for the other shards' channels, by shard
+		std::vector<std::vector<Task>> outbox_;
+		std::unordered_map<Connection*, Staged> staged_;
+		Message msg_;
+		std::string encoded_;
+
+		//subscribers by channel, for Subscriptions
+		mutable std::mutex countsLock_;
+		std::map<std::string, size_t> counts_;
+	};
+
+	void StandInBroker::Connection::Send(const char* data, size_t size)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (closed || size == 0)
+		{
+			return;
+		}
+		if (out.empty())
+		{
+			ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (sent < 0)
+			{
+				//a failed connection is closed when its owner next reads it
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+					return;
+				}
+				sent = 0;
+			}
+			if ((size_t)sent == size)
+			{
+				return;
+			}
+			data += sent;
+			size -= (size_t)sent;
+			owner->Watch(*this, true);
+		}
+		out.append(data, size);
+	}
+
+	void StandInBroker::Connection::Flush()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (closed || out.empty())
+		{
+			return;
+		}
+		ssize_t sent = ::send(fd, out.data(), out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent > 0)
+		{
+			out.erase(0, (size_t)sent);
+		}
+		if (out.empty())
+		{
+			owner->Watch(*this, false);
+		}
+	}
+
+	StandInBroker::StandInBroker(size_t shards, bool binary) :
+		binary_(binary),
+		listenFd_(-1),
+		port_(0),
+		stopping_(false),
+		lastConnection_(0)
+	{
+		if (shards == 0)
+		{
+			shards = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (size_t i = 0; i < shards; i++)
+		{
+			shards_.emplace_back(new Shard(*this, i, shards));
+		}
+	}
+
+	StandInBroker::~StandInBroker()
+	{
+		Stop();
+	}
+
+	bool StandInBroker::Start(int port)
+	{
+		listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (listenFd_ < 0)
+		{
+			return false;
+		}
+
+		int on = 1;
+		setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons((uint16_t)port);
+		socklen_t size = sizeof(addr);
+		if (::bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+			::listen(listenFd_, 256) != 0 ||
+			::getsockname(listenFd_, (sockaddr*)&addr, &size) != 0)
+		{
+			::close(listenFd_);
+			listenFd_ = -1;
+			return false;
+		}
+
+		port_ = ntohs(addr.sin_port);
+		stopping_ = false;
+		for (auto& shard : shards_)
+		{
+			if (!shard->Start())
+			{
+				Stop();
+				return false;
+			}
+		}
+		acceptThread_ = std::thread([this]() { Accept(); });
+		return true;
+	}
+
+	void StandInBroker::Stop()
+	{
+		if (listenFd_ < 0)
+		{
+			return;
+		}
+
+		stopping_ = true;
+		//wakes accept
+		::shutdown(listenFd_, SHUT_RDWR);
+		if (acceptThread_.joinable())
+		{
+			acceptThread_.join();
+		}
+		::close(listenFd_);
+		listenFd_ = -1;
+
+		for (auto& shard : shards_)
+		{
+			shard->Stop();
+		}
+		for (auto& shard : shards_)
+		{
+			shard->Clear();
+		}
+	}
+
+	std::string StandInBroker::Url() const
+	{
+		return "ws://127.0.0.1:" + std::to_string(port_);
+	}
+
+	size_t StandInBroker::Received() const
+	{
+		size_t received = 0;
+		for (auto& shard : shards_)
+		{
+			received += shard->Received();
+		}
+		return received;
+	}
+
+	size_t StandInBroker::Subscriptions(const std::string& channel) const
+	{
+		return ShardFor(channel).Subscriptions(channel);
+	}
+
+	StandInBroker::Shard& StandInBroker::ShardFor(const std::string& channel) const
+	{
+		return *shards_[std::hash<std::string>()(channel) % shards_.size()];
+	}
+
+	void StandInBroker::Accept()
+	{
+		//connections are spread over the shards in turn
+		size_t next = 0;
+		while (!stopping_)
+		{
+			int fd = ::accept4(listenFd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+				{
+					continue;
+				}
+				return;
+			}
+
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			shards_[next++ % shards_.size()]->Adopt(fd, ++lastConnection_);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//a WebSocket broker for load testing the client on one box. It routes
+	//the channel commands between its connections like the .NET server's
+	//Channels class, with the same wire format and error responses:
+	//	SUBSCRIBETOCHANNEL, REMOVESUBSCRIPTION	add or remove the connection
+	//		as a subscriber to the channel
+	//	PUBLISHMESSAGE	sent to every subscriber, as an UPDATE
+	//	ADDLISTENER		the connection handles the channel's requests
+	//	SENDREQUEST		sent to the listener with SourceId set to the
+	//		requesting connection, an error if there is no listener
+	//	SENDMESSAGE		sent to the subscriber DestinationId names, usually
+	//		the SourceId of a request, an error if there is no such subscriber
+	//Each request is answered with a success or error response. Unlike the
+	//.NET server there is no LOGIN, and REMOVESUBSCRIPTION removes the one
+	//subscriber rather than the whole channel.
+	//
+	//Channels are sharded by name across one thread per core. A shard owns
+	//its channels' subscribers and listener, so it handles their commands in
+	//order without locks, and runs an epoll loop for the connections it was
+	//given. A request read by one shard for a channel of another is handed
+	//over to that one in batches, and whichever shard routes a message
+	//writes it to the receiving connection directly.
+	class StandInBroker
+	{
+	public:
+		//shards: 0 for one per core. binary: select
+		//BinaryCodec::BINARY_PROTOCOL when a client offers it.
+		explicit StandInBroker(size_t shards = 0, bool binary = true);
+		~StandInBroker();
+
+		//listen on 127.0.0.1:port, 0 picks a free port
+		bool Start(int port = 0);
+		void Stop();
+
+		int Port() const { return port_; }
+		std::string Url() const;
+		size_t Shards() const { return shards_.size(); }
+		//messages received on all connections
+		size_t Received() const;
+		//connections subscribed to channel
+		size_t Subscriptions(const std::string& channel) const;
+
+	private:
+		class Shard;
+		struct Connection;
+
+		void Accept();
+		Shard& ShardFor(const std::string& channel) const;
+
+		StandInBroker(const StandInBroker&);
+		StandInBroker& operator=(const StandInBroker&);
+
+		bool binary_;
+		int listenFd_;
+		int port_;
+		std::atomic<bool> stopping_;
+		uint64_t lastConnection_;
+		std::vector<std::unique_ptr<Shard>> shards_;
+		std::thread acceptThread_;
+	};
+}
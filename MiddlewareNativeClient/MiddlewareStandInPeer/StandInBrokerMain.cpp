@@ -0,0 +1,42 @@
+#include "StandInBroker.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//runs a stand in broker until killed, for load testing clients against on
+//one box. Usage: MiddlewareStandInBroker [port] [--shards n] [--json]
+int main(int argc, char* argv[])
+{
+	int port = 8080;
+	size_t shards = 0;
+	bool binary = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--json") == 0)
+		{
+			binary = false;
+		}
+		else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc)
+		{
+			shards = (size_t)atoi(argv[++i]);
+		}
+		else
+		{
+			port = atoi(argv[i]);
+		}
+	}
+
+	MiddlewareLib::StandInBroker broker(shards, binary);
+	if (!broker.Start(port))
+	{
+		std::cerr << "unable to listen on port " << port << std::endl;
+		return 1;
+	}
+
+	std::cout << "listening on " << broker.Url() << " with " << broker.Shards() << " shards" << (binary ? "" : ", JSON only") << std::endl;
+	for (;;)
+	{
+		pause();
+	}
+}
@@ -0,0 +1,249 @@
+#include "StandInPeer.h"
+#include "BinaryCodec.h"
+#include "MessageCodec.h"
+#include "WebSocketFraming.h"
+#include <chrono>
+#include <set>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace MiddlewareLib
+{
+	using namespace WebSocketFraming;
+
+	StandInPeer::StandInPeer(bool binary) :
+		binary_(binary),
+		listenFd_(-1),
+		port_(0),
+		stopping_(false),
+		paused_(false),
+		received_(0)
+	{
+	}
+
+	StandInPeer::~StandInPeer()
+	{
+		Stop();
+	}
+
+	bool StandInPeer::Start(int port)
+	{
+		listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (listenFd_ < 0)
+		{
+			return false;
+		}
+
+		int on = 1;
+		setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons((uint16_t)port);
+		socklen_t size = sizeof(addr);
+		if (::bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+			::listen(listenFd_, 64) != 0 ||
+			::getsockname(listenFd_, (sockaddr*)&addr, &size) != 0)
+		{
+			::close(listenFd_);
+			listenFd_ = -1;
+			return false;
+		}
+
+		port_ = ntohs(addr.sin_port);
+		stopping_ = false;
+		acceptThread_ = std::thread([this]() { Accept(); });
+		return true;
+	}
+
+	void StandInPeer::Stop()
+	{
+		if (listenFd_ < 0)
+		{
+			return;
+		}
+
+		stopping_ = true;
+		//wakes accept and any blocking reads
+		::shutdown(listenFd_, SHUT_RDWR);
+		acceptThread_.join();
+		::close(listenFd_);
+		listenFd_ = -1;
+
+		std::vector<std::thread> connections;
+		{
+			std::lock_guard<std::mutex> lock(connectionsLock_);
+			for (int fd : connectionFds_)
+			{
+				::shutdown(fd, SHUT_RDWR);
+			}
+			connections.swap(connections_);
+		}
+		for (auto& connection : connections)
+		{
+			connection.join();
+		}
+		for (int fd : connectionFds_)
+		{
+			::close(fd);
+		}
+		connectionFds_.clear();
+	}
+
+	std::string StandInPeer::Url() const
+	{
+		return "ws://127.0.0.1:" + std::to_string(port_);
+	}
+
+	void StandInPeer::Accept()
+	{
+		while (!stopping_)
+		{
+			int fd = ::accept(listenFd_, NULL, NULL);
+			if (fd < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return;
+			}
+
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			std::lock_guard<std::mutex> lock(connectionsLock_);
+			connectionFds_.push_back(fd);
+			connections_.emplace_back([this, fd]() { Serve(fd); });
+		}
+	}
+
+	size_t StandInPeer::Subscriptions(const std::string& channel) const
+	{
+		std::lock_guard<std::mutex> lock(subscriptionsLock_);
+		auto found = subscriptions_.find(channel);
+		return found != subscriptions_.end() ? found->second : 0;
+	}
+
+	void StandInPeer::Subscribe(const std::string& channel, bool subscribe)
+	{
+		std::lock_guard<std::mutex> lock(subscriptionsLock_);
+		size_t& count = subscriptions_[channel];
+		count = subscribe ? count + 1 : count - 1;
+	}
+
+	void StandInPeer::Serve(int fd)
+	{
+		std::string in;
+		char buffer[64 * 1024];
+
+		//handshake
+		size_t end;
+		while ((end = in.find("\r\n\r\n")) == std::string::npos)
+		{
+			ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+			if (n <= 0 || in.size() > MaxRequestSize)
+			{
+				return;
+			}
+			in.append(buffer, (size_t)n);
+		}
+		std::string request = in.substr(0, end + 2);
+		in.erase(0, end + 4);
+
+		bool binaryProtocol;
+		std::unique_ptr<PerMessageDeflate> deflater;
+		std::string response = Upgrade(request, binary_, deflate_, binaryProtocol, deflater);
+		if (!SendAll(fd, response.data(), response.size()))
+		{
+			return;
+		}
+
+		//frames. Replies to everything read in one go are sent together.
+		FrameReader reader;
+		Message msg;
+		std::string encoded;
+		std::string out;
+		//channels this connection is subscribed to
+		std::set<std::string> subscribed;
+		for (;;)
+		{
+			bool closed;
+			size_t offset = reader.Read(&in[0], in.size(), out, deflater.get(), closed, [&](const char* message, size_t size, bool binary)
+			{
+				bool decoded = binary ?
+					BinaryCodec::Decode(message, size, msg) :
+					MessageCodec::Decode(message, size, msg);
+				if (!decoded)
+				{
+					return;
+				}
+				received_++;
+
+				if (msg.type_ == REQUEST)
+				{
+					bool update = false;
+					if (msg.command_ == "SUBSCRIBETOCHANNEL" && subscribed.insert(msg.channel_).second)
+					{
+						Subscribe(msg.channel_, true);
+					}
+					else if (msg.command_ == "REMOVESUBSCRIPTION" && subscribed.erase(msg.channel_) > 0)
+					{
+						Subscribe(msg.channel_, false);
+					}
+					else if (msg.command_ == "PUBLISHMESSAGE")
+					{
+						update = subscribed.count(msg.channel_) > 0;
+					}
+
+					msg.type_ = RESPONSE_SUCCESS;
+					AppendMessage(out, msg, binary, encoded, deflater.get());
+
+					if (update)
+					{
+						msg.type_ = UPDATE;
+						msg.requestId_.clear();
+						AppendMessage(out, msg, binary, encoded, deflater.get());
+					}
+				}
+			});
+			in.erase(0, offset);
+
+			if (!out.empty())
+			{
+				if (!SendAll(fd, out.data(), out.size()))
+				{
+					break;
+				}
+				out.clear();
+			}
+			if (closed)
+			{
+				break;
+			}
+
+			while (paused_ && !stopping_)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+			if (n <= 0)
+			{
+				break;
+			}
+			in.append(buffer, (size_t)n);
+		}
+		::shutdown(fd, SHUT_RDWR);
+
+		for (auto& channel : subscribed)
+		{
+			Subscribe(channel, false);
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MiddlewareLib
+{
+	//a WebSocket peer on the loopback interface that stands in for the broker
+	//in tests and benchmarks. It negotiates the message encoding like the
+	//broker would and answers every request with a success response echoing
+	//the request's payload, in the encoding the request came in. Like the
+	//broker it records SUBSCRIBETOCHANNEL and REMOVESUBSCRIPTION, and sends a
+	//PUBLISHMESSAGE back as an UPDATE when its connection is subscribed to
+	//the channel. Each connection is served by its own thread with blocking
+	//sockets.
+	class StandInPeer
+	{
+	public:
+		//binary: select BinaryCodec::BINARY_PROTOCOL when a client offers it
+		explicit StandInPeer(bool binary = true);
+		~StandInPeer();
+
+		//accept permessage-deflate from clients that offer it. windowBits and
+		//contextTakeover apply to what the peer sends. Call before Start.
+		void SetDeflate(const DeflateOptions& deflate) { deflate_ = deflate; }
+
+		//listen on 127.0.0.1:port, 0 picks a free port
+		bool Start(int port = 0);
+		void Stop();
+
+		int Port() const { return port_; }
+		std::string Url() const;
+		//messages received on all connections
+		size_t Received() const { return received_; }
+		//stop reading from the connections, as a stalled broker would, so
+		//what clients send backs up in the socket buffers
+		void Pause(bool paused) { paused_ = paused; }
+		//connections subscribed to channel
+		size_t Subscriptions(const std::string& channel) const;
+
+	private:
+		void Accept();
+		void Serve(int fd);
+		void Subscribe(const std::string& channel, bool subscribe);
+
+		StandInPeer(const StandInPeer&);
+		StandInPeer& operator=(const StandInPeer&);
+
+		bool binary_;
+		DeflateOptions deflate_;
+		int listenFd_;
+		int port_;
+		std::atomic<bool> stopping_;
+		std::atomic<bool> paused_;
+		std::atomic<size_t> received_;
+		std::thread acceptThread_;
+		std::mutex connectionsLock_;
+		std::vector<int> connectionFds_;
+		std::vector<std::thread> connections_;
+		mutable std::mutex subscriptionsLock_;
+		std::map<std::string, size_t> subscriptions_;
+	};
+}
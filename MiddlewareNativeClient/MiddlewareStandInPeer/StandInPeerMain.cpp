@@ -0,0 +1,43 @@
+#include "StandInPeer.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//runs a stand in peer until killed, for trying the client against without a
+//broker. Usage: MiddlewareStandInPeer [port] [--json] [--deflate]
+int main(int argc, char* argv[])
+{
+	int port = 8080;
+	bool binary = true;
+	MiddlewareLib::DeflateOptions deflate;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--json") == 0)
+		{
+			binary = false;
+		}
+		else if (strcmp(argv[i], "--deflate") == 0)
+		{
+			deflate.enabled = true;
+		}
+		else
+		{
+			port = atoi(argv[i]);
+		}
+	}
+
+	MiddlewareLib::StandInPeer peer(binary);
+	peer.SetDeflate(deflate);
+	if (!peer.Start(port))
+	{
+		std::cerr << "unable to listen on port " << port << std::endl;
+		return 1;
+	}
+
+	std::cout << "listening on " << peer.Url() << (binary ? "" : ", JSON only") << (deflate.enabled ? ", deflate" : "") << std::endl;
+	for (;;)
+	{
+		pause();
+	}
+}
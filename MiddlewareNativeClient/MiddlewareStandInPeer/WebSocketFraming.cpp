@@ -0,0 +1,133 @@
+#include "WebSocketFraming.h"
+#include "BinaryCodec.h"
+#include "Handshake.h"
+#include "MessageCodec.h"
+#include <strings.h>
+#include <sys/socket.h>
+
+namespace MiddlewareLib
+{
+	namespace WebSocketFraming
+	{
+		std::string Header(const std::string& request, const char* name)
+		{
+			size_t nameSize = strlen(name);
+			size_t line = request.find("\r\n");
+			while (line != std::string::npos && line + 2 < request.size())
+			{
+				size_t begin = line + 2;
+				line = request.find("\r\n", begin);
+				if (line == std::string::npos)
+				{
+					break;
+				}
+				if (line - begin > nameSize && request[begin + nameSize] == ':' &&
+					strncasecmp(request.c_str() + begin, name, nameSize) == 0)
+				{
+					size_t value = request.find_first_not_of(' ', begin + nameSize + 1);
+					return value < line ? request.substr(value, line - value) : std::string();
+				}
+			}
+			return std::string();
+		}
+
+		bool Offered(const std::string& protocols, const char* protocol)
+		{
+			size_t begin = 0;
+			while (begin < protocols.size())
+			{
+				size_t end = protocols.find(',', begin);
+				if (end == std::string::npos)
+				{
+					end = protocols.size();
+				}
+				size_t first = protocols.find_first_not_of(' ', begin);
+				size_t last = protocols.find_last_not_of(' ', end - 1);
+				if (first < end && last >= first && protocols.compare(first, last - first + 1, protocol) == 0)
+				{
+					return true;
+				}
+				begin = end + 1;
+			}
+			return false;
+		}
+
+		std::string Upgrade(const std::string& request, bool offerBinary, const DeflateOptions& deflate,
+			bool& binary, std::unique_ptr<PerMessageDeflate>& deflater)
+		{
+			std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n";
+			response += "Sec-WebSocket-Accept: " + Handshake::Accept(Header(request, "Sec-WebSocket-Key")) + "\r\n";
+			std::string protocols = Header(request, "Sec-WebSocket-Protocol");
+			binary = offerBinary && Offered(protocols, BinaryCodec::BINARY_PROTOCOL);
+			if (binary)
+			{
+				response += std::string("Sec-WebSocket-Protocol: ") + BinaryCodec::BINARY_PROTOCOL + "\r\n";
+			}
+			else if (Offered(protocols, BinaryCodec::JSON_PROTOCOL))
+			{
+				response += std::string("Sec-WebSocket-Protocol: ") + BinaryCodec::JSON_PROTOCOL + "\r\n";
+			}
+			std::string extensions;
+			PerMessageDeflate::Respond(deflate, Header(request, "Sec-WebSocket-Extensions"), extensions, deflater);
+			if (!extensions.empty())
+			{
+				response += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+			}
+			response += "\r\n";
+			return response;
+		}
+
+		bool SendAll(int fd, const char* data, size_t size)
+		{
+			while (size > 0)
+			{
+				ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+				if (sent <= 0)
+				{
+					return false;
+				}
+				data += sent;
+				size -= (size_t)sent;
+			}
+			return true;
+		}
+
+		void AppendFrame(std::string& out, Opcode opcode, const char* data, size_t size, bool compressed)
+		{
+			out.push_back((char)(0x80 | (compressed ? 0x40 : 0) | opcode));
+			if (size < 126)
+			{
+				out.push_back((char)size);
+			}
+			else if (size < 65536)
+			{
+				out.push_back((char)126);
+				out.push_back((char)(size >> 8));
+				out.push_back((char)size);
+			}
+			else
+			{
+				out.push_back((char)127);
+				for (int i = 7; i >= 0; i--)
+				{
+					out.push_back((char)((uint64_t)size >> (i * 8)));
+				}
+			}
+			out.append(data, size);
+		}
+
+		void AppendMessage(std::string& out, const Message& msg, bool binary, std::string& encoded, PerMessageDeflate* deflater)
+		{
+			if (binary)
+			{
+				BinaryCodec::Encode(msg, encoded);
+			}
+			else
+			{
+				MessageCodec::Encode(msg, encoded);
+			}
+			bool deflated = deflater != NULL && deflater->Deflate(encoded);
+			AppendFrame(out, binary ? BINARY : TEXT, encoded.data(), encoded.size(), deflated);
+		}
+	}
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "MiddlewareClientLib.h"
+#include "Masking.h"
+#include "PerMessageDeflate.h"
+#include <memory>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+namespace MiddlewareLib
+{
+	//the server side of the WebSocket protocol shared by the stand in peer
+	//and broker: the upgrade handshake, and reading the frames clients send
+	//and writing the ones sent back
+	namespace WebSocketFraming
+	{
+		enum Opcode
+		{
+			CONTINUATION = 0x0,
+			TEXT = 0x1,
+			BINARY = 0x2,
+			CLOSE = 0x8,
+			PING = 0x9,
+			PONG = 0xa
+		};
+
+		//the longest upgrade request read before giving up on a client
+		const size_t MaxRequestSize = 8192;
+
+		//value of the named header in an HTTP request, empty if it is missing
+		std::string Header(const std::string& request, const char* name);
+		//true if the comma separated list contains protocol
+		bool Offered(const std::string& protocols, const char* protocol);
+
+		//the 101 response to a client's upgrade request. binary is set if
+		//BinaryCodec::BINARY_PROTOCOL was selected, which it is only if
+		//offerBinary and the client offered it. deflater is made if the
+		//client's permessage-deflate offer was accepted.
+		std::string Upgrade(const std::string& request, bool offerBinary, const DeflateOptions& deflate,
+			bool& binary, std::unique_ptr<PerMessageDeflate>& deflater);
+
+		//blocking send of all of data, false if the connection failed
+		bool SendAll(int fd, const char* data, size_t size);
+		//append an unmasked frame, as a server sends them
+		void AppendFrame(std::string& out, Opcode opcode, const char* data, size_t size, bool compressed = false);
+		//the message encoded as BinaryCodec or MessageCodec, in a frame
+		void AppendMessage(std::string& out, const Message& msg, bool binary, std::string& encoded, PerMessageDeflate* deflater = NULL);
+
+		//reassembles the messages clients send from their frames, which may
+		//be fragmented and compressed, and answers the control frames
+		class FrameReader
+		{
+		public:
+			FrameReader() : opcode_(TEXT), compressed_(false) {}
+
+			//read the whole frames at the start of data, unmasking them in
+			//place. onMessage(data, size, binary) is called for each complete
+			//message and the answers to control frames appended to out.
+			//Returns the bytes read, closed is set if the client closed the
+			//connection or sent what could not be inflated.
+			template <typename OnMessage>
+			size_t Read(char* data, size_t size, std::string& out, PerMessageDeflate* deflater, bool& closed, OnMessage onMessage)
+			{
+				size_t offset = 0;
+				closed = false;
+				for (;;)
+				{
+					size_t available = size - offset;
+					const uint8_t* p = (const uint8_t*)data + offset;
+					if (available < 2)
+					{
+						break;
+					}
+
+					bool fin = (p[0] & 0x80) != 0;
+					bool compressed = (p[0] & 0x40) != 0;
+					Opcode opcode = (Opcode)(p[0] & 0x0f);
+					bool masked = (p[1] & 0x80) != 0;
+					uint64_t length = p[1] & 0x7f;
+					size_t header = 2;
+					if (length == 126)
+					{
+						header = 4;
+						if (available < header)
+						{
+							break;
+						}
+						length = ((uint64_t)p[2] << 8) | p[3];
+					}
+					else if (length == 127)
+					{
+						header = 10;
+						if (available < header)
+						{
+							break;
+						}
+						length = 0;
+						for (int i = 0; i < 8; i++)
+						{
+							length = (length << 8) | p[2 + i];
+						}
+					}
+					size_t maskOffset = header;
+					if (masked)
+					{
+						header += 4;
+					}
+					if (available < header + length)
+					{
+						break;
+					}
+
+					char* payload = data + offset + header;
+					if (masked)
+					{
+						uint8_t key[4];
+						memcpy(key, p + maskOffset, 4);
+						Masking::Mask((uint8_t*)payload, (size_t)length, key);
+					}
+					offset += header + (size_t)length;
+
+					if (opcode == PING)
+					{
+						AppendFrame(out, PONG, payload, (size_t)length);
+						continue;
+					}
+					if (opcode == CLOSE)
+					{
+						AppendFrame(out, CLOSE, payload, (size_t)length);
+						closed = true;
+						break;
+					}
+					if (opcode == PONG)
+					{
+						continue;
+					}
+
+					if (opcode != CONTINUATION)
+					{
+						opcode_ = opcode;
+						compressed_ = compressed;
+						message_.clear();
+					}
+					message_.append(payload, (size_t)length);
+					if (!fin)
+					{
+						continue;
+					}
+
+					if (compressed_)
+					{
+						if (deflater == NULL || !deflater->Inflate(message_.data(), message_.size(), inflated_))
+						{
+							closed = true;
+							break;
+						}
+						message_.swap(inflated_);
+					}
+					onMessage(message_.data(), message_.size(), opcode_ == BINARY);
+				}
+				return offset;
+			}
+
+		private:
+			//the message being reassembled, as it started
+			std::string message_;
+			Opcode opcode_;
+			bool compressed_;
+			std::string inflated_;
+		};
+	}
+}
@@ -0,0 +1,681 @@
+#include "stdafx.h"
+#include "LoadGenerator.h"
+#include <MiddlewareClientLib.h>
+#include <LatencyHistogram.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <string_view>
+#include <thread>
+
+using MiddlewareLib::ISession;
+using MiddlewareLib::LatencyHistogram;
+using MiddlewareLib::MiddlewareRequestParams;
+
+bool PayloadSizes::Parse(const std::string& spec)
+{
+	std::vector<std::pair<size_t, double>> sizes;
+	size_t dash = spec.find('-');
+	if (dash != std::string::npos)
+	{
+		size_t low = strtoul(spec.substr(0, dash).c_str(), NULL, 10);
+		size_t high = strtoul(spec.substr(dash + 1).c_str(), NULL, 10);
+		if (low == 0 || high < low)
+		{
+			return false;
+		}
+		sizes.push_back(std::make_pair(low, 0.0));
+		sizes.push_back(std::make_pair(high, 0.0));
+		sizes_.swap(sizes);
+		uniform_ = true;
+		return true;
+	}
+
+	double total = 0;
+	size_t start = 0;
+	while (start < spec.size())
+	{
+		size_t end = spec.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = spec.size();
+		}
+		std::string item = spec.substr(start, end - start);
+		size_t colon = item.find(':');
+		size_t size = strtoul(item.substr(0, colon).c_str(), NULL, 10);
+		double weight = colon == std::string::npos ? 1.0 : atof(item.substr(colon + 1).c_str());
+		if (size == 0 || weight <= 0)
+		{
+			return false;
+		}
+		total += weight;
+		sizes.push_back(std::make_pair(size, total));
+		start = end + 1;
+	}
+	if (sizes.empty())
+	{
+		return false;
+	}
+	for (auto& size : sizes)
+	{
+		size.second /= total;
+	}
+	sizes_.swap(sizes);
+	uniform_ = false;
+	return true;
+}
+
+size_t PayloadSizes::Next(std::mt19937_64& random) const
+{
+	if (uniform_)
+	{
+		return std::uniform_int_distribution<size_t>(sizes_[0].first, sizes_[1].first)(random);
+	}
+	if (sizes_.size() == 1)
+	{
+		return sizes_[0].first;
+	}
+
+	double pick = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+	for (auto& size : sizes_)
+	{
+		if (pick < size.second)
+		{
+			return size.first;
+		}
+	}
+	return sizes_.back().first;
+}
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock_t;
+
+	const char StampTag[] = "LG ";
+	const size_t StampTagSize = sizeof(StampTag) - 1;
+
+	uint64_t Now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock_t::now().time_since_epoch()).count();
+	}
+
+	//"LG <sender> <sequence> <send time> " padded with dots to size
+	void WritePayload(std::string& payload, unsigned int sender, uint64_t sequence, uint64_t sent, size_t size)
+	{
+		char number[24];
+		payload.assign(StampTag, StampTagSize);
+		for (uint64_t value : { (uint64_t)sender, sequence, sent })
+		{
+			payload.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+			payload.push_back(' ');
+		}
+		if (size > payload.size())
+		{
+			payload.append(size - payload.size(), '.');
+		}
+	}
+
+	bool ReadStamp(std::string_view payload, unsigned int& sender, uint64_t& sequence, uint64_t& sent)
+	{
+		if (payload.size() < StampTagSize || payload.compare(0, StampTagSize, StampTag) != 0)
+		{
+			return false;
+		}
+		const char* p = payload.data() + StampTagSize;
+		const char* end = payload.data() + payload.size();
+		auto result = std::from_chars(p, end, sender);
+		if (result.ec != std::errc() || result.ptr == end || *result.ptr != ' ')
+		{
+			return false;
+		}
+		result = std::from_chars(result.ptr + 1, end, sequence);
+		if (result.ec != std::errc() || result.ptr == end || *result.ptr != ' ')
+		{
+			return false;
+		}
+		result = std::from_chars(result.ptr + 1, end, sent);
+		return result.ec == std::errc();
+	}
+
+	//raise value to at least target
+	void RaiseTo(std::atomic<uint64_t>& value, uint64_t target)
+	{
+		uint64_t current = value.load(std::memory_order_relaxed);
+		while (target > current && !value.compare_exchange_weak(current, target, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	struct Run;
+
+	struct Sender
+	{
+		unsigned int index;
+		bool requester;
+		ISession* session;
+		std::vector<MiddlewareRequestParams> channels;
+		//sequence of the last message sent
+		std::atomic<uint64_t> sent;
+		//requests: responses and timeouts. Publishers: the highest
+		//sequence a subscriber has received, so with several subscribers
+		//an update completes when the first receives it.
+		std::atomic<uint64_t> completed;
+
+		Sender() : index(0), requester(false), session(NULL), sent(0), completed(0) {}
+	};
+
+	struct Run
+	{
+		explicit Run(const LoadOptions& options) : options(options), start(0), measureFrom(0), end(0),
+			publishes(0), requests(0), updates(0), responses(0), errors(0), lost(0), refused(0), unstamped(0) {}
+
+		bool Measured(uint64_t sent) const { return sent >= measureFrom && sent < end; }
+
+		const LoadOptions& options;
+		uint64_t start;
+		uint64_t measureFrom;
+		uint64_t end;
+		std::vector<std::unique_ptr<Sender>> senders;
+
+		LatencyHistogram updateLatency;
+		LatencyHistogram requestLatency;
+		//those sent in the measurement period
+		std::atomic<uint64_t> publishes;
+		std::atomic<uint64_t> requests;
+		std::atomic<uint64_t> updates;
+		std::atomic<uint64_t> responses;
+		std::atomic<uint64_t> errors;
+		//all through the run
+		std::atomic<uint64_t> lost;
+		std::atomic<uint64_t> refused;
+		std::atomic<uint64_t> unstamped;
+	};
+
+	//completes a requester's requests, one for all of them
+	class RequestCompletion : public MiddlewareLib::IRequestCompletion
+	{
+	public:
+		RequestCompletion(Run& run, Sender& sender) : run_(run), sender_(sender) {}
+
+		void Complete(ISession*, bool success, std::string_view payload)
+		{
+			uint64_t now = Now();
+			sender_.completed.fetch_add(1, std::memory_order_relaxed);
+
+			unsigned int sender;
+			uint64_t sequence;
+			uint64_t sent;
+			if (!ReadStamp(payload, sender, sequence, sent))
+			{
+				//a timeout or error does not echo the payload, nor may a
+				//broker's response
+				if (!success && payload == MiddlewareLib::REQUEST_TIMED_OUT)
+				{
+					run_.lost.fetch_add(1, std::memory_order_relaxed);
+				}
+				else if (!success)
+				{
+					run_.errors.fetch_add(1, std::memory_order_relaxed);
+				}
+				else
+				{
+					run_.unstamped.fetch_add(1, std::memory_order_relaxed);
+				}
+				return;
+			}
+
+			if (!run_.Measured(sent))
+			{
+				return;
+			}
+			if (success)
+			{
+				run_.responses.fetch_add(1, std::memory_order_relaxed);
+				run_.requestLatency.Record(now - sent);
+			}
+			else
+			{
+				run_.errors.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+	private:
+		Run& run_;
+		Sender& sender_;
+	};
+
+	void OnUpdate(ISession*, MiddlewareLib::ChannelId, const MiddlewareLib::MessageView& message, void* context)
+	{
+		if (message.type_ != MiddlewareLib::UPDATE)
+		{
+			return;
+		}
+
+		uint64_t now = Now();
+		Run& run = *(Run*)context;
+		unsigned int sender;
+		uint64_t sequence;
+		uint64_t sent;
+		if (!ReadStamp(message.payload_, sender, sequence, sent) || sender >= run.senders.size())
+		{
+			run.unstamped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		RaiseTo(run.senders[sender]->completed, sequence);
+		if (run.Measured(sent))
+		{
+			run.updates.fetch_add(1, std::memory_order_relaxed);
+			run.updateLatency.Record(now - sent);
+		}
+	}
+
+	//wait until due, sleeping for most of it and yielding for the rest as
+	//sleeps overshoot by tens of microseconds
+	void WaitUntil(uint64_t due)
+	{
+		for (;;)
+		{
+			uint64_t now = Now();
+			if (now >= due)
+			{
+				return;
+			}
+			if (due - now > 200000)
+			{
+				std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 100000));
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void Send(Run& run, Sender& sender)
+	{
+		const LoadOptions& options = run.options;
+		std::mt19937_64 random(sender.index + 1);
+		std::string payload;
+
+		//open loop: each sender an even share of the rate, staggered so
+		//they do not all send at once
+		uint64_t interval = (uint64_t)(1e9 * (double)run.senders.size() / options.rate);
+		uint64_t due = run.start + interval * sender.index / run.senders.size();
+		uint64_t timeout = (uint64_t)options.timeoutMs * 1000000;
+		uint64_t lastProgress = Now();
+		uint64_t lastCompleted = 0;
+
+		for (;;)
+		{
+			if (options.closedLoop)
+			{
+				//wait for a free slot, giving up on the oldest messages if
+				//nothing comes back for a while
+				for (;;)
+				{
+					uint64_t now = Now();
+					if (now >= run.end)
+					{
+						return;
+					}
+					uint64_t sent = sender.sent.load(std::memory_order_relaxed);
+					uint64_t completed = sender.completed.load(std::memory_order_relaxed);
+					if (completed != lastCompleted)
+					{
+						lastCompleted = completed;
+						lastProgress = now;
+					}
+					if (sent - std::min(completed, sent) < options.window)
+					{
+						break;
+					}
+					if (now - lastProgress > timeout)
+					{
+						//requests time out of their own accord
+						if (!sender.requester)
+						{
+							RaiseTo(sender.completed, sent);
+							run.lost.fetch_add(sent - completed, std::memory_order_relaxed);
+						}
+						lastProgress = now;
+					}
+					std::this_thread::yield();
+				}
+				due = Now();
+			}
+			else
+			{
+				if (due >= run.end)
+				{
+					return;
+				}
+				WaitUntil(due);
+			}
+
+			uint64_t sequence = sender.sent.load(std::memory_order_relaxed) + 1;
+			WritePayload(payload, sender.index, sequence, due, options.payload.Next(random));
+			const MiddlewareRequestParams& params = sender.channels[sequence % sender.channels.size()];
+			bool sent = sender.requester ?
+				MiddlewareLib::SendRequest(sender.session, params, payload) :
+				MiddlewareLib::PublishMessage(sender.session, params, payload);
+			if (sent)
+			{
+				sender.sent.store(sequence, std::memory_order_relaxed);
+				if (run.Measured(due))
+				{
+					(sender.requester ? run.requests : run.publishes).fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			else
+			{
+				run.refused.fetch_add(1, std::memory_order_relaxed);
+			}
+			due += interval;
+		}
+	}
+
+	void PrintLatency(std::ostream& out, const char* name, const LatencyHistogram& latency)
+	{
+		out << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(1);
+		if (latency.Count() == 0)
+		{
+			out << "none received" << std::endl;
+			return;
+		}
+		out << "p50 " << latency.ValueAtPercentile(50) / 1000.0
+			<< "us  p99 " << latency.ValueAtPercentile(99) / 1000.0
+			<< "us  p99.9 " << latency.ValueAtPercentile(99.9) / 1000.0
+			<< "us  max " << latency.Max() / 1000.0
+			<< "us  (" << latency.Count() << ")" << std::endl;
+	}
+
+	bool ReadCount(const char* value, unsigned int& count)
+	{
+		char* end;
+		unsigned long parsed = strtoul(value, &end, 10);
+		if (end == value || *end != '\0')
+		{
+			return false;
+		}
+		count = (unsigned int)parsed;
+		return true;
+	}
+}
+
+void PrintLoadUsage(std::ostream& out)
+{
+	out << "usage: TestMiddlewareConsoleApp load [options]" << std::endl
+		<< "  --url URL            broker to connect to (ws://localhost:8080)" << std::endl
+		<< "  --sessions N         sessions to open (1)" << std::endl
+		<< "  --channels N         channels to publish and send requests on (1)" << std::endl
+		<< "  --subscribers N      sessions subscribing to every channel, 0 for all (0)" << std::endl
+		<< "  --publishers N       publishing threads (1)" << std::endl
+		<< "  --requesters N       request sending threads (0)" << std::endl
+		<< "  --payload SPEC       payload bytes: 256, 64-4096 or 64:90,4096:10 (64)" << std::endl
+		<< "  --rate N             messages a second over all senders, open loop (1000)" << std::endl
+		<< "  --closed-loop        send as messages complete rather than at the rate" << std::endl
+		<< "  --window N           messages in flight per sender, closed loop (1)" << std::endl
+		<< "  --seconds N          length of the measurement (10)" << std::endl
+		<< "  --warmup N           seconds of load before measuring (1)" << std::endl
+		<< "  --timeout-ms N       when a message is counted as lost (1000)" << std::endl
+		<< "  --threads N          event loop threads, 0 for one per core (0)" << std::endl;
+}
+
+bool ParseLoadOptions(int argc, char* argv[], LoadOptions& options, std::string& error)
+{
+	for (int i = 0; i < argc; i++)
+	{
+		std::string name = argv[i];
+		if (name == "--closed-loop")
+		{
+			options.closedLoop = true;
+			continue;
+		}
+		if (name.compare(0, 2, "--") != 0)
+		{
+			error = "unknown option " + name;
+			return false;
+		}
+		if (i + 1 >= argc)
+		{
+			error = "missing value for " + name;
+			return false;
+		}
+
+		const char* value = argv[++i];
+		bool valid = true;
+		if (name == "--url")
+		{
+			options.url = value;
+		}
+		else if (name == "--sessions")
+		{
+			valid = ReadCount(value, options.sessions) && options.sessions > 0;
+		}
+		else if (name == "--channels")
+		{
+			valid = ReadCount(value, options.channels) && options.channels > 0;
+		}
+		else if (name == "--subscribers")
+		{
+			valid = ReadCount(value, options.subscribers);
+		}
+		else if (name == "--publishers")
+		{
+			valid = ReadCount(value, options.publishers);
+		}
+		else if (name == "--requesters")
+		{
+			valid = ReadCount(value, options.requesters);
+		}
+		else if (name == "--payload")
+		{
+			valid = options.payload.Parse(value);
+		}
+		else if (name == "--rate")
+		{
+			options.rate = atof(value);
+			valid = options.rate > 0;
+		}
+		else if (name == "--window")
+		{
+			valid = ReadCount(value, options.window) && options.window > 0;
+		}
+		else if (name == "--seconds")
+		{
+			valid = ReadCount(value, options.seconds) && options.seconds > 0;
+		}
+		else if (name == "--warmup")
+		{
+			valid = ReadCount(value, options.warmupSeconds);
+		}
+		else if (name == "--timeout-ms")
+		{
+			valid = ReadCount(value, options.timeoutMs) && options.timeoutMs > 0;
+		}
+		else if (name == "--threads")
+		{
+			valid = ReadCount(value, options.threads);
+		}
+		else
+		{
+			error = "unknown option " + name;
+			return false;
+		}
+
+		if (!valid)
+		{
+			error = "invalid value " + std::string(value) + " for " + name;
+			return false;
+		}
+	}
+
+	if (options.publishers + options.requesters == 0)
+	{
+		error = "nothing to send, there must be a publisher or requester";
+		return false;
+	}
+	return true;
+}
+
+int RunLoad(const LoadOptions& options, std::ostream& out)
+{
+	Run run(options);
+
+	std::vector<std::string> channels;
+	for (unsigned int i = 0; i < options.channels; i++)
+	{
+		channels.push_back("LoadChannel" + std::to_string(i));
+	}
+
+	std::vector<ISession*> sessions;
+#ifdef _WIN32
+	//each session's dispatcher blocks, so each needs a thread
+	std::vector<std::thread> dispatchers;
+	for (unsigned int i = 0; i < options.sessions; i++)
+	{
+		ISession* session = MiddlewareLib::CreateSession(options.url.c_str());
+		sessions.push_back(session);
+		dispatchers.push_back(std::thread([session]() { MiddlewareLib::StartDispatching(session); }));
+	}
+#else
+	unsigned int threads = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	MiddlewareLib::ReactorPool* pool = MiddlewareLib::CreateReactorPool(std::min(threads, options.sessions));
+	for (unsigned int i = 0; i < options.sessions; i++)
+	{
+		ISession* session = MiddlewareLib::CreateSession(pool, options.url.c_str());
+		sessions.push_back(session);
+		MiddlewareLib::StartDispatching(session);
+	}
+#endif
+
+	auto teardown = [&]()
+	{
+		for (ISession* session : sessions)
+		{
+			MiddlewareLib::DestroySession(session);
+		}
+#ifdef _WIN32
+		for (auto& dispatcher : dispatchers)
+		{
+			dispatcher.join();
+		}
+#else
+		MiddlewareLib::DestroyReactorPool(pool);
+#endif
+	};
+
+	for (ISession* session : sessions)
+	{
+		MiddlewareLib::ConnectionLoad load;
+		if (!MiddlewareLib::GetConnectionLoad(session, 0, load) || !load.connected)
+		{
+			out << "unable to connect to " << options.url << std::endl;
+			teardown();
+			return 1;
+		}
+	}
+
+	unsigned int subscribers = options.subscribers == 0 ? options.sessions : std::min(options.subscribers, options.sessions);
+	for (unsigned int i = 0; i < subscribers; i++)
+	{
+		for (auto& channel : channels)
+		{
+			MiddlewareRequestParams params{ channel, NULL, NULL, 0, NULL };
+			if (MiddlewareLib::AddChannelHandler(sessions[i], params, OnUpdate, &run) == 0)
+			{
+				out << "unable to subscribe to " << channel << std::endl;
+				teardown();
+				return 1;
+			}
+		}
+	}
+
+	//publishers then requesters, spread over the sessions
+	unsigned int senderCount = options.publishers + options.requesters;
+	for (unsigned int i = 0; i < senderCount; i++)
+	{
+		std::unique_ptr<Sender> sender(new Sender());
+		sender->index = i;
+		sender->requester = i >= options.publishers;
+		sender->session = sessions[i % sessions.size()];
+		std::shared_ptr<MiddlewareLib::IRequestCompletion> completion;
+		if (sender->requester)
+		{
+			completion.reset(new RequestCompletion(run, *sender));
+		}
+		//each starts on a different channel
+		for (unsigned int c = 0; c < options.channels; c++)
+		{
+			MiddlewareRequestParams params{ channels[(i + c) % options.channels], NULL, NULL, 0, NULL };
+			params.deadline_ms = options.timeoutMs;
+			params.completion = completion;
+			sender->channels.push_back(params);
+		}
+		run.senders.push_back(std::move(sender));
+	}
+
+	run.start = Now();
+	run.measureFrom = run.start + (uint64_t)options.warmupSeconds * 1000000000;
+	run.end = run.measureFrom + (uint64_t)options.seconds * 1000000000;
+	std::vector<std::thread> senders;
+	for (auto& sender : run.senders)
+	{
+		Sender* s = sender.get();
+		senders.push_back(std::thread([&run, s]() { Send(run, *s); }));
+	}
+	for (auto& sender : senders)
+	{
+		sender.join();
+	}
+
+	//wait for the last messages to come back
+	uint64_t drainUntil = Now() + (uint64_t)options.timeoutMs * 1000000;
+	for (;;)
+	{
+		bool drained = true;
+		for (auto& sender : run.senders)
+		{
+			if (sender->completed.load() < sender->sent.load())
+			{
+				drained = false;
+			}
+		}
+		if (drained || Now() >= drainUntil)
+		{
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	teardown();
+
+	double seconds = (double)options.seconds;
+	out << options.sessions << " sessions, " << options.channels << " channels, " << subscribers << " subscribing, "
+		<< options.publishers << " publishers, " << options.requesters << " requesters, ";
+	if (options.closedLoop)
+	{
+		out << "closed loop with " << options.window << " in flight each";
+	}
+	else
+	{
+		out << "open loop at " << options.rate << "/s";
+	}
+	out << ", " << options.seconds << "s" << std::endl;
+
+	out << std::fixed << std::setprecision(0)
+		<< "published         " << run.publishes << " (" << run.publishes / seconds << "/s)" << std::endl
+		<< "updates received  " << run.updates << " (" << run.updates / seconds << "/s)" << std::endl
+		<< "requests sent     " << run.requests << " (" << run.requests / seconds << "/s)" << std::endl
+		<< "responses         " << run.responses << " (" << run.responses / seconds << "/s)" << std::endl
+		<< "errors            " << run.errors << ", lost " << run.lost << ", refused " << run.refused
+		<< ", unstamped " << run.unstamped << std::endl;
+	PrintLatency(out, "update latency", run.updateLatency);
+	PrintLatency(out, "request latency", run.requestLatency);
+	return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <iosfwd>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+//the sizes of the payloads a load run sends. The spec is a size ("256"), a
+//range sizes are picked from evenly ("64-4096") or weighted sizes
+//("64:90,1024:9,65536:1").
+class PayloadSizes
+{
+public:
+	PayloadSizes() : sizes_(1, std::make_pair((size_t)64, 1.0)), uniform_(false) {}
+
+	bool Parse(const std::string& spec);
+	size_t Next(std::mt19937_64& random) const;
+
+private:
+	//(size, cumulative weight), or the range's ends when uniform_
+	std::vector<std::pair<size_t, double>> sizes_;
+	bool uniform_;
+};
+
+struct LoadOptions
+{
+	std::string url = "ws://localhost:8080";
+	unsigned int sessions = 1;
+	unsigned int channels = 1;
+	//sessions that subscribe to every channel, the first ones. 0 for all.
+	unsigned int subscribers = 0;
+	unsigned int publishers = 1;
+	unsigned int requesters = 0;
+	PayloadSizes payload;
+	//messages a second over all publishers and requesters, open loop only
+	double rate = 1000;
+	//each publisher and requester keeps window messages in flight and
+	//sends the next as one completes, rather than sending at the rate
+	bool closedLoop = false;
+	unsigned int window = 1;
+	unsigned int seconds = 10;
+	//sent before the measurement starts, not counted
+	unsigned int warmupSeconds = 1;
+	//a message not back after this long is counted as lost, freeing its
+	//slot in closed loop
+	unsigned int timeoutMs = 1000;
+	//event loop threads driving the sessions, 0 for one per core. Not
+	//used on Windows, where each session has a thread.
+	unsigned int threads = 0;
+};
+
+//false with error set if the arguments are not valid
+bool ParseLoadOptions(int argc, char* argv[], LoadOptions& options, std::string& error);
+void PrintLoadUsage(std::ostream& out);
+
+//publish and send requests over options.sessions sessions as options say
+//and report throughput and round trip latency to out. The latency of an
+//update is from the send time the publisher writes into its payload to its
+//arrival at each subscriber. That of a request is to its response, which
+//must echo the payload. In open loop the send time is when the message was
+//due, so a sender falling behind counts against latency. Returns the
+//process exit code.
+int RunLoad(const LoadOptions& options, std::ostream& out);
@@ -2,8 +2,10 @@
 //
 #include "stdafx.h"
 #include <MiddlewareClientLib.h>
+#include "LoadGenerator.h"
 #include <boost/shared_ptr.hpp>
 #include <iostream>
+#include <string.h>
 
 namespace
 {
@@ -21,7 +23,7 @@ static void middlewareHandler(MiddlewareLib::ISession* session, const Middleware
 		if (session != NULL)
 		{
 			std::string response = "you just said: " + message.payload_;
-			MiddlewareLib::MiddlewareRequestParams params{ message.channel_ , NULL, NULL };
+			MiddlewareLib::MiddlewareRequestParams params{ message.channel_ , NULL, NULL, 0, NULL };
 			MiddlewareLib::SendMessageToChannel(session, params, response, message.sourceId_);
 		}
 	}
@@ -39,13 +41,31 @@ static void sendSucceded(MiddlewareLib::ISession*, const std::string& message)
 
 typedef boost::shared_ptr<MiddlewareLib::ISession> SessionPtr_t;
 
-int main()
+//with no arguments listens on the test channel and answers requests, with
+//"load" runs a load test, see PrintLoadUsage
+int main(int argc, char* argv[])
 {
+	if (argc > 1)
+	{
+		LoadOptions options;
+		std::string error;
+		if (strcmp(argv[1], "load") != 0 || !ParseLoadOptions(argc - 2, argv + 2, options, error))
+		{
+			if (!error.empty())
+			{
+				std::cerr << error << std::endl;
+			}
+			PrintLoadUsage(std::cerr);
+			return 1;
+		}
+		return RunLoad(options, std::cout);
+	}
+
 	SessionPtr_t session(MiddlewareLib::CreateSession("ws://localhost:8080"), MiddlewareLib::DestroySession);
 	MiddlewareLib::RegisterMessageCallbackFunction( middlewareHandler);
 
 	//register as a listener to test channel
-	MiddlewareLib::MiddlewareRequestParams params{ TestChannel, sendSucceded, sendFailed };
+	MiddlewareLib::MiddlewareRequestParams params{ TestChannel, sendSucceded, sendFailed, 0, NULL };
 	MiddlewareLib::AddChannelListener(session.get(), params);
 
 	MiddlewareLib::StartDispatching(session.get());
@@ -5,12 +5,16 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "targetver.h"
+#endif
 
 #include <stdio.h>
+#ifdef _WIN32
 #include <tchar.h>
 
 #include <Windows.h>
+#endif
 #include <string>
 
 